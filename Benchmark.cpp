@@ -0,0 +1,197 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+const std::vector<BenchmarkPreset>& BenchmarkPreset::GetPresets()
+{
+	//name, objects, meshes, hierarchy depth, materials, warm up frames, measure frames
+	static const std::vector<BenchmarkPreset> presets =
+	{
+		{ "small", 64, 4, 1, 4, 60, 300 },
+		{ "medium", 1024, 8, 4, 16, 120, 600 },
+		{ "large", 8192, 16, 8, 64, 120, 600 },
+		//transform update is recursive, long chains stress it
+		{ "deep", 1024, 4, 32, 4, 120, 600 },
+	};
+	return presets;
+}
+
+const BenchmarkPreset* BenchmarkPreset::Find(std::string_view name)
+{
+	const std::vector<BenchmarkPreset>& presets = GetPresets();
+	auto ite = std::find_if(presets.begin(), presets.end(), [name](const BenchmarkPreset& preset) { return preset.name == name; });
+	return ite == presets.end() ? nullptr : &*ite;
+}
+
+const char* Benchmark::GetPhaseName(FramePhase phase)
+{
+	static const char* names[PhaseCount] = { "wait", "update", "cull", "upload", "record", "submit", "present" };
+	return names[static_cast<uint32_t>(phase)];
+}
+
+void Benchmark::BeginFrame()
+{
+	mFrameBegin = Clock::now();
+	mLapBegin = mFrameBegin;
+	mPhaseTimes = {};
+}
+
+void Benchmark::Lap(FramePhase phase)
+{
+	Clock::time_point now = Clock::now();
+	mPhaseTimes[static_cast<uint32_t>(phase)] += std::chrono::duration<double, std::milli>(now - mLapBegin).count();
+	mLapBegin = now;
+}
+
+void Benchmark::EndFrame()
+{
+	double frameTime = std::chrono::duration<double, std::milli>(Clock::now() - mFrameBegin).count();
+	if (!IsWarmup())
+	{
+		mFrameTimes.push_back(frameTime);
+		mFramePhaseTimes.push_back(mPhaseTimes);
+	}
+	++mFrame;
+}
+
+void Benchmark::AddGpuFrame(const GpuProfiler& profiler)
+{
+	if (profiler.GetResolvedFrameCount() == mGpuResolvedFrameCount)
+		return;
+	mGpuResolvedFrameCount = profiler.GetResolvedFrameCount();
+
+	const GpuProfiler::FrameResult& result = profiler.GetLastResult();
+	if (result.frame < mPreset.warmupFrames)
+		return;
+
+	mGpuFrameTimes.push_back(result.milliseconds);
+	for (const GpuProfiler::ScopeResult& scope : result.scopes)
+	{
+		auto ite = std::find_if(mGpuScopes.begin(), mGpuScopes.end(), [&scope](const GpuScopeSamples& samples) { return samples.name == scope.name; });
+		GpuScopeSamples& samples = ite != mGpuScopes.end() ? *ite : mGpuScopes.emplace_back(GpuScopeSamples{ scope.name });
+		samples.milliseconds.push_back(scope.milliseconds);
+		if (scope.hasStatistics)
+		{
+			++samples.statisticsFrames;
+			for (uint32_t i = 0; i < GpuProfiler::StatisticCount; ++i)
+				samples.statistics[i] += static_cast<double>(scope.statistics[i]);
+		}
+	}
+}
+
+Benchmark::Statistics Benchmark::ComputeStatistics(std::vector<double> samples)
+{
+	Statistics statistics;
+	if (samples.empty())
+		return statistics;
+
+	std::sort(samples.begin(), samples.end());
+	auto Percentile = [&samples](double percent) {
+		size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * samples.size()));
+		return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+	};
+
+	statistics.avg = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+	statistics.min = samples.front();
+	statistics.p50 = Percentile(50.0);
+	statistics.p95 = Percentile(95.0);
+	statistics.p99 = Percentile(99.0);
+	statistics.max = samples.back();
+	return statistics;
+}
+
+std::vector<double> Benchmark::GetSamples(uint32_t phase) const
+{
+	std::vector<double> samples;
+	samples.reserve(mFramePhaseTimes.size());
+	for (const std::array<double, PhaseCount>& phaseTimes : mFramePhaseTimes)
+		samples.push_back(phaseTimes[phase]);
+	return samples;
+}
+
+void Benchmark::PrintSummary() const
+{
+	Statistics frame = ComputeStatistics(mFrameTimes);
+	std::cout << std::format("benchmark {}: {} objects, {} meshes, depth {}, {} materials, {} frames",
+		mPreset.name, mPreset.objectCount, mPreset.meshCount, mPreset.hierarchyDepth, mPreset.materialCount, mFrameTimes.size()) << std::endl;
+	std::cout << std::format("  {:<8} avg {:8.3f} p50 {:8.3f} p95 {:8.3f} p99 {:8.3f} ms",
+		"frame", frame.avg, frame.p50, frame.p95, frame.p99) << std::endl;
+
+	for (uint32_t phase = 0; phase < PhaseCount; ++phase)
+	{
+		Statistics statistics = ComputeStatistics(GetSamples(phase));
+		std::cout << std::format("  {:<8} avg {:8.3f} p50 {:8.3f} p95 {:8.3f} p99 {:8.3f} ms",
+			GetPhaseName(static_cast<FramePhase>(phase)), statistics.avg, statistics.p50, statistics.p95, statistics.p99) << std::endl;
+	}
+
+	if (mGpuFrameTimes.empty())
+		return;
+
+	Statistics gpuFrame = ComputeStatistics(mGpuFrameTimes);
+	std::cout << std::format("  gpu, {} frames", mGpuFrameTimes.size()) << std::endl;
+	std::cout << std::format("  {:<16} avg {:8.3f} p50 {:8.3f} p95 {:8.3f} p99 {:8.3f} ms",
+		"frame", gpuFrame.avg, gpuFrame.p50, gpuFrame.p95, gpuFrame.p99) << std::endl;
+	for (const GpuScopeSamples& scope : mGpuScopes)
+	{
+		Statistics statistics = ComputeStatistics(scope.milliseconds);
+		std::cout << std::format("  {:<16} avg {:8.3f} p50 {:8.3f} p95 {:8.3f} p99 {:8.3f} ms",
+			scope.name, statistics.avg, statistics.p50, statistics.p95, statistics.p99) << std::endl;
+	}
+}
+
+void Benchmark::WriteJson(const std::string& path, uint32_t width, uint32_t height, bool headless) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+		throw std::runtime_error(std::format("can't write benchmark result: {}", path));
+
+	auto StatisticsJson = [](const Statistics& statistics) {
+		return std::format("{{ \"avg\": {:.4f}, \"min\": {:.4f}, \"p50\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, \"max\": {:.4f} }}",
+			statistics.avg, statistics.min, statistics.p50, statistics.p95, statistics.p99, statistics.max);
+	};
+
+	file << "{\n";
+	file << std::format("\t\"preset\": {{ \"name\": \"{}\", \"objects\": {}, \"meshes\": {}, \"hierarchyDepth\": {}, \"materials\": {} }},\n",
+		mPreset.name, mPreset.objectCount, mPreset.meshCount, mPreset.hierarchyDepth, mPreset.materialCount);
+	file << std::format("\t\"width\": {},\n\t\"height\": {},\n\t\"headless\": {},\n", width, height, headless ? "true" : "false");
+	file << std::format("\t\"warmupFrames\": {},\n\t\"frames\": {},\n", mPreset.warmupFrames, mFrameTimes.size());
+	file << std::format("\t\"frameMs\": {},\n", StatisticsJson(ComputeStatistics(mFrameTimes)));
+
+	file << "\t\"phasesMs\": {\n";
+	for (uint32_t phase = 0; phase < PhaseCount; ++phase)
+	{
+		file << std::format("\t\t\"{}\": {}{}\n", GetPhaseName(static_cast<FramePhase>(phase)),
+			StatisticsJson(ComputeStatistics(GetSamples(phase))), phase + 1 < PhaseCount ? "," : "");
+	}
+	file << "\t},\n";
+
+	//gpu scopes are render graph passes, statistics is average per frame
+	file << std::format("\t\"gpuFrames\": {},\n", mGpuFrameTimes.size());
+	file << std::format("\t\"gpuFrameMs\": {},\n", StatisticsJson(ComputeStatistics(mGpuFrameTimes)));
+	file << "\t\"gpuScopes\": {\n";
+	for (size_t i = 0; i < mGpuScopes.size(); ++i)
+	{
+		const GpuScopeSamples& scope = mGpuScopes[i];
+		file << std::format("\t\t\"{}\": {{ \"ms\": {}", scope.name, StatisticsJson(ComputeStatistics(scope.milliseconds)));
+		if (scope.statisticsFrames > 0)
+		{
+			file << ", \"statistics\": { ";
+			for (uint32_t statistic = 0; statistic < GpuProfiler::StatisticCount; ++statistic)
+			{
+				file << std::format("\"{}\": {:.1f}{}", GpuProfiler::GetStatisticName(statistic),
+					scope.statistics[statistic] / scope.statisticsFrames, statistic + 1 < GpuProfiler::StatisticCount ? ", " : " }");
+			}
+		}
+		file << std::format(" }}{}\n", i + 1 < mGpuScopes.size() ? "," : "");
+	}
+	file << "\t}\n";
+	file << "}\n";
+
+	std::cout << "benchmark result written to " << path << std::endl;
+}
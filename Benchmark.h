@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "GpuProfiler.hpp"
+
+//Frame time benchmark run by TriangleApp
+//SocoAppVk --benchmark <preset> [--json out.json] [--headless] [--size WxH]
+//warm up frames are dropped, every measured frame records cpu time of each phase
+//and gpu time of each profiler scope, gpu result arrives GpuProfiler::FrameLatency frames late
+
+struct BenchmarkPreset
+{
+	std::string name;
+	uint32_t objectCount;
+	uint32_t meshCount;
+	//objects are parented in chains of this length, 1 means no hierarchy
+	uint32_t hierarchyDepth;
+	uint32_t materialCount;
+	uint32_t warmupFrames;
+	uint32_t measureFrames;
+
+	static const std::vector<BenchmarkPreset>& GetPresets();
+	//nullptr if not found
+	static const BenchmarkPreset* Find(std::string_view name);
+};
+
+//in frame order, wait is gpu idle/fence/acquire before upload and record
+enum class FramePhase : uint32_t { Wait, Update, Cull, Upload, Record, Submit, Present, Count };
+
+class Benchmark
+{
+public:
+	Benchmark(const BenchmarkPreset& preset) : mPreset(preset) {}
+
+	const BenchmarkPreset& GetPreset() const { return mPreset; }
+	bool IsWarmup() const { return mFrame < mPreset.warmupFrames; }
+	bool IsDone() const { return mFrame >= mPreset.warmupFrames + mPreset.measureFrames; }
+
+	void BeginFrame();
+	//time since the previous lap is charged to phase, a phase may be lapped more than once per frame
+	void Lap(FramePhase phase);
+	void EndFrame();
+	//take the latest resolved gpu frame if it's new and not a warm up frame
+	void AddGpuFrame(const GpuProfiler& profiler);
+
+	void PrintSummary() const;
+	void WriteJson(const std::string& path, uint32_t width, uint32_t height, bool headless) const;
+
+	static const char* GetPhaseName(FramePhase phase);
+
+private:
+	static constexpr uint32_t PhaseCount = static_cast<uint32_t>(FramePhase::Count);
+	using Clock = std::chrono::high_resolution_clock;
+
+	struct Statistics
+	{
+		double avg = 0.0;
+		double min = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+	//nearest rank
+	static Statistics ComputeStatistics(std::vector<double> samples);
+	std::vector<double> GetSamples(uint32_t phase) const;
+
+	struct GpuScopeSamples
+	{
+		std::string name;
+		std::vector<double> milliseconds;
+		//summed over frames, reported as average per frame
+		uint32_t statisticsFrames = 0;
+		std::array<double, GpuProfiler::StatisticCount> statistics = {};
+	};
+
+	BenchmarkPreset mPreset;
+	uint32_t mFrame = 0;
+
+	Clock::time_point mFrameBegin;
+	Clock::time_point mLapBegin;
+	std::array<double, PhaseCount> mPhaseTimes = {};
+
+	//ms of measured frames
+	std::vector<double> mFrameTimes;
+	std::vector<std::array<double, PhaseCount>> mFramePhaseTimes;
+
+	uint64_t mGpuResolvedFrameCount = 0;
+	std::vector<double> mGpuFrameTimes;
+	//in first appearance order, a scope that appears once per frame gets one sample per frame
+	std::vector<GpuScopeSamples> mGpuScopes;
+};
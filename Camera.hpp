@@ -3,6 +3,9 @@
 #include "ConstantBuffer.hpp"
 #include "DeviceComponent.h"
 
+#include <vector>
+#include <algorithm>
+
 class Camera : public DeviceComponent
 {
 public:
@@ -42,6 +45,31 @@ public:
 	inline void SetFar(float farPlane) { mFar = farPlane; }
 	inline float GetAspect() const { return mAspect; }
 	inline void SetAspect(float aspect) { mAspect = aspect; }
+	inline float GetViewportHeight() const { return mViewportHeight; }
+	inline void SetViewportHeight(float height) { mViewportHeight = height; }
+
+	//Size in pixels of a world space length at the nearest point of bounding sphere
+	inline float GetProjectedSize(const glm::vec3& centerWS, float radiusWS, float sizeWS) const
+	{
+		float distance = std::max(glm::distance(mTransform.GetGlobalPosition(), centerWS) - radiusWS, mNear);
+		return sizeWS / (distance * std::tan(mFov * 0.5f)) * mViewportHeight * 0.5f;
+	}
+
+	//Coarsest lod whose projected error is within thresholdPixels, lodErrors is increasing object space error
+	//switch to coarser lod need error within thresholdPixels * (1 - hysteresis), so lod do not flicker at the boundary
+	inline uint32_t SelectLod(const std::vector<float>& lodErrors, const glm::vec3& centerWS, float radiusWS, float worldScale,
+		uint32_t currentLod, float thresholdPixels = 1.0f, float hysteresis = 0.25f) const
+	{
+		uint32_t lod = 0;
+		for (uint32_t i = 1; i < lodErrors.size(); ++i)
+		{
+			float threshold = i > currentLod ? thresholdPixels * (1.0f - hysteresis) : thresholdPixels;
+			if (GetProjectedSize(centerWS, radiusWS, lodErrors[i] * worldScale) > threshold)
+				break;
+			lod = i;
+		}
+		return lod;
+	}
 
 	void BuildBuffer()
 	{
@@ -121,6 +149,7 @@ private:
 	float mNear = 0.25f;
 	float mFar = 1000.0f;
 	float mAspect = 800.0f / 600.0f;
+	float mViewportHeight = 600.0f;
 
 	PerCamera mPerCameraData;
 	//VkBuffer mPerCameraBuffer = VK_NULL_HANDLE;
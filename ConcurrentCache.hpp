@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <functional>
+
+//Sharded cache for device objects created on demand (sampler, set layout, pipeline layout)
+//Hit only takes the shared lock of one shard; miss inserts an empty entry under the exclusive lock,
+//then creates the value outside the lock with std::call_once, so each key is created exactly once
+//and a slow vkCreate* never blocks lookups of other keys
+//分片缓存: 命中只加单个分片的读锁; 未命中时在写锁内插入空条目, 在锁外用call_once创建, 保证每个key只创建一次
+template<typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>, size_t ShardCount = 16>
+class ConcurrentCache
+{
+public:
+	//factory: Value(const Key&), may throw, the next Get will retry
+	template<typename Factory>
+	Value GetOrCreate(const Key& key, Factory&& factory)
+	{
+		const size_t hash = Hash()(key);
+		Shard& shard = mShards[ShardIndex(hash)];
+
+		Entry* entry = nullptr;
+		{
+			std::shared_lock readLock(shard.mutex);
+			auto ite = shard.entries.find(key);
+			if (ite != shard.entries.end())
+				entry = &ite->second;
+		}
+
+		if (entry == nullptr)
+		{
+			std::unique_lock writeLock(shard.mutex);
+			//unordered_map node never move, pointer is stable after rehash
+			entry = &shard.entries.try_emplace(key).first->second;
+		}
+
+		std::call_once(entry->once, [&]() { entry->value = factory(key); });
+		return entry->value;
+	}
+
+	//Not thread safe with GetOrCreate, only call on destroy
+	template<typename Func>
+	void ForEach(Func&& func)
+	{
+		for (Shard& shard : mShards)
+		{
+			std::unique_lock writeLock(shard.mutex);
+			for (auto& [key, entry] : shard.entries)
+				func(key, entry.value);
+		}
+	}
+
+	//predicate: bool(const Key&, const Value&), may destroy the value before returning true
+	//no GetOrCreate of an erased key may run at the same time, other keys are safe
+	template<typename Predicate>
+	void EraseIf(Predicate&& predicate)
+	{
+		for (Shard& shard : mShards)
+		{
+			std::unique_lock writeLock(shard.mutex);
+			std::erase_if(shard.entries, [&predicate](const auto& pair) { return predicate(pair.first, pair.second.value); });
+		}
+	}
+
+	void Clear()
+	{
+		for (Shard& shard : mShards)
+		{
+			std::unique_lock writeLock(shard.mutex);
+			shard.entries.clear();
+		}
+	}
+
+	size_t Size() const
+	{
+		size_t size = 0;
+		for (const Shard& shard : mShards)
+		{
+			std::shared_lock readLock(shard.mutex);
+			size += shard.entries.size();
+		}
+		return size;
+	}
+
+private:
+	struct Entry
+	{
+		std::once_flag once;
+		Value value{};
+	};
+
+	struct Shard
+	{
+		mutable std::shared_mutex mutex;
+		std::unordered_map<Key, Entry, Hash, KeyEqual> entries;
+	};
+
+	//bucket index of inner map also use low bits, mix high bits to pick shard
+	static size_t ShardIndex(size_t hash)
+	{
+		return (hash ^ (hash >> 16)) % ShardCount;
+	}
+
+	std::array<Shard, ShardCount> mShards;
+};
@@ -15,6 +15,8 @@
 
 #include "SamplerPool.hpp"
 #include "PipelineLayoutPool.hpp"
+#include "GpuProfiler.hpp"
+#include "Log.h"
 
 class Device
 {
@@ -35,11 +37,70 @@ public:
 		mDeviceFeatures = deviceFeatures;
 
 		PickPhysicalDevice();
+
+		//GpuProfiler collects pipeline statistics when supported
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(mPhysicalDevice, &supportedFeatures);
+		mDeviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+
+		//PipelineCompiler links pipelines from cached parts when supported
+		//without fast linking a link costs about as much as a full pipeline, not worth it
+		if (SystemInfo::IsVulkanDeviceSupport(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && SystemInfo::IsVulkanDeviceSupport(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+		{
+			VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+			VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, &libraryFeatures };
+			vkGetPhysicalDeviceFeatures2(mPhysicalDevice, &features);
+
+			VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT libraryProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT };
+			VkPhysicalDeviceProperties2 properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, &libraryProperties };
+			vkGetPhysicalDeviceProperties2(mPhysicalDevice, &properties);
+
+			mGraphicsPipelineLibrary = libraryFeatures.graphicsPipelineLibrary == VK_TRUE && libraryProperties.graphicsPipelineLibraryFastLinking == VK_TRUE;
+		}
+		if (mGraphicsPipelineLibrary)
+		{
+			mDeviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+			mDeviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		}
+
+		//RenderGraph begins passes without render pass and framebuffer when supported, core in 1.3, extension on 1.1
+		if (SystemInfo::IsVulkanDeviceSupport(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) && SystemInfo::IsVulkanDeviceSupport(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME)
+			&& SystemInfo::IsVulkanDeviceSupport(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME))
+		{
+			VkPhysicalDeviceDynamicRenderingFeaturesKHR renderingFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR };
+			VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, &renderingFeatures };
+			vkGetPhysicalDeviceFeatures2(mPhysicalDevice, &features);
+			mDynamicRendering = renderingFeatures.dynamicRendering == VK_TRUE;
+		}
+		if (mDynamicRendering)
+		{
+			mDeviceExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+			mDeviceExtensions.push_back(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+			mDeviceExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+		}
+
 		CreateLogicalDevice();
 		CreateCommandPool();
 
+		mCmdPipelineBarrier2 = (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(mDevice, "vkCmdPipelineBarrier2KHR");
+		if (mCmdPipelineBarrier2 == nullptr)
+			throw std::runtime_error("failed to load vkCmdPipelineBarrier2KHR!");
+		if (mDynamicRendering)
+		{
+			mCmdBeginRendering = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(mDevice, "vkCmdBeginRenderingKHR");
+			mCmdEndRendering = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(mDevice, "vkCmdEndRenderingKHR");
+			if (mCmdBeginRendering == nullptr || mCmdEndRendering == nullptr)
+				throw std::runtime_error("failed to load vkCmdBeginRenderingKHR!");
+		}
+
+		//shared by every pipeline creation, vkCreateGraphicsPipelines with it is thread safe
+		VkPipelineCacheCreateInfo pipelineCacheInfo = {};
+		pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		ThrowIfFailed(vkCreatePipelineCache(mDevice, &pipelineCacheInfo, nullptr, &mPipelineCache));
+
 		mSamplerPool.Init(mPhysicalDevice, mDevice);
 		mPipelineLayoutPool.Init(mDevice, &mSamplerPool);
+		mGpuProfiler.Init(mPhysicalDevice, mDevice, mGraphicsQueue.index, mDeviceFeatures.pipelineStatisticsQuery == VK_TRUE);
 	}
 
 	void Destroy()
@@ -48,6 +109,8 @@ public:
 		vkDestroyCommandPool(mDevice, mTransferCommandPool, nullptr);
 		mSamplerPool.Clear();
 		mPipelineLayoutPool.Clear();
+		mGpuProfiler.Clear();
+		vkDestroyPipelineCache(mDevice, mPipelineCache, nullptr);
 		vkDestroyDevice(mDevice, nullptr);
 	}
 
@@ -71,6 +134,28 @@ public:
 		return &mPipelineLayoutPool;
 	}
 
+	GpuProfiler* GetGpuProfiler()
+	{
+		return &mGpuProfiler;
+	}
+
+	VkPipelineCache GetPipelineCache() const
+	{
+		return mPipelineCache;
+	}
+
+	//VK_EXT_graphics_pipeline_library with fast linking, enabled when supported
+	bool IsGraphicsPipelineLibrarySupported() const
+	{
+		return mGraphicsPipelineLibrary;
+	}
+
+	//VK_KHR_dynamic_rendering, enabled when supported
+	bool IsDynamicRenderingSupported() const
+	{
+		return mDynamicRendering;
+	}
+
 	struct QueueIndexPair
 	{
 		uint32_t index;
@@ -116,6 +201,37 @@ public:
 		throw std::runtime_error("failed to find suitable memory type!");
 	}
 
+	VkDeviceMemory AllocateMemory(VkDeviceSize size, uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+	{
+		VkMemoryAllocateInfo allocInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = size,
+			.memoryTypeIndex = FindMemoryType(typeFilter, properties)
+		};
+
+		VkDeviceMemory memory;
+		ThrowIfFailed(vkAllocateMemory(mDevice, &allocInfo, nullptr, &memory));
+		return memory;
+	}
+
+	//VK_KHR_synchronization2, one call for a batch of barriers
+	void CmdPipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfoKHR& dependencyInfo) const
+	{
+		mCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+
+	//VK_KHR_dynamic_rendering, only when IsDynamicRenderingSupported
+	void CmdBeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfoKHR& renderingInfo) const
+	{
+		mCmdBeginRendering(commandBuffer, &renderingInfo);
+	}
+
+	void CmdEndRendering(VkCommandBuffer commandBuffer) const
+	{
+		mCmdEndRendering(commandBuffer);
+	}
+
 private:
 	VkInstance mInstance = VK_NULL_HANDLE;
 	VkSurfaceKHR mSurface = VK_NULL_HANDLE;
@@ -137,6 +253,14 @@ private:
 
 	SamplerPool mSamplerPool;
 	PipelineLayoutPool mPipelineLayoutPool;
+	GpuProfiler mGpuProfiler;
+	VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+	bool mGraphicsPipelineLibrary = false;
+	bool mDynamicRendering = false;
+
+	PFN_vkCmdPipelineBarrier2KHR mCmdPipelineBarrier2 = nullptr;
+	PFN_vkCmdBeginRenderingKHR mCmdBeginRendering = nullptr;
+	PFN_vkCmdEndRenderingKHR mCmdEndRendering = nullptr;
 
 #ifdef NDEBUG
 	const bool mEnableValidationLayers = false;
@@ -166,10 +290,10 @@ private:
 		{
 			print = true;
 
-			std::cout << "available extension(" << availableExtensions.size() << "):" << std::endl;
+			LOG_DEBUG("available extension({}):", availableExtensions.size());
 			for (const auto& extension : availableExtensions)
 			{
-				std::cout << "\t" << extension.extensionName << std::endl;
+				LOG_DEBUG("\t{}", extension.extensionName);
 			}
 		}
 		if (queryExtensionCount != nullptr)
@@ -194,8 +318,13 @@ private:
 
 			bool extensionsSupported = CheckDeviceExtensionSupport(device, queryExtensionCount);
 
-			SwapChainSupportDetails swapChainSupport = SwapChainSupportDetails::QuerySwapChainSupport(device, mSurface);
-			bool swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+			//headless has no surface, nothing to present
+			bool swapChainAdequate = true;
+			if (mSurface != VK_NULL_HANDLE)
+			{
+				SwapChainSupportDetails swapChainSupport = SwapChainSupportDetails::QuerySwapChainSupport(device, mSurface);
+				swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+			}
 
 			return queueIndices.isComplete() && extensionsSupported && swapChainAdequate;
 		};
@@ -259,6 +388,31 @@ private:
 
 		createInfo.pEnabledFeatures = &mDeviceFeatures;
 
+		//render graph batch barriers with vkCmdPipelineBarrier2
+		VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features
+		{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+			.synchronization2 = VK_TRUE
+		};
+		createInfo.pNext = &synchronization2Features;
+
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures
+		{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+			.graphicsPipelineLibrary = VK_TRUE
+		};
+		if (mGraphicsPipelineLibrary)
+			synchronization2Features.pNext = &libraryFeatures;
+
+		VkPhysicalDeviceDynamicRenderingFeaturesKHR renderingFeatures
+		{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+			.pNext = createInfo.pNext,
+			.dynamicRendering = VK_TRUE
+		};
+		if (mDynamicRendering)
+			createInfo.pNext = &renderingFeatures;
+
 		createInfo.enabledExtensionCount = static_cast<uint32_t>(mDeviceExtensions.size());
 		createInfo.ppEnabledExtensionNames = mDeviceExtensions.data();
 
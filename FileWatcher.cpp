@@ -0,0 +1,107 @@
+#include "FileWatcher.h"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <format>
+#include <stdexcept>
+
+FileWatcher::FileWatcher(const std::filesystem::path& directory) : mDirectory(Normalize(directory))
+{
+	mDirectoryHandle = CreateFileW(mDirectory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+	if (mDirectoryHandle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error(std::format("can't watch directory: {}", mDirectory.string()));
+
+	mStopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	mThread = std::thread([this]() { Run(); });
+}
+
+FileWatcher::~FileWatcher()
+{
+	SetEvent(mStopEvent);
+	mThread.join();
+	CloseHandle(mStopEvent);
+	CloseHandle(mDirectoryHandle);
+}
+
+std::vector<std::filesystem::path> FileWatcher::PollChanges()
+{
+	std::vector<std::filesystem::path> changes;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	std::lock_guard lock(mMutex);
+	for (auto ite = mPending.begin(); ite != mPending.end();)
+	{
+		if (now - ite->second < QuietTime)
+		{
+			++ite;
+			continue;
+		}
+		changes.push_back(ite->first);
+		ite = mPending.erase(ite);
+	}
+	return changes;
+}
+
+std::filesystem::path FileWatcher::Normalize(const std::filesystem::path& path)
+{
+	return std::filesystem::absolute(path).lexically_normal();
+}
+
+void FileWatcher::Run()
+{
+	PROFILE_THREAD("File Watcher");
+
+	//DWORD aligned, FILE_NOTIFY_INFORMATION requirement
+	alignas(DWORD) std::byte buffer[16 * 1024];
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+	while (true)
+	{
+		ResetEvent(overlapped.hEvent);
+		if (!ReadDirectoryChangesW(mDirectoryHandle, buffer, sizeof(buffer), TRUE,
+			FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr))
+		{
+			LOG_ERROR("file watcher: ReadDirectoryChangesW failed on {}, error {}", mDirectory.string(), GetLastError());
+			break;
+		}
+
+		HANDLE events[] = { overlapped.hEvent, mStopEvent };
+		if (WaitForMultipleObjects(_countof(events), events, FALSE, INFINITE) != WAIT_OBJECT_0)
+		{
+			CancelIoEx(mDirectoryHandle, &overlapped);
+			DWORD ignored = 0;
+			GetOverlappedResult(mDirectoryHandle, &overlapped, &ignored, TRUE);
+			break;
+		}
+
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(mDirectoryHandle, &overlapped, &bytes, FALSE))
+			continue;
+		//zero means the buffer overflowed and the changes are lost
+		if (bytes == 0)
+		{
+			LOG_WARNING("file watcher: too many changes in {}, some are missed", mDirectory.string());
+			continue;
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::lock_guard lock(mMutex);
+		for (const std::byte* entry = buffer;;)
+		{
+			const FILE_NOTIFY_INFORMATION& info = *reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(entry);
+			if (info.Action == FILE_ACTION_ADDED || info.Action == FILE_ACTION_MODIFIED || info.Action == FILE_ACTION_RENAMED_NEW_NAME)
+			{
+				std::wstring name(info.FileName, info.FileNameLength / sizeof(WCHAR));
+				mPending[(mDirectory / name).lexically_normal()] = now;
+			}
+
+			if (info.NextEntryOffset == 0)
+				break;
+			entry += info.NextEntryOffset;
+		}
+	}
+
+	CloseHandle(overlapped.hEvent);
+}
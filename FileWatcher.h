@@ -0,0 +1,44 @@
+#pragma once
+
+#include <windows.h>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Watches a directory tree on a background thread with ReadDirectoryChangesW
+//editors often write a file in several steps, a change is reported after the file has been quiet for QuietTime
+class FileWatcher
+{
+public:
+	static constexpr std::chrono::milliseconds QuietTime{ 100 };
+
+	//throws if the directory can't be opened
+	FileWatcher(const std::filesystem::path& directory);
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	//files written or renamed into the tree since the last call, absolute and lexically normal
+	std::vector<std::filesystem::path> PollChanges();
+
+	//absolute and lexically normal, compare with what PollChanges returns
+	static std::filesystem::path Normalize(const std::filesystem::path& path);
+
+private:
+	void Run();
+
+	std::filesystem::path mDirectory;
+	HANDLE mDirectoryHandle = INVALID_HANDLE_VALUE;
+	HANDLE mStopEvent = nullptr;
+
+	std::mutex mMutex;
+	//path -> time of last write
+	std::map<std::filesystem::path, std::chrono::steady_clock::time_point> mPending;
+
+	std::thread mThread;
+};
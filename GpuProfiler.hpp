@@ -0,0 +1,323 @@
+#pragma once
+
+#include "dxUtil.hpp"
+#include "Profiler.h"
+#include "Log.h"
+
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//GPU time and pipeline statistics of named scopes, owned by Device
+//Each frame uses its own query pools, results are read FrameLatency frames later without waiting,
+//a frame whose queries are not available yet is dropped instead of stalling
+//Pipeline statistics queries can't nest, only the outermost scope collects them
+class GpuProfiler
+{
+public:
+	static constexpr uint32_t FrameLatency = 3;
+	static constexpr uint32_t MaxScopes = 64;
+
+	enum Statistic : uint32_t
+	{
+		InputAssemblyVertices,
+		InputAssemblyPrimitives,
+		VertexShaderInvocations,
+		ClippingInvocations,
+		ClippingPrimitives,
+		FragmentShaderInvocations,
+		StatisticCount
+	};
+
+	struct ScopeResult
+	{
+		std::string name;
+		uint32_t depth = 0;
+		double milliseconds = 0.0;
+		bool hasStatistics = false;
+		std::array<uint64_t, StatisticCount> statistics = {};
+	};
+
+	struct FrameResult
+	{
+		uint64_t frame = 0;
+		//BeginFrame to EndFrame
+		double milliseconds = 0.0;
+		std::vector<ScopeResult> scopes;
+	};
+
+	//RAII marker, e.g. GpuProfiler::Scope scope(profiler, commandBuffer, "Shadow");
+	class Scope
+	{
+	public:
+		Scope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const std::string& name)
+			: mProfiler(profiler), mCommandBuffer(commandBuffer), mScope(profiler.BeginScope(commandBuffer, name)) {}
+		~Scope() { mProfiler.EndScope(mCommandBuffer, mScope); }
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		GpuProfiler& mProfiler;
+		VkCommandBuffer mCommandBuffer;
+		uint32_t mScope;
+	};
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, bool pipelineStatistics)
+	{
+		mDevice = device;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		mTimestampPeriod = properties.limits.timestampPeriod;
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+		uint32_t validBits = queueFamilyIndex < queueFamilyCount ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+		mTimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+		//queue can't write timestamp, every call is a no-op
+		if (validBits == 0)
+		{
+			LOG_WARNING("gpu profiler: timestamp is not supported by graphics queue");
+			return;
+		}
+
+		for (FrameQueries& frameQueries : mFrames)
+		{
+			VkQueryPoolCreateInfo timestampPoolInfo
+			{
+				.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				.queryType = VK_QUERY_TYPE_TIMESTAMP,
+				.queryCount = 2 + 2 * MaxScopes
+			};
+			ThrowIfFailed(vkCreateQueryPool(mDevice, &timestampPoolInfo, nullptr, &frameQueries.timestampPool));
+
+			if (!pipelineStatistics)
+				continue;
+
+			VkQueryPoolCreateInfo statisticsPoolInfo
+			{
+				.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+				.queryCount = MaxScopes,
+				//result order follows bit order
+				.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+			};
+			ThrowIfFailed(vkCreateQueryPool(mDevice, &statisticsPoolInfo, nullptr, &frameQueries.statisticsPool));
+		}
+
+		mEnabled = true;
+	}
+
+	void Clear()
+	{
+		for (FrameQueries& frameQueries : mFrames)
+		{
+			if (frameQueries.timestampPool != VK_NULL_HANDLE)
+				vkDestroyQueryPool(mDevice, frameQueries.timestampPool, nullptr);
+			if (frameQueries.statisticsPool != VK_NULL_HANDLE)
+				vkDestroyQueryPool(mDevice, frameQueries.statisticsPool, nullptr);
+			frameQueries = {};
+		}
+		mEnabled = false;
+	}
+
+	bool IsEnabled() const { return mEnabled; }
+
+	//first command of the frame, outside render pass
+	//resolve the frame that used this slot FrameLatency frames ago, then reset the queries for reuse
+	void BeginFrame(VkCommandBuffer commandBuffer)
+	{
+		if (!mEnabled)
+			return;
+
+		FrameQueries& frameQueries = mFrames[mFrame % FrameLatency];
+		if (frameQueries.recorded)
+			Resolve(frameQueries);
+
+		frameQueries.frame = mFrame;
+		frameQueries.scopes.clear();
+		frameQueries.statisticsCount = 0;
+		frameQueries.recorded = true;
+		mDepth = 0;
+		mStatisticsActive = false;
+
+		vkCmdResetQueryPool(commandBuffer, frameQueries.timestampPool, 0, 2 + 2 * MaxScopes);
+		if (frameQueries.statisticsPool != VK_NULL_HANDLE)
+			vkCmdResetQueryPool(commandBuffer, frameQueries.statisticsPool, 0, MaxScopes);
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frameQueries.timestampPool, 0);
+	}
+
+	void EndFrame(VkCommandBuffer commandBuffer)
+	{
+		if (!mEnabled)
+			return;
+
+		FrameQueries& frameQueries = mFrames[mFrame % FrameLatency];
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameQueries.timestampPool, 1);
+		++mFrame;
+	}
+
+	//between BeginFrame and EndFrame, begin and end in the same command buffer, both inside or both outside a render pass
+	//return UINT32_MAX when disabled or out of scopes, EndScope ignores it
+	uint32_t BeginScope(VkCommandBuffer commandBuffer, const std::string& name)
+	{
+		FrameQueries& frameQueries = mFrames[mFrame % FrameLatency];
+		if (!mEnabled || frameQueries.scopes.size() >= MaxScopes)
+			return UINT32_MAX;
+
+		uint32_t scope = static_cast<uint32_t>(frameQueries.scopes.size());
+		ScopeQueries& scopeQueries = frameQueries.scopes.emplace_back();
+		scopeQueries.name = name;
+		scopeQueries.depth = mDepth++;
+		//counter track name, interned the first time a scope name is seen
+		auto [counterName, inserted] = mCounterNames.try_emplace(name, nullptr);
+		if (inserted)
+			counterName->second = Profiler::Intern("GPU " + name);
+		scopeQueries.counterName = counterName->second;
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frameQueries.timestampPool, 2 + 2 * scope);
+		if (frameQueries.statisticsPool != VK_NULL_HANDLE && !mStatisticsActive)
+		{
+			scopeQueries.statisticsQuery = frameQueries.statisticsCount++;
+			vkCmdBeginQuery(commandBuffer, frameQueries.statisticsPool, scopeQueries.statisticsQuery, 0);
+			mStatisticsActive = true;
+		}
+		return scope;
+	}
+
+	void EndScope(VkCommandBuffer commandBuffer, uint32_t scope)
+	{
+		if (scope == UINT32_MAX)
+			return;
+
+		FrameQueries& frameQueries = mFrames[mFrame % FrameLatency];
+		ScopeQueries& scopeQueries = frameQueries.scopes[scope];
+		if (scopeQueries.statisticsQuery != UINT32_MAX)
+		{
+			vkCmdEndQuery(commandBuffer, frameQueries.statisticsPool, scopeQueries.statisticsQuery);
+			mStatisticsActive = false;
+		}
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameQueries.timestampPool, 3 + 2 * scope);
+		--mDepth;
+	}
+
+	//latest resolved frame, frame is 0 and scopes is empty before the first one
+	const FrameResult& GetLastResult() const { return mLastResult; }
+	//frames resolved since start, a caller compares it to know if the result is new
+	uint64_t GetResolvedFrameCount() const { return mResolvedFrameCount; }
+	uint64_t GetDroppedFrameCount() const { return mDroppedFrameCount; }
+
+	static const char* GetStatisticName(uint32_t statistic)
+	{
+		static const char* names[StatisticCount] = { "iaVertices", "iaPrimitives", "vsInvocations", "clipInvocations", "clipPrimitives", "fsInvocations" };
+		return names[statistic];
+	}
+
+private:
+	struct ScopeQueries
+	{
+		std::string name;
+		const char* counterName = nullptr;
+		uint32_t depth = 0;
+		uint32_t statisticsQuery = UINT32_MAX;
+	};
+
+	struct FrameQueries
+	{
+		VkQueryPool timestampPool = VK_NULL_HANDLE;
+		VkQueryPool statisticsPool = VK_NULL_HANDLE;
+		uint64_t frame = 0;
+		bool recorded = false;
+		std::vector<ScopeQueries> scopes;
+		uint32_t statisticsCount = 0;
+	};
+
+	double TicksToMilliseconds(uint64_t begin, uint64_t end) const
+	{
+		//timestampPeriod is nanoseconds per tick
+		return static_cast<double>((end - begin) & mTimestampMask) * mTimestampPeriod * 1e-6;
+	}
+
+	void Resolve(FrameQueries& frameQueries)
+	{
+		//value and availability pair for every query, VK_NOT_READY if any is not available
+		const uint32_t timestampCount = 2 + 2 * static_cast<uint32_t>(frameQueries.scopes.size());
+		mTimestampData.resize(timestampCount * 2);
+		VkResult result = vkGetQueryPoolResults(mDevice, frameQueries.timestampPool, 0, timestampCount,
+			mTimestampData.size() * sizeof(uint64_t), mTimestampData.data(), 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		if (result == VK_SUCCESS && frameQueries.statisticsCount > 0)
+		{
+			mStatisticsData.resize(frameQueries.statisticsCount * (StatisticCount + 1));
+			result = vkGetQueryPoolResults(mDevice, frameQueries.statisticsPool, 0, frameQueries.statisticsCount,
+				mStatisticsData.size() * sizeof(uint64_t), mStatisticsData.data(), (StatisticCount + 1) * sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		}
+
+		if (result == VK_NOT_READY)
+		{
+			++mDroppedFrameCount;
+			return;
+		}
+		ThrowIfFailed(result);
+
+		auto Timestamp = [this](uint32_t query) { return mTimestampData[query * 2]; };
+
+		mLastResult.frame = frameQueries.frame;
+		mLastResult.milliseconds = TicksToMilliseconds(Timestamp(0), Timestamp(1));
+		mLastResult.scopes.resize(frameQueries.scopes.size());
+		for (size_t i = 0; i < frameQueries.scopes.size(); ++i)
+		{
+			const ScopeQueries& scopeQueries = frameQueries.scopes[i];
+			ScopeResult& scopeResult = mLastResult.scopes[i];
+			scopeResult.name = scopeQueries.name;
+			scopeResult.depth = scopeQueries.depth;
+			scopeResult.milliseconds = TicksToMilliseconds(Timestamp(2 + 2 * static_cast<uint32_t>(i)), Timestamp(3 + 2 * static_cast<uint32_t>(i)));
+			scopeResult.hasStatistics = scopeQueries.statisticsQuery != UINT32_MAX;
+			scopeResult.statistics = {};
+			if (scopeResult.hasStatistics)
+			{
+				const uint64_t* statistics = &mStatisticsData[scopeQueries.statisticsQuery * (StatisticCount + 1)];
+				std::copy(statistics, statistics + StatisticCount, scopeResult.statistics.begin());
+			}
+		}
+		++mResolvedFrameCount;
+
+		//gpu times show up as counter tracks next to the cpu scopes of the trace
+		PROFILE_COUNTER("GPU frame", mLastResult.milliseconds);
+		for (size_t i = 0; i < mLastResult.scopes.size(); ++i)
+			PROFILE_COUNTER(frameQueries.scopes[i].counterName, mLastResult.scopes[i].milliseconds);
+	}
+
+	VkDevice mDevice = VK_NULL_HANDLE;
+	bool mEnabled = false;
+	float mTimestampPeriod = 1.0f;
+	uint64_t mTimestampMask = ~0ull;
+
+	std::array<FrameQueries, FrameLatency> mFrames;
+	uint64_t mFrame = 0;
+	uint32_t mDepth = 0;
+	bool mStatisticsActive = false;
+
+	FrameResult mLastResult;
+	uint64_t mResolvedFrameCount = 0;
+	uint64_t mDroppedFrameCount = 0;
+	std::vector<uint64_t> mTimestampData;
+	std::vector<uint64_t> mStatisticsData;
+	std::unordered_map<std::string, const char*> mCounterNames;
+};
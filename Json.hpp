@@ -0,0 +1,266 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <stdexcept>
+#include <format>
+#include <cstdint>
+
+//Minimal json DOM for asset import (glTF), object keep member order, duplicated key take the first
+class JsonValue
+{
+public:
+	enum class Type { Null, Bool, Number, String, Array, Object };
+
+	static JsonValue Parse(std::string_view text)
+	{
+		size_t position = 0;
+		JsonValue value = ParseValue(text, position, 0);
+		SkipWhitespace(text, position);
+		if (position != text.size())
+			throw std::runtime_error(std::format("json: unexpected character at {}", position));
+		return value;
+	}
+
+	Type GetType() const { return mType; }
+	bool IsNull() const { return mType == Type::Null; }
+	bool IsNumber() const { return mType == Type::Number; }
+	bool IsString() const { return mType == Type::String; }
+	bool IsArray() const { return mType == Type::Array; }
+	bool IsObject() const { return mType == Type::Object; }
+
+	bool GetBool(bool defaultValue = false) const { return mType == Type::Bool ? mBool : defaultValue; }
+	double GetNumber(double defaultValue = 0.0) const { return mType == Type::Number ? mNumber : defaultValue; }
+	const std::string& GetString() const { return mString; }
+
+	size_t Size() const { return mValues.size(); }
+	const JsonValue& operator[](size_t index) const { return index < mValues.size() ? mValues[index] : Null(); }
+	const std::vector<JsonValue>& GetArray() const { return mValues; }
+
+	//missing member return null value
+	const JsonValue& operator[](std::string_view key) const
+	{
+		for (size_t i = 0; i < mKeys.size(); ++i)
+		{
+			if (mKeys[i] == key)
+				return mValues[i];
+		}
+		return Null();
+	}
+
+	bool Has(std::string_view key) const { return !(*this)[key].IsNull(); }
+	const std::vector<std::string>& GetKeys() const { return mKeys; }
+
+	uint32_t GetUint(uint32_t defaultValue = 0) const { return mType == Type::Number ? static_cast<uint32_t>(mNumber) : defaultValue; }
+	float GetFloat(float defaultValue = 0.0f) const { return mType == Type::Number ? static_cast<float>(mNumber) : defaultValue; }
+
+private:
+	static constexpr int MaxDepth = 256;
+
+	static const JsonValue& Null()
+	{
+		static const JsonValue null;
+		return null;
+	}
+
+	static void SkipWhitespace(std::string_view text, size_t& position)
+	{
+		while (position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r'))
+			++position;
+	}
+
+	static void Expect(std::string_view text, size_t& position, std::string_view token)
+	{
+		if (text.substr(position, token.size()) != token)
+			throw std::runtime_error(std::format("json: expect {} at {}", token, position));
+		position += token.size();
+	}
+
+	static JsonValue ParseValue(std::string_view text, size_t& position, int depth)
+	{
+		if (depth > MaxDepth)
+			throw std::runtime_error("json: nesting too deep");
+
+		SkipWhitespace(text, position);
+		if (position >= text.size())
+			throw std::runtime_error("json: unexpected end");
+
+		JsonValue value;
+		char c = text[position];
+		if (c == '{')
+		{
+			value.mType = Type::Object;
+			++position;
+			SkipWhitespace(text, position);
+			if (position < text.size() && text[position] == '}')
+			{
+				++position;
+				return value;
+			}
+
+			while (true)
+			{
+				SkipWhitespace(text, position);
+				value.mKeys.push_back(ParseString(text, position));
+				SkipWhitespace(text, position);
+				Expect(text, position, ":");
+				value.mValues.push_back(ParseValue(text, position, depth + 1));
+				SkipWhitespace(text, position);
+				if (position < text.size() && text[position] == ',')
+				{
+					++position;
+					continue;
+				}
+				Expect(text, position, "}");
+				return value;
+			}
+		}
+		else if (c == '[')
+		{
+			value.mType = Type::Array;
+			++position;
+			SkipWhitespace(text, position);
+			if (position < text.size() && text[position] == ']')
+			{
+				++position;
+				return value;
+			}
+
+			while (true)
+			{
+				value.mValues.push_back(ParseValue(text, position, depth + 1));
+				SkipWhitespace(text, position);
+				if (position < text.size() && text[position] == ',')
+				{
+					++position;
+					continue;
+				}
+				Expect(text, position, "]");
+				return value;
+			}
+		}
+		else if (c == '"')
+		{
+			value.mType = Type::String;
+			value.mString = ParseString(text, position);
+		}
+		else if (c == 't')
+		{
+			Expect(text, position, "true");
+			value.mType = Type::Bool;
+			value.mBool = true;
+		}
+		else if (c == 'f')
+		{
+			Expect(text, position, "false");
+			value.mType = Type::Bool;
+			value.mBool = false;
+		}
+		else if (c == 'n')
+		{
+			Expect(text, position, "null");
+		}
+		else
+		{
+			value.mType = Type::Number;
+			auto [end, error] = std::from_chars(text.data() + position, text.data() + text.size(), value.mNumber);
+			if (error != std::errc())
+				throw std::runtime_error(std::format("json: invalid number at {}", position));
+			position = end - text.data();
+		}
+
+		return value;
+	}
+
+	static void AppendUtf8(std::string& str, uint32_t codePoint)
+	{
+		if (codePoint < 0x80)
+			str += static_cast<char>(codePoint);
+		else if (codePoint < 0x800)
+		{
+			str += static_cast<char>(0xC0 | (codePoint >> 6));
+			str += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000)
+		{
+			str += static_cast<char>(0xE0 | (codePoint >> 12));
+			str += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			str += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			str += static_cast<char>(0xF0 | (codePoint >> 18));
+			str += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+			str += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			str += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+	}
+
+	static uint32_t ParseHex4(std::string_view text, size_t& position)
+	{
+		uint32_t codeUnit = 0;
+		if (position + 4 > text.size() || std::from_chars(text.data() + position, text.data() + position + 4, codeUnit, 16).ptr != text.data() + position + 4)
+			throw std::runtime_error(std::format("json: invalid unicode escape at {}", position));
+		position += 4;
+		return codeUnit;
+	}
+
+	static std::string ParseString(std::string_view text, size_t& position)
+	{
+		Expect(text, position, "\"");
+
+		std::string str;
+		while (position < text.size() && text[position] != '"')
+		{
+			char c = text[position++];
+			if (c != '\\')
+			{
+				str += c;
+				continue;
+			}
+
+			if (position >= text.size())
+				break;
+
+			char escape = text[position++];
+			switch (escape)
+			{
+			case '"': str += '"'; break;
+			case '\\': str += '\\'; break;
+			case '/': str += '/'; break;
+			case 'b': str += '\b'; break;
+			case 'f': str += '\f'; break;
+			case 'n': str += '\n'; break;
+			case 'r': str += '\r'; break;
+			case 't': str += '\t'; break;
+			case 'u':
+			{
+				uint32_t codePoint = ParseHex4(text, position);
+				//surrogate pair
+				if (codePoint >= 0xD800 && codePoint < 0xDC00 && text.substr(position, 2) == "\\u")
+				{
+					position += 2;
+					uint32_t low = ParseHex4(text, position);
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				AppendUtf8(str, codePoint);
+				break;
+			}
+			default:
+				throw std::runtime_error(std::format("json: invalid escape at {}", position));
+			}
+		}
+
+		Expect(text, position, "\"");
+		return str;
+	}
+
+	Type mType = Type::Null;
+	bool mBool = false;
+	double mNumber = 0.0;
+	std::string mString;
+	std::vector<std::string> mKeys;
+	std::vector<JsonValue> mValues;
+};
@@ -0,0 +1,178 @@
+#include "Log.h"
+#include "dxUtil.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Log
+{
+	namespace
+	{
+		//queue sentinel, never formatted
+		struct StubMessage : Message
+		{
+			void Format(std::string& out) const override {}
+		};
+
+		//single producer (the owning thread), single consumer (the writer thread)
+		//head is the last consumed message, it's released when the next one is consumed
+		struct ThreadQueue
+		{
+			Message* head;
+			Message* tail;
+
+			ThreadQueue() : head(new StubMessage()), tail(head) {}
+
+			void Push(Message* message)
+			{
+				tail->next.store(message, std::memory_order_release);
+				tail = message;
+			}
+
+			//released head may still be in the batch being written, caller deletes it afterwards
+			Message* Pop(std::vector<Message*>& released)
+			{
+				Message* next = head->next.load(std::memory_order_acquire);
+				if (next == nullptr)
+					return nullptr;
+				released.push_back(head);
+				head = next;
+				return next;
+			}
+		};
+
+		class Writer
+		{
+		public:
+			Writer() : mThread([this]() { Run(); }) {}
+
+			~Writer()
+			{
+				{
+					std::lock_guard lock(mMutex);
+					mStop = true;
+				}
+				mWake.notify_one();
+				mThread.join();
+			}
+
+			ThreadQueue& GetThreadQueue()
+			{
+				//queues are never freed, messages of exited threads are still written
+				thread_local ThreadQueue* queue = nullptr;
+				if (queue == nullptr)
+				{
+					std::lock_guard lock(mMutex);
+					queue = mQueues.emplace_back(std::make_unique<ThreadQueue>()).get();
+				}
+				return *queue;
+			}
+
+			void Flush()
+			{
+				std::unique_lock lock(mMutex);
+				uint64_t generation = ++mFlushRequested;
+				mWake.notify_one();
+				mFlushed.wait(lock, [this, generation]() { return mFlushCompleted >= generation; });
+			}
+
+		private:
+			void Run()
+			{
+				std::vector<Message*> batch;
+				std::vector<Message*> released;
+				std::vector<ThreadQueue*> queues;
+				std::string text;
+				bool stop = false;
+				while (!stop)
+				{
+					uint64_t flushGeneration;
+					{
+						//idle poll, pushing never wakes the writer so the caller doesn't pay for a notify
+						std::unique_lock lock(mMutex);
+						mWake.wait_for(lock, std::chrono::milliseconds(5), [this]() { return mStop || mFlushRequested > mFlushCompleted; });
+						stop = mStop;
+						flushGeneration = mFlushRequested;
+						queues.clear();
+						for (const std::unique_ptr<ThreadQueue>& queue : mQueues)
+							queues.push_back(queue.get());
+					}
+
+					batch.clear();
+					for (ThreadQueue* queue : queues)
+					{
+						while (Message* message = queue->Pop(released))
+							batch.push_back(message);
+					}
+					std::stable_sort(batch.begin(), batch.end(), [](const Message* a, const Message* b) { return a->time < b->time; });
+
+					for (const Message* message : batch)
+					{
+						text.clear();
+						if (message->level == Level::Warning)
+							text = "warning: ";
+						else if (message->level == Level::Error)
+							text = "error: ";
+						message->Format(text);
+						text.push_back('\n');
+						(message->level >= Level::Warning ? std::cerr : std::cout) << text;
+					}
+					//one flush per batch instead of one per line
+					if (!batch.empty())
+						std::cout.flush();
+
+					for (Message* message : released)
+						delete message;
+					released.clear();
+
+					{
+						std::lock_guard lock(mMutex);
+						mFlushCompleted = std::max(mFlushCompleted, flushGeneration);
+					}
+					mFlushed.notify_all();
+				}
+			}
+
+			std::mutex mMutex;
+			std::condition_variable mWake;
+			std::condition_variable mFlushed;
+			bool mStop = false;
+			uint64_t mFlushRequested = 0;
+			uint64_t mFlushCompleted = 0;
+			std::vector<std::unique_ptr<ThreadQueue>> mQueues;
+
+			//last member, the thread starts after everything above is constructed
+			std::thread mThread;
+		};
+
+		Writer& GetWriter()
+		{
+			static Writer writer;
+			return writer;
+		}
+
+		const std::chrono::steady_clock::time_point gStartTime = std::chrono::steady_clock::now();
+	}
+
+	std::string Narrow(const std::wstring& text)
+	{
+		return to_string(text);
+	}
+
+	void Push(Message* message)
+	{
+		message->time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gStartTime).count();
+		GetWriter().GetThreadQueue().Push(message);
+	}
+
+	void Flush()
+	{
+		GetWriter().Flush();
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <format>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+//Leveled logger, LOG_INFO("mesh lod {}: {} triangles", lod, count)
+//arguments are copied into a per-thread lock-free queue, formatting and console io happen on a writer thread
+//levels below SOCO_LOG_LEVEL are compiled out, arguments are not evaluated
+//0 debug, 1 info, 2 warning, 3 error, 4 off
+#ifndef SOCO_LOG_LEVEL
+#ifdef _DEBUG
+#define SOCO_LOG_LEVEL 0
+#else
+#define SOCO_LOG_LEVEL 1
+#endif
+#endif
+
+namespace Log
+{
+	enum class Level : uint8_t { Debug, Info, Warning, Error };
+
+	//wide string argument, converted to utf-8 on the writer thread
+	struct WideText
+	{
+		std::wstring text;
+	};
+	std::string Narrow(const std::wstring& text);
+
+	//argument as stored in the queue: strings are owned copies, the caller's buffer may be gone when formatted
+	template<typename T>
+	struct Capture { using Type = std::decay_t<T>; };
+	template<typename T> requires std::is_convertible_v<const T&, std::string_view>
+	struct Capture<T> { using Type = std::string; };
+	template<typename T> requires std::is_convertible_v<const T&, std::wstring_view>
+	struct Capture<T> { using Type = WideText; };
+	template<typename T>
+	using CaptureType = typename Capture<std::remove_cvref_t<T>>::Type;
+
+	struct Message
+	{
+		Level level = Level::Info;
+		//ns, messages of different threads are written in time order within a batch
+		uint64_t time = 0;
+		//link of the owning thread's queue
+		std::atomic<Message*> next = nullptr;
+
+		virtual ~Message() = default;
+		virtual void Format(std::string& out) const = 0;
+	};
+
+	template<typename... T>
+	struct FormatMessage : Message
+	{
+		std::string_view format;
+		std::tuple<T...> args;
+
+		FormatMessage(Level level, std::string_view format, T&&... args) : format(format), args(std::move(args)...) { this->level = level; }
+
+		void Format(std::string& out) const override
+		{
+			std::apply([&out, this](const T&... values) { std::vformat_to(std::back_inserter(out), format, std::make_format_args(values...)); }, args);
+		}
+	};
+
+	//takes ownership, message is deleted by the writer thread
+	void Push(Message* message);
+	//block until every message pushed before the call is written
+	void Flush();
+
+	template<typename... Args>
+	void Write(Level level, std::format_string<CaptureType<Args>...> format, Args&&... args)
+	{
+		Push(new FormatMessage<CaptureType<Args>...>(level, format.get(), CaptureType<Args>(std::forward<Args>(args))...));
+	}
+}
+
+template<>
+struct std::formatter<Log::WideText> : std::formatter<std::string>
+{
+	auto format(const Log::WideText& text, std::format_context& context) const
+	{
+		return std::formatter<std::string>::format(Log::Narrow(text.text), context);
+	}
+};
+
+#if SOCO_LOG_LEVEL <= 0
+#define LOG_DEBUG(...) Log::Write(Log::Level::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if SOCO_LOG_LEVEL <= 1
+#define LOG_INFO(...) Log::Write(Log::Level::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if SOCO_LOG_LEVEL <= 2
+#define LOG_WARNING(...) Log::Write(Log::Level::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
+
+#if SOCO_LOG_LEVEL <= 3
+#define LOG_ERROR(...) Log::Write(Log::Level::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
@@ -1,9 +1,29 @@
 ﻿#include "Material.h"
+#include "MaterialSystem.h"
+#include "dxUtil.hpp"
 
-Material::Material(Shader* shader, RenderState* renderState)
-    :mShader(shader)
+#include <format>
+#include <stdexcept>
+
+Material::Material(MaterialSystem* owner, uint32_t index, const ParameterBlockLayout& layout, uint32_t pipelineStateIndex)
+	: mOwner(owner), mIndex(index), mLayout(&layout), mPipelineStateIndex(pipelineStateIndex), mData(layout.size)
+{ }
+
+const ShaderParameter& Material::FindParameter(std::string_view name, ShaderParameterType type) const
+{
+	const ShaderParameter* parameter = mLayout->FindParameter(name);
+	if (parameter == nullptr)
+		throw std::runtime_error(std::format("material parameter {} is not in {}", name, mLayout->name));
+	if (parameter->type != type)
+		throw std::runtime_error(std::format("material parameter {} is {}, set as {}", name, magic_enum::enum_name(parameter->type), magic_enum::enum_name(type)));
+	return *parameter;
+}
+
+void Material::MarkDirty()
 {
-    assert(shader != nullptr && "创建材质shader不能为空");
+	if (mDirty)
+		return;
 
-    
+	mDirty = true;
+	mOwner->mDirtyMaterials.push_back(mIndex);
 }
@@ -1,28 +1,97 @@
 ﻿#pragma once
 
-#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <glm/glm.hpp>
 
 #include "Shader.h"
+#include "PSO.h"
 
-struct BlendState
+class MaterialSystem;
+
+//what a material adds to a pipeline key, materials with equal state are drawn with the same pipelines
+struct MaterialPipelineState
 {
-    VkPipelineColorBlendStateCreateInfo blendState;
-    VkPipelineColorBlendAttachmentState attachmentBlendState[8];
+	std::string shader;
+	RenderState renderState;
+	SpecializationValues specialization;
+
+	auto operator<=>(const MaterialPipelineState&) const = default;
 };
 
-struct RenderState
+template<>
+struct std::hash<MaterialPipelineState>
 {
-    VkPipelineRasterizationStateCreateInfo rasterizeState;
-    VkPipelineDepthStencilStateCreateInfo depthStencilState;
-    BlendState blendState;
+	std::size_t operator()(const MaterialPipelineState& state) const
+	{
+		std::size_t res = std::hash<std::string>()(state.shader);
+		res ^= std::hash<uint32_t>()(static_cast<uint32_t>(state.renderState.depthCompareOp) | (state.renderState.depthWrite ? 0x100 : 0)
+			| (state.renderState.colorAttachmentCount << 16)) << 1;
+		res ^= std::hash<SpecializationValues>()(state.specialization) >> 1;
+		return res;
+	}
 };
 
+//Parameters of one material in the layout of the PerMaterial block, created by MaterialSystem
+//Set only writes the cpu copy and queues the material for the next upload
 class Material
 {
 public:
-    Material(Shader* shader, RenderState* renderState = nullptr);
+	Material(MaterialSystem* owner, uint32_t index, const ParameterBlockLayout& layout, uint32_t pipelineStateIndex);
+
+	Material(const Material&) = delete;
+	Material& operator=(const Material&) = delete;
+
+	//throws if the block has no such parameter or its type is not T
+	template<typename T>
+	void Set(std::string_view name, const T& value)
+	{
+		static_assert(std::is_same_v<T, float> || std::is_same_v<T, glm::vec2> || std::is_same_v<T, glm::vec3> || std::is_same_v<T, glm::vec4>
+			|| std::is_same_v<T, glm::mat4> || std::is_same_v<T, int32_t> || std::is_same_v<T, uint32_t>,
+			"material parameter is float, vec2, vec3, vec4, mat4, int or uint");
+
+		ShaderParameterType type;
+		if constexpr (std::is_same_v<T, float>)
+			type = ShaderParameterType::Float;
+		else if constexpr (std::is_same_v<T, glm::vec2>)
+			type = ShaderParameterType::Float2;
+		else if constexpr (std::is_same_v<T, glm::vec3>)
+			type = ShaderParameterType::Float3;
+		else if constexpr (std::is_same_v<T, glm::vec4>)
+			type = ShaderParameterType::Float4;
+		else if constexpr (std::is_same_v<T, glm::mat4>)
+			type = ShaderParameterType::Float4x4;
+		else if constexpr (std::is_same_v<T, int32_t>)
+			type = ShaderParameterType::Int;
+		else
+			type = ShaderParameterType::UInt;
+
+		const ShaderParameter& parameter = FindParameter(name, type);
+		std::memcpy(mData.data() + parameter.offset, &value, sizeof(T));
+		MarkDirty();
+	}
+
+	//slot in the material buffer, the shader reads PerMaterial[index]
+	uint32_t GetIndex() const { return mIndex; }
+	//index into MaterialSystem::GetPipelineStates
+	uint32_t GetPipelineStateIndex() const { return mPipelineStateIndex; }
+	const std::vector<std::byte>& GetData() const { return mData; }
 
 private:
-    Shader* mShader;
-    
+	friend class MaterialSystem;
+
+	const ShaderParameter& FindParameter(std::string_view name, ShaderParameterType type) const;
+	void MarkDirty();
+
+	MaterialSystem* mOwner;
+	uint32_t mIndex;
+	const ParameterBlockLayout* mLayout;
+	uint32_t mPipelineStateIndex;
+	std::vector<std::byte> mData;
+	//already in the owner's upload list
+	bool mDirty = false;
 };
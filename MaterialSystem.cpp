@@ -0,0 +1,124 @@
+#include "MaterialSystem.h"
+#include "dxUtil.hpp"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+MaterialSystem::MaterialSystem(Device* device, const Shader& shader, const std::string& blockName, uint32_t capacity)
+	: DeviceComponent(device), mCapacity(std::max(capacity, 1u))
+{
+	const ParameterBlockLayout* layout = shader.FindParameterBlock(blockName);
+	if (layout == nullptr || layout->size == 0)
+		throw std::runtime_error(std::format("material block {} is not declared", blockName));
+	mLayout = *layout;
+
+	const VkDeviceSize size = static_cast<VkDeviceSize>(mLayout.size) * mCapacity;
+	auto CreateBuffer = [this, size](VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory) {
+		VkBufferCreateInfo bufferInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = size,
+			.usage = usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+		};
+		ThrowIfFailed(vkCreateBuffer(mDevice->GetDevice(), &bufferInfo, nullptr, &buffer));
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(mDevice->GetDevice(), buffer, &memRequirements);
+		memory = mDevice->AllocateMemory(memRequirements.size, memRequirements.memoryTypeBits, properties);
+		ThrowIfFailed(vkBindBufferMemory(mDevice->GetDevice(), buffer, memory, 0));
+	};
+
+	//staging holds at most every material once
+	CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mBuffer, mMemory);
+	CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mStagingBuffer, mStagingMemory);
+	ThrowIfFailed(vkMapMemory(mDevice->GetDevice(), mStagingMemory, 0, size, 0, &mStagingData));
+
+	mMaterials.reserve(mCapacity);
+	LOG_INFO("material system: {} of {} bytes, {} materials at most", mLayout.name, mLayout.size, mCapacity);
+}
+
+MaterialSystem::~MaterialSystem()
+{
+	VkDevice device = mDevice->GetDevice();
+	if (mStagingData != nullptr)
+		vkUnmapMemory(device, mStagingMemory);
+	vkDestroyBuffer(device, mStagingBuffer, nullptr);
+	vkFreeMemory(device, mStagingMemory, nullptr);
+	vkDestroyBuffer(device, mBuffer, nullptr);
+	vkFreeMemory(device, mMemory, nullptr);
+}
+
+Material* MaterialSystem::CreateMaterial(const std::string& shaderName, const Shader& shader, const RenderState& renderState,
+	const SpecializationValues& specialization)
+{
+	if (mMaterials.size() >= mCapacity)
+		throw std::runtime_error(std::format("material system is full, {} materials", mCapacity));
+	if (!IsCompatible(shader))
+		throw std::runtime_error(std::format("{} declares another layout of {}", shaderName, mLayout.name));
+
+	MaterialPipelineState state{ shaderName, renderState, specialization };
+	auto [ite, inserted] = mPipelineStateIndices.try_emplace(state, static_cast<uint32_t>(mPipelineStates.size()));
+	if (inserted)
+		mPipelineStates.push_back(std::move(state));
+
+	Material* material = mMaterials.emplace_back(std::make_unique<Material>(this, static_cast<uint32_t>(mMaterials.size()), mLayout, ite->second)).get();
+	//zeroed parameters are uploaded too
+	material->MarkDirty();
+	return material;
+}
+
+bool MaterialSystem::IsCompatible(const Shader& shader) const
+{
+	const ParameterBlockLayout* layout = shader.FindParameterBlock(mLayout.name);
+	return layout == nullptr || *layout == mLayout;
+}
+
+void MaterialSystem::RecordUpload(VkCommandBuffer commandBuffer)
+{
+	if (mDirtyMaterials.empty())
+		return;
+
+	PROFILE_FUNCTION();
+
+	//packed in index order, materials next to each other in the buffer are one copy region
+	std::sort(mDirtyMaterials.begin(), mDirtyMaterials.end());
+	mCopyRegions.clear();
+	const VkDeviceSize stride = mLayout.size;
+	VkDeviceSize stagingOffset = 0;
+	for (uint32_t index : mDirtyMaterials)
+	{
+		Material& material = *mMaterials[index];
+		std::memcpy(static_cast<std::byte*>(mStagingData) + stagingOffset, material.mData.data(), stride);
+		material.mDirty = false;
+
+		const VkDeviceSize dstOffset = index * stride;
+		if (!mCopyRegions.empty() && mCopyRegions.back().dstOffset + mCopyRegions.back().size == dstOffset)
+			mCopyRegions.back().size += stride;
+		else
+			mCopyRegions.push_back({ stagingOffset, dstOffset, stride });
+		stagingOffset += stride;
+	}
+	mDirtyMaterials.clear();
+
+	vkCmdCopyBuffer(commandBuffer, mStagingBuffer, mBuffer, static_cast<uint32_t>(mCopyRegions.size()), mCopyRegions.data());
+
+	VkMemoryBarrier2KHR uploadBarrier
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR,
+		.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+		.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR,
+		.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR
+	};
+	VkDependencyInfoKHR dependencyInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+		.memoryBarrierCount = 1,
+		.pMemoryBarriers = &uploadBarrier
+	};
+	mDevice->CmdPipelineBarrier2(commandBuffer, dependencyInfo);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "DeviceComponent.h"
+#include "Material.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Parameter blocks of every material in one device local storage buffer, the shader indexes it with the material index
+//the layout is the block of the first shader, every material shader declares the same block
+//Material::Set only writes the cpu copy; RecordUpload packs the materials changed since the last upload into
+//a staging buffer and copies them with one command, drawing writes no descriptor and binds no set per material
+class MaterialSystem : public DeviceComponent
+{
+public:
+	//throws if the shader doesn't declare the block; capacity is fixed, the buffer is never reallocated
+	MaterialSystem(Device* device, const Shader& shader, const std::string& blockName, uint32_t capacity);
+	~MaterialSystem();
+
+	MaterialSystem(const MaterialSystem&) = delete;
+	MaterialSystem& operator=(const MaterialSystem&) = delete;
+
+	//parameters start zeroed, throws when full or when the shader declares another layout of the block
+	Material* CreateMaterial(const std::string& shaderName, const Shader& shader, const RenderState& renderState = {},
+		const SpecializationValues& specialization = {});
+	Material* GetMaterial(uint32_t index) const { return mMaterials[index].get(); }
+	uint32_t GetMaterialCount() const { return static_cast<uint32_t>(mMaterials.size()); }
+
+	//distinct pipeline states of the materials, Material::GetPipelineStateIndex indexes it
+	const std::vector<MaterialPipelineState>& GetPipelineStates() const { return mPipelineStates; }
+
+	const ParameterBlockLayout& GetLayout() const { return mLayout; }
+	//a shader without the block is compatible, e.g. depth only shader
+	bool IsCompatible(const Shader& shader) const;
+
+	//outside of rendering, before the shaders reading the buffer; nothing is recorded when no material changed
+	//the staging buffer is reused, the previous upload must be complete
+	void RecordUpload(VkCommandBuffer commandBuffer);
+	size_t GetDirtyCount() const { return mDirtyMaterials.size(); }
+
+	//storage buffer of all capacity, written to the descriptor once
+	VkDescriptorBufferInfo GetBufferInfo() const { return { mBuffer, 0, VK_WHOLE_SIZE }; }
+
+private:
+	friend class Material;
+
+	ParameterBlockLayout mLayout;
+	uint32_t mCapacity;
+
+	std::vector<std::unique_ptr<Material>> mMaterials;
+	std::vector<uint32_t> mDirtyMaterials;
+	std::vector<VkBufferCopy> mCopyRegions;
+
+	std::vector<MaterialPipelineState> mPipelineStates;
+	std::unordered_map<MaterialPipelineState, uint32_t> mPipelineStateIndices;
+
+	VkBuffer mBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory mMemory = VK_NULL_HANDLE;
+	VkBuffer mStagingBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory mStagingMemory = VK_NULL_HANDLE;
+	void* mStagingData = nullptr;
+};
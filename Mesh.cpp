@@ -1,6 +1,16 @@
 #include "Mesh.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <vk_format_utils.h>
+#include <fstream>
+#include <format>
+#include <glm/gtc/constants.hpp>
+
+#include "MeshFile.h"
+#include "Profiler.h"
+#include "Log.h"
 
 #include <cassert>
 
@@ -33,15 +43,7 @@ std::unique_ptr<Mesh> Mesh::CreateTriangle(Device* device)
 
 	//indices
 	uint32_t indices[3] = { 0, 1, 2 };
-	res->mIndices32.resize(_countof(indices));
-	memcpy(res->mIndices32.data(), indices, sizeof(indices));
-
-	res->mIndices16.resize(res->mIndices32.size());
-	for (int i = 0; i < res->mIndices32.size(); ++i)
-	{
-		res->mIndices16[i] = static_cast<uint16_t>(res->mIndices32[i]);
-	}
-
+	res->mIndices.assign(std::begin(indices), std::end(indices));
 	res->bIndex32 = false;
 
 	res->mAttributes.insert({ "POSITION", VK_FORMAT_R32G32B32_SFLOAT, 0, 0});
@@ -53,7 +55,25 @@ std::unique_ptr<Mesh> Mesh::CreateTriangle(Device* device)
 	submesh.BaseVertexLocation = 0;
 	res->mSubmeshes.push_back(submesh);
 
-	res->BuildBuffer();
+	if (device != nullptr)
+		res->BuildBuffer();
+
+	return res;
+}
+
+std::unique_ptr<Mesh> Mesh::Create(Device* device, MeshData&& data)
+{
+	std::unique_ptr<Mesh> res(new Mesh(device));
+
+	res->mVertexCount = data.vertexCount;
+	res->mAttributes = std::move(data.attributes);
+	res->mVertexDatas = std::move(data.vertexDatas);
+	res->mSubmeshes = std::move(data.submeshes);
+	res->mIndices = std::move(data.indices);
+	res->CompactIndices();
+
+	if (device != nullptr)
+		res->BuildBuffer();
 
 	return res;
 }
@@ -79,17 +99,110 @@ uint32_t Mesh::GetBindingStride(uint32_t binding) const
 		return mVertexDatas[binding].size() / mVertexCount;
 	}
 
+	//loaded from mesh file, no cpu data
+	if (binding < mBindingStrides.size())
+	{
+		return mBindingStrides[binding];
+	}
+
 	return 0;
 }
 
 void Mesh::BuildBuffer()
 {
+	std::vector<BufferSource> vertexSources;
+	for (const std::vector<std::byte>& vertexData : mVertexDatas)
+		vertexSources.push_back({ vertexData.data(), vertexData.size() });
+
+	//16 bit copy only live until upload
+	std::vector<uint16_t> indices16;
+	BufferSource indexSource = { mIndices.data(), mIndices.size() * sizeof(uint32_t) };
+	if (!bIndex32)
+	{
+		indices16 = GetIndices16();
+		indexSource = { indices16.data(), indices16.size() * sizeof(uint16_t) };
+	}
+
+	BuildBuffer(vertexSources, indexSource);
+}
+
+std::vector<uint16_t> Mesh::GetIndices16() const
+{
+	assert(!bIndex32);
+	return std::vector<uint16_t>(mIndices.begin(), mIndices.end());
+}
+
+void Mesh::CompactIndices()
+{
+	//lod and meshlet range is built on submesh
+	assert(mLodSubmeshes.empty() && mMeshlets.empty());
+
+	std::vector<SubmeshGeometry> submeshes;
+	for (const SubmeshGeometry& submesh : mSubmeshes)
+	{
+		const uint32_t* indices = mIndices.data() + submesh.StartIndexLocation;
+
+		//greedy triangle run whose index span fit 16 bit, BaseVertexLocation is the smallest index of run
+		std::vector<SubmeshGeometry> pieces;
+		uint32_t runStart = 0;
+		uint32_t runMin = UINT32_MAX;
+		uint32_t runMax = 0;
+		uint32_t submeshMin = UINT32_MAX;
+		for (uint32_t i = 0; i + 3 <= submesh.IndexCount; i += 3)
+		{
+			const uint32_t triangleMin = std::min({ indices[i], indices[i + 1], indices[i + 2] });
+			const uint32_t triangleMax = std::max({ indices[i], indices[i + 1], indices[i + 2] });
+			submeshMin = std::min(submeshMin, triangleMin);
+			if (i > runStart && std::max(runMax, triangleMax) - std::min(runMin, triangleMin) > UINT16_MAX)
+			{
+				pieces.push_back({ i - runStart, submesh.StartIndexLocation + runStart, runMin });
+				runStart = i;
+				runMin = UINT32_MAX;
+				runMax = 0;
+			}
+			runMin = std::min(runMin, triangleMin);
+			runMax = std::max(runMax, triangleMax);
+		}
+		if (runStart < submesh.IndexCount || pieces.empty())
+			pieces.push_back({ submesh.IndexCount - runStart, submesh.StartIndexLocation + runStart, runMin });
+
+		//vertex order without locality split into tiny draws, keep it whole and use 32 bit
+		if (pieces.size() > 1 && submesh.IndexCount / 3 / pieces.size() < MinSplitTriangles)
+			pieces = { { submesh.IndexCount, submesh.StartIndexLocation, submeshMin } };
+
+		for (SubmeshGeometry& piece : pieces)
+		{
+			if (piece.BaseVertexLocation == UINT32_MAX)
+				piece.BaseVertexLocation = 0;
+			for (uint32_t i = 0; i < piece.IndexCount; ++i)
+				mIndices[piece.StartIndexLocation + i] -= piece.BaseVertexLocation;
+			piece.BaseVertexLocation += submesh.BaseVertexLocation;
+			submeshes.push_back(piece);
+		}
+	}
+
+	if (submeshes.size() != mSubmeshes.size())
+		LOG_INFO("mesh index: {} submeshes split into {} for 16 bit index", mSubmeshes.size(), submeshes.size());
+	mSubmeshes = std::move(submeshes);
+
+	//every index is relative to its range base now
+	uint32_t maxIndex = 0;
+	for (uint32_t index : mIndices)
+		maxIndex = std::max(maxIndex, index);
+	bIndex32 = maxIndex > UINT16_MAX;
+}
+
+void Mesh::BuildBuffer(const std::vector<BufferSource>& vertexSources, const BufferSource& indexSource)
+{
+	PROFILE_FUNCTION();
+
 	std::set<uint32_t> queueFamilyIndices = { mDevice->GetGraphicsQueue().index, mDevice->GetTransferQueue().index };
 	std::vector<uint32_t> queueFamilyIndicesUnique(queueFamilyIndices.begin(), queueFamilyIndices.end());
 
 	//Build VertexBuffer
-	std::vector<VkBuffer> uploadBuffers(mVertexDatas.size() + 1);//1 is indexBuffer
-	mVertexBuffers.resize(mVertexDatas.size());
+	const bool hasMeshlet = !mMeshletData.empty();
+	std::vector<VkBuffer> uploadBuffers(vertexSources.size() + 1 + (hasMeshlet ? 1 : 0));//1 is indexBuffer, then meshletBuffer
+	mVertexBuffers.resize(vertexSources.size());
 
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -99,7 +212,7 @@ void Mesh::BuildBuffer()
 
 	for (size_t i = 0; i < mVertexBuffers.size(); ++i)
 	{
-		bufferInfo.size = mVertexDatas[i].size();
+		bufferInfo.size = vertexSources[i].size;
 
 		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 		ThrowIfFailed(vkCreateBuffer(mDevice->GetDevice(), &bufferInfo, nullptr, &uploadBuffers[i]));
@@ -109,7 +222,7 @@ void Mesh::BuildBuffer()
 	}
 	//Build IndexBuffer
 	size_t indexBufferOffset = mVertexBuffers.size();
-	VkDeviceSize indexBufferSize = bIndex32 ? (mIndices32.size() * sizeof(uint32_t)) : (mIndices16.size() * sizeof(uint16_t));
+	VkDeviceSize indexBufferSize = indexSource.size;
 
 	bufferInfo.size = indexBufferSize;
 
@@ -118,10 +231,22 @@ void Mesh::BuildBuffer()
 	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	ThrowIfFailed(vkCreateBuffer(mDevice->GetDevice(), &bufferInfo, nullptr, &mIndexBuffer));
 
+	//Build MeshletBuffer
+	size_t meshletBufferOffset = indexBufferOffset + 1;
+	if (hasMeshlet)
+	{
+		bufferInfo.size = mMeshletData.size();
+
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		ThrowIfFailed(vkCreateBuffer(mDevice->GetDevice(), &bufferInfo, nullptr, &(uploadBuffers[meshletBufferOffset])));
+		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		ThrowIfFailed(vkCreateBuffer(mDevice->GetDevice(), &bufferInfo, nullptr, &mMeshletBuffer));
+	}
+
 	//Allocate Memory
 	VkDeviceMemory uploadMemory;
 
-	std::vector<uint32_t> memSizeVector(mVertexBuffers.size() + 1);
+	std::vector<uint32_t> memSizeVector(uploadBuffers.size());
 	uint32_t totalMemorySize = 0;
 	uint32_t memoryTypeBits = 0;
 
@@ -144,6 +269,16 @@ void Mesh::BuildBuffer()
 		memoryTypeBits |= memRequirements.memoryTypeBits;
 	}
 
+	if (hasMeshlet)
+	{
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(mDevice->GetDevice(), mMeshletBuffer, &memRequirements);
+
+		totalMemorySize += memRequirements.size;
+		memSizeVector[meshletBufferOffset] = memRequirements.size;
+		memoryTypeBits |= memRequirements.memoryTypeBits;
+	}
+
 	VkMemoryAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 
@@ -151,7 +286,7 @@ void Mesh::BuildBuffer()
 	allocInfo.memoryTypeIndex = mDevice->FindMemoryType(memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 	ThrowIfFailed(vkAllocateMemory(mDevice->GetDevice(), &allocInfo, nullptr, &mDeviceMemory));
 
-	std::vector<uint32_t> memSizeVectorUploader(mVertexBuffers.size() + 1);
+	std::vector<uint32_t> memSizeVectorUploader(uploadBuffers.size());
 	uint32_t totalMemorySizeUploader = 0;
 	uint32_t memoryTypeBitsUploader = 0;
 
@@ -181,6 +316,13 @@ void Mesh::BuildBuffer()
 	}
 	ThrowIfFailed(vkBindBufferMemory(mDevice->GetDevice(), uploadBuffers[indexBufferOffset], uploadMemory, memOffsetUploader));
 	ThrowIfFailed(vkBindBufferMemory(mDevice->GetDevice(), mIndexBuffer, mDeviceMemory, memOffset));
+	if (hasMeshlet)
+	{
+		memOffset += memSizeVector[indexBufferOffset];
+		memOffsetUploader += memSizeVectorUploader[indexBufferOffset];
+		ThrowIfFailed(vkBindBufferMemory(mDevice->GetDevice(), uploadBuffers[meshletBufferOffset], uploadMemory, memOffsetUploader));
+		ThrowIfFailed(vkBindBufferMemory(mDevice->GetDevice(), mMeshletBuffer, mDeviceMemory, memOffset));
+	}
 
 	//Upload Buffer
 	{
@@ -188,16 +330,19 @@ void Mesh::BuildBuffer()
 		ThrowIfFailed(vkMapMemory(mDevice->GetDevice(), uploadMemory, 0, VK_WHOLE_SIZE, 0, &data));
 
 		memOffsetUploader = 0;
-		for (size_t i = 0; i < mVertexDatas.size(); ++i)
+		for (size_t i = 0; i < vertexSources.size(); ++i)
 		{
-			memcpy((void*)((BYTE*)data + memOffsetUploader), mVertexDatas[i].data(), mVertexDatas[i].size());
+			memcpy((void*)((BYTE*)data + memOffsetUploader), vertexSources[i].data, vertexSources[i].size);
 			memOffsetUploader += memSizeVector[i];
 		}
 
-		if (bIndex32)
-			memcpy((void*)((BYTE*)data + memOffsetUploader), mIndices32.data(), indexBufferSize);
-		else
-			memcpy((void*)((BYTE*)data + memOffsetUploader), mIndices16.data(), indexBufferSize);
+		memcpy((void*)((BYTE*)data + memOffsetUploader), indexSource.data, indexBufferSize);
+
+		if (hasMeshlet)
+		{
+			memOffsetUploader += memSizeVectorUploader[indexBufferOffset];
+			memcpy((void*)((BYTE*)data + memOffsetUploader), mMeshletData.data(), mMeshletData.size());
+		}
 
 		vkUnmapMemory(mDevice->GetDevice(), uploadMemory);
 	}
@@ -225,13 +370,19 @@ void Mesh::BuildBuffer()
 
 			for (size_t i = 0; i < mVertexBuffers.size(); ++i)
 			{
-				copyRegion.size = mVertexDatas[i].size();
+				copyRegion.size = vertexSources[i].size;
 
 				vkCmdCopyBuffer(transferCmd, uploadBuffers[i], mVertexBuffers[i], 1, &copyRegion);
 			}
 
 			copyRegion.size = indexBufferSize;
 			vkCmdCopyBuffer(transferCmd, uploadBuffers[indexBufferOffset], mIndexBuffer, 1, &copyRegion);
+
+			if (hasMeshlet)
+			{
+				copyRegion.size = mMeshletData.size();
+				vkCmdCopyBuffer(transferCmd, uploadBuffers[meshletBufferOffset], mMeshletBuffer, 1, &copyRegion);
+			}
 		}
 		vkEndCommandBuffer(transferCmd);
 
@@ -256,7 +407,7 @@ void Mesh::BuildBuffer()
 	vkFreeMemory(mDevice->GetDevice(), uploadMemory, nullptr);
 	
 	//SetOffset
-	mVertexBufferOffsets.resize(mVertexDatas.size());
+	mVertexBufferOffsets.resize(vertexSources.size());
 	for (size_t i = 0; i < mVertexBufferOffsets.size(); ++i)
 	{
 		mVertexBufferOffsets[i] = static_cast<VkDeviceSize>(0);
@@ -265,12 +416,941 @@ void Mesh::BuildBuffer()
 
 void Mesh::ReleaseBuffer()
 {
+	if (mDevice == nullptr)
+		return;
+
 	vkFreeMemory(mDevice->GetDevice(), mDeviceMemory, nullptr);
+	mDeviceMemory = VK_NULL_HANDLE;
 
 	for (const VkBuffer& buffer : mVertexBuffers)
 		vkDestroyBuffer(mDevice->GetDevice(), buffer, nullptr);
+	mVertexBuffers.clear();
+	mVertexBufferOffsets.clear();
 
 	vkDestroyBuffer(mDevice->GetDevice(), mIndexBuffer, nullptr);
+	mIndexBuffer = VK_NULL_HANDLE;
+
+	vkDestroyBuffer(mDevice->GetDevice(), mMeshletBuffer, nullptr);
+	mMeshletBuffer = VK_NULL_HANDLE;
+}
+
+void Mesh::Save(const std::string& path) const
+{
+	//Load streams the file to staging memory and keeps no cpu copy
+	if (mVertexCount > 0 && (mVertexDatas.empty() || mIndices.empty()))
+		throw std::runtime_error(std::format("save mesh file {} failed: mesh has no cpu data", path));
+
+	const std::vector<SubmeshGeometry>& submeshes = mSubmeshes;
+	const uint32_t indexCount = static_cast<uint32_t>(mMeshlets.empty() ? mIndices.size() : mMeshletIndexStart);
+	const uint64_t indexSize = static_cast<uint64_t>(indexCount) * (bIndex32 ? sizeof(uint32_t) : sizeof(uint16_t));
+
+	MeshFile::Header header = {};
+	memcpy(header.magic, MeshFile::Magic, sizeof(header.magic));
+	header.version = MeshFile::Version;
+	header.flags = bIndex32 ? MeshFile::Index32 : 0;
+	header.vertexCount = mVertexCount;
+	header.indexCount = indexCount;
+	header.attributeCount = static_cast<uint32_t>(mAttributes.size());
+	header.bindingCount = static_cast<uint32_t>(mVertexDatas.size());
+	header.submeshCount = static_cast<uint32_t>(submeshes.size());
+	header.lodCount = static_cast<uint32_t>(mLodSubmeshes.size()) + 1;
+	memcpy(header.boundingSphere, &mBoundingSphere, sizeof(header.boundingSphere));
+	memcpy(header.dequantizeScale, &mPositionDequantizeScale, sizeof(float) * 3);
+	memcpy(header.dequantizeOffset, &mPositionDequantizeOffset, sizeof(float) * 3);
+
+	//section layout
+	uint64_t offset = MeshFile::AlignSection(sizeof(header));
+	auto Allocate = [&offset](uint64_t size) {
+		uint64_t sectionOffset = offset;
+		offset = MeshFile::AlignSection(offset + size);
+		return sectionOffset;
+	};
+	header.attributeOffset = Allocate(sizeof(MeshFile::Attribute) * header.attributeCount);
+	header.bindingOffset = Allocate(sizeof(MeshFile::Binding) * header.bindingCount);
+	header.submeshOffset = Allocate(sizeof(MeshFile::Submesh) * header.submeshCount);
+	header.lodOffset = Allocate(sizeof(MeshFile::Lod) * (header.lodCount - 1));
+	header.lodSubmeshOffset = Allocate(sizeof(MeshFile::Submesh) * (header.lodCount - 1) * header.submeshCount);
+	header.indexOffset = Allocate(indexSize);
+
+	std::vector<MeshFile::Binding> bindings(header.bindingCount);
+	for (uint32_t i = 0; i < header.bindingCount; ++i)
+	{
+		bindings[i].size = mVertexDatas[i].size();
+		bindings[i].stride = GetBindingStride(i);
+		bindings[i].offset = Allocate(bindings[i].size);
+	}
+	header.fileSize = offset;
+
+	std::vector<MeshFile::Attribute> attributes;
+	for (const VertexAttributeDesc& attribute : mAttributes)
+	{
+		MeshFile::Attribute fileAttribute = {};
+		if (attribute.semantic.size() >= sizeof(fileAttribute.semantic))
+			throw std::runtime_error(std::format("semantic {} is too long for mesh file", attribute.semantic));
+		memcpy(fileAttribute.semantic, attribute.semantic.c_str(), attribute.semantic.size());
+		fileAttribute.format = attribute.format;
+		fileAttribute.offset = attribute.offset;
+		fileAttribute.binding = attribute.binding;
+		attributes.push_back(fileAttribute);
+	}
+
+	auto ToFileSubmesh = [](const SubmeshGeometry& submesh) {
+		return MeshFile::Submesh{ submesh.IndexCount, submesh.StartIndexLocation, submesh.BaseVertexLocation, 0 };
+	};
+
+	std::vector<MeshFile::Submesh> fileSubmeshes;
+	for (const SubmeshGeometry& submesh : submeshes)
+		fileSubmeshes.push_back(ToFileSubmesh(submesh));
+
+	std::vector<MeshFile::Lod> lods;
+	std::vector<MeshFile::Submesh> lodSubmeshes;
+	for (size_t lod = 0; lod < mLodSubmeshes.size(); ++lod)
+	{
+		lods.push_back({ mLodErrors[lod + 1] });
+		for (const SubmeshGeometry& submesh : mLodSubmeshes[lod])
+			lodSubmeshes.push_back(ToFileSubmesh(submesh));
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw std::runtime_error(std::format("create mesh file failed: {}", path));
+
+	auto Write = [&file](uint64_t offset, const void* data, uint64_t size) {
+		//zero padding to section offset
+		static const char zeros[MeshFile::SectionAlignment] = {};
+		uint64_t position = static_cast<uint64_t>(file.tellp());
+		assert(position <= offset && offset - position < MeshFile::SectionAlignment);
+		file.write(zeros, offset - position);
+		file.write(static_cast<const char*>(data), size);
+	};
+
+	Write(0, &header, sizeof(header));
+	Write(header.attributeOffset, attributes.data(), sizeof(MeshFile::Attribute) * attributes.size());
+	Write(header.bindingOffset, bindings.data(), sizeof(MeshFile::Binding) * bindings.size());
+	Write(header.submeshOffset, fileSubmeshes.data(), sizeof(MeshFile::Submesh) * fileSubmeshes.size());
+	Write(header.lodOffset, lods.data(), sizeof(MeshFile::Lod) * lods.size());
+	Write(header.lodSubmeshOffset, lodSubmeshes.data(), sizeof(MeshFile::Submesh) * lodSubmeshes.size());
+	const std::vector<uint16_t> indices16 = bIndex32 ? std::vector<uint16_t>() : GetIndices16();
+	Write(header.indexOffset, bIndex32 ? static_cast<const void*>(mIndices.data()) : static_cast<const void*>(indices16.data()), indexSize);
+	for (uint32_t i = 0; i < header.bindingCount; ++i)
+		Write(bindings[i].offset, mVertexDatas[i].data(), bindings[i].size);
+	Write(header.fileSize, nullptr, 0);
+
+	if (!file)
+		throw std::runtime_error(std::format("write mesh file failed: {}", path));
+}
+
+std::unique_ptr<Mesh> Mesh::Load(Device* device, const std::string& path)
+{
+	MeshFile::MappedFile file(path);
+	const MeshFile::Header& header = MeshFile::Validate(file);
+
+	std::unique_ptr<Mesh> res(new Mesh(device));
+	res->mVertexCount = header.vertexCount;
+	res->bIndex32 = (header.flags & MeshFile::Index32) != 0;
+	memcpy(&res->mBoundingSphere, header.boundingSphere, sizeof(header.boundingSphere));
+	memcpy(&res->mPositionDequantizeScale, header.dequantizeScale, sizeof(float) * 3);
+	memcpy(&res->mPositionDequantizeOffset, header.dequantizeOffset, sizeof(float) * 3);
+
+	const MeshFile::Attribute* attributes = MeshFile::GetSection<MeshFile::Attribute>(file, header.attributeOffset);
+	for (uint32_t i = 0; i < header.attributeCount; ++i)
+	{
+		const MeshFile::Attribute& attribute = attributes[i];
+		std::string semantic(attribute.semantic, strnlen(attribute.semantic, sizeof(attribute.semantic)));
+		res->mAttributes.insert({ semantic, static_cast<VkFormat>(attribute.format), attribute.offset, attribute.binding });
+	}
+
+	auto ToSubmesh = [](const MeshFile::Submesh& submesh) {
+		return SubmeshGeometry{ submesh.indexCount, submesh.startIndexLocation, submesh.baseVertexLocation };
+	};
+
+	const MeshFile::Submesh* submeshes = MeshFile::GetSection<MeshFile::Submesh>(file, header.submeshOffset);
+	for (uint32_t i = 0; i < header.submeshCount; ++i)
+		res->mSubmeshes.push_back(ToSubmesh(submeshes[i]));
+
+	const MeshFile::Lod* lods = MeshFile::GetSection<MeshFile::Lod>(file, header.lodOffset);
+	const MeshFile::Submesh* lodSubmeshes = MeshFile::GetSection<MeshFile::Submesh>(file, header.lodSubmeshOffset);
+	for (uint32_t lod = 0; lod + 1 < header.lodCount; ++lod)
+	{
+		res->mLodErrors.push_back(lods[lod].error);
+		std::vector<SubmeshGeometry>& levelSubmeshes = res->mLodSubmeshes.emplace_back();
+		for (uint32_t i = 0; i < header.submeshCount; ++i)
+			levelSubmeshes.push_back(ToSubmesh(lodSubmeshes[lod * header.submeshCount + i]));
+	}
+
+	//stream go from the mapping to staging memory, no intermediate vector
+	const MeshFile::Binding* bindings = MeshFile::GetSection<MeshFile::Binding>(file, header.bindingOffset);
+	std::vector<BufferSource> vertexSources;
+	for (uint32_t i = 0; i < header.bindingCount; ++i)
+	{
+		res->mBindingStrides.push_back(bindings[i].stride);
+		vertexSources.push_back({ file.GetData() + bindings[i].offset, static_cast<size_t>(bindings[i].size) });
+	}
+
+	BufferSource indexSource = { file.GetData() + header.indexOffset,
+		static_cast<size_t>(header.indexCount) * (res->bIndex32 ? sizeof(uint32_t) : sizeof(uint16_t)) };
+
+	if (device != nullptr)
+		res->BuildBuffer(vertexSources, indexSource);
+
+	return res;
+}
+
+std::vector<uint32_t> Mesh::GetAbsoluteIndices() const
+{
+	std::vector<uint32_t> indices;
+	for (const SubmeshGeometry& submesh : mSubmeshes)
+	{
+		for (uint32_t i = 0; i < submesh.IndexCount; ++i)
+		{
+			indices.push_back(mIndices[submesh.StartIndexLocation + i] + submesh.BaseVertexLocation);
+		}
+	}
+	return indices;
+}
+
+MeshOptimizeStats Mesh::AnalyzeVertexCache(uint32_t cacheSize) const
+{
+	std::vector<uint32_t> indices = GetAbsoluteIndices();
+	return MeshOptimizer::Analyze(indices.data(), indices.size(), mVertexCount, GetBindingStride(0), cacheSize);
+}
+
+std::vector<MeshOptimizeReport> Mesh::Optimize(const MeshOptimizeSettings& settings)
+{
+	std::vector<MeshOptimizeReport> reports;
+	if (mVertexCount == 0 || mSubmeshes.empty() || mVertexDatas.empty())
+		return reports;
+
+	//lod and meshlet index is not remapped, build them again after optimize
+	ClearLods();
+
+	//vertex count referenced by submesh, index is relative to BaseVertexLocation
+	auto SubmeshVertexCount = [this](const SubmeshGeometry& submesh) {
+		uint32_t maxIndex = 0;
+		for (uint32_t i = 0; i < submesh.IndexCount; ++i)
+			maxIndex = std::max(maxIndex, mIndices[submesh.StartIndexLocation + i]);
+		return submesh.IndexCount == 0 ? 0 : maxIndex + 1;
+	};
+
+	std::vector<uint32_t> scratch;
+
+	if (settings.vertexCache)
+	{
+		MeshOptimizeReport report{ "VertexCache", true, AnalyzeVertexCache(settings.cacheSize) };
+		for (const SubmeshGeometry& submesh : mSubmeshes)
+		{
+			uint32_t* indices = mIndices.data() + submesh.StartIndexLocation;
+			scratch.assign(indices, indices + submesh.IndexCount);
+			MeshOptimizer::OptimizeVertexCache(indices, scratch.data(), scratch.size(), SubmeshVertexCount(submesh), settings.cacheSize);
+		}
+		report.after = AnalyzeVertexCache(settings.cacheSize);
+		reports.push_back(report);
+	}
+
+	if (settings.overdraw)
+	{
+		MeshOptimizeReport report{ "Overdraw", false, AnalyzeVertexCache(settings.cacheSize) };
+		std::optional<VertexAttributeDesc> position = GetVertexAttribute("POSITION");
+		if (position && position->format == VK_FORMAT_R32G32B32_SFLOAT)
+		{
+			const uint32_t stride = GetBindingStride(position->binding);
+			const std::byte* vertices = mVertexDatas[position->binding].data() + position->offset;
+			for (const SubmeshGeometry& submesh : mSubmeshes)
+			{
+				uint32_t* indices = mIndices.data() + submesh.StartIndexLocation;
+				scratch.assign(indices, indices + submesh.IndexCount);
+				MeshOptimizer::OptimizeOverdraw(indices, scratch.data(), scratch.size(),
+					reinterpret_cast<const float*>(vertices + static_cast<size_t>(submesh.BaseVertexLocation) * stride), stride,
+					SubmeshVertexCount(submesh), settings.cacheSize, settings.overdrawThreshold);
+			}
+			report.applied = true;
+		}
+		report.after = AnalyzeVertexCache(settings.cacheSize);
+		reports.push_back(report);
+	}
+
+	if (settings.vertexFetch)
+	{
+		MeshOptimizeReport report{ "VertexFetch", true, AnalyzeVertexCache(settings.cacheSize) };
+
+		std::vector<uint32_t> absoluteIndices = GetAbsoluteIndices();
+		std::vector<uint32_t> remap(mVertexCount);
+		MeshOptimizer::GenerateVertexFetchRemap(remap.data(), absoluteIndices.data(), absoluteIndices.size(), mVertexCount);
+
+		//index become absolute, CompactIndices rebase and split submesh afterward
+		for (SubmeshGeometry& submesh : mSubmeshes)
+		{
+			for (uint32_t j = 0; j < submesh.IndexCount; ++j)
+			{
+				uint32_t& index = mIndices[submesh.StartIndexLocation + j];
+				index = remap[index + submesh.BaseVertexLocation];
+			}
+			submesh.BaseVertexLocation = 0;
+		}
+
+		for (size_t binding = 0; binding < mVertexDatas.size(); ++binding)
+		{
+			std::vector<std::byte> vertexData(mVertexDatas[binding].size());
+			MeshOptimizer::RemapVertices(vertexData.data(), mVertexDatas[binding].data(), mVertexCount, GetBindingStride(binding), remap.data());
+			mVertexDatas[binding] = std::move(vertexData);
+		}
+		report.after = AnalyzeVertexCache(settings.cacheSize);
+		reports.push_back(report);
+	}
+
+	CompactIndices();
+
+	for (const MeshOptimizeReport& report : reports)
+	{
+		LOG_INFO("mesh optimize {}{}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}, overfetch {:.3f} -> {:.3f}",
+			report.pass, report.applied ? "" : "(skipped)", report.before.acmr, report.after.acmr,
+			report.before.atvr, report.after.atvr, report.before.overfetch, report.after.overfetch);
+	}
+
+	if (mIndexBuffer != VK_NULL_HANDLE)
+	{
+		ReleaseBuffer();
+		BuildBuffer();
+	}
+
+	return reports;
+}
+
+void Mesh::ComputeBoundingSphere()
+{
+	std::optional<VertexAttributeDesc> position = GetVertexAttribute("POSITION");
+	if (!position || position->format != VK_FORMAT_R32G32B32_SFLOAT || mVertexCount == 0 || mVertexDatas.empty())
+		return;
+
+	const uint32_t stride = GetBindingStride(position->binding);
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	for (uint32_t i = 0; i < mVertexCount; ++i)
+	{
+		glm::vec3 p;
+		memcpy(&p, mVertexDatas[position->binding].data() + i * stride + position->offset, sizeof(p));
+		boundsMin = glm::min(boundsMin, p);
+		boundsMax = glm::max(boundsMax, p);
+	}
+
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < mVertexCount; ++i)
+	{
+		glm::vec3 p;
+		memcpy(&p, mVertexDatas[position->binding].data() + i * stride + position->offset, sizeof(p));
+		radius = std::max(radius, glm::length(p - center));
+	}
+	mBoundingSphere = glm::vec4(center, radius);
+}
+
+void Mesh::BuildLods(const MeshLodSettings& settings)
+{
+	std::optional<VertexAttributeDesc> position = GetVertexAttribute("POSITION");
+	if (!position || position->format != VK_FORMAT_R32G32B32_SFLOAT || mVertexDatas.empty())
+		throw std::runtime_error("BuildLods need R32G32B32_SFLOAT POSITION");
+
+	ClearLods();
+	ComputeBoundingSphere();
+
+	const uint32_t positionStride = GetBindingStride(position->binding);
+	const std::byte* positions = mVertexDatas[position->binding].data() + position->offset;
+
+	//gather weighted float attributes into one stream
+	std::vector<float> weights;
+	std::vector<std::pair<VertexAttributeDesc, uint32_t>> weightedAttributes;//attribute, component count
+	for (const VertexAttributeDesc& attribute : mAttributes)
+	{
+		uint32_t componentCount = VertexQuantization::FloatComponentCount(attribute.format);
+		if (componentCount == 0)
+			continue;
+
+		for (const auto& [prefix, weight] : settings.attributeWeights)
+		{
+			if (weight > 0.0f && attribute.semantic.rfind(prefix, 0) == 0)
+			{
+				weightedAttributes.push_back({ attribute, componentCount });
+				weights.insert(weights.end(), componentCount, weight);
+				break;
+			}
+		}
+	}
+
+	const uint32_t attributeCount = static_cast<uint32_t>(weights.size());
+	std::vector<float> attributeData(static_cast<size_t>(mVertexCount) * attributeCount);
+	for (uint32_t i = 0; i < mVertexCount; ++i)
+	{
+		float* target = attributeData.data() + static_cast<size_t>(i) * attributeCount;
+		for (const auto& [attribute, componentCount] : weightedAttributes)
+		{
+			memcpy(target, mVertexDatas[attribute.binding].data() + static_cast<size_t>(i) * GetBindingStride(attribute.binding) + attribute.offset, sizeof(float) * componentCount);
+			target += componentCount;
+		}
+	}
+
+	const float targetError = settings.targetError * mBoundingSphere.w;
+	mLodIndexStart = static_cast<uint32_t>(mIndices.size());
+
+	//each lod simplify the previous one
+	std::vector<uint32_t> lodIndices;
+	for (uint32_t lod = 1; lod < settings.lodCount; ++lod)
+	{
+		const std::vector<SubmeshGeometry>& source = GetLodSubmesh(lod - 1);
+		std::vector<SubmeshGeometry> submeshes(source.size());
+		size_t sourceIndexCount = 0;
+		size_t indexCount = 0;
+		float lodError = mLodErrors.back();
+
+		for (size_t i = 0; i < source.size(); ++i)
+		{
+			const SubmeshGeometry& submesh = source[i];
+			const size_t targetIndexCount = static_cast<size_t>(mSubmeshes[i].IndexCount * std::pow(settings.reduction, static_cast<float>(lod))) / 3 * 3;
+
+			lodIndices.resize(submesh.IndexCount);
+			float error = 0.0f;
+			size_t count = MeshOptimizer::Simplify(lodIndices.data(), mIndices.data() + submesh.StartIndexLocation, submesh.IndexCount,
+				reinterpret_cast<const float*>(positions + static_cast<size_t>(submesh.BaseVertexLocation) * positionStride), positionStride, mVertexCount - submesh.BaseVertexLocation,
+				attributeData.data() + static_cast<size_t>(submesh.BaseVertexLocation) * attributeCount, attributeCount * sizeof(float), weights.data(), attributeCount,
+				targetIndexCount, targetError, &error);
+
+			submeshes[i] = { static_cast<uint32_t>(count), static_cast<uint32_t>(mIndices.size()), submesh.BaseVertexLocation };
+			mIndices.insert(mIndices.end(), lodIndices.begin(), lodIndices.begin() + count);
+			lodError = std::max(lodError, error);
+			sourceIndexCount += submesh.IndexCount;
+			indexCount += count;
+		}
+
+		//error limit reached, no more useful lod
+		if (indexCount > sourceIndexCount * 95 / 100)
+		{
+			mIndices.resize(submeshes.empty() ? mIndices.size() : submeshes.front().StartIndexLocation);
+			break;
+		}
+
+		LOG_INFO("mesh lod {}: {} triangles, error {}", lod, indexCount / 3, lodError);
+		mLodSubmeshes.push_back(std::move(submeshes));
+		mLodErrors.push_back(lodError);
+	}
+
+	if (mIndexBuffer != VK_NULL_HANDLE)
+	{
+		ReleaseBuffer();
+		BuildBuffer();
+	}
+}
+
+void Mesh::ClearLods()
+{
+	ClearMeshlets();
+	if (mLodSubmeshes.empty())
+		return;
+
+	mIndices.resize(mLodIndexStart);
+	mLodSubmeshes.clear();
+	mLodErrors = { 0.0f };
+	mLodIndexStart = 0;
+}
+
+void Mesh::BuildMeshlets(uint32_t maxVertices, uint32_t maxTriangles)
+{
+	std::optional<VertexAttributeDesc> position = GetVertexAttribute("POSITION");
+	if (!position || position->format != VK_FORMAT_R32G32B32_SFLOAT || mVertexDatas.empty())
+		throw std::runtime_error("BuildMeshlets need R32G32B32_SFLOAT POSITION");
+
+	ClearMeshlets();
+
+	const uint32_t stride = GetBindingStride(position->binding);
+	const float* positions = reinterpret_cast<const float*>(mVertexDatas[position->binding].data() + position->offset);
+
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint8_t> meshletTriangles;
+	std::vector<uint32_t> meshletSubmeshes;
+
+	mMeshletIndexStart = static_cast<uint32_t>(mIndices.size());
+	for (uint32_t submeshIndex = 0; submeshIndex < mSubmeshes.size(); ++submeshIndex)
+	{
+		const SubmeshGeometry& submesh = mSubmeshes[submeshIndex];
+		const size_t firstVertex = meshletVertices.size();
+		const size_t count = MeshOptimizer::BuildMeshlets(meshlets, meshletVertices, meshletTriangles,
+			mIndices.data() + submesh.StartIndexLocation, submesh.IndexCount, mVertexCount - submesh.BaseVertexLocation, maxVertices, maxTriangles);
+		meshletSubmeshes.insert(meshletSubmeshes.end(), count, submeshIndex);
+
+		//bounds use absolute vertex
+		for (size_t i = firstVertex; i < meshletVertices.size(); ++i)
+			meshletVertices[i] += submesh.BaseVertexLocation;
+	}
+
+	//meshlet index for indexed draw, relative to submesh base again
+	mMeshlets.reserve(meshlets.size());
+	for (size_t i = 0; i < meshlets.size(); ++i)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		const SubmeshGeometry& submesh = mSubmeshes[meshletSubmeshes[i]];
+
+		MeshletGeometry geometry;
+		geometry.Submesh = meshletSubmeshes[i];
+		geometry.IndexCount = meshlet.triangleCount * 3;
+		geometry.StartIndexLocation = static_cast<uint32_t>(mIndices.size());
+		geometry.Bounds = MeshOptimizer::ComputeMeshletBounds(meshlet, meshletVertices.data(), meshletTriangles.data(), positions, stride);
+		mMeshlets.push_back(geometry);
+
+		for (uint32_t j = 0; j < geometry.IndexCount; ++j)
+		{
+			uint8_t local = meshletTriangles[meshlet.triangleOffset * 3 + j];
+			mIndices.push_back(meshletVertices[meshlet.vertexOffset + local] - submesh.BaseVertexLocation);
+		}
+	}
+
+	//pack meshlet, vertex, triangle array for GPU
+	mMeshletVertexOffset = meshlets.size() * sizeof(PackedMeshlet);
+	mMeshletTriangleOffset = mMeshletVertexOffset + meshletVertices.size() * sizeof(uint32_t);
+	mMeshletData.assign(mMeshletTriangleOffset + ((meshletTriangles.size() + 3) & ~size_t(3)), std::byte(0));
+
+	PackedMeshlet* packedMeshlets = reinterpret_cast<PackedMeshlet*>(mMeshletData.data());
+	for (size_t i = 0; i < meshlets.size(); ++i)
+	{
+		const MeshletBounds& bounds = mMeshlets[i].Bounds;
+		PackedMeshlet& packed = packedMeshlets[i];
+		memcpy(packed.center, bounds.center, sizeof(packed.center));
+		packed.radius = bounds.radius;
+		for (int axis = 0; axis < 3; ++axis)
+			packed.coneAxis[axis] = VertexQuantization::FloatToSnorm8(bounds.coneAxis[axis]);
+		//widen cutoff to cover axis and cutoff rounding, larger cutoff cull less
+		packed.coneCutoff = VertexQuantization::FloatToSnorm8(std::min(bounds.coneCutoff + 2.0f / 127.0f, 1.0f));
+		packed.vertexOffset = meshlets[i].vertexOffset;
+		packed.triangleOffset = meshlets[i].triangleOffset;
+		packed.vertexTriangleCount = meshlets[i].vertexCount | (meshlets[i].triangleCount << 16);
+	}
+	memcpy(mMeshletData.data() + mMeshletVertexOffset, meshletVertices.data(), meshletVertices.size() * sizeof(uint32_t));
+	memcpy(mMeshletData.data() + mMeshletTriangleOffset, meshletTriangles.data(), meshletTriangles.size());
+
+	LOG_INFO("meshlet: {} meshlets, {} vertices, {} triangles, {} bytes",
+		meshlets.size(), meshletVertices.size(), meshletTriangles.size() / 3, mMeshletData.size());
+
+	if (mIndexBuffer != VK_NULL_HANDLE)
+	{
+		ReleaseBuffer();
+		BuildBuffer();
+	}
+}
+
+void Mesh::ClearMeshlets()
+{
+	if (mMeshlets.empty())
+		return;
+
+	mIndices.resize(mMeshletIndexStart);
+	mMeshlets.clear();
+	mMeshletData.clear();
+	mMeshletIndexStart = 0;
+	mMeshletVertexOffset = 0;
+	mMeshletTriangleOffset = 0;
+}
+
+void Mesh::CullMeshlets(const glm::mat4& objectToClip, const glm::vec3& cameraPositionOS, std::vector<SubmeshGeometry>& draws) const
+{
+	draws.clear();
+	if (mMeshlets.empty())
+	{
+		draws = mSubmeshes;
+		return;
+	}
+
+	//frustum plane in object space (Gribb Hartmann), clip z in [-w, w]
+	glm::mat4 m = glm::transpose(objectToClip);
+	glm::vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+	for (glm::vec4& plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	for (const MeshletGeometry& meshlet : mMeshlets)
+	{
+		const glm::vec3 center(meshlet.Bounds.center[0], meshlet.Bounds.center[1], meshlet.Bounds.center[2]);
+		const float radius = meshlet.Bounds.radius;
+
+		bool visible = true;
+		for (const glm::vec4& plane : planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			{
+				visible = false;
+				break;
+			}
+		}
+
+		const glm::vec3 coneAxis(meshlet.Bounds.coneAxis[0], meshlet.Bounds.coneAxis[1], meshlet.Bounds.coneAxis[2]);
+		const glm::vec3 view = center - cameraPositionOS;
+		if (visible && glm::dot(view, coneAxis) >= meshlet.Bounds.coneCutoff * glm::length(view) + radius)
+			visible = false;
+
+		if (!visible)
+			continue;
+
+		const SubmeshGeometry& submesh = mSubmeshes[meshlet.Submesh];
+		if (!draws.empty() && draws.back().BaseVertexLocation == submesh.BaseVertexLocation
+			&& draws.back().StartIndexLocation + draws.back().IndexCount == meshlet.StartIndexLocation)
+		{
+			draws.back().IndexCount += meshlet.IndexCount;
+		}
+		else
+		{
+			draws.push_back({ meshlet.IndexCount, meshlet.StartIndexLocation, submesh.BaseVertexLocation });
+		}
+	}
+}
+
+glm::mat4 Mesh::GetPositionDequantizeMatrix() const
+{
+	glm::mat4 matrix(1.0f);
+	matrix[0][0] = mPositionDequantizeScale.x;
+	matrix[1][1] = mPositionDequantizeScale.y;
+	matrix[2][2] = mPositionDequantizeScale.z;
+	matrix[3] = glm::vec4(mPositionDequantizeOffset, 1.0f);
+	return matrix;
+}
+
+std::vector<VertexAttributeError> Mesh::Quantize(const VertexQuantizeSettings& settings)
+{
+	using namespace VertexQuantization;
+
+	enum class Encoding { Copy, PositionHalf, PositionSnorm16, OctSnorm16, OctSnorm8, Half, Unorm8 };
+
+	struct AttributeLayout
+	{
+		VertexAttributeDesc source;
+		VertexAttributeDesc target;
+		Encoding encoding;
+		uint32_t componentCount;//source float component count
+		uint32_t sourceSize;
+		uint32_t size;
+		double errorSum = 0.0;
+		float maxError = 0.0f;
+	};
+
+	std::vector<VertexAttributeError> report;
+	if (mVertexCount == 0 || mVertexDatas.empty())
+		return report;
+
+	ComputeBoundingSphere();
+
+	//Snorm16 position bounds
+	std::optional<VertexAttributeDesc> position = GetVertexAttribute("POSITION");
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	if (position && FloatComponentCount(position->format) == 3)
+	{
+		const uint32_t stride = GetBindingStride(position->binding);
+		for (uint32_t i = 0; i < mVertexCount; ++i)
+		{
+			glm::vec3 p;
+			memcpy(&p, mVertexDatas[position->binding].data() + i * stride + position->offset, sizeof(p));
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+	}
+	const glm::vec3 boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 boundsExtent = (boundsMax - boundsMin) * 0.5f;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (!(boundsExtent[axis] > 0.0f))
+			boundsExtent[axis] = 1.0f;
+	}
+
+	auto ChooseEncoding = [&settings](const VertexAttributeDesc& attribute, uint32_t componentCount, VkFormat& format) {
+		const std::string& semantic = attribute.semantic;
+		if (semantic == "POSITION" && componentCount == 3)
+		{
+			if (settings.position == PositionEncoding::Half) { format = VK_FORMAT_R16G16B16A16_SFLOAT; return Encoding::PositionHalf; }
+			if (settings.position == PositionEncoding::Snorm16) { format = VK_FORMAT_R16G16B16A16_SNORM; return Encoding::PositionSnorm16; }
+		}
+		else if ((semantic == "NORMAL" && componentCount == 3) || (semantic == "TANGENT" && componentCount >= 3))
+		{
+			//tangent keep sign of w in z
+			const bool tangent = semantic == "TANGENT";
+			DirectionEncoding encoding = tangent ? settings.tangent : settings.normal;
+			if (encoding == DirectionEncoding::OctSnorm16) { format = tangent ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R16G16_SNORM; return Encoding::OctSnorm16; }
+			if (encoding == DirectionEncoding::OctSnorm8) { format = tangent ? VK_FORMAT_R8G8B8A8_SNORM : VK_FORMAT_R8G8_SNORM; return Encoding::OctSnorm8; }
+		}
+		else if (semantic.rfind("TEXCOORD", 0) == 0 && componentCount > 0 && settings.texcoord == TexcoordEncoding::Half)
+		{
+			constexpr VkFormat halfFormats[] = { VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT };
+			format = halfFormats[componentCount - 1];
+			return Encoding::Half;
+		}
+		else if (semantic.rfind("COLOR", 0) == 0 && componentCount >= 3 && settings.color == ColorEncoding::Unorm8)
+		{
+			format = VK_FORMAT_R8G8B8A8_UNORM;
+			return Encoding::Unorm8;
+		}
+
+		format = attribute.format;
+		return Encoding::Copy;
+	};
+
+	//decode encoded attribute back to float, for error report
+	auto Decode = [this](const AttributeLayout& layout, const std::byte* data, float* value) {
+		switch (layout.encoding)
+		{
+		case Encoding::PositionHalf:
+		case Encoding::Half:
+		{
+			uint16_t halfs[4];
+			memcpy(halfs, data, sizeof(uint16_t) * layout.componentCount);
+			for (uint32_t c = 0; c < layout.componentCount; ++c)
+				value[c] = HalfToFloat(halfs[c]);
+			break;
+		}
+		case Encoding::PositionSnorm16:
+		{
+			int16_t snorms[3];
+			memcpy(snorms, data, sizeof(snorms));
+			for (uint32_t c = 0; c < 3; ++c)
+				value[c] = Snorm16ToFloat(snorms[c]) * mPositionDequantizeScale[c] + mPositionDequantizeOffset[c];
+			break;
+		}
+		case Encoding::OctSnorm16:
+		case Encoding::OctSnorm8:
+		{
+			const bool snorm16 = layout.encoding == Encoding::OctSnorm16;
+			float oct[3];
+			for (uint32_t c = 0; c < (layout.componentCount >= 4 ? 3u : 2u); ++c)
+			{
+				if (snorm16)
+				{
+					int16_t snorm;
+					memcpy(&snorm, data + c * sizeof(int16_t), sizeof(snorm));
+					oct[c] = Snorm16ToFloat(snorm);
+				}
+				else
+					oct[c] = Snorm8ToFloat(static_cast<int8_t>(data[c]));
+			}
+			OctDecode(oct, value);
+			if (layout.componentCount >= 4)
+				value[3] = oct[2];
+			break;
+		}
+		case Encoding::Unorm8:
+			for (uint32_t c = 0; c < layout.componentCount; ++c)
+				value[c] = Unorm8ToFloat(static_cast<uint8_t>(data[c]));
+			break;
+		default:
+			break;
+		}
+	};
+
+	auto Encode = [this](const AttributeLayout& layout, const float* value, std::byte* data) {
+		switch (layout.encoding)
+		{
+		case Encoding::PositionHalf:
+		case Encoding::Half:
+		{
+			uint16_t halfs[4] = { 0, 0, 0, 0x3C00 };
+			for (uint32_t c = 0; c < layout.componentCount; ++c)
+				halfs[c] = FloatToHalf(value[c]);
+			memcpy(data, halfs, layout.size);
+			break;
+		}
+		case Encoding::PositionSnorm16:
+		{
+			int16_t snorms[4] = { 0, 0, 0, 32767 };
+			for (uint32_t c = 0; c < 3; ++c)
+				snorms[c] = FloatToSnorm16((value[c] - mPositionDequantizeOffset[c]) / mPositionDequantizeScale[c]);
+			memcpy(data, snorms, layout.size);
+			break;
+		}
+		case Encoding::OctSnorm16:
+		case Encoding::OctSnorm8:
+		{
+			float oct[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			OctEncode(value, oct);
+			if (layout.componentCount >= 4)
+				oct[2] = value[3] < 0.0f ? -1.0f : 1.0f;
+
+			const uint32_t count = layout.componentCount >= 4 ? 4 : 2;
+			for (uint32_t c = 0; c < count; ++c)
+			{
+				if (layout.encoding == Encoding::OctSnorm16)
+				{
+					int16_t snorm = FloatToSnorm16(oct[c]);
+					memcpy(data + c * sizeof(int16_t), &snorm, sizeof(snorm));
+				}
+				else
+					data[c] = static_cast<std::byte>(FloatToSnorm8(oct[c]));
+			}
+			break;
+		}
+		case Encoding::Unorm8:
+			for (uint32_t c = 0; c < 4; ++c)
+				data[c] = static_cast<std::byte>(c < layout.componentCount ? FloatToUnorm8(value[c]) : 255);
+			break;
+		default:
+			break;
+		}
+	};
+
+	if (position && FloatComponentCount(position->format) == 3 && settings.position == PositionEncoding::Snorm16)
+	{
+		mPositionDequantizeScale = boundsExtent;
+		mPositionDequantizeOffset = boundsCenter;
+	}
+
+	std::set<VertexAttributeDesc> attributes;
+	for (uint32_t binding = 0; binding < mVertexDatas.size(); ++binding)
+	{
+		const uint32_t sourceStride = GetBindingStride(binding);
+
+		std::vector<AttributeLayout> layouts;
+		for (const VertexAttributeDesc& attribute : mAttributes)
+		{
+			if (attribute.binding != binding)
+				continue;
+
+			AttributeLayout layout;
+			layout.source = attribute;
+			layout.target = attribute;
+			layout.componentCount = FloatComponentCount(attribute.format);
+			layout.encoding = ChooseEncoding(attribute, layout.componentCount, layout.target.format);
+			layout.sourceSize = FormatElementSize(attribute.format);
+			layout.size = FormatElementSize(layout.target.format);
+			layouts.push_back(layout);
+		}
+
+		//pack in source order, align attribute to 4 bytes
+		std::sort(layouts.begin(), layouts.end(), [](const AttributeLayout& lhs, const AttributeLayout& rhs) {
+			return lhs.source.offset < rhs.source.offset;
+		});
+
+		uint32_t stride = 0;
+		for (AttributeLayout& layout : layouts)
+		{
+			layout.target.offset = stride;
+			stride += (layout.size + 3) & ~3u;
+		}
+
+		std::vector<std::byte> vertexData(static_cast<size_t>(stride) * mVertexCount);
+		for (uint32_t i = 0; i < mVertexCount; ++i)
+		{
+			for (AttributeLayout& layout : layouts)
+			{
+				const std::byte* source = mVertexDatas[binding].data() + static_cast<size_t>(i) * sourceStride + layout.source.offset;
+				std::byte* target = vertexData.data() + static_cast<size_t>(i) * stride + layout.target.offset;
+
+				if (layout.encoding == Encoding::Copy)
+				{
+					memcpy(target, source, layout.size);
+					continue;
+				}
+
+				float value[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				memcpy(value, source, sizeof(float) * layout.componentCount);
+				if (layout.encoding == Encoding::OctSnorm16 || layout.encoding == Encoding::OctSnorm8)
+				{
+					float length = std::sqrt(value[0] * value[0] + value[1] * value[1] + value[2] * value[2]);
+					if (length > 0.0f)
+					{
+						for (uint32_t c = 0; c < 3; ++c)
+							value[c] /= length;
+					}
+				}
+
+				Encode(layout, value, target);
+
+				float decoded[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				Decode(layout, target, decoded);
+
+				float error = 0.0f;
+				for (uint32_t c = 0; c < std::min(layout.componentCount, 3u); ++c)
+					error += (decoded[c] - value[c]) * (decoded[c] - value[c]);
+				error = std::sqrt(error);
+				layout.maxError = std::max(layout.maxError, error);
+				layout.errorSum += error;
+			}
+		}
+
+		for (const AttributeLayout& layout : layouts)
+		{
+			attributes.insert(layout.target);
+			report.push_back({ layout.source.semantic, layout.source.format, layout.target.format, layout.sourceSize, layout.size,
+				layout.maxError, static_cast<float>(layout.errorSum / mVertexCount) });
+		}
+
+		LOG_INFO("vertex quantize binding {}: stride {} -> {}", binding, sourceStride, stride);
+		mVertexDatas[binding] = std::move(vertexData);
+	}
+	mAttributes = std::move(attributes);
+
+	for (const VertexAttributeError& error : report)
+	{
+		LOG_INFO("\t{}: {} -> {}, {} -> {} bytes, max error {}, mean error {}", error.semantic, magic_enum::enum_name(error.sourceFormat),
+			magic_enum::enum_name(error.format), error.sourceSize, error.size, error.maxError, error.meanError);
+	}
+
+	if (mIndexBuffer != VK_NULL_HANDLE)
+	{
+		ReleaseBuffer();
+		BuildBuffer();
+	}
+
+	return report;
+}
+
+void Mesh::SetStreamLayout(MeshStreamLayout layout)
+{
+	if (mVertexCount == 0 || mVertexDatas.empty())
+		return;
+
+	std::optional<VertexAttributeDesc> position = GetVertexAttribute("POSITION");
+	const bool split = layout == MeshStreamLayout::SplitPosition && position && mAttributes.size() > 1;
+
+	//keep source order: binding, then offset
+	std::vector<VertexAttributeDesc> sources(mAttributes.begin(), mAttributes.end());
+	std::sort(sources.begin(), sources.end(), [](const VertexAttributeDesc& lhs, const VertexAttributeDesc& rhs) {
+		return lhs.binding != rhs.binding ? lhs.binding < rhs.binding : lhs.offset < rhs.offset;
+	});
+
+	std::vector<uint32_t> strides(split ? 2 : 1, 0);
+	std::vector<VertexAttributeDesc> targets = sources;
+	for (VertexAttributeDesc& target : targets)
+	{
+		target.binding = split && target.semantic != "POSITION" ? 1 : 0;
+		target.offset = strides[target.binding];
+		strides[target.binding] += (FormatElementSize(target.format) + 3) & ~3u;
+	}
+
+	std::vector<std::vector<std::byte>> vertexDatas(strides.size());
+	for (size_t binding = 0; binding < strides.size(); ++binding)
+		vertexDatas[binding].resize(static_cast<size_t>(strides[binding]) * mVertexCount);
+
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		const VertexAttributeDesc& source = sources[i];
+		const VertexAttributeDesc& target = targets[i];
+		const uint32_t sourceStride = GetBindingStride(source.binding);
+		const uint32_t size = FormatElementSize(source.format);
+		for (uint32_t vertex = 0; vertex < mVertexCount; ++vertex)
+		{
+			memcpy(vertexDatas[target.binding].data() + static_cast<size_t>(vertex) * strides[target.binding] + target.offset,
+				mVertexDatas[source.binding].data() + static_cast<size_t>(vertex) * sourceStride + source.offset, size);
+		}
+	}
+
+	std::string strideText;
+	for (uint32_t stride : strides)
+		strideText += std::format(" {}", stride);
+	LOG_INFO("vertex stream layout {}: stride{}", magic_enum::enum_name(layout), std::move(strideText));
+
+	mVertexDatas = std::move(vertexDatas);
+	mAttributes = std::set<VertexAttributeDesc>(targets.begin(), targets.end());
+
+	if (mIndexBuffer != VK_NULL_HANDLE)
+	{
+		ReleaseBuffer();
+		BuildBuffer();
+	}
+}
+
+uint32_t Mesh::GetPositionBinding() const
+{
+	std::optional<VertexAttributeDesc> position = GetVertexAttribute("POSITION");
+	return position ? position->binding : 0;
 }
 
 std::unique_ptr<FormatMesh> FormatMesh::CreateTriangle(Device* device)
@@ -292,15 +1372,7 @@ std::unique_ptr<FormatMesh> FormatMesh::CreateTriangle(Device* device)
 
 	//indices
 	uint32_t indices[3] = { 0, 1, 2 };
-	res->mIndices32.resize(_countof(indices));
-	memcpy(res->mIndices32.data(), indices, sizeof(indices));
-
-	res->mIndices16.resize(res->mIndices32.size());
-	for (int i = 0; i < res->mIndices32.size(); ++i)
-	{
-		res->mIndices16[i] = static_cast<uint16_t>(res->mIndices32[i]);
-	}
-
+	res->mIndices.assign(std::begin(indices), std::end(indices));
 	res->bIndex32 = false;
 
 	res->mAttributes.insert({ "POSITION", VK_FORMAT_R32G32B32_SFLOAT, 0, 0 });
@@ -316,7 +1388,8 @@ std::unique_ptr<FormatMesh> FormatMesh::CreateTriangle(Device* device)
 	submesh.BaseVertexLocation = 0;
 	res->mSubmeshes.push_back(submesh);
 
-	res->BuildBuffer();
+	if (device != nullptr)
+		res->BuildBuffer();
 
 	return res;
 }
@@ -341,16 +1414,83 @@ std::unique_ptr<FormatMesh> FormatMesh::CreatePlane(Device* device)
 
 	//indices
 	uint32_t indices[6] = { 0, 1, 2, 1, 3, 2 };
-	res->mIndices32.resize(_countof(indices));
-	memcpy(res->mIndices32.data(), indices, sizeof(indices));
+	res->mIndices.assign(std::begin(indices), std::end(indices));
+	res->bIndex32 = false;
+
+	res->mAttributes.insert({ "POSITION", VK_FORMAT_R32G32B32_SFLOAT, 0, 0 });
+	res->mAttributes.insert({ "NORMAL", VK_FORMAT_R32G32B32_SFLOAT, 12, 0 });
+	res->mAttributes.insert({ "TANGENT", VK_FORMAT_R32G32B32A32_SFLOAT, 24, 0 });
+	res->mAttributes.insert({ "TEXCOORD", VK_FORMAT_R32G32_SFLOAT, 40, 0 });
+	res->mAttributes.insert({ "TEXCOORD1", VK_FORMAT_R32G32_SFLOAT, 48, 0 });
+	res->mAttributes.insert({ "COLOR", VK_FORMAT_R32G32B32_SFLOAT, 56, 0 });
+
+	SubmeshGeometry submesh;
+	submesh.IndexCount = _countof(indices);
+	submesh.StartIndexLocation = 0;
+	submesh.BaseVertexLocation = 0;
+	res->mSubmeshes.push_back(submesh);
+
+	if (device != nullptr)
+		res->BuildBuffer();
+
+	return res;
+}
 
-	res->mIndices16.resize(res->mIndices32.size());
-	for (int i = 0; i < res->mIndices32.size(); ++i)
+std::unique_ptr<FormatMesh> FormatMesh::CreateSphere(Device* device, uint32_t segments, uint32_t rings)
+{
+	std::unique_ptr<FormatMesh> res(new FormatMesh(device));
+
+	segments = std::max(segments, 3u);
+	rings = std::max(rings, 2u);
+	const float pi = glm::pi<float>();
+
+	//seam and pole vertices are duplicated for uv
+	std::vector<Vertex> vertices;
+	vertices.reserve((rings + 1) * (segments + 1));
+	for (uint32_t r = 0; r <= rings; ++r)
 	{
-		res->mIndices16[i] = static_cast<uint16_t>(res->mIndices32[i]);
+		float theta = pi * r / rings;
+		for (uint32_t s = 0; s <= segments; ++s)
+		{
+			float phi = 2.0f * pi * s / segments;
+			glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+
+			Vertex vertex = {};
+			for (int i = 0; i < 3; ++i)
+			{
+				vertex.position[i] = normal[i] * 0.5f;
+				vertex.normal[i] = normal[i];
+				vertex.color[i] = normal[i] * 0.5f + 0.5f;
+			}
+			vertex.tangent[0] = -std::sin(phi);
+			vertex.tangent[2] = std::cos(phi);
+			vertex.tangent[3] = 1.0f;
+			vertex.uv0[0] = static_cast<float>(s) / segments;
+			vertex.uv0[1] = static_cast<float>(r) / rings;
+			vertices.push_back(vertex);
+		}
 	}
 
-	res->bIndex32 = false;
+	res->mVertexDatas.resize(1);
+	res->mVertexDatas[0].resize(vertices.size() * sizeof(Vertex));
+
+	memcpy(res->mVertexDatas[0].data(), vertices.data(), vertices.size() * sizeof(Vertex));
+	res->mVertexCount = static_cast<uint32_t>(vertices.size());
+
+	//clockwise seen from outside, the degenerate half of pole quads is skipped
+	const uint32_t stride = segments + 1;
+	for (uint32_t r = 0; r < rings; ++r)
+	{
+		for (uint32_t s = 0; s < segments; ++s)
+		{
+			uint32_t i0 = r * stride + s, i1 = i0 + 1, i2 = i0 + stride, i3 = i2 + 1;
+			if (r != 0)
+				res->mIndices.insert(res->mIndices.end(), { i0, i1, i2 });
+			if (r != rings - 1)
+				res->mIndices.insert(res->mIndices.end(), { i1, i3, i2 });
+		}
+	}
+	res->bIndex32 = res->mVertexCount > UINT16_MAX;
 
 	res->mAttributes.insert({ "POSITION", VK_FORMAT_R32G32B32_SFLOAT, 0, 0 });
 	res->mAttributes.insert({ "NORMAL", VK_FORMAT_R32G32B32_SFLOAT, 12, 0 });
@@ -360,18 +1500,20 @@ std::unique_ptr<FormatMesh> FormatMesh::CreatePlane(Device* device)
 	res->mAttributes.insert({ "COLOR", VK_FORMAT_R32G32B32_SFLOAT, 56, 0 });
 
 	SubmeshGeometry submesh;
-	submesh.IndexCount = _countof(indices);
+	submesh.IndexCount = static_cast<uint32_t>(res->mIndices.size());
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 	res->mSubmeshes.push_back(submesh);
 
-	res->BuildBuffer();
+	if (device != nullptr)
+		res->BuildBuffer();
 
 	return res;
 }
 
 Vertex& FormatMesh::GetVertex(int i)
 {
+	assert(GetBindingStride(0) == sizeof(Vertex));
 	assert(sizeof(Vertex) * i < mVertexDatas[0].size());
 	return *(static_cast<Vertex*>(static_cast<void*>(mVertexDatas[0].data())) + i);
 }
\ No newline at end of file
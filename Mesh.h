@@ -7,8 +7,13 @@
 #include <vulkan/vulkan.h>
 #include <string>
 #include <set>
+#include <map>
+#include <algorithm>
+#include <glm/glm.hpp>
 
 #include "DeviceComponent.h"
+#include "MeshOptimizer.h"
+#include "VertexQuantization.hpp"
 
 struct VertexAttributeDesc
 {
@@ -31,6 +36,64 @@ struct VertexAttributeDesc
 
 
 
+struct MeshOptimizeSettings
+{
+	bool vertexCache = true;
+	bool overdraw = true;
+	bool vertexFetch = true;
+	uint32_t cacheSize = MeshOptimizer::DefaultCacheSize;
+	float overdrawThreshold = 1.05f;
+};
+
+struct MeshOptimizeReport
+{
+	std::string pass;
+	bool applied = false;
+	MeshOptimizeStats before;
+	MeshOptimizeStats after;
+};
+
+struct MeshLodSettings
+{
+	uint32_t lodCount = 4;//include lod 0
+	float reduction = 0.25f;//triangle ratio of each lod to the previous one
+	float targetError = 0.05f;//relative to mesh radius
+	//semantic prefix -> weight, float attribute only
+	std::map<std::string, float> attributeWeights = { {"NORMAL", 0.5f}, {"TEXCOORD", 1.0f}, {"COLOR", 0.5f} };
+};
+
+//How attributes are distributed to vertex bindings
+enum class MeshStreamLayout
+{
+	//every attribute in binding 0
+	Interleaved,
+	//POSITION alone in binding 0, others interleaved in binding 1, depth only pass fetch binding 0 only
+	SplitPosition,
+};
+
+struct MeshletGeometry
+{
+	uint32_t Submesh;
+	uint32_t IndexCount;
+	uint32_t StartIndexLocation;//meshlet index is stored after all submesh index, relative to submesh BaseVertexLocation
+	MeshletBounds Bounds;
+};
+
+//Element of meshlet buffer (std430), vertex and triangle array follow meshlet array
+//vertex: uint, BaseVertexLocation added; triangle: 3 uint8 local vertex index, packed in uint
+struct PackedMeshlet
+{
+	float center[3];
+	float radius;
+	int8_t coneAxis[3];
+	int8_t coneCutoff;//snorm8, rounded up
+	uint32_t vertexOffset;
+	uint32_t triangleOffset;
+	uint32_t vertexTriangleCount;//vertex count | triangle count << 16
+};
+
+struct MeshData;
+
 //Mesh只提供Vertex Attribute在顶点数据中的偏移，不保证精度和Component数量
 class Mesh : public DeviceComponent
 {
@@ -45,38 +108,126 @@ public:
 	};
 
 	static std::unique_ptr<Mesh> CreateTriangle(Device* device);
+	//Submesh is split when its index span exceed 16 bit, index type is chosen by the max index
+	static std::unique_ptr<Mesh> Create(Device* device, MeshData&& data);
 	std::optional<VertexAttributeDesc> GetVertexAttribute(const std::string semantic) const;
-	uint32_t GetBindingCount() const { return mVertexDatas.size(); }
+	uint32_t GetBindingCount() const { return std::max(mVertexDatas.size(), mBindingStrides.size()); }
 	uint32_t GetBindingStride(uint32_t binding) const;
 	const VkBuffer* GetVertexBuffers() const { return mVertexBuffers.data(); }
 	const VkBuffer GetIndexBuffer() const { return mIndexBuffer; }
 	const std::vector<SubmeshGeometry>& GetSubmesh() { return mSubmeshes; }
 	const VkDeviceSize* GetOffsets() const { return mVertexBufferOffsets.data(); }
 	VkIndexType GetIndexType() const { return bIndex32 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16; }
+	//Reorder index and vertex data of every submesh, rebuild buffer if already built
+	//overdraw pass need float3 POSITION, submesh may be split afterward to keep 16 bit index (see CompactIndices)
+	std::vector<MeshOptimizeReport> Optimize(const MeshOptimizeSettings& settings = {});
+	MeshOptimizeStats AnalyzeVertexCache(uint32_t cacheSize = MeshOptimizer::DefaultCacheSize) const;
+	//Re-encode float attributes of every binding, attribute format and offset is updated, other format is copied
+	//Optimize before it, overdraw pass need float position
+	std::vector<VertexAttributeError> Quantize(const VertexQuantizeSettings& settings = {});
+	//Map encoded position to object space, identity unless position is Snorm16
+	glm::mat4 GetPositionDequantizeMatrix() const;
+	//Repack vertex data into the bindings of layout, attribute keep its format and relative order
+	void SetStreamLayout(MeshStreamLayout layout);
+	uint32_t GetPositionBinding() const;
+
+	//Write cpu data to .smesh (see MeshFile.h), meshlet is not saved, throw if there is none (mesh from Load)
+	void Save(const std::string& path) const;
+	//Map .smesh and copy its streams from the mapping to staging memory, cpu data is not kept
+	static std::unique_ptr<Mesh> Load(Device* device, const std::string& path);
+
+	//Simplified index range of every submesh, share vertex buffer with lod 0
+	//call after Optimize and before BuildMeshlets, Quantize
+	void BuildLods(const MeshLodSettings& settings = {});
+	void ClearLods();
+	uint32_t GetLodCount() const { return static_cast<uint32_t>(mLodErrors.size()); }
+	//object space error of each lod, lod 0 is 0
+	const std::vector<float>& GetLodErrors() const { return mLodErrors; }
+	const std::vector<SubmeshGeometry>& GetLodSubmesh(uint32_t lod) const { return lod == 0 ? mSubmeshes : mLodSubmeshes[lod - 1]; }
+	//xyz center, w radius in object space
+	glm::vec4 GetBoundingSphere() const { return mBoundingSphere; }
+
+	//Split every submesh into meshlets, need float3 POSITION, call after Optimize and before Quantize
+	void BuildMeshlets(uint32_t maxVertices = MeshOptimizer::MaxMeshletVertices, uint32_t maxTriangles = MeshOptimizer::MaxMeshletTriangles);
+	void ClearMeshlets();
+	const std::vector<MeshletGeometry>& GetMeshlets() const { return mMeshlets; }
+	VkBuffer GetMeshletBuffer() const { return mMeshletBuffer; }
+	VkDeviceSize GetMeshletVertexOffset() const { return mMeshletVertexOffset; }
+	VkDeviceSize GetMeshletTriangleOffset() const { return mMeshletTriangleOffset; }
+	//Frustum and backface cone culling in object space, adjacent visible meshlets are merged into one draw
+	//without meshlet, draws is all submesh
+	void CullMeshlets(const glm::mat4& objectToClip, const glm::vec3& cameraPositionOS, std::vector<SubmeshGeometry>& draws) const;
 	~Mesh() { ReleaseBuffer(); }
 
 protected:
+	//device may be nullptr for offline processing, buffer is not built
 	Mesh(Device* device) : DeviceComponent(device) {}
+
+	struct BufferSource
+	{
+		const void* data;
+		size_t size;
+	};
 	
 	void BuildBuffer();
+	void BuildBuffer(const std::vector<BufferSource>& vertexSources, const BufferSource& indexSource);
 	void ReleaseBuffer();
+	//from float3 POSITION, keep the last one if position is quantized
+	void ComputeBoundingSphere();
+	//index of all submesh with BaseVertexLocation added
+	std::vector<uint32_t> GetAbsoluteIndices() const;
+	//Rebase every submesh to its smallest index and split submesh whose index span exceed 16 bit,
+	//then pick index type, call without lod and meshlet
+	void CompactIndices();
+	std::vector<uint16_t> GetIndices16() const;
+
+	//split piece smaller than this is not worth the extra draw
+	static constexpr uint32_t MinSplitTriangles = 1024;
 
 	uint32_t mVertexCount = 0;
 	bool bIndex32 = false;
 
 	std::set<VertexAttributeDesc> mAttributes;
 	std::vector<std::vector<std::byte>> mVertexDatas;
-	std::vector<uint16_t> mIndices16;
-	std::vector<uint32_t> mIndices32;
+	std::vector<uint32_t> mBindingStrides;//only for mesh without cpu data
+	//relative to BaseVertexLocation of its range, uploaded as uint16 unless bIndex32
+	std::vector<uint32_t> mIndices;
 
 	std::vector<SubmeshGeometry> mSubmeshes;
 
+	//index layout: submesh, lod, meshlet
+	std::vector<std::vector<SubmeshGeometry>> mLodSubmeshes;
+	std::vector<float> mLodErrors = { 0.0f };
+	uint32_t mLodIndexStart = 0;
+	glm::vec4 mBoundingSphere = glm::vec4(0.0f);
+
+	std::vector<MeshletGeometry> mMeshlets;
+	uint32_t mMeshletIndexStart = 0;
+	std::vector<std::byte> mMeshletData;
+	VkDeviceSize mMeshletVertexOffset = 0;
+	VkDeviceSize mMeshletTriangleOffset = 0;
+
+	glm::vec3 mPositionDequantizeScale = glm::vec3(1.0f);
+	glm::vec3 mPositionDequantizeOffset = glm::vec3(0.0f);
+
 	std::vector<VkBuffer> mVertexBuffers;
 	std::vector<VkDeviceSize> mVertexBufferOffsets;
 	VkBuffer mIndexBuffer = VK_NULL_HANDLE;
+	VkBuffer mMeshletBuffer = VK_NULL_HANDLE;
 	VkDeviceMemory mDeviceMemory = VK_NULL_HANDLE;
 };
 
+//Cpu data to create Mesh, index is relative to submesh BaseVertexLocation
+struct MeshData
+{
+	std::string name;
+	uint32_t vertexCount = 0;
+	std::set<VertexAttributeDesc> attributes;
+	std::vector<std::vector<std::byte>> vertexDatas;
+	std::vector<uint32_t> indices;
+	std::vector<Mesh::SubmeshGeometry> submeshes;
+};
+
 struct Vertex
 {
 	float position[3];
@@ -93,6 +244,9 @@ class FormatMesh : public Mesh
 public:
 	static std::unique_ptr<FormatMesh> CreateTriangle(Device* device);
 	static std::unique_ptr<FormatMesh> CreatePlane(Device* device);
+	//uv sphere of radius 0.5, triangle count grows with segments * rings
+	static std::unique_ptr<FormatMesh> CreateSphere(Device* device, uint32_t segments, uint32_t rings);
+	//Only valid before Quantize and SetStreamLayout(SplitPosition)
 	Vertex& GetVertex(int i);
 private:
 	FormatMesh(Device* device) : Mesh(device) {}
@@ -0,0 +1,152 @@
+#include "MeshConverter.h"
+#include "MeshFile.h"
+#include "Mesh.h"
+#include "MeshImporter.h"
+#include "Log.h"
+
+#include <iostream>
+#include <chrono>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cfloat>
+#include <algorithm>
+#include <format>
+
+namespace MeshConverter
+{
+	int Run(int argc, char** argv)
+	{
+		if (argc < 2)
+			return -1;
+
+		std::string_view command = argv[1];
+		if (command == "--convert-mesh")
+			return Convert(argc, argv);
+		if (command == "--bench-mesh-load")
+			return BenchmarkLoad(argc, argv);
+
+		return -1;
+	}
+
+	static std::unique_ptr<Mesh> LoadSource(std::string_view source)
+	{
+		//no device, cpu data only
+		if (source == "builtin:triangle")
+			return FormatMesh::CreateTriangle(nullptr);
+		if (source == "builtin:plane")
+			return FormatMesh::CreatePlane(nullptr);
+		if (source == "builtin:sphere")
+			return FormatMesh::CreateSphere(nullptr, 32, 16);
+
+		//.obj .gltf .glb, every mesh of the file merged into submeshes
+		return Mesh::Create(nullptr, MeshImporter::Merge(MeshImporter::Import(std::string(source))));
+	}
+
+	int Convert(int argc, char** argv)
+	{
+		if (argc < 4)
+		{
+			std::cerr << "usage: --convert-mesh <source> <output.smesh> [--no-optimize] [--no-lod] [--no-quantize] [--interleaved]" << std::endl;
+			return 1;
+		}
+
+		bool optimize = true;
+		bool lod = true;
+		bool quantize = true;
+		bool splitPosition = true;
+		for (int i = 4; i < argc; ++i)
+		{
+			std::string_view option = argv[i];
+			if (option == "--no-optimize")
+				optimize = false;
+			else if (option == "--no-lod")
+				lod = false;
+			else if (option == "--no-quantize")
+				quantize = false;
+			else if (option == "--interleaved")
+				splitPosition = false;
+			else
+			{
+				std::cerr << "unknown option: " << option << std::endl;
+				return 1;
+			}
+		}
+
+		std::unique_ptr<Mesh> mesh = LoadSource(argv[2]);
+
+		//same order as runtime: optimize, lod, quantize, stream layout
+		if (optimize)
+			mesh->Optimize();
+		if (lod)
+			mesh->BuildLods();
+		if (quantize)
+			mesh->Quantize();
+		mesh->SetStreamLayout(splitPosition ? MeshStreamLayout::SplitPosition : MeshStreamLayout::Interleaved);
+
+		mesh->Save(argv[3]);
+		LOG_INFO("mesh saved: {}", argv[3]);
+		return 0;
+	}
+
+	int BenchmarkLoad(int argc, char** argv)
+	{
+		if (argc < 3)
+		{
+			std::cerr << "usage: --bench-mesh-load <input.smesh> [iterations]" << std::endl;
+			return 1;
+		}
+
+		const std::string path = argv[2];
+		const int iterations = argc > 3 ? std::max(std::atoi(argv[3]), 1) : 100;
+
+		//staging arena is reused between loads like the upload heap
+		std::vector<std::byte> staging;
+		uint64_t copiedBytes = 0;
+		double totalSeconds = 0.0;
+		double firstSeconds = 0.0;
+		double bestSeconds = DBL_MAX;
+
+		for (int iteration = 0; iteration < iterations; ++iteration)
+		{
+			auto begin = std::chrono::high_resolution_clock::now();
+
+			MeshFile::MappedFile file(path);
+			const MeshFile::Header& header = MeshFile::Validate(file);
+
+			const uint64_t indexSize = static_cast<uint64_t>(header.indexCount) * ((header.flags & MeshFile::Index32) ? sizeof(uint32_t) : sizeof(uint16_t));
+			uint64_t loadSize = indexSize;
+			const MeshFile::Binding* bindings = MeshFile::GetSection<MeshFile::Binding>(file, header.bindingOffset);
+			for (uint32_t i = 0; i < header.bindingCount; ++i)
+				loadSize += bindings[i].size;
+
+			if (staging.size() < loadSize)
+				staging.resize(loadSize);
+
+			uint64_t stagingOffset = 0;
+			for (uint32_t i = 0; i < header.bindingCount; ++i)
+			{
+				memcpy(staging.data() + stagingOffset, file.GetData() + bindings[i].offset, bindings[i].size);
+				stagingOffset += bindings[i].size;
+			}
+			memcpy(staging.data() + stagingOffset, file.GetData() + header.indexOffset, indexSize);
+
+			file.Close();
+
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+			if (iteration == 0)
+				firstSeconds = seconds;
+			bestSeconds = std::min(bestSeconds, seconds);
+			totalSeconds += seconds;
+			copiedBytes += loadSize;
+		}
+
+		const double bytesPerLoad = static_cast<double>(copiedBytes) / iterations;
+		std::cout << std::format("mesh load {}: {} bytes, {} iterations", path, static_cast<uint64_t>(bytesPerLoad), iterations) << std::endl;
+		std::cout << std::format("\tfirst {:.3f} ms, {:.2f} GB/s", firstSeconds * 1000.0, bytesPerLoad / firstSeconds / 1e9) << std::endl;
+		std::cout << std::format("\tbest  {:.3f} ms, {:.2f} GB/s", bestSeconds * 1000.0, bytesPerLoad / bestSeconds / 1e9) << std::endl;
+		std::cout << std::format("\tavg   {:.3f} ms, {:.2f} GB/s", totalSeconds / iterations * 1000.0, static_cast<double>(copiedBytes) / totalSeconds / 1e9) << std::endl;
+		return 0;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+//Command line mesh tools, run by main before the app starts
+//SocoAppVk --convert-mesh <source> <output.smesh> [--no-optimize] [--no-lod] [--no-quantize] [--interleaved]
+//	source: builtin:triangle, builtin:plane, builtin:sphere, *.obj, *.gltf, *.glb
+//SocoAppVk --bench-mesh-load <input.smesh> [iterations]
+namespace MeshConverter
+{
+	//return -1 if argv is not a mesh tool command, else the process exit code
+	int Run(int argc, char** argv);
+
+	int Convert(int argc, char** argv);
+	//map, validate and copy every stream to a reused staging arena, report GB/s
+	int BenchmarkLoad(int argc, char** argv);
+}
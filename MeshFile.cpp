@@ -0,0 +1,171 @@
+#include "MeshFile.h"
+
+#include <vk_format_utils.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <format>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MeshFile
+{
+	void MappedFile::Open(const std::string& path)
+	{
+		Close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error(std::format("open mesh file failed: {}", path));
+		mFile = file;
+
+		LARGE_INTEGER size;
+		GetFileSizeEx(file, &size);
+		mSize = static_cast<size_t>(size.QuadPart);
+		if (mSize == 0)
+			return;
+
+		mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mMapping == nullptr)
+		{
+			Close();
+			throw std::runtime_error(std::format("map mesh file failed: {}", path));
+		}
+
+		mData = static_cast<const std::byte*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+#else
+		mFile = open(path.c_str(), O_RDONLY);
+		if (mFile < 0)
+			throw std::runtime_error(std::format("open mesh file failed: {}", path));
+
+		struct stat fileStat;
+		fstat(mFile, &fileStat);
+		mSize = static_cast<size_t>(fileStat.st_size);
+		if (mSize == 0)
+			return;
+
+		void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+		mData = data == MAP_FAILED ? nullptr : static_cast<const std::byte*>(data);
+		if (mData != nullptr)
+			madvise(data, mSize, MADV_SEQUENTIAL);
+#endif
+
+		if (mData == nullptr)
+		{
+			Close();
+			throw std::runtime_error(std::format("map mesh file failed: {}", path));
+		}
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (mData != nullptr)
+			UnmapViewOfFile(mData);
+		if (mMapping != nullptr)
+			CloseHandle(mMapping);
+		if (mFile != nullptr)
+			CloseHandle(mFile);
+		mMapping = nullptr;
+		mFile = nullptr;
+#else
+		if (mData != nullptr)
+			munmap(const_cast<std::byte*>(mData), mSize);
+		if (mFile >= 0)
+			close(mFile);
+		mFile = -1;
+#endif
+		mData = nullptr;
+		mSize = 0;
+	}
+
+	const Header& Validate(const MappedFile& file)
+	{
+		if (file.GetSize() < sizeof(Header))
+			throw std::runtime_error("mesh file too small");
+
+		const Header& header = *GetSection<Header>(file, 0);
+		if (memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+			throw std::runtime_error("not a mesh file");
+		if (header.version != Version)
+			throw std::runtime_error(std::format("mesh file version {} is not supported, expect {}", header.version, Version));
+		if (header.fileSize != file.GetSize())
+			throw std::runtime_error("mesh file is truncated");
+		if (header.lodCount < 1)
+			throw std::runtime_error("mesh file has no lod");
+
+		auto CheckSection = [&file](uint64_t offset, uint64_t size, const char* name) {
+			if (offset % SectionAlignment != 0 || offset > file.GetSize() || size > file.GetSize() - offset)
+				throw std::runtime_error(std::format("mesh file section {} out of range", name));
+		};
+
+		const uint64_t indexSize = static_cast<uint64_t>(header.indexCount) * ((header.flags & Index32) ? sizeof(uint32_t) : sizeof(uint16_t));
+		CheckSection(header.attributeOffset, sizeof(Attribute) * static_cast<uint64_t>(header.attributeCount), "attribute");
+		CheckSection(header.bindingOffset, sizeof(Binding) * static_cast<uint64_t>(header.bindingCount), "binding");
+		CheckSection(header.submeshOffset, sizeof(Submesh) * static_cast<uint64_t>(header.submeshCount), "submesh");
+		CheckSection(header.lodOffset, sizeof(Lod) * static_cast<uint64_t>(header.lodCount - 1), "lod");
+		CheckSection(header.lodSubmeshOffset, sizeof(Submesh) * static_cast<uint64_t>(header.lodCount - 1) * header.submeshCount, "lod submesh");
+		CheckSection(header.indexOffset, indexSize, "index");
+
+		const Binding* bindings = GetSection<Binding>(file, header.bindingOffset);
+		for (uint32_t i = 0; i < header.bindingCount; ++i)
+		{
+			CheckSection(bindings[i].offset, bindings[i].size, "vertex");
+			if (bindings[i].size != static_cast<uint64_t>(bindings[i].stride) * header.vertexCount)
+				throw std::runtime_error("mesh file vertex stream size mismatch");
+		}
+
+		const Attribute* attributes = GetSection<Attribute>(file, header.attributeOffset);
+		for (uint32_t i = 0; i < header.attributeCount; ++i)
+		{
+			const Attribute& attribute = attributes[i];
+			if (attribute.binding >= header.bindingCount)
+				throw std::runtime_error(std::format("mesh file attribute {} binding {} out of range", i, attribute.binding));
+			const uint32_t formatSize = FormatElementSize(static_cast<VkFormat>(attribute.format));
+			if (formatSize == 0 || static_cast<uint64_t>(attribute.offset) + formatSize > bindings[attribute.binding].stride)
+				throw std::runtime_error(std::format("mesh file attribute {} exceed stride of binding {}", i, attribute.binding));
+		}
+
+		//largest index of a range, a bad one makes the gpu fetch outside the vertex buffer
+		auto MaxIndex = [&file, &header](uint32_t start, uint32_t count) {
+			uint32_t maxIndex = 0;
+			if (header.flags & Index32)
+			{
+				const uint32_t* indices = GetSection<uint32_t>(file, header.indexOffset) + start;
+				for (uint32_t i = 0; i < count; ++i)
+					maxIndex = std::max(maxIndex, indices[i]);
+			}
+			else
+			{
+				const uint16_t* indices = GetSection<uint16_t>(file, header.indexOffset) + start;
+				for (uint32_t i = 0; i < count; ++i)
+					maxIndex = std::max<uint32_t>(maxIndex, indices[i]);
+			}
+			return maxIndex;
+		};
+
+		//lod 0 and every extra lod
+		auto CheckSubmeshes = [&header, &MaxIndex](const Submesh* submeshes, uint32_t count, const char* name) {
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const Submesh& submesh = submeshes[i];
+				if (static_cast<uint64_t>(submesh.startIndexLocation) + submesh.indexCount > header.indexCount || submesh.baseVertexLocation > header.vertexCount)
+					throw std::runtime_error(std::format("mesh file {} {} out of range", name, i));
+				if (submesh.indexCount > 0 && static_cast<uint64_t>(submesh.baseVertexLocation) + MaxIndex(submesh.startIndexLocation, submesh.indexCount) >= header.vertexCount)
+					throw std::runtime_error(std::format("mesh file {} {} index out of vertex range", name, i));
+			}
+		};
+		CheckSubmeshes(GetSection<Submesh>(file, header.submeshOffset), header.submeshCount, "submesh");
+		CheckSubmeshes(GetSection<Submesh>(file, header.lodSubmeshOffset), (header.lodCount - 1) * header.submeshCount, "lod submesh");
+
+		return header;
+	}
+}
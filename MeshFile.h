@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+//Binary mesh container (.smesh), little endian, every section is 16 bytes aligned so vertex stream can be
+//copied from the mapped file to staging memory directly
+//header | attributes | bindings | submeshes | lods | lod submeshes | index data | vertex streams
+namespace MeshFile
+{
+	constexpr char Magic[4] = { 'S', 'M', 'S', 'H' };
+	constexpr uint32_t Version = 2;
+	constexpr uint64_t SectionAlignment = 16;
+
+	enum Flags : uint32_t
+	{
+		Index32 = 1 << 0,
+	};
+
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t flags;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t attributeCount;
+		uint32_t bindingCount;
+		uint32_t submeshCount;
+		uint32_t lodCount;//include lod 0, lod section has lodCount - 1 entries, each has submeshCount submeshes
+		uint32_t reserved;
+		float boundingSphere[4];
+		float dequantizeScale[4];
+		float dequantizeOffset[4];
+		uint64_t attributeOffset;
+		uint64_t bindingOffset;
+		uint64_t submeshOffset;
+		uint64_t lodOffset;
+		uint64_t lodSubmeshOffset;
+		uint64_t indexOffset;
+		uint64_t fileSize;
+	};
+
+	struct Attribute
+	{
+		char semantic[32];
+		uint32_t format;
+		uint32_t offset;
+		uint32_t binding;
+		uint32_t reserved;
+	};
+
+	struct Binding
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint32_t stride;
+		uint32_t reserved;
+	};
+
+	struct Submesh
+	{
+		uint32_t indexCount;
+		uint32_t startIndexLocation;
+		uint32_t baseVertexLocation;
+		uint32_t reserved;
+	};
+
+	struct Lod
+	{
+		float error;
+		uint32_t reserved[3];
+	};
+
+	inline uint64_t AlignSection(uint64_t offset)
+	{
+		return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+	}
+
+	//Read only file mapping, CreateFileMapping on windows, mmap otherwise
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		explicit MappedFile(const std::string& path) { Open(path); }
+		~MappedFile() { Close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		//throw runtime_error if failed
+		void Open(const std::string& path);
+		void Close();
+
+		const std::byte* GetData() const { return mData; }
+		size_t GetSize() const { return mSize; }
+
+	private:
+		const std::byte* mData = nullptr;
+		size_t mSize = 0;
+#ifdef _WIN32
+		void* mFile = nullptr;
+		void* mMapping = nullptr;
+#else
+		int mFile = -1;
+#endif
+	};
+
+	//Check magic, version, every section is inside the file, submesh, attribute and index reference valid range
+	//throw runtime_error if invalid
+	const Header& Validate(const MappedFile& file);
+
+	template<typename T>
+	const T* GetSection(const MappedFile& file, uint64_t offset)
+	{
+		return reinterpret_cast<const T*>(file.GetData() + offset);
+	}
+}
@@ -0,0 +1,927 @@
+#include "MeshImporter.h"
+#include "MeshFile.h"
+#include "Json.hpp"
+#include "Log.h"
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <charconv>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cmath>
+#include <format>
+#include <chrono>
+
+namespace
+{
+	std::string ToLower(std::string_view str)
+	{
+		std::string res(str);
+		for (char& c : res)
+			c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+		return res;
+	}
+
+	const char* SkipSpace(const char* ptr, const char* end)
+	{
+		while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+			++ptr;
+		return ptr;
+	}
+
+	const char* SkipLine(const char* ptr, const char* end)
+	{
+		while (ptr < end && *ptr != '\n')
+			++ptr;
+		return ptr < end ? ptr + 1 : end;
+	}
+
+	//from_chars do not accept leading '+'
+	bool ParseFloat(const char*& ptr, const char* end, float& value)
+	{
+		ptr = SkipSpace(ptr, end);
+		if (ptr < end && *ptr == '+')
+			++ptr;
+		auto [next, error] = std::from_chars(ptr, end, value);
+		if (error != std::errc())
+			return false;
+		ptr = next;
+		return true;
+	}
+
+	bool ParseInt(const char*& ptr, const char* end, int32_t& value)
+	{
+		if (ptr < end && *ptr == '+')
+			++ptr;
+		auto [next, error] = std::from_chars(ptr, end, value);
+		if (error != std::errc())
+			return false;
+		ptr = next;
+		return true;
+	}
+
+	//Vertex attribute layout of Vertex, same as FormatMesh
+	std::set<VertexAttributeDesc> GetVertexAttributes()
+	{
+		return {
+			{ "POSITION", VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position), 0 },
+			{ "NORMAL", VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal), 0 },
+			{ "TANGENT", VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, tangent), 0 },
+			{ "TEXCOORD", VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv0), 0 },
+			{ "TEXCOORD1", VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv1), 0 },
+			{ "COLOR", VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color), 0 },
+		};
+	}
+
+	Vertex DefaultVertex()
+	{
+		Vertex vertex = {};
+		vertex.tangent[0] = 1.0f;
+		vertex.tangent[3] = 1.0f;
+		vertex.color[0] = vertex.color[1] = vertex.color[2] = 1.0f;
+		return vertex;
+	}
+
+	//obj corner, 0 based index
+	//relative bit set: value is chunk local vertex count at the face plus the negative index, can be < 0 when it refer to previous chunk
+	struct ObjCorner
+	{
+		int32_t position;
+		int32_t texcoord;
+		int32_t normal;
+		uint8_t relative = 0;//bit per component
+
+		bool operator==(const ObjCorner&) const = default;
+	};
+
+	struct ObjCornerHash
+	{
+		size_t operator()(const ObjCorner& corner) const
+		{
+			return (static_cast<size_t>(corner.position) * 73856093u) ^ (static_cast<size_t>(corner.texcoord) * 19349663u) ^ (static_cast<size_t>(corner.normal) * 83492791u);
+		}
+	};
+
+	constexpr int32_t ObjMissing = INT32_MIN;
+
+	struct ObjChunk
+	{
+		std::vector<float> positions;
+		std::vector<float> colors;
+		std::vector<float> texcoords;
+		std::vector<float> normals;
+		std::vector<ObjCorner> corners;//3 per triangle
+		std::vector<std::pair<size_t, std::string>> materials;//first triangle, material name
+		bool hasColor = false;
+		std::string error;
+	};
+
+	void ParseObjChunk(const char* begin, const char* end, ObjChunk& chunk)
+	{
+		std::vector<ObjCorner> polygon;
+
+		const char* ptr = begin;
+		size_t lineNumber = 0;
+		while (ptr < end)
+		{
+			const char* line = SkipSpace(ptr, end);
+			ptr = SkipLine(line, end);
+			++lineNumber;
+
+			if (line >= end || *line == '#' || *line == '\n' || *line == '\r')
+				continue;
+
+			if (line[0] == 'v' && line + 1 < end && (line[1] == ' ' || line[1] == '\t'))
+			{
+				const char* cursor = line + 1;
+				float p[3];
+				if (!ParseFloat(cursor, end, p[0]) || !ParseFloat(cursor, end, p[1]) || !ParseFloat(cursor, end, p[2]))
+				{
+					chunk.error = "invalid vertex position";
+					return;
+				}
+				chunk.positions.insert(chunk.positions.end(), p, p + 3);
+
+				//optional vertex color extension: v x y z r g b
+				float color[3] = { 1.0f, 1.0f, 1.0f };
+				const char* colorCursor = cursor;
+				if (ParseFloat(colorCursor, ptr, color[0]) && ParseFloat(colorCursor, ptr, color[1]) && ParseFloat(colorCursor, ptr, color[2]))
+					chunk.hasColor = true;
+				chunk.colors.insert(chunk.colors.end(), color, color + 3);
+			}
+			else if (line[0] == 'v' && line + 2 < end && line[1] == 't')
+			{
+				const char* cursor = line + 2;
+				float uv[2] = { 0.0f, 0.0f };
+				if (!ParseFloat(cursor, end, uv[0]))
+				{
+					chunk.error = "invalid texcoord";
+					return;
+				}
+				ParseFloat(cursor, ptr, uv[1]);
+				chunk.texcoords.insert(chunk.texcoords.end(), uv, uv + 2);
+			}
+			else if (line[0] == 'v' && line + 2 < end && line[1] == 'n')
+			{
+				const char* cursor = line + 2;
+				float n[3];
+				if (!ParseFloat(cursor, end, n[0]) || !ParseFloat(cursor, end, n[1]) || !ParseFloat(cursor, end, n[2]))
+				{
+					chunk.error = "invalid normal";
+					return;
+				}
+				chunk.normals.insert(chunk.normals.end(), n, n + 3);
+			}
+			else if (line[0] == 'f' && line + 1 < end && (line[1] == ' ' || line[1] == '\t'))
+			{
+				polygon.clear();
+				const char* cursor = line + 1;
+				while (true)
+				{
+					cursor = SkipSpace(cursor, ptr);
+					if (cursor >= ptr || *cursor == '\n' || *cursor == '\r' || *cursor == '#')
+						break;
+
+					//v, v/vt, v//vn, v/vt/vn
+					int32_t values[3] = { ObjMissing, ObjMissing, ObjMissing };
+					uint8_t relative = 0;
+					const size_t counts[3] = { chunk.positions.size() / 3, chunk.texcoords.size() / 2, chunk.normals.size() / 3 };
+					for (int component = 0; component < 3; ++component)
+					{
+						int32_t value;
+						if (cursor < ptr && *cursor != '/' && ParseInt(cursor, ptr, value))
+						{
+							if (value > 0)
+								values[component] = value - 1;
+							else if (value < 0)
+							{
+								//resolved on merge, chunk base is unknown here
+								values[component] = static_cast<int32_t>(counts[component]) + value;
+								relative |= 1 << component;
+							}
+							else
+							{
+								chunk.error = "invalid face index";
+								return;
+							}
+						}
+
+						if (cursor < ptr && *cursor == '/')
+							++cursor;
+						else
+							break;
+					}
+
+					if (values[0] == ObjMissing)
+					{
+						chunk.error = "face without position";
+						return;
+					}
+					polygon.push_back({ values[0], values[1], values[2], relative });
+
+					//skip rest of token
+					while (cursor < ptr && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r')
+						++cursor;
+				}
+
+				//fan triangulation
+				for (size_t i = 2; i < polygon.size(); ++i)
+				{
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[i - 1]);
+					chunk.corners.push_back(polygon[i]);
+				}
+			}
+			else if (end - line > 7 && strncmp(line, "usemtl", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))
+			{
+				const char* name = SkipSpace(line + 6, ptr);
+				const char* nameEnd = ptr;
+				while (nameEnd > name && (nameEnd[-1] == '\n' || nameEnd[-1] == '\r' || nameEnd[-1] == ' ' || nameEnd[-1] == '\t'))
+					--nameEnd;
+				chunk.materials.push_back({ chunk.corners.size() / 3, std::string(name, nameEnd) });
+			}
+		}
+	}
+
+	//glTF accessor view
+	struct GltfAccessor
+	{
+		const std::byte* data = nullptr;
+		uint32_t count = 0;
+		uint32_t componentCount = 0;
+		uint32_t componentType = 0;
+		size_t stride = 0;
+		bool normalized = false;
+
+		float ReadFloat(uint32_t index, uint32_t component) const
+		{
+			const std::byte* element = data + stride * index;
+			switch (componentType)
+			{
+			case 5120: { int8_t v; memcpy(&v, element + component, 1); return normalized ? std::max(v / 127.0f, -1.0f) : v; }
+			case 5121: { uint8_t v; memcpy(&v, element + component, 1); return normalized ? v / 255.0f : v; }
+			case 5122: { int16_t v; memcpy(&v, element + component * 2, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : v; }
+			case 5123: { uint16_t v; memcpy(&v, element + component * 2, 2); return normalized ? v / 65535.0f : v; }
+			case 5125: { uint32_t v; memcpy(&v, element + component * 4, 4); return static_cast<float>(v); }
+			case 5126: { float v; memcpy(&v, element + component * 4, 4); return v; }
+			default: return 0.0f;
+			}
+		}
+
+		uint32_t ReadUint(uint32_t index) const
+		{
+			const std::byte* element = data + stride * index;
+			switch (componentType)
+			{
+			case 5121: { uint8_t v; memcpy(&v, element, 1); return v; }
+			case 5123: { uint16_t v; memcpy(&v, element, 2); return v; }
+			case 5125: { uint32_t v; memcpy(&v, element, 4); return v; }
+			default: return 0;
+			}
+		}
+	};
+
+	uint32_t GltfComponentSize(uint32_t componentType)
+	{
+		switch (componentType)
+		{
+		case 5120: case 5121: return 1;
+		case 5122: case 5123: return 2;
+		case 5125: case 5126: return 4;
+		default: throw std::runtime_error(std::format("glTF: unknown component type {}", componentType));
+		}
+	}
+
+	uint32_t GltfComponentCount(const std::string& type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		throw std::runtime_error(std::format("glTF: unsupported accessor type {}", type));
+	}
+
+	std::vector<std::byte> DecodeBase64(std::string_view text)
+	{
+		auto Decode = [](char c) -> int {
+			if (c >= 'A' && c <= 'Z') return c - 'A';
+			if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+			if (c >= '0' && c <= '9') return c - '0' + 52;
+			if (c == '+' || c == '-') return 62;
+			if (c == '/' || c == '_') return 63;
+			return -1;
+		};
+
+		std::vector<std::byte> data;
+		data.reserve(text.size() / 4 * 3);
+		uint32_t bits = 0;
+		int bitCount = 0;
+		for (char c : text)
+		{
+			int value = Decode(c);
+			if (value < 0)
+				continue;
+			bits = (bits << 6) | static_cast<uint32_t>(value);
+			bitCount += 6;
+			if (bitCount >= 8)
+			{
+				bitCount -= 8;
+				data.push_back(static_cast<std::byte>((bits >> bitCount) & 0xFF));
+			}
+		}
+		return data;
+	}
+
+	//Buffers of a glTF file, external buffer is mapped
+	struct GltfBuffers
+	{
+		std::vector<std::unique_ptr<MeshFile::MappedFile>> mappedFiles;
+		std::vector<std::vector<std::byte>> decodedBuffers;
+		std::vector<std::pair<const std::byte*, size_t>> buffers;
+	};
+
+	GltfAccessor GetGltfAccessor(const JsonValue& document, const GltfBuffers& buffers, uint32_t accessorIndex)
+	{
+		const JsonValue& accessor = document["accessors"][accessorIndex];
+		if (!accessor.IsObject())
+			throw std::runtime_error(std::format("glTF: accessor {} not found", accessorIndex));
+		if (accessor.Has("sparse"))
+			throw std::runtime_error("glTF: sparse accessor is not supported");
+
+		GltfAccessor view;
+		view.count = accessor["count"].GetUint();
+		view.componentType = accessor["componentType"].GetUint();
+		view.componentCount = GltfComponentCount(accessor["type"].GetString());
+		view.normalized = accessor["normalized"].GetBool();
+
+		const uint32_t elementSize = GltfComponentSize(view.componentType) * view.componentCount;
+		if (!accessor.Has("bufferView"))
+			throw std::runtime_error("glTF: accessor without bufferView is not supported");
+
+		const JsonValue& bufferView = document["bufferViews"][accessor["bufferView"].GetUint()];
+		const uint32_t bufferIndex = bufferView["buffer"].GetUint();
+		if (bufferIndex >= buffers.buffers.size())
+			throw std::runtime_error("glTF: buffer index out of range");
+
+		const auto [bufferData, bufferSize] = buffers.buffers[bufferIndex];
+		const uint64_t viewOffset = static_cast<uint64_t>(bufferView["byteOffset"].GetNumber());
+		const uint64_t viewLength = static_cast<uint64_t>(bufferView["byteLength"].GetNumber());
+		const uint64_t accessorOffset = static_cast<uint64_t>(accessor["byteOffset"].GetNumber());
+		view.stride = bufferView.Has("byteStride") ? bufferView["byteStride"].GetUint() : elementSize;
+		if (view.stride < elementSize)
+			throw std::runtime_error(std::format("glTF: accessor {} stride {} smaller than element", accessorIndex, view.stride));
+
+		//last element only need its own size, not the full stride
+		const uint64_t requiredSize = view.count == 0 ? accessorOffset : accessorOffset + static_cast<uint64_t>(view.stride) * (view.count - 1) + elementSize;
+		if (viewOffset + viewLength > bufferSize || requiredSize > viewLength)
+			throw std::runtime_error(std::format("glTF: accessor {} out of buffer range", accessorIndex));
+
+		view.data = bufferData + viewOffset + accessorOffset;
+		return view;
+	}
+
+	//one primitive to vertex and index, attribute not present keep default
+	void ReadGltfPrimitive(const JsonValue& document, const GltfBuffers& buffers, const JsonValue& primitive,
+		std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const JsonValue& attributes = primitive["attributes"];
+		if (!attributes.Has("POSITION"))
+			throw std::runtime_error("glTF: primitive without POSITION");
+
+		GltfAccessor positions = GetGltfAccessor(document, buffers, attributes["POSITION"].GetUint());
+		vertices.assign(positions.count, DefaultVertex());
+
+		//componentCounts: accepted VECn, float or normalized integer in componentTypes
+		auto ReadAttribute = [&](const char* semantic, std::initializer_list<uint32_t> componentCounts, std::initializer_list<uint32_t> componentTypes, auto&& write) {
+			if (!attributes.Has(semantic))
+				return;
+			GltfAccessor accessor = GetGltfAccessor(document, buffers, attributes[semantic].GetUint());
+			if (accessor.count != positions.count)
+				throw std::runtime_error(std::format("glTF: {} count mismatch", semantic));
+			if (std::find(componentCounts.begin(), componentCounts.end(), accessor.componentCount) == componentCounts.end())
+				throw std::runtime_error(std::format("glTF: {} unsupported accessor type VEC{}", semantic, accessor.componentCount));
+			if (std::find(componentTypes.begin(), componentTypes.end(), accessor.componentType) == componentTypes.end() || (accessor.componentType != 5126 && !accessor.normalized))
+				throw std::runtime_error(std::format("glTF: {} unsupported component type {}", semantic, accessor.componentType));
+			for (uint32_t i = 0; i < accessor.count; ++i)
+				write(vertices[i], accessor, i);
+		};
+
+		ReadAttribute("POSITION", { 3 }, { 5126 }, [](Vertex& vertex, const GltfAccessor& accessor, uint32_t i) {
+			for (uint32_t c = 0; c < 3; ++c)
+				vertex.position[c] = accessor.ReadFloat(i, c);
+		});
+		ReadAttribute("NORMAL", { 3 }, { 5126 }, [](Vertex& vertex, const GltfAccessor& accessor, uint32_t i) {
+			for (uint32_t c = 0; c < 3; ++c)
+				vertex.normal[c] = accessor.ReadFloat(i, c);
+		});
+		ReadAttribute("TANGENT", { 4 }, { 5126 }, [](Vertex& vertex, const GltfAccessor& accessor, uint32_t i) {
+			for (uint32_t c = 0; c < 4; ++c)
+				vertex.tangent[c] = accessor.ReadFloat(i, c);
+		});
+		ReadAttribute("TEXCOORD_0", { 2 }, { 5126, 5121, 5123 }, [](Vertex& vertex, const GltfAccessor& accessor, uint32_t i) {
+			vertex.uv0[0] = accessor.ReadFloat(i, 0);
+			vertex.uv0[1] = accessor.ReadFloat(i, 1);
+		});
+		ReadAttribute("TEXCOORD_1", { 2 }, { 5126, 5121, 5123 }, [](Vertex& vertex, const GltfAccessor& accessor, uint32_t i) {
+			vertex.uv1[0] = accessor.ReadFloat(i, 0);
+			vertex.uv1[1] = accessor.ReadFloat(i, 1);
+		});
+		ReadAttribute("COLOR_0", { 3, 4 }, { 5126, 5121, 5123 }, [](Vertex& vertex, const GltfAccessor& accessor, uint32_t i) {
+			for (uint32_t c = 0; c < 3; ++c)
+				vertex.color[c] = accessor.ReadFloat(i, c);
+		});
+
+		if (primitive.Has("indices"))
+		{
+			GltfAccessor indexAccessor = GetGltfAccessor(document, buffers, primitive["indices"].GetUint());
+			if (indexAccessor.componentCount != 1 || (indexAccessor.componentType != 5121 && indexAccessor.componentType != 5123 && indexAccessor.componentType != 5125))
+				throw std::runtime_error(std::format("glTF: unsupported index accessor, component type {} count {}", indexAccessor.componentType, indexAccessor.componentCount));
+			indices.resize(indexAccessor.count - indexAccessor.count % 3);
+			for (uint32_t i = 0; i < indices.size(); ++i)
+			{
+				indices[i] = indexAccessor.ReadUint(i);
+				if (indices[i] >= positions.count)
+					throw std::runtime_error("glTF: index out of range");
+			}
+		}
+		else
+		{
+			indices.resize(positions.count - positions.count % 3);
+			for (uint32_t i = 0; i < indices.size(); ++i)
+				indices[i] = i;
+		}
+	}
+}
+
+uint32_t MeshImporter::GetThreadCount(const MeshImportSettings& settings)
+{
+	uint32_t threadCount = settings.threadCount != 0 ? settings.threadCount : std::thread::hardware_concurrency();
+	return std::max(threadCount, 1u);
+}
+
+void MeshImporter::ParallelFor(size_t count, uint32_t threadCount, const std::function<void(size_t)>& job)
+{
+	std::atomic<size_t> next = 0;
+	std::mutex errorMutex;
+	std::exception_ptr error;
+
+	auto run = [&]() {
+		//an exception leaving a std::thread calls std::terminate, keep the first one and stop taking jobs
+		for (size_t i = next++; i < count; i = next++)
+		{
+			try {
+				job(i);
+			}
+			catch (...) {
+				std::lock_guard lock(errorMutex);
+				if (!error)
+					error = std::current_exception();
+				next = count;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const size_t workerCount = std::min<size_t>(threadCount, count);
+	for (size_t i = 1; i < workerCount; ++i)
+		threads.emplace_back(run);
+	run();
+	for (std::thread& thread : threads)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+std::vector<MeshData> MeshImporter::Import(const std::string& path, const MeshImportSettings& settings)
+{
+	auto begin = std::chrono::high_resolution_clock::now();
+
+	std::string extension = ToLower(std::filesystem::path(path).extension().string());
+	std::vector<MeshData> meshes;
+	if (extension == ".obj")
+		meshes = ImportObj(path, settings);
+	else if (extension == ".gltf" || extension == ".glb")
+		meshes = ImportGltf(path, settings);
+	else
+		throw std::runtime_error(std::format("unsupported mesh file: {}", path));
+
+	size_t triangleCount = 0;
+	size_t vertexCount = 0;
+	for (const MeshData& mesh : meshes)
+	{
+		triangleCount += mesh.indices.size() / 3;
+		vertexCount += mesh.vertexCount;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+	LOG_INFO("import {}: {} meshes, {} vertices, {} triangles, {:.1f} ms", path, meshes.size(), vertexCount, triangleCount, seconds * 1000.0);
+
+	return meshes;
+}
+
+MeshData MeshImporter::Merge(std::vector<MeshData>&& meshes)
+{
+	MeshData res;
+	if (meshes.empty())
+		return res;
+
+	res.name = meshes.front().name;
+	res.attributes = meshes.front().attributes;
+	res.vertexDatas.resize(meshes.front().vertexDatas.size());
+
+	for (MeshData& mesh : meshes)
+	{
+		if (mesh.attributes != res.attributes || mesh.vertexDatas.size() != res.vertexDatas.size())
+			throw std::runtime_error("merge mesh with different vertex layout");
+
+		const uint32_t baseVertex = res.vertexCount;
+		const uint32_t startIndex = static_cast<uint32_t>(res.indices.size());
+		for (Mesh::SubmeshGeometry submesh : mesh.submeshes)
+		{
+			submesh.BaseVertexLocation += baseVertex;
+			submesh.StartIndexLocation += startIndex;
+			res.submeshes.push_back(submesh);
+		}
+
+		for (size_t binding = 0; binding < mesh.vertexDatas.size(); ++binding)
+			res.vertexDatas[binding].insert(res.vertexDatas[binding].end(), mesh.vertexDatas[binding].begin(), mesh.vertexDatas[binding].end());
+		res.indices.insert(res.indices.end(), mesh.indices.begin(), mesh.indices.end());
+		res.vertexCount += mesh.vertexCount;
+	}
+
+	return res;
+}
+
+MeshData MeshImporter::BuildMeshData(std::string name, std::vector<SubmeshVertices>&& submeshes)
+{
+	MeshData res;
+	res.name = std::move(name);
+	res.attributes = GetVertexAttributes();
+
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (const SubmeshVertices& submesh : submeshes)
+	{
+		vertexCount += submesh.vertices.size();
+		indexCount += submesh.indices.size();
+	}
+
+	res.vertexDatas.resize(1);
+	res.vertexDatas[0].resize(vertexCount * sizeof(Vertex));
+	res.indices.reserve(indexCount);
+
+	for (const SubmeshVertices& submesh : submeshes)
+	{
+		if (submesh.indices.empty())
+			continue;
+
+		Mesh::SubmeshGeometry geometry;
+		geometry.IndexCount = static_cast<uint32_t>(submesh.indices.size());
+		geometry.StartIndexLocation = static_cast<uint32_t>(res.indices.size());
+		geometry.BaseVertexLocation = res.vertexCount;
+		res.submeshes.push_back(geometry);
+
+		memcpy(res.vertexDatas[0].data() + static_cast<size_t>(res.vertexCount) * sizeof(Vertex), submesh.vertices.data(), submesh.vertices.size() * sizeof(Vertex));
+		res.indices.insert(res.indices.end(), submesh.indices.begin(), submesh.indices.end());
+		res.vertexCount += static_cast<uint32_t>(submesh.vertices.size());
+	}
+
+	return res;
+}
+
+void MeshImporter::DeduplicateVertices(SubmeshVertices& submesh)
+{
+	struct VertexHash
+	{
+		size_t operator()(const Vertex& vertex) const
+		{
+			//FNV-1a over bytes, Vertex has no padding
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&vertex);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); ++i)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			return static_cast<size_t>(hash);
+		}
+	};
+	struct VertexEqual
+	{
+		bool operator()(const Vertex& lhs, const Vertex& rhs) const { return memcmp(&lhs, &rhs, sizeof(Vertex)) == 0; }
+	};
+
+	std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> vertexMap;
+	vertexMap.reserve(submesh.vertices.size());
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> remap(submesh.vertices.size());
+	for (size_t i = 0; i < submesh.vertices.size(); ++i)
+	{
+		auto [ite, inserted] = vertexMap.try_emplace(submesh.vertices[i], static_cast<uint32_t>(vertices.size()));
+		if (inserted)
+			vertices.push_back(submesh.vertices[i]);
+		remap[i] = ite->second;
+	}
+
+	for (uint32_t& index : submesh.indices)
+		index = remap[index];
+	submesh.vertices = std::move(vertices);
+}
+
+void MeshImporter::ComputeMissingNormals(SubmeshVertices& submesh)
+{
+	std::vector<bool> missing(submesh.vertices.size());
+	bool anyMissing = false;
+	for (size_t i = 0; i < submesh.vertices.size(); ++i)
+	{
+		const float* n = submesh.vertices[i].normal;
+		missing[i] = n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f;
+		anyMissing |= missing[i];
+	}
+	if (!anyMissing)
+		return;
+
+	//cross length is twice the area, so the sum is area weighted
+	for (size_t i = 0; i + 2 < submesh.indices.size(); i += 3)
+	{
+		const float* p0 = submesh.vertices[submesh.indices[i]].position;
+		const float* p1 = submesh.vertices[submesh.indices[i + 1]].position;
+		const float* p2 = submesh.vertices[submesh.indices[i + 2]].position;
+		float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			uint32_t vertex = submesh.indices[i + corner];
+			if (!missing[vertex])
+				continue;
+			for (int axis = 0; axis < 3; ++axis)
+				submesh.vertices[vertex].normal[axis] += normal[axis];
+		}
+	}
+
+	for (size_t i = 0; i < submesh.vertices.size(); ++i)
+	{
+		if (!missing[i])
+			continue;
+		float* n = submesh.vertices[i].normal;
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length > 0.0f)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+				n[axis] /= length;
+		}
+	}
+}
+
+void MeshImporter::ConvertToLeftHanded(SubmeshVertices& submesh)
+{
+	//mirror z, tangent frame handedness flip with it
+	for (Vertex& vertex : submesh.vertices)
+	{
+		vertex.position[2] = -vertex.position[2];
+		vertex.normal[2] = -vertex.normal[2];
+		vertex.tangent[2] = -vertex.tangent[2];
+		vertex.tangent[3] = -vertex.tangent[3];
+	}
+
+	//counter clockwise to clockwise
+	for (size_t i = 0; i + 2 < submesh.indices.size(); i += 3)
+		std::swap(submesh.indices[i + 1], submesh.indices[i + 2]);
+}
+
+std::vector<MeshData> MeshImporter::ImportObj(const std::string& path, const MeshImportSettings& settings)
+{
+	MeshFile::MappedFile file(path);
+	const char* data = reinterpret_cast<const char*>(file.GetData());
+	const size_t size = file.GetSize();
+
+	//chunk boundary at line start
+	const uint32_t threadCount = GetThreadCount(settings);
+	const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / (1 << 16)));
+	std::vector<const char*> boundaries = { data };
+	for (size_t i = 1; i < chunkCount; ++i)
+	{
+		const char* boundary = std::max(data + size * i / chunkCount, boundaries.back());
+		boundaries.push_back(SkipLine(boundary, data + size));
+	}
+	boundaries.push_back(data + size);
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	ParallelFor(chunkCount, threadCount, [&](size_t i) { ParseObjChunk(boundaries[i], boundaries[i + 1], chunks[i]); });
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		if (!chunk.error.empty())
+			throw std::runtime_error(std::format("obj {}: {}", path, chunk.error));
+	}
+
+	//resolve relative index, group triangle by material
+	std::vector<float> positions, colors, texcoords, normals;
+	bool hasColor = false;
+	std::vector<std::string> materialNames;
+	std::map<std::string, size_t> materialSubmesh;
+	std::vector<std::vector<ObjCorner>> submeshCorners;
+
+	size_t currentSubmesh = SIZE_MAX;
+	auto SelectMaterial = [&](const std::string& name) {
+		auto [ite, inserted] = materialSubmesh.try_emplace(name, submeshCorners.size());
+		if (inserted)
+		{
+			submeshCorners.emplace_back();
+			materialNames.push_back(name);
+		}
+		currentSubmesh = ite->second;
+	};
+
+	for (ObjChunk& chunk : chunks)
+	{
+		const int32_t bases[3] = { static_cast<int32_t>(positions.size() / 3), static_cast<int32_t>(texcoords.size() / 2), static_cast<int32_t>(normals.size() / 3) };
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		colors.insert(colors.end(), chunk.colors.begin(), chunk.colors.end());
+		texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		hasColor |= chunk.hasColor;
+
+		size_t materialIndex = 0;
+		for (size_t triangle = 0; triangle < chunk.corners.size() / 3; ++triangle)
+		{
+			while (materialIndex < chunk.materials.size() && chunk.materials[materialIndex].first == triangle)
+				SelectMaterial(chunk.materials[materialIndex++].second);
+			if (currentSubmesh == SIZE_MAX)
+				SelectMaterial("");
+
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				ObjCorner resolved = chunk.corners[triangle * 3 + corner];
+				int32_t* values[3] = { &resolved.position, &resolved.texcoord, &resolved.normal };
+				for (int component = 0; component < 3; ++component)
+				{
+					if ((resolved.relative & (1 << component)) == 0)
+						continue;
+					const int64_t value = static_cast<int64_t>(*values[component]) + bases[component];
+					if (value < 0)
+						throw std::runtime_error(std::format("obj {}: invalid face index", path));
+					*values[component] = static_cast<int32_t>(value);
+				}
+				resolved.relative = 0;
+				submeshCorners[currentSubmesh].push_back(resolved);
+			}
+		}
+		//material switch after the last triangle of chunk
+		while (materialIndex < chunk.materials.size())
+			SelectMaterial(chunk.materials[materialIndex++].second);
+	}
+
+	const int32_t counts[3] = { static_cast<int32_t>(positions.size() / 3), static_cast<int32_t>(texcoords.size() / 2), static_cast<int32_t>(normals.size() / 3) };
+
+	//dedup each submesh in parallel, corner -> vertex
+	std::vector<SubmeshVertices> submeshes(submeshCorners.size());
+	ParallelFor(submeshCorners.size(), threadCount, [&](size_t submeshIndex) {
+		const std::vector<ObjCorner>& corners = submeshCorners[submeshIndex];
+		SubmeshVertices& submesh = submeshes[submeshIndex];
+
+		std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> vertexMap;
+		vertexMap.reserve(corners.size() / 2);
+		submesh.indices.reserve(corners.size());
+
+		for (const ObjCorner& corner : corners)
+		{
+			if (corner.position >= counts[0] || corner.texcoord >= counts[1] || corner.normal >= counts[2])
+				throw std::runtime_error(std::format("obj {}: face index out of range", path));
+
+			auto [ite, inserted] = vertexMap.try_emplace(corner, static_cast<uint32_t>(submesh.vertices.size()));
+			if (inserted)
+			{
+				Vertex vertex = DefaultVertex();
+				memcpy(vertex.position, &positions[corner.position * 3], sizeof(float) * 3);
+				if (hasColor)
+					memcpy(vertex.color, &colors[corner.position * 3], sizeof(float) * 3);
+				if (corner.texcoord != ObjMissing)
+				{
+					//obj uv origin is bottom left
+					vertex.uv0[0] = texcoords[corner.texcoord * 2];
+					vertex.uv0[1] = 1.0f - texcoords[corner.texcoord * 2 + 1];
+				}
+				if (corner.normal != ObjMissing)
+					memcpy(vertex.normal, &normals[corner.normal * 3], sizeof(float) * 3);
+				submesh.vertices.push_back(vertex);
+			}
+			submesh.indices.push_back(ite->second);
+		}
+
+		ComputeMissingNormals(submesh);
+		if (settings.leftHanded)
+			ConvertToLeftHanded(submesh);
+	});
+
+	std::vector<MeshData> meshes;
+	meshes.push_back(BuildMeshData(std::filesystem::path(path).stem().string(), std::move(submeshes)));
+	return meshes;
+}
+
+std::vector<MeshData> MeshImporter::ImportGltf(const std::string& path, const MeshImportSettings& settings)
+{
+	MeshFile::MappedFile file(path);
+	const std::byte* data = file.GetData();
+	const size_t size = file.GetSize();
+
+	//glb: header, json chunk, optional bin chunk
+	std::string_view jsonText;
+	std::pair<const std::byte*, size_t> glbBinary = { nullptr, 0 };
+	if (size >= 12 && memcmp(data, "glTF", 4) == 0)
+	{
+		uint32_t version, length;
+		memcpy(&version, data + 4, 4);
+		memcpy(&length, data + 8, 4);
+		if (version != 2 || length > size)
+			throw std::runtime_error(std::format("glb {}: invalid header", path));
+
+		size_t offset = 12;
+		while (offset + 8 <= length)
+		{
+			uint32_t chunkLength, chunkType;
+			memcpy(&chunkLength, data + offset, 4);
+			memcpy(&chunkType, data + offset + 4, 4);
+			offset += 8;
+			if (offset + chunkLength > length)
+				throw std::runtime_error(std::format("glb {}: chunk out of range", path));
+
+			if (chunkType == 0x4E4F534A)//JSON
+				jsonText = std::string_view(reinterpret_cast<const char*>(data + offset), chunkLength);
+			else if (chunkType == 0x004E4942 && glbBinary.first == nullptr)//BIN
+				glbBinary = { data + offset, chunkLength };
+			offset += (chunkLength + 3) & ~3u;
+		}
+	}
+	else
+	{
+		jsonText = std::string_view(reinterpret_cast<const char*>(data), size);
+	}
+
+	const JsonValue document = JsonValue::Parse(jsonText);
+
+	//buffers: glb binary, data uri or external file
+	GltfBuffers buffers;
+	const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+	for (const JsonValue& buffer : document["buffers"].GetArray())
+	{
+		const size_t byteLength = static_cast<size_t>(buffer["byteLength"].GetNumber());
+		if (!buffer.Has("uri"))
+		{
+			if (glbBinary.first == nullptr || glbBinary.second < byteLength)
+				throw std::runtime_error(std::format("glTF {}: missing binary chunk", path));
+			buffers.buffers.push_back(glbBinary);
+			continue;
+		}
+
+		const std::string& uri = buffer["uri"].GetString();
+		if (uri.rfind("data:", 0) == 0)
+		{
+			size_t comma = uri.find(";base64,");
+			if (comma == std::string::npos)
+				throw std::runtime_error(std::format("glTF {}: only base64 data uri is supported", path));
+			std::vector<std::byte>& decoded = buffers.decodedBuffers.emplace_back(DecodeBase64(std::string_view(uri).substr(comma + 8)));
+			buffers.buffers.push_back({ decoded.data(), decoded.size() });
+		}
+		else
+		{
+			auto& mapped = buffers.mappedFiles.emplace_back(std::make_unique<MeshFile::MappedFile>((directory / uri).string()));
+			buffers.buffers.push_back({ mapped->GetData(), mapped->GetSize() });
+		}
+
+		if (buffers.buffers.back().second < byteLength)
+			throw std::runtime_error(std::format("glTF {}: buffer smaller than byteLength", path));
+	}
+
+	//one job per mesh
+	const std::vector<JsonValue>& gltfMeshes = document["meshes"].GetArray();
+	std::vector<MeshData> meshes(gltfMeshes.size());
+	ParallelFor(gltfMeshes.size(), GetThreadCount(settings), [&](size_t meshIndex) {
+		const JsonValue& gltfMesh = gltfMeshes[meshIndex];
+		std::vector<SubmeshVertices> submeshes;
+		for (const JsonValue& primitive : gltfMesh["primitives"].GetArray())
+		{
+			//triangle list only
+			if (primitive["mode"].GetUint(4) != 4)
+				continue;
+
+			SubmeshVertices& submesh = submeshes.emplace_back();
+			ReadGltfPrimitive(document, buffers, primitive, submesh.vertices, submesh.indices);
+			DeduplicateVertices(submesh);
+			ComputeMissingNormals(submesh);
+			if (settings.leftHanded)
+				ConvertToLeftHanded(submesh);
+		}
+
+		std::string name = gltfMesh["name"].IsString() ? gltfMesh["name"].GetString() : std::format("mesh{}", meshIndex);
+		meshes[meshIndex] = BuildMeshData(std::move(name), std::move(submeshes));
+	});
+
+	return meshes;
+}
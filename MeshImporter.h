@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+
+struct MeshImportSettings
+{
+	//obj and glTF are right handed, mirror z and flip winding to match our left handed clockwise front face
+	bool leftHanded = true;
+	//0: std::thread::hardware_concurrency
+	uint32_t threadCount = 0;
+};
+
+//Import .obj, .gltf, .glb into Vertex (FormatMesh layout) streams
+//obj: one mesh, one submesh per usemtl, file is mapped and parsed in chunks on every thread
+//glTF: one mesh per glTF mesh, one submesh per triangle primitive, each mesh is a job
+//node transform, material, skin and morph target are ignored
+class MeshImporter
+{
+public:
+	static std::vector<MeshData> Import(const std::string& path, const MeshImportSettings& settings = {});
+	//Concat submeshes of every mesh, BaseVertexLocation and StartIndexLocation are offset
+	static MeshData Merge(std::vector<MeshData>&& meshes);
+
+private:
+	struct SubmeshVertices
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	static std::vector<MeshData> ImportObj(const std::string& path, const MeshImportSettings& settings);
+	static std::vector<MeshData> ImportGltf(const std::string& path, const MeshImportSettings& settings);
+
+	//Each submesh get its own vertex range, so 16 bit index work while a submesh has less than 65536 vertices
+	static MeshData BuildMeshData(std::string name, std::vector<SubmeshVertices>&& submeshes);
+	static void DeduplicateVertices(SubmeshVertices& submesh);
+	//Area weighted normal for vertex whose normal is zero
+	static void ComputeMissingNormals(SubmeshVertices& submesh);
+	static void ConvertToLeftHanded(SubmeshVertices& submesh);
+	static uint32_t GetThreadCount(const MeshImportSettings& settings);
+	//job(0..count-1) on at most threadCount threads, the first exception is rethrown after every thread joined
+	static void ParallelFor(size_t count, uint32_t threadCount, const std::function<void(size_t)>& job);
+};
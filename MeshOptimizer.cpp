@@ -0,0 +1,876 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <cfloat>
+#include <array>
+#include <unordered_map>
+
+namespace
+{
+	//FIFO cache with timestamp, vertex is in cache if it was inserted in the last cacheSize insertions
+	class FifoCache
+	{
+	public:
+		FifoCache(uint32_t entryCount, uint32_t cacheSize)
+			: mTimestamps(entryCount, 0), mCacheSize(cacheSize), mTimestamp(cacheSize + 1)
+		{ }
+
+		//return true if miss
+		bool Access(uint32_t entry)
+		{
+			if (mTimestamp - mTimestamps[entry] > mCacheSize)
+			{
+				mTimestamps[entry] = mTimestamp++;
+				return true;
+			}
+			return false;
+		}
+
+		bool Contains(uint32_t entry) const { return mTimestamp - mTimestamps[entry] <= mCacheSize; }
+		uint32_t Age(uint32_t entry) const { return mTimestamp - mTimestamps[entry]; }
+
+		void Flush() { mTimestamp += mCacheSize + 1; }
+
+	private:
+		std::vector<uint32_t> mTimestamps;
+		uint32_t mCacheSize;
+		uint32_t mTimestamp;
+	};
+
+	//Symmetric 4x4 plane quadric, weight is sum of triangle area
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0, c = 0;
+		double weight = 0;
+
+		static Quadric FromPlane(double x, double y, double z, double d, double weight)
+		{
+			Quadric q;
+			q.a00 = weight * x * x; q.a01 = weight * x * y; q.a02 = weight * x * z;
+			q.a11 = weight * y * y; q.a12 = weight * y * z; q.a22 = weight * z * z;
+			q.b0 = weight * x * d; q.b1 = weight * y * d; q.b2 = weight * z * d;
+			q.c = weight * d * d;
+			q.weight = weight;
+			return q;
+		}
+
+		Quadric& operator+=(const Quadric& rhs)
+		{
+			a00 += rhs.a00; a01 += rhs.a01; a02 += rhs.a02; a11 += rhs.a11; a12 += rhs.a12; a22 += rhs.a22;
+			b0 += rhs.b0; b1 += rhs.b1; b2 += rhs.b2; c += rhs.c;
+			weight += rhs.weight;
+			return *this;
+		}
+
+		//weighted sum of squared distance to planes
+		double Error(const float* p) const
+		{
+			double x = p[0], y = p[1], z = p[2];
+			double error = a00 * x * x + a11 * y * y + a22 * z * z
+				+ 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2 * (b0 * x + b1 * y + b2 * z) + c;
+			return std::max(error, 0.0);
+		}
+	};
+
+	void TriangleNormal(const float* p0, const float* p1, const float* p2, float normal[3])
+	{
+		float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+}
+
+MeshOptimizeStats MeshOptimizer::Analyze(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t vertexStride, uint32_t cacheSize)
+{
+	MeshOptimizeStats stats;
+	if (indexCount < 3 || vertexCount == 0)
+		return stats;
+
+	FifoCache vertexCache(vertexCount, cacheSize);
+	std::vector<bool> used(vertexCount, false);
+	uint32_t uniqueCount = 0;
+	uint32_t misses = 0;
+
+	//vertex fetch cache, fetch happen on post transform cache miss
+	const uint64_t lineCount = vertexStride == 0 ? 0 : (static_cast<uint64_t>(vertexCount) * vertexStride + DefaultFetchCacheLineSize - 1) / DefaultFetchCacheLineSize;
+	FifoCache fetchCache(static_cast<uint32_t>(lineCount), 64);
+	uint64_t fetchedBytes = 0;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		uint32_t vertex = indices[i];
+		assert(vertex < vertexCount);
+
+		if (!used[vertex])
+		{
+			used[vertex] = true;
+			++uniqueCount;
+		}
+
+		if (!vertexCache.Access(vertex))
+			continue;
+
+		++misses;
+
+		if (vertexStride != 0)
+		{
+			uint64_t beginLine = static_cast<uint64_t>(vertex) * vertexStride / DefaultFetchCacheLineSize;
+			uint64_t endLine = (static_cast<uint64_t>(vertex + 1) * vertexStride - 1) / DefaultFetchCacheLineSize;
+			for (uint64_t line = beginLine; line <= endLine; ++line)
+			{
+				if (fetchCache.Access(static_cast<uint32_t>(line)))
+					fetchedBytes += DefaultFetchCacheLineSize;
+			}
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+	stats.atvr = uniqueCount == 0 ? 0.0f : static_cast<float>(misses) / static_cast<float>(uniqueCount);
+	stats.overfetch = (vertexStride == 0 || uniqueCount == 0) ? 0.0f
+		: static_cast<float>(fetchedBytes) / static_cast<float>(static_cast<uint64_t>(uniqueCount) * vertexStride);
+
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+{
+	assert(destination != indices);
+	const size_t faceCount = indexCount / 3;
+	if (faceCount == 0 || vertexCount == 0)
+		return;
+
+	//vertex -> triangle adjacency
+	std::vector<uint32_t> liveCount(vertexCount, 0);
+	for (size_t i = 0; i < faceCount * 3; ++i)
+		++liveCount[indices[i]];
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	std::partial_sum(liveCount.begin(), liveCount.end(), adjacencyOffsets.begin() + 1);
+
+	std::vector<uint32_t> adjacency(faceCount * 3);
+	{
+		std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t face = 0; face < faceCount; ++face)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+				adjacency[fillOffsets[indices[face * 3 + corner]]++] = face;
+		}
+	}
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> emitted(faceCount, false);
+	std::vector<uint32_t> deadEndStack;
+	deadEndStack.reserve(faceCount * 3);
+
+	uint32_t fanningVertex = indices[0];
+	uint32_t inputCursor = 0;
+	size_t outputFace = 0;
+
+	while (fanningVertex != ~0u)
+	{
+		//emit all live triangle of fanning vertex, new vertices are next candidates
+		const size_t candidateBegin = deadEndStack.size();
+		for (uint32_t adjacencyIndex = adjacencyOffsets[fanningVertex]; adjacencyIndex < adjacencyOffsets[fanningVertex + 1]; ++adjacencyIndex)
+		{
+			uint32_t face = adjacency[adjacencyIndex];
+			if (emitted[face])
+				continue;
+
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				uint32_t vertex = indices[face * 3 + corner];
+				destination[outputFace * 3 + corner] = vertex;
+				deadEndStack.push_back(vertex);
+				--liveCount[vertex];
+				cache.Access(vertex);
+			}
+
+			emitted[face] = true;
+			++outputFace;
+		}
+
+		//next fanning vertex: the oldest candidate that still in cache after emit all its triangles
+		uint32_t nextVertex = ~0u;
+		int bestPriority = -1;
+		for (size_t candidateIndex = candidateBegin; candidateIndex < deadEndStack.size(); ++candidateIndex)
+		{
+			uint32_t vertex = deadEndStack[candidateIndex];
+			if (liveCount[vertex] == 0)
+				continue;
+
+			int priority = 0;
+			if (cache.Age(vertex) + 2 * liveCount[vertex] <= cacheSize)
+				priority = static_cast<int>(cache.Age(vertex));
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				nextVertex = vertex;
+			}
+		}
+
+		//dead end, recent vertex first, then scan input order
+		if (nextVertex == ~0u)
+		{
+			while (!deadEndStack.empty())
+			{
+				uint32_t vertex = deadEndStack.back();
+				deadEndStack.pop_back();
+				if (liveCount[vertex] > 0)
+				{
+					nextVertex = vertex;
+					break;
+				}
+			}
+
+			while (nextVertex == ~0u && inputCursor < vertexCount)
+			{
+				if (liveCount[inputCursor] > 0)
+					nextVertex = inputCursor;
+				++inputCursor;
+			}
+		}
+
+		fanningVertex = nextVertex;
+	}
+
+	assert(outputFace == faceCount);
+}
+
+std::vector<uint32_t> MeshOptimizer::GenerateClusters(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize, float threshold)
+{
+	const size_t faceCount = indexCount / 3;
+	std::vector<uint32_t> clusters;
+	if (faceCount == 0)
+		return clusters;
+
+	//hard boundary, all vertex of triangle miss means cache is already cold there
+	std::vector<uint32_t> hardBoundaries;
+	{
+		FifoCache cache(vertexCount, cacheSize);
+		for (uint32_t face = 0; face < faceCount; ++face)
+		{
+			uint32_t misses = 0;
+			for (uint32_t corner = 0; corner < 3; ++corner)
+				misses += cache.Access(indices[face * 3 + corner]) ? 1 : 0;
+
+			if (face == 0 || misses == 3)
+				hardBoundaries.push_back(face);
+		}
+	}
+	hardBoundaries.push_back(static_cast<uint32_t>(faceCount));
+
+	const float meshAcmr = Analyze(indices, indexCount, vertexCount, 0, cacheSize).acmr;
+
+	//soft boundary, split when cluster start cold is already good enough
+	FifoCache cache(vertexCount, cacheSize);
+	for (size_t hardIndex = 0; hardIndex + 1 < hardBoundaries.size(); ++hardIndex)
+	{
+		const uint32_t hardBegin = hardBoundaries[hardIndex];
+		const uint32_t hardEnd = hardBoundaries[hardIndex + 1];
+
+		cache.Flush();
+		clusters.push_back(hardBegin);
+
+		uint32_t clusterMisses = 0;
+		uint32_t clusterFaces = 0;
+		for (uint32_t face = hardBegin; face < hardEnd; ++face)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+				clusterMisses += cache.Access(indices[face * 3 + corner]) ? 1 : 0;
+			++clusterFaces;
+
+			if (threshold > 0.0f && face + 1 < hardEnd
+				&& static_cast<float>(clusterMisses) <= threshold * meshAcmr * static_cast<float>(clusterFaces))
+			{
+				cache.Flush();
+				clusters.push_back(face + 1);
+				clusterMisses = 0;
+				clusterFaces = 0;
+			}
+		}
+	}
+
+	return clusters;
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+	const float* positions, size_t positionStride, uint32_t vertexCount, uint32_t cacheSize, float threshold)
+{
+	assert(destination != indices);
+	const size_t faceCount = indexCount / 3;
+	if (faceCount == 0 || vertexCount == 0)
+		return;
+
+	auto Position = [positions, positionStride](uint32_t vertex) {
+		return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + positionStride * vertex);
+	};
+
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		const float* position = Position(vertex);
+		for (int axis = 0; axis < 3; ++axis)
+			meshCentroid[axis] += position[axis];
+	}
+	for (int axis = 0; axis < 3; ++axis)
+		meshCentroid[axis] /= static_cast<float>(vertexCount);
+
+	std::vector<uint32_t> clusters = GenerateClusters(indices, indexCount, vertexCount, cacheSize, threshold);
+	clusters.push_back(static_cast<uint32_t>(faceCount));
+
+	//sort key: area weight centroid of cluster project on its average normal
+	const size_t clusterCount = clusters.size() - 1;
+	std::vector<float> sortKeys(clusterCount, 0.0f);
+	for (size_t clusterIndex = 0; clusterIndex < clusterCount; ++clusterIndex)
+	{
+		float centroid[3] = { 0.0f, 0.0f, 0.0f };
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+		float areaSum = 0.0f;
+
+		for (uint32_t face = clusters[clusterIndex]; face < clusters[clusterIndex + 1]; ++face)
+		{
+			const float* p0 = Position(indices[face * 3 + 0]);
+			const float* p1 = Position(indices[face * 3 + 1]);
+			const float* p2 = Position(indices[face * 3 + 2]);
+
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float faceNormal[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+			float area = std::sqrt(faceNormal[0] * faceNormal[0] + faceNormal[1] * faceNormal[1] + faceNormal[2] * faceNormal[2]);
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				centroid[axis] += area * (p0[axis] + p1[axis] + p2[axis]) / 3.0f;
+				normal[axis] += faceNormal[axis];
+			}
+			areaSum += area;
+		}
+
+		if (areaSum <= 0.0f)
+			continue;
+
+		float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (normalLength <= 0.0f)
+			continue;
+
+		float key = 0.0f;
+		for (int axis = 0; axis < 3; ++axis)
+			key += (centroid[axis] / areaSum - meshCentroid[axis]) * (normal[axis] / normalLength);
+		sortKeys[clusterIndex] = key;
+	}
+
+	std::vector<uint32_t> clusterOrder(clusterCount);
+	std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&sortKeys](uint32_t lhs, uint32_t rhs) {
+		return sortKeys[lhs] > sortKeys[rhs];
+	});
+
+	size_t outputIndex = 0;
+	for (uint32_t clusterIndex : clusterOrder)
+	{
+		size_t beginIndex = static_cast<size_t>(clusters[clusterIndex]) * 3;
+		size_t endIndex = static_cast<size_t>(clusters[clusterIndex + 1]) * 3;
+		std::copy(indices + beginIndex, indices + endIndex, destination + outputIndex);
+		outputIndex += endIndex - beginIndex;
+	}
+}
+
+uint32_t MeshOptimizer::GenerateVertexFetchRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, uint32_t vertexCount)
+{
+	std::fill(remap, remap + vertexCount, ~0u);
+
+	uint32_t nextVertex = 0;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		uint32_t vertex = indices[i];
+		if (remap[vertex] == ~0u)
+			remap[vertex] = nextVertex++;
+	}
+
+	const uint32_t usedCount = nextVertex;
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		if (remap[vertex] == ~0u)
+			remap[vertex] = nextVertex++;
+	}
+
+	return usedCount;
+}
+
+void MeshOptimizer::RemapIndices(uint32_t* destination, const uint32_t* indices, size_t indexCount, const uint32_t* remap)
+{
+	for (size_t i = 0; i < indexCount; ++i)
+		destination[i] = remap[indices[i]];
+}
+
+void MeshOptimizer::RemapVertices(void* destination, const void* vertices, uint32_t vertexCount, size_t vertexStride, const uint32_t* remap)
+{
+	assert(destination != vertices);
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		memcpy(static_cast<uint8_t*>(destination) + remap[vertex] * vertexStride,
+			static_cast<const uint8_t*>(vertices) + vertex * vertexStride, vertexStride);
+	}
+}
+
+size_t MeshOptimizer::BuildMeshlets(std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint8_t>& meshletTriangles,
+	const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t maxVertices, uint32_t maxTriangles)
+{
+	assert(maxVertices >= 3 && maxVertices <= 256);
+	assert(maxTriangles >= 1);
+
+	const size_t firstMeshlet = meshlets.size();
+
+	//local index of vertex in current meshlet, 0xFFFF means not in it
+	//wider than meshletTriangles so local index 255 of a 256 vertex meshlet is not the marker
+	std::vector<uint16_t> localIndices(vertexCount, 0xFFFF);
+	Meshlet meshlet = { static_cast<uint32_t>(meshletVertices.size()), static_cast<uint32_t>(meshletTriangles.size() / 3), 0, 0 };
+
+	auto FinishMeshlet = [&]() {
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			localIndices[meshletVertices[meshlet.vertexOffset + i]] = 0xFFFF;
+
+		meshlets.push_back(meshlet);
+		meshlet = { static_cast<uint32_t>(meshletVertices.size()), static_cast<uint32_t>(meshletTriangles.size() / 3), 0, 0 };
+	};
+
+	for (size_t face = 0; face < indexCount / 3; ++face)
+	{
+		const uint32_t* triangle = indices + face * 3;
+
+		uint32_t newVertices = 0;
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			//degenerate triangle may reference a vertex twice
+			bool duplicate = (corner > 0 && triangle[corner] == triangle[0]) || (corner > 1 && triangle[corner] == triangle[1]);
+			newVertices += (localIndices[triangle[corner]] == 0xFFFF && !duplicate) ? 1 : 0;
+		}
+
+		if (meshlet.vertexCount + newVertices > maxVertices || meshlet.triangleCount + 1 > maxTriangles)
+			FinishMeshlet();
+
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			uint16_t& local = localIndices[triangle[corner]];
+			if (local == 0xFFFF)
+			{
+				local = static_cast<uint16_t>(meshlet.vertexCount++);
+				meshletVertices.push_back(triangle[corner]);
+			}
+			meshletTriangles.push_back(static_cast<uint8_t>(local));
+		}
+		++meshlet.triangleCount;
+	}
+
+	if (meshlet.triangleCount > 0)
+		FinishMeshlet();
+
+	return meshlets.size() - firstMeshlet;
+}
+
+MeshletBounds MeshOptimizer::ComputeMeshletBounds(const Meshlet& meshlet, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+	const float* positions, size_t positionStride)
+{
+	auto Position = [positions, positionStride](uint32_t vertex) {
+		return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + positionStride * vertex);
+	};
+
+	MeshletBounds bounds = {};
+
+	//sphere around bounding box center
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+	{
+		const float* position = Position(meshletVertices[meshlet.vertexOffset + i]);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			boundsMin[axis] = std::min(boundsMin[axis], position[axis]);
+			boundsMax[axis] = std::max(boundsMax[axis], position[axis]);
+		}
+	}
+	for (int axis = 0; axis < 3; ++axis)
+		bounds.center[axis] = (boundsMin[axis] + boundsMax[axis]) * 0.5f;
+
+	float radiusSquare = 0.0f;
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+	{
+		const float* position = Position(meshletVertices[meshlet.vertexOffset + i]);
+		float distanceSquare = 0.0f;
+		for (int axis = 0; axis < 3; ++axis)
+			distanceSquare += (position[axis] - bounds.center[axis]) * (position[axis] - bounds.center[axis]);
+		radiusSquare = std::max(radiusSquare, distanceSquare);
+	}
+	bounds.radius = std::sqrt(radiusSquare);
+
+	//normal cone, axis is average of triangle normal
+	std::vector<float> normals;
+	normals.reserve(meshlet.triangleCount * 3);
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t face = 0; face < meshlet.triangleCount; ++face)
+	{
+		const uint8_t* triangle = meshletTriangles + (meshlet.triangleOffset + face) * 3;
+		const float* p0 = Position(meshletVertices[meshlet.vertexOffset + triangle[0]]);
+		const float* p1 = Position(meshletVertices[meshlet.vertexOffset + triangle[1]]);
+		const float* p2 = Position(meshletVertices[meshlet.vertexOffset + triangle[2]]);
+
+		float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		float normal[3] = {
+			e1[1] * e2[2] - e1[2] * e2[1],
+			e1[2] * e2[0] - e1[0] * e2[2],
+			e1[0] * e2[1] - e1[1] * e2[0]
+		};
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length <= 0.0f)
+			continue;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			normals.push_back(normal[i] / length);
+			axis[i] += normal[i] / length;
+		}
+	}
+
+	bounds.coneCutoff = 1.0f;
+	float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (axisLength <= 0.0f)
+		return bounds;
+
+	float minDot = 1.0f;
+	for (int i = 0; i < 3; ++i)
+		bounds.coneAxis[i] = axis[i] / axisLength;
+	for (size_t i = 0; i < normals.size(); i += 3)
+		minDot = std::min(minDot, normals[i] * bounds.coneAxis[0] + normals[i + 1] * bounds.coneAxis[1] + normals[i + 2] * bounds.coneAxis[2]);
+
+	//cone wider than about 84 degrees can hardly be culled
+	if (minDot > 0.1f)
+		bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+
+	return bounds;
+}
+
+size_t MeshOptimizer::Simplify(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+	const float* positions, size_t positionStride, uint32_t vertexCount,
+	const float* attributes, size_t attributeStride, const float* attributeWeights, uint32_t attributeCount,
+	size_t targetIndexCount, float targetError, float* resultError)
+{
+	auto Position = [positions, positionStride](uint32_t vertex) {
+		return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + positionStride * vertex);
+	};
+	auto Attribute = [attributes, attributeStride](uint32_t vertex) {
+		return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(attributes) + attributeStride * vertex);
+	};
+
+	std::vector<uint32_t> result(indices, indices + indexCount - indexCount % 3);
+	if (resultError)
+		*resultError = 0.0f;
+
+	if (result.size() <= targetIndexCount)
+	{
+		std::copy(result.begin(), result.end(), destination);
+		return result.size();
+	}
+
+	//vertices sharing one position: a pair is a seam and collapses together along it,
+	//three or more meet at an attribute corner and are locked
+	std::vector<bool> locked(vertexCount, false);
+	std::vector<uint32_t> twins(vertexCount, UINT32_MAX);
+	//first vertex of the position
+	std::vector<uint32_t> positionIds(vertexCount);
+	{
+		struct PositionHash
+		{
+			size_t operator()(const std::array<float, 3>& p) const
+			{
+				uint32_t bits[3];
+				memcpy(bits, p.data(), sizeof(bits));
+				return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+			}
+		};
+		std::unordered_map<std::array<float, 3>, uint32_t, PositionHash> firstVertex;
+		std::vector<uint32_t> positionVertexCounts(vertexCount, 0);
+		for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			const float* p = Position(vertex);
+			auto [ite, inserted] = firstVertex.try_emplace({ p[0], p[1], p[2] }, vertex);
+			positionIds[vertex] = ite->second;
+			++positionVertexCounts[ite->second];
+		}
+		for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			const uint32_t first = positionIds[vertex];
+			if (positionVertexCounts[first] > 2)
+				locked[vertex] = true;
+			else if (positionVertexCounts[first] == 2 && vertex != first)
+			{
+				twins[vertex] = first;
+				twins[first] = vertex;
+			}
+		}
+	}
+
+	//lock boundary vertex, edge used by one triangle; edges are compared by position so a seam is not a boundary
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(result.size());
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				uint32_t a = positionIds[result[i + corner]];
+				uint32_t b = positionIds[result[i + (corner + 1) % 3]];
+				if (a != b)
+					edges.push_back((static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		std::vector<bool> boundary(vertexCount, false);
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t j = i + 1;
+			while (j < edges.size() && edges[j] == edges[i])
+				++j;
+			if (j - i == 1)
+			{
+				boundary[static_cast<uint32_t>(edges[i] >> 32)] = true;
+				boundary[static_cast<uint32_t>(edges[i])] = true;
+			}
+			i = j;
+		}
+		for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			if (boundary[positionIds[vertex]])
+				locked[vertex] = true;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		float normal[3];
+		TriangleNormal(Position(result[i]), Position(result[i + 1]), Position(result[i + 2]), normal);
+		double length = std::sqrt(double(normal[0]) * normal[0] + double(normal[1]) * normal[1] + double(normal[2]) * normal[2]);
+		if (length <= 0.0)
+			continue;
+
+		double x = normal[0] / length, y = normal[1] / length, z = normal[2] / length;
+		const float* p0 = Position(result[i]);
+		double d = -(x * p0[0] + y * p0[1] + z * p0[2]);
+		Quadric quadric = Quadric::FromPlane(x, y, z, d, length * 0.5);
+		for (int corner = 0; corner < 3; ++corner)
+			quadrics[result[i + corner]] += quadric;
+	}
+
+	//squared plane distance in position unit
+	auto PositionCost = [&](const Quadric& quadric, uint32_t to) {
+		return quadric.weight > 0.0 ? quadric.Error(Position(to)) / quadric.weight : 0.0;
+	};
+	auto AttributeCost = [&](uint32_t from, uint32_t to) {
+		double cost = 0.0;
+		for (uint32_t k = 0; k < attributeCount; ++k)
+		{
+			double difference = Attribute(from)[k] - Attribute(to)[k];
+			cost += attributeWeights[k] * difference * difference;
+		}
+		return cost;
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		//position and attribute cost, order and limit collapses
+		double cost;
+		//position part alone, reported as the error
+		double positionCost;
+		//other side of a seam, collapsed with from and to
+		uint32_t fromTwin;
+		uint32_t toTwin;
+	};
+
+	const double errorLimit = static_cast<double>(targetError) * targetError;
+	double maxPositionCost = 0.0;
+
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+
+	auto EdgeExists = [&](uint32_t a, uint32_t b) {
+		for (uint32_t adjacencyIndex = adjacencyOffsets[a]; adjacencyIndex < adjacencyOffsets[a + 1]; ++adjacencyIndex)
+		{
+			const uint32_t* triangle = result.data() + adjacency[adjacencyIndex] * 3;
+			if (triangle[0] == b || triangle[1] == b || triangle[2] == b)
+				return true;
+		}
+		return false;
+	};
+
+	//cost is DBL_MAX when from can't move to to
+	auto MakeCollapse = [&](uint32_t from, uint32_t to) {
+		Collapse collapse = { from, to, DBL_MAX, DBL_MAX, UINT32_MAX, UINT32_MAX };
+		if (locked[from])
+			return collapse;
+
+		Quadric quadric = quadrics[from];
+		quadric += quadrics[to];
+		double attributeCost = AttributeCost(from, to);
+		if (twins[from] != UINT32_MAX)
+		{
+			//seam vertex only slides along the seam, its twin takes the same edge on the other side
+			if (twins[to] == UINT32_MAX || twins[from] == to || !EdgeExists(twins[from], twins[to]))
+				return collapse;
+			collapse.fromTwin = twins[from];
+			collapse.toTwin = twins[to];
+			quadric += quadrics[collapse.fromTwin];
+			quadric += quadrics[collapse.toTwin];
+			attributeCost += AttributeCost(collapse.fromTwin, collapse.toTwin);
+		}
+
+		collapse.positionCost = PositionCost(quadric, to);
+		collapse.cost = collapse.positionCost + attributeCost;
+		return collapse;
+	};
+
+	//count triangles around from removed by the collapse, true if one of the others flips
+	auto Flips = [&](uint32_t from, uint32_t to, size_t& removed) {
+		for (uint32_t adjacencyIndex = adjacencyOffsets[from]; adjacencyIndex < adjacencyOffsets[from + 1]; ++adjacencyIndex)
+		{
+			const uint32_t* triangle = result.data() + adjacency[adjacencyIndex] * 3;
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			{
+				++removed;
+				continue;
+			}
+
+			const float* before[3] = { Position(triangle[0]), Position(triangle[1]), Position(triangle[2]) };
+			const float* after[3] = { before[0], before[1], before[2] };
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				if (triangle[corner] == from)
+					after[corner] = Position(to);
+			}
+
+			float normalBefore[3], normalAfter[3];
+			TriangleNormal(before[0], before[1], before[2], normalBefore);
+			TriangleNormal(after[0], after[1], after[2], normalAfter);
+			if (normalBefore[0] * normalAfter[0] + normalBefore[1] * normalAfter[1] + normalBefore[2] * normalAfter[2] <= 0.0f)
+				return true;
+		}
+		return false;
+	};
+
+	auto Apply = [&](uint32_t from, uint32_t to) {
+		remap[from] = to;
+		quadrics[to] += quadrics[from];
+		for (uint32_t adjacencyIndex = adjacencyOffsets[from]; adjacencyIndex < adjacencyOffsets[from + 1]; ++adjacencyIndex)
+		{
+			const uint32_t* triangle = result.data() + adjacency[adjacencyIndex] * 3;
+			for (int corner = 0; corner < 3; ++corner)
+				touched[triangle[corner]] = true;
+		}
+	};
+
+	while (result.size() > targetIndexCount)
+	{
+		//vertex -> triangle adjacency of current result
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index : result)
+			++adjacencyOffsets[index + 1];
+		std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < result.size(); ++i)
+				adjacency[fillOffsets[result[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		//cheaper direction of every edge
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				uint32_t a = result[i + corner];
+				uint32_t b = result[i + (corner + 1) % 3];
+				//each interior edge is seen twice, keep one; a seam edge is seen once and kept, touched skips a duplicate
+				if (a > b && (twins[a] == UINT32_MAX || twins[b] == UINT32_MAX))
+					continue;
+
+				Collapse ab = MakeCollapse(a, b);
+				Collapse ba = MakeCollapse(b, a);
+				if (ab.cost == DBL_MAX && ba.cost == DBL_MAX)
+					continue;
+				collapses.push_back(ab.cost <= ba.cost ? ab : ba);
+			}
+		}
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+		std::iota(remap.begin(), remap.end(), 0);
+		std::fill(touched.begin(), touched.end(), false);
+		size_t triangleCount = result.size() / 3;
+		size_t collapseCount = 0;
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (triangleCount * 3 <= targetIndexCount || collapse.cost > errorLimit)
+				break;
+			const bool seam = collapse.fromTwin != UINT32_MAX;
+			if (touched[collapse.from] || touched[collapse.to] || (seam && (touched[collapse.fromTwin] || touched[collapse.toTwin])))
+				continue;
+
+			//reject collapse flipping a triangle around from
+			size_t removed = 0;
+			if (Flips(collapse.from, collapse.to, removed) || (seam && Flips(collapse.fromTwin, collapse.toTwin, removed)))
+				continue;
+
+			Apply(collapse.from, collapse.to);
+			if (seam)
+				Apply(collapse.fromTwin, collapse.toTwin);
+
+			triangleCount -= removed;
+			maxPositionCost = std::max(maxPositionCost, collapse.positionCost);
+			++collapseCount;
+		}
+
+		if (collapseCount == 0)
+			break;
+
+		//apply remap and remove degenerate triangle
+		size_t writeIndex = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			result[writeIndex++] = a;
+			result[writeIndex++] = b;
+			result[writeIndex++] = c;
+		}
+		result.resize(writeIndex);
+	}
+
+	if (resultError)
+		*resultError = static_cast<float>(std::sqrt(maxPositionCost));
+
+	std::copy(result.begin(), result.end(), destination);
+	return result.size();
+}
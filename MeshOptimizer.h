@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+//post transform vertex cache statistics
+//acmr: cache miss per triangle, best 0.5, worst 3
+//atvr: cache miss per vertex, best 1
+//overfetch: fetched bytes / used vertex bytes, best 1
+struct MeshOptimizeStats
+{
+	float acmr = 0.0f;
+	float atvr = 0.0f;
+	float overfetch = 0.0f;
+};
+
+//Cluster of at most MaxMeshletVertices vertex and MaxMeshletTriangles triangle
+//vertex is index to meshletVertices, triangle is 3 uint8 local vertex index in meshletTriangles
+struct Meshlet
+{
+	uint32_t vertexOffset;
+	uint32_t triangleOffset;//in triangles, byte offset is triangleOffset * 3
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+//Bounding sphere and backface cone, cull when
+//dot(center - cameraPosition, coneAxis) >= coneCutoff * length(center - cameraPosition) + radius
+struct MeshletBounds
+{
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float coneCutoff;//sin of cone spread, 1 never cull
+};
+
+//CPU index / vertex processing, operate on uint32 index, no device dependence
+//index must be less than vertexCount
+class MeshOptimizer
+{
+public:
+	static constexpr uint32_t DefaultCacheSize = 16;
+	static constexpr uint32_t DefaultFetchCacheLineSize = 64;
+	static constexpr uint32_t MaxMeshletVertices = 64;
+	static constexpr uint32_t MaxMeshletTriangles = 124;
+
+	//FIFO cache simulation, vertexStride only used for overfetch, 0 skip it
+	static MeshOptimizeStats Analyze(const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+		uint32_t vertexStride = 0, uint32_t cacheSize = DefaultCacheSize);
+
+	//Tipsify (Sander 2007), linear time vertex cache optimization
+	static void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+		uint32_t cacheSize = DefaultCacheSize);
+
+	//Reorder clusters of vertex cache optimized index outside in (Sander 2007 fast triangle reorder),
+	//cluster face outward draw first so it occludes the inner one
+	//hard boundary: triangle all vertex miss cache, soft boundary: cluster acmr <= threshold * mesh acmr
+	//positions: float3, positionStride in bytes, front face normal = cross(p1 - p0, p2 - p0)
+	//threshold: allow acmr grow, 1.05 means 5% worse cache hit
+	static void OptimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+		const float* positions, size_t positionStride, uint32_t vertexCount,
+		uint32_t cacheSize = DefaultCacheSize, float threshold = 1.05f);
+
+	//Vertex order by first use in index, unused vertex move to the end
+	//remap[oldIndex] = newIndex, return used vertex count
+	static uint32_t GenerateVertexFetchRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, uint32_t vertexCount);
+
+	static void RemapIndices(uint32_t* destination, const uint32_t* indices, size_t indexCount, const uint32_t* remap);
+
+	//destination must not alias vertices
+	static void RemapVertices(void* destination, const void* vertices, uint32_t vertexCount, size_t vertexStride, const uint32_t* remap);
+
+	//Greedy split in index order, optimize vertex cache first for better cluster
+	//meshletVertices store original vertex index, return meshlet count
+	static size_t BuildMeshlets(std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint8_t>& meshletTriangles,
+		const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+		uint32_t maxVertices = MaxMeshletVertices, uint32_t maxTriangles = MaxMeshletTriangles);
+
+	static MeshletBounds ComputeMeshletBounds(const Meshlet& meshlet, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+		const float* positions, size_t positionStride);
+
+	//Quadric error edge collapse (Garland 1997), collapse to existing vertex so result reuse the vertex buffer
+	//boundary vertex is locked; a seam vertex pair (same position, different vertex) only collapses along the seam,
+	//both sides together, three or more vertices on one position are locked
+	//attributes: attributeCount floats per vertex, cost += weight * squared attribute difference
+	//targetError limits the cost, attribute term included; resultError is the plane distance part alone,
+	//both are root mean square plane distance in position unit, return index count
+	static size_t Simplify(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+		const float* positions, size_t positionStride, uint32_t vertexCount,
+		const float* attributes, size_t attributeStride, const float* attributeWeights, uint32_t attributeCount,
+		size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+private:
+	//return start triangle of each cluster, first is always 0
+	static std::vector<uint32_t> GenerateClusters(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize, float threshold);
+};
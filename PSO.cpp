@@ -1,44 +1,218 @@
 #include "PSO.h"
+#include "PipelineLibrary.hpp"
 #include "dxUtil.hpp"
+#include "Profiler.h"
+
+#include <set>
+#include <format>
+#include <stdexcept>
 
 PSO::PSO(){}
 
-void PSO::Init(VkDevice device, const Shader& shader, const Mesh& mesh, const VkExtent2D& viewport2D, const VkRenderPass renderPass, uint32_t subPassIndex)
+void PSO::Init(VkDevice device, const Shader& shader, const Mesh& mesh, const VkRenderPass renderPass, uint32_t subPassIndex,
+	const RenderState& renderState, const SpecializationValues& specialization)
+{
+	Init(device, { &shader, &mesh, renderPass, subPassIndex, {}, renderState, specialization });
+}
+
+void PSO::Init(VkDevice device, const PSOKey& key, VkPipelineCache pipelineCache)
 {
+	PROFILE_FUNCTION();
+
 	mDevice = device;
+	mKey = key;
+	mLinked = false;
 
 	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	SetupPipeline(pipelineInfo, key);
+
+	ThrowIfFailed(vkCreateGraphicsPipelines(mDevice, pipelineCache, 1, &pipelineInfo, nullptr, &mGraphicsPipeline));
+}
+
+void PSO::InitLinked(VkDevice device, const PSOKey& key, PipelineLibrary& library, VkPipelineCache pipelineCache)
+{
+	PROFILE_FUNCTION();
+
+	mDevice = device;
+	mKey = key;
+	mLinked = true;
+
+	//same state as the monolithic pipeline, each part takes its own subset
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	SetupPipeline(pipelineInfo, key);
+	const uint64_t shaderHash = key.shader->GetSpirvHash();
+
+	std::vector<VkPipelineShaderStageCreateInfo> preRasterizationStages;
+	std::vector<VkPipelineShaderStageCreateInfo> fragmentStages;
+	for (uint32_t i = 0; i < pipelineInfo.stageCount; ++i)
+	{
+		if (pipelineInfo.pStages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT)
+			fragmentStages.push_back(pipelineInfo.pStages[i]);
+		else
+			preRasterizationStages.push_back(pipelineInfo.pStages[i]);
+	}
+
+	VkPipeline parts[static_cast<size_t>(PipelineLibrary::Part::Count)];
+
+	PipelineLibraryKey vertexInputKey;
+	for (const VkVertexInputBindingDescription& binding : mVertexInputBindings)
+		vertexInputKey.vertexInput.insert(vertexInputKey.vertexInput.end(), { binding.binding, binding.stride, static_cast<uint32_t>(binding.inputRate) });
+	for (const VkVertexInputAttributeDescription& attribute : mVertexAttributes)
+		vertexInputKey.vertexInput.insert(vertexInputKey.vertexInput.end(), { attribute.location, attribute.binding, static_cast<uint32_t>(attribute.format), attribute.offset });
+	parts[0] = library.Get(PipelineLibrary::Part::VertexInput, vertexInputKey, [&]() {
+		VkGraphicsPipelineCreateInfo partInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		partInfo.pVertexInputState = pipelineInfo.pVertexInputState;
+		partInfo.pInputAssemblyState = pipelineInfo.pInputAssemblyState;
+		return CreateLibraryPart(partInfo, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, pipelineCache);
+	});
+
+	//without render pass the parts after vertex input take VkPipelineRenderingCreateInfoKHR, view mask and formats
+	PipelineLibraryKey preRasterizationKey{ .shader = shaderHash, .renderPass = key.renderPass, .subpass = key.subpass,
+		.specialization = key.specialization };
+	parts[1] = library.Get(PipelineLibrary::Part::PreRasterization, preRasterizationKey, [&]() {
+		VkGraphicsPipelineCreateInfo partInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, pipelineInfo.pNext };
+		partInfo.stageCount = static_cast<uint32_t>(preRasterizationStages.size());
+		partInfo.pStages = preRasterizationStages.data();
+		partInfo.pViewportState = pipelineInfo.pViewportState;
+		partInfo.pRasterizationState = pipelineInfo.pRasterizationState;
+		partInfo.pDynamicState = pipelineInfo.pDynamicState;
+		partInfo.layout = pipelineInfo.layout;
+		partInfo.renderPass = pipelineInfo.renderPass;
+		partInfo.subpass = pipelineInfo.subpass;
+		return CreateLibraryPart(partInfo, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, pipelineCache);
+	});
+
+	//depth only shader has no fragment stage, the part still carries depth state
+	PipelineLibraryKey fragmentKey{ .shader = shaderHash, .renderPass = key.renderPass, .subpass = key.subpass,
+		.formats = { {}, key.formats.depthFormat }, .renderState = { key.renderState.depthCompareOp, key.renderState.depthWrite, 0 }, .specialization = key.specialization };
+	parts[2] = library.Get(PipelineLibrary::Part::FragmentShader, fragmentKey, [&]() {
+		VkGraphicsPipelineCreateInfo partInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, pipelineInfo.pNext };
+		partInfo.stageCount = static_cast<uint32_t>(fragmentStages.size());
+		partInfo.pStages = fragmentStages.data();
+		partInfo.pDepthStencilState = pipelineInfo.pDepthStencilState;
+		partInfo.pMultisampleState = pipelineInfo.pMultisampleState;
+		partInfo.layout = pipelineInfo.layout;
+		partInfo.renderPass = pipelineInfo.renderPass;
+		partInfo.subpass = pipelineInfo.subpass;
+		return CreateLibraryPart(partInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, pipelineCache);
+	});
+
+	PipelineLibraryKey fragmentOutputKey{ .renderPass = key.renderPass, .subpass = key.subpass, .formats = key.formats,
+		.renderState = { VK_COMPARE_OP_NEVER, false, key.renderState.colorAttachmentCount } };
+	parts[3] = library.Get(PipelineLibrary::Part::FragmentOutput, fragmentOutputKey, [&]() {
+		VkGraphicsPipelineCreateInfo partInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, pipelineInfo.pNext };
+		partInfo.pColorBlendState = pipelineInfo.pColorBlendState;
+		partInfo.pMultisampleState = pipelineInfo.pMultisampleState;
+		partInfo.renderPass = pipelineInfo.renderPass;
+		partInfo.subpass = pipelineInfo.subpass;
+		return CreateLibraryPart(partInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, pipelineCache);
+	});
+
+	//fast link, no link time optimization; the monolithic pipeline replaces it later
+	VkPipelineLibraryCreateInfoKHR linkInfo = { VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR };
+	linkInfo.libraryCount = _countof(parts);
+	linkInfo.pLibraries = parts;
+
+	VkGraphicsPipelineCreateInfo linkedInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	linkedInfo.pNext = &linkInfo;
+	linkedInfo.layout = pipelineInfo.layout;
+
+	PROFILE_SCOPE("PSO::Link");
+	ThrowIfFailed(vkCreateGraphicsPipelines(mDevice, pipelineCache, 1, &linkedInfo, nullptr, &mGraphicsPipeline));
+}
+
+void PSO::Clear()
+{
+	if (mGraphicsPipeline == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyPipeline(mDevice, mGraphicsPipeline, nullptr);
+	mGraphicsPipeline = VK_NULL_HANDLE;
+}
+
+void PSO::SetupPipeline(VkGraphicsPipelineCreateInfo& pipelineInfo, const PSOKey& key)
+{
+	const Shader& shader = *key.shader;
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 
-	SetupShaderStageAndPipelineLayout(pipelineInfo, shader);
-	SetupRenderPass(pipelineInfo, renderPass, subPassIndex);
+	SetupShaderStageAndPipelineLayout(pipelineInfo, shader, key.specialization);
+	SetupRenderPass(pipelineInfo, key.renderPass, key.subpass, key.formats);
 
-	SetupInputLayout(pipelineInfo, shader, mesh);
-	SetupViewport(pipelineInfo, viewport2D);
+	SetupInputLayout(pipelineInfo, shader, *key.mesh);
+	SetupViewport(pipelineInfo);
 	SetupRasterizerState(pipelineInfo);
 	SetupMultisamplingState(pipelineInfo);
-	SetupDepthStencilState(pipelineInfo);
-	SetupBlendState(pipelineInfo);
+	SetupDepthStencilState(pipelineInfo, key.renderState);
+	SetupBlendState(pipelineInfo, key.renderState);
 	SetupDynamicState(pipelineInfo);
-
-	ThrowIfFailed(vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mGraphicsPipeline));
 }
 
-void PSO::Clear()
+VkPipeline PSO::CreateLibraryPart(const VkGraphicsPipelineCreateInfo& partInfo, VkGraphicsPipelineLibraryFlagsEXT flags, VkPipelineCache pipelineCache) const
 {
-	vkDestroyPipeline(mDevice, mGraphicsPipeline, nullptr);
+	PROFILE_SCOPE("PSO::CreateLibraryPart");
+
+	VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT, partInfo.pNext };
+	libraryInfo.flags = flags;
+
+	VkGraphicsPipelineCreateInfo createInfo = partInfo;
+	createInfo.pNext = &libraryInfo;
+	createInfo.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+
+	VkPipeline part;
+	ThrowIfFailed(vkCreateGraphicsPipelines(mDevice, pipelineCache, 1, &createInfo, nullptr, &part));
+	return part;
 }
 
-void PSO::SetupShaderStageAndPipelineLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Shader& shader)
+void PSO::SetupShaderStageAndPipelineLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Shader& shader, const SpecializationValues& specialization)
 {
 	shader.SetupPipelineShaderStageInfo(pipelineInfo);
 	shader.SetupPipelineLayout(pipelineInfo);
+	if (specialization.IsEmpty())
+		return;
+
+	//32 bit constants, VkBool32 for bool; an id a stage doesn't use is ignored by that stage
+	mSpecializationEntries.clear();
+	mSpecializationData.clear();
+	for (const SpecializationValues::Value& value : specialization.GetValues())
+	{
+		const SpecializationConstant* constant = shader.FindSpecializationConstant(value.name);
+		if (constant == nullptr)
+			throw std::runtime_error(std::format("shader has no specialization constant {}", value.name));
+		if (constant->type != value.type)
+			throw std::runtime_error(std::format("specialization constant {} is {}, set as {}", value.name,
+				magic_enum::enum_name(constant->type), magic_enum::enum_name(value.type)));
+
+		mSpecializationEntries.push_back({ constant->id, static_cast<uint32_t>(mSpecializationData.size() * sizeof(uint32_t)), sizeof(uint32_t) });
+		mSpecializationData.push_back(value.bits);
+	}
+
+	mSpecializationInfo = {};
+	mSpecializationInfo.mapEntryCount = static_cast<uint32_t>(mSpecializationEntries.size());
+	mSpecializationInfo.pMapEntries = mSpecializationEntries.data();
+	mSpecializationInfo.dataSize = mSpecializationData.size() * sizeof(uint32_t);
+	mSpecializationInfo.pData = mSpecializationData.data();
+
+	mStages.assign(pipelineInfo.pStages, pipelineInfo.pStages + pipelineInfo.stageCount);
+	for (VkPipelineShaderStageCreateInfo& stage : mStages)
+		stage.pSpecializationInfo = &mSpecializationInfo;
+	pipelineInfo.pStages = mStages.data();
 }
 
-void PSO::SetupRenderPass(VkGraphicsPipelineCreateInfo& pipelineInfo, const VkRenderPass renderPass, uint32_t subPassIndex)
+void PSO::SetupRenderPass(VkGraphicsPipelineCreateInfo& pipelineInfo, const VkRenderPass renderPass, uint32_t subPassIndex, const RenderTargetFormats& formats)
 {
 	pipelineInfo.renderPass = renderPass;
 	pipelineInfo.subpass = subPassIndex;
+	if (renderPass != VK_NULL_HANDLE)
+		return;
+
+	//dynamic rendering, depth attachment only, stencil is never attached
+	mRenderingInfo = {};
+	mRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	mRenderingInfo.colorAttachmentCount = static_cast<uint32_t>(formats.colorFormats.size());
+	mRenderingInfo.pColorAttachmentFormats = formats.colorFormats.data();
+	mRenderingInfo.depthAttachmentFormat = formats.depthFormat;
+	mRenderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+	pipelineInfo.pNext = &mRenderingInfo;
 }
 
 void PSO::SetupInputLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Shader& shader, const Mesh& mesh)
@@ -65,17 +239,26 @@ void PSO::SetupInputLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Sha
 			vertexAttribute.format = VK_FORMAT_UNDEFINED;
 			vertexAttribute.offset = 0;
 		}
+
+		//an attribute without its binding description is invalid input state, fail the build instead
+		if (vertexAttribute.binding >= mesh.GetBindingCount())
+			throw std::runtime_error(std::format("vertex attribute {} uses binding {}, mesh has {} bindings",
+				semantic, vertexAttribute.binding, mesh.GetBindingCount()));
 	}
 
-	mVertexInputBindings.resize(mesh.GetBindingCount());
+	//only binding read by shader, depth only shader on split position layout fetch position stream alone
+	std::set<uint32_t> usedBindings;
+	for (const VkVertexInputAttributeDescription& vertexAttribute : mVertexAttributes)
+		usedBindings.insert(vertexAttribute.binding);
 
-	for (int i = 0; i < mVertexInputBindings.size(); ++i)
+	mVertexInputBindings.clear();
+	for (uint32_t binding : usedBindings)
 	{
-		VkVertexInputBindingDescription& vertexInputBinding = mVertexInputBindings[i];
-
-		vertexInputBinding.binding = i;
-		vertexInputBinding.stride = mesh.GetBindingStride(i);
+		VkVertexInputBindingDescription vertexInputBinding = {};
+		vertexInputBinding.binding = binding;
+		vertexInputBinding.stride = mesh.GetBindingStride(binding);
 		vertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		mVertexInputBindings.push_back(vertexInputBinding);
 	}
 
 	mVertexInputInfo = {};
@@ -94,26 +277,15 @@ void PSO::SetupInputLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Sha
 	pipelineInfo.pInputAssemblyState = &mInputAssembly;
 }
 
-void PSO::SetupViewport(VkGraphicsPipelineCreateInfo& pipelineInfo, const VkExtent2D& viewport2D)
+void PSO::SetupViewport(VkGraphicsPipelineCreateInfo& pipelineInfo)
 {
-	mViewport = {};
-	mViewport.x = 0.0f;
-	mViewport.y = 0.0f;
-	mViewport.width = (float)viewport2D.width;
-	mViewport.height = (float)viewport2D.height;
-	mViewport.minDepth = 0.0f;
-	mViewport.maxDepth = 1.0f;
-
-	mScissor = {};
-	mScissor.offset = { 0, 0 };
-	mScissor.extent = viewport2D;
-
+	//both dynamic, set when the command buffer is recorded
 	mViewportState = {};
 	mViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	mViewportState.viewportCount = 1;
-	mViewportState.pViewports = &mViewport;
+	mViewportState.pViewports = nullptr;
 	mViewportState.scissorCount = 1;
-	mViewportState.pScissors = &mScissor;
+	mViewportState.pScissors = nullptr;
 
 	pipelineInfo.pViewportState = &mViewportState;
 }
@@ -150,14 +322,14 @@ void PSO::SetupMultisamplingState(VkGraphicsPipelineCreateInfo& pipelineInfo)
 	pipelineInfo.pMultisampleState = &mMultisampling;
 }
 
-void PSO::SetupDepthStencilState(VkGraphicsPipelineCreateInfo& pipelineInfo)
+void PSO::SetupDepthStencilState(VkGraphicsPipelineCreateInfo& pipelineInfo, const RenderState& renderState)
 {
 	mDepthStencil = {};
 
 	mDepthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	mDepthStencil.depthTestEnable = VK_TRUE;
-	mDepthStencil.depthWriteEnable = VK_TRUE;
-	mDepthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	mDepthStencil.depthWriteEnable = renderState.depthWrite ? VK_TRUE : VK_FALSE;
+	mDepthStencil.depthCompareOp = renderState.depthCompareOp;
 	mDepthStencil.depthBoundsTestEnable = VK_FALSE;
 	mDepthStencil.minDepthBounds = 0.0f; // Optional
 	mDepthStencil.maxDepthBounds = 1.0f; // Optional
@@ -168,7 +340,7 @@ void PSO::SetupDepthStencilState(VkGraphicsPipelineCreateInfo& pipelineInfo)
 	pipelineInfo.pDepthStencilState = &mDepthStencil;
 }
 
-void PSO::SetupBlendState(VkGraphicsPipelineCreateInfo& pipelineInfo)
+void PSO::SetupBlendState(VkGraphicsPipelineCreateInfo& pipelineInfo, const RenderState& renderState)
 {
 	mColorBlendAttachment = {};
 	mColorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -184,7 +356,7 @@ void PSO::SetupBlendState(VkGraphicsPipelineCreateInfo& pipelineInfo)
 	mColorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 	mColorBlending.logicOpEnable = VK_FALSE;
 	mColorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-	mColorBlending.attachmentCount = 1;
+	mColorBlending.attachmentCount = renderState.colorAttachmentCount;
 	mColorBlending.pAttachments = &mColorBlendAttachment;
 	mColorBlending.blendConstants[0] = 0.0f; // Optional
 	mColorBlending.blendConstants[1] = 0.0f; // Optional
@@ -198,7 +370,7 @@ void PSO::SetupDynamicState(VkGraphicsPipelineCreateInfo& pipelineInfo)
 {
 	mDynamicState = {};
 	mDynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	mDynamicState.dynamicStateCount = 2;
+	mDynamicState.dynamicStateCount = _countof(mDynamicStates);
 	mDynamicState.pDynamicStates = mDynamicStates;
 
 	pipelineInfo.pDynamicState = &mDynamicState;
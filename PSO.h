@@ -4,42 +4,164 @@
 
 #include "Shader.h"
 
+//Depth and color output of a pipeline
+//depth prepass: LESS, depth write, no color attachment; main pass after prepass: EQUAL, no depth write
+struct RenderState
+{
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+	bool depthWrite = true;
+	//same as subpass color attachment count
+	uint32_t colorAttachmentCount = 1;
+
+	auto operator<=>(const RenderState&) const = default;
+};
+
+//attachment formats of a VK_KHR_dynamic_rendering pass, take the place of the render pass
+struct RenderTargetFormats
+{
+	std::vector<VkFormat> colorFormats;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+	auto operator<=>(const RenderTargetFormats&) const = default;
+};
+
+template<>
+struct std::hash<RenderTargetFormats>
+{
+	std::size_t operator()(const RenderTargetFormats& key) const
+	{
+		std::size_t res = std::hash<uint32_t>()(static_cast<uint32_t>(key.depthFormat));
+		for (size_t i = 0; i < key.colorFormats.size(); ++i)
+			res ^= std::hash<uint32_t>()(static_cast<uint32_t>(key.colorFormats[i])) << (i % 4 + 1);
+		return res;
+	}
+};
+
+//everything PSO::Init builds a pipeline from, equal keys build the same pipeline
+//viewport and scissor are dynamic, a key outlives resize unless the render pass is recreated;
+//renderPass is null with dynamic rendering, formats are used instead
+struct PSOKey
+{
+	const Shader* shader = nullptr;
+	//vertex layout of the mesh
+	const Mesh* mesh = nullptr;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+	RenderTargetFormats formats;
+	RenderState renderState;
+	SpecializationValues specialization;
+
+	bool operator==(const PSOKey& rhs) const = default;
+};
+
+template<>
+struct std::hash<PSOKey>
+{
+	std::size_t operator()(const PSOKey& key) const
+	{
+		std::size_t res = std::hash<const Shader*>()(key.shader);
+		res ^= std::hash<const Mesh*>()(key.mesh) << 1;
+		res ^= std::hash<RenderTargetFormats>()(key.formats) >> 1;
+		res ^= std::hash<VkRenderPass>()(key.renderPass) << 1;
+		res ^= std::hash<uint32_t>()(key.subpass) << 2;
+		res ^= std::hash<uint32_t>()(static_cast<uint32_t>(key.renderState.depthCompareOp) | (key.renderState.depthWrite ? 0x100 : 0)
+			| (key.renderState.colorAttachmentCount << 16)) >> 2;
+		res ^= std::hash<SpecializationValues>()(key.specialization) << 3;
+		return res;
+	}
+};
+
+//key of one VK_EXT_graphics_pipeline_library part, a part fills only the fields it reads
+//shader is the spir-v hash, parts of identical shaders are shared and a reloaded shader never hits a stale part
+struct PipelineLibraryKey
+{
+	uint64_t shader = 0;
+	//bindings then attributes, flattened
+	std::vector<uint32_t> vertexInput;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+	RenderTargetFormats formats;
+	RenderState renderState;
+	SpecializationValues specialization;
+
+	bool operator==(const PipelineLibraryKey& rhs) const = default;
+};
+
+template<>
+struct std::hash<PipelineLibraryKey>
+{
+	std::size_t operator()(const PipelineLibraryKey& key) const
+	{
+		std::size_t res = std::hash<uint64_t>()(key.shader);
+		for (size_t i = 0; i < key.vertexInput.size(); ++i)
+			res ^= std::hash<uint32_t>()(key.vertexInput[i]) << (i % 8);
+		res ^= std::hash<RenderTargetFormats>()(key.formats) >> 1;
+		res ^= std::hash<VkRenderPass>()(key.renderPass) << 1;
+		res ^= std::hash<uint32_t>()(key.subpass) << 2;
+		res ^= std::hash<uint32_t>()(static_cast<uint32_t>(key.renderState.depthCompareOp) | (key.renderState.depthWrite ? 0x100 : 0)
+			| (key.renderState.colorAttachmentCount << 16)) >> 2;
+		res ^= std::hash<SpecializationValues>()(key.specialization) << 3;
+		return res;
+	}
+};
+
+class PipelineLibrary;
+
 class PSO
 {
 public:
 	PSO();
 
-	void Init(VkDevice device, const Shader& shader, const Mesh& mesh, const VkExtent2D& viewport2D, const VkRenderPass renderPass, uint32_t subPassIndex);
+	//throws if a specialization value is not declared by the shader or its type doesn't match
+	void Init(VkDevice device, const Shader& shader, const Mesh& mesh, const VkRenderPass renderPass, uint32_t subPassIndex,
+		const RenderState& renderState = {}, const SpecializationValues& specialization = {});
+	//shader and mesh of the key are only read here, safe on any thread while they are alive
+	void Init(VkDevice device, const PSOKey& key, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+	//VK_EXT_graphics_pipeline_library: the four parts come from the library, missing ones are created, then linked without optimization
+	void InitLinked(VkDevice device, const PSOKey& key, PipelineLibrary& library, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
 	void Clear();
 
 	VkPipeline GetPipeline() { return mGraphicsPipeline; }
-	VkViewport& GetViewport() { return mViewport; }
+	const PSOKey& GetKey() const { return mKey; }
+	bool IsLinked() const { return mLinked; }
 
 private:
-	void SetupShaderStageAndPipelineLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Shader& shader);
-	void SetupRenderPass(VkGraphicsPipelineCreateInfo& pipelineInfo, const VkRenderPass renderPass, uint32_t subPassIndex);
+	void SetupPipeline(VkGraphicsPipelineCreateInfo& pipelineInfo, const PSOKey& key);
+	VkPipeline CreateLibraryPart(const VkGraphicsPipelineCreateInfo& partInfo, VkGraphicsPipelineLibraryFlagsEXT flags, VkPipelineCache pipelineCache) const;
+	void SetupShaderStageAndPipelineLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Shader& shader, const SpecializationValues& specialization);
+	void SetupRenderPass(VkGraphicsPipelineCreateInfo& pipelineInfo, const VkRenderPass renderPass, uint32_t subPassIndex, const RenderTargetFormats& formats);
 	void SetupInputLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Shader& shader,  const Mesh& mesh);
-	void SetupViewport(VkGraphicsPipelineCreateInfo& pipelineInfo, const VkExtent2D& viewport2D);
+	void SetupViewport(VkGraphicsPipelineCreateInfo& pipelineInfo);
 	void SetupRasterizerState(VkGraphicsPipelineCreateInfo& pipelineInfo);
 	void SetupMultisamplingState(VkGraphicsPipelineCreateInfo& pipelineInfo);
-	void SetupDepthStencilState(VkGraphicsPipelineCreateInfo& pipelineInfo);
-	void SetupBlendState(VkGraphicsPipelineCreateInfo& pipelineInfo);
+	void SetupDepthStencilState(VkGraphicsPipelineCreateInfo& pipelineInfo, const RenderState& renderState);
+	void SetupBlendState(VkGraphicsPipelineCreateInfo& pipelineInfo, const RenderState& renderState);
 	void SetupDynamicState(VkGraphicsPipelineCreateInfo& pipelineInfo);
 
 	VkDevice mDevice;
 	VkPipeline mGraphicsPipeline = VK_NULL_HANDLE;
+	PSOKey mKey;
+	bool mLinked = false;
 
-	const VkDynamicState mDynamicStates[2] = {
+	//not const, PSO is swapped when hot reload rebuilds it
+	VkDynamicState mDynamicStates[3] = {
 		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
 		VK_DYNAMIC_STATE_LINE_WIDTH
 	};
 
+	//pNext of the create info when there is no render pass
+	VkPipelineRenderingCreateInfoKHR mRenderingInfo;
+
+	//copy of shader stages with specialization info, one info shared by every stage
+	std::vector<VkPipelineShaderStageCreateInfo> mStages;
+	std::vector<VkSpecializationMapEntry> mSpecializationEntries;
+	std::vector<uint32_t> mSpecializationData;
+	VkSpecializationInfo mSpecializationInfo;
 	VkPipelineVertexInputStateCreateInfo mVertexInputInfo;
 	VkPipelineInputAssemblyStateCreateInfo mInputAssembly;
 	std::vector<VkVertexInputBindingDescription> mVertexInputBindings;
 	std::vector<VkVertexInputAttributeDescription> mVertexAttributes;
-	VkViewport mViewport;
-	VkRect2D mScissor;
 	VkPipelineViewportStateCreateInfo mViewportState;
 	VkPipelineRasterizationStateCreateInfo mRasterizer;
 	VkPipelineMultisampleStateCreateInfo mMultisampling;
@@ -0,0 +1,274 @@
+#include "PipelineCompiler.h"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+PipelineCompiler::PipelineCompiler(Device* device, bool useLibrary, uint32_t threadCount) : DeviceComponent(device)
+{
+	mUseLibrary = useLibrary && mDevice->IsGraphicsPipelineLibrarySupported();
+	mLibrary.Init(mDevice->GetDevice());
+	LOG_INFO("pipeline compiler: graphics pipeline library {}", mUseLibrary ? "on" : "off");
+
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+		mThreads.emplace_back([this]() { Run(); });
+}
+
+PipelineCompiler::~PipelineCompiler()
+{
+	{
+		std::lock_guard lock(mMutex);
+		mStop = true;
+	}
+	mJobQueued.notify_all();
+	for (std::thread& thread : mThreads)
+		thread.join();
+}
+
+std::shared_future<PSO*> PipelineCompiler::Request(const PSOKey& key)
+{
+	std::lock_guard lock(mMutex);
+	return FindOrQueue(key)->future;
+}
+
+PSO* PipelineCompiler::TryGet(const PSOKey& key)
+{
+	std::lock_guard lock(mMutex);
+	std::shared_ptr<Entry> entry = FindOrQueue(key);
+	if (entry->state != State::Ready)
+		return nullptr;
+	return entry->optimized ? entry->optimized.get() : entry->pso.get();
+}
+
+void PipelineCompiler::WaitIdle()
+{
+	PROFILE_FUNCTION();
+
+	std::unique_lock lock(mMutex);
+	mJobDone.wait(lock, [this]() { return mQueue.empty() && mOptimizeQueue.empty() && mCompiling == 0; });
+}
+
+std::vector<std::unique_ptr<PSO>> PipelineCompiler::Remove(const std::function<bool(const PSOKey&)>& predicate)
+{
+	std::lock_guard lock(mMutex);
+
+	std::erase_if(mQueue, [&](const Job& job) { return predicate(job.first); });
+	std::erase_if(mOptimizeQueue, [&](const Job& job) { return predicate(job.first); });
+
+	std::vector<std::unique_ptr<PSO>> removed;
+	std::unordered_set<uint64_t> removedShaders;
+	for (auto ite = mEntries.begin(); ite != mEntries.end();)
+	{
+		if (!predicate(ite->first))
+		{
+			++ite;
+			continue;
+		}
+
+		if (mUseLibrary)
+			removedShaders.insert(ite->first.shader->GetSpirvHash());
+
+		Entry& entry = *ite->second;
+		if (entry.state == State::Queued)
+			entry.promise.set_exception(std::make_exception_ptr(std::runtime_error("pipeline removed before it was compiled")));
+		if (entry.pso)
+			removed.push_back(std::move(entry.pso));
+		if (entry.optimized)
+			removed.push_back(std::move(entry.optimized));
+		//vkCreateGraphicsPipelines can't be cancelled, the build finishes on its own
+		if (entry.state == State::Compiling || entry.optimizeState == State::Compiling)
+		{
+			entry.orphaned = true;
+			++mOrphans;
+			if (mUseLibrary && entry.state == State::Compiling)
+				mOrphanShaders.insert(ite->first.shader->GetSpirvHash());
+		}
+		ite = mEntries.erase(ite);
+	}
+
+	//parts of a shader no key uses anymore, e.g. every older version of a hot reloaded one
+	//a key left in the cache may still be linking with them, or link later, an orphaned link removes them when done
+	for (const auto& [key, entry] : mEntries)
+		removedShaders.erase(key.shader->GetSpirvHash());
+	for (uint64_t shader : removedShaders)
+	{
+		if (!mOrphanShaders.contains(shader))
+			mLibrary.Remove(shader);
+	}
+
+	mJobDone.notify_all();
+	return removed;
+}
+
+void PipelineCompiler::Clear()
+{
+	for (std::unique_ptr<PSO>& pso : Remove([](const PSOKey&) { return true; }))
+		pso->Clear();
+
+	{
+		std::unique_lock lock(mMutex);
+		//orphaned builds are the only jobs left
+		mJobDone.wait(lock, [this]() { return mCompiling == 0; });
+	}
+
+	//no job is running, parts hold render passes of the keys just removed
+	mLibrary.Clear();
+}
+
+size_t PipelineCompiler::GetPendingCount() const
+{
+	std::lock_guard lock(mMutex);
+	return mQueue.size() + mOptimizeQueue.size() + mCompiling;
+}
+
+uint32_t PipelineCompiler::GetOrphanCount() const
+{
+	std::lock_guard lock(mMutex);
+	return mOrphans;
+}
+
+std::shared_ptr<PipelineCompiler::Entry> PipelineCompiler::FindOrQueue(const PSOKey& key)
+{
+	auto ite = mEntries.find(key);
+	if (ite != mEntries.end())
+		return ite->second;
+
+	std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+	entry->future = entry->promise.get_future().share();
+	mEntries.emplace(key, entry);
+	mQueue.emplace_back(key, entry);
+	mJobQueued.notify_one();
+	return entry;
+}
+
+void PipelineCompiler::Compile(const Job& job)
+{
+	const auto& [key, entry] = job;
+
+	std::unique_ptr<PSO> pso = std::make_unique<PSO>();
+	std::exception_ptr error;
+	try {
+		PROFILE_SCOPE("PipelineCompiler::Compile");
+		if (mUseLibrary)
+			pso->InitLinked(mDevice->GetDevice(), key, mLibrary, mDevice->GetPipelineCache());
+		else
+			pso->Init(mDevice->GetDevice(), key, mDevice->GetPipelineCache());
+	}
+	catch (const std::exception& e) {
+		LOG_ERROR("pipeline compile failed: {}", e.what());
+		error = std::current_exception();
+	}
+	catch (const DxVkException& e) {
+		LOG_ERROR("pipeline compile failed: {}", e.ToString());
+		error = std::current_exception();
+	}
+
+	std::unique_lock lock(mMutex);
+	if (entry->orphaned)
+	{
+		--mOrphans;
+		entry->state = error ? State::Failed : State::Ready;
+		entry->promise.set_exception(error ? error : std::make_exception_ptr(std::runtime_error("pipeline removed while it was compiled")));
+		if (mUseLibrary)
+		{
+			//the parts Remove kept for this link, or the ones it created after it
+			const uint64_t shader = key.shader->GetSpirvHash();
+			mOrphanShaders.erase(mOrphanShaders.find(shader));
+			const bool used = mOrphanShaders.contains(shader) ||
+				std::any_of(mEntries.begin(), mEntries.end(), [&](const auto& pair) { return pair.first.shader->GetSpirvHash() == shader; });
+			if (!used)
+				mLibrary.Remove(shader);
+		}
+		lock.unlock();
+		//never handed out, no frame can use it
+		if (!error)
+			pso->Clear();
+		return;
+	}
+	if (error)
+	{
+		entry->state = State::Failed;
+		entry->promise.set_exception(error);
+		return;
+	}
+
+	entry->pso = std::move(pso);
+	entry->state = State::Ready;
+	entry->promise.set_value(entry->pso.get());
+	if (mUseLibrary)
+	{
+		entry->optimizeState = State::Queued;
+		mOptimizeQueue.push_back(job);
+	}
+}
+
+void PipelineCompiler::Optimize(const Job& job)
+{
+	const auto& [key, entry] = job;
+
+	std::unique_ptr<PSO> pso = std::make_unique<PSO>();
+	bool failed = false;
+	try {
+		PROFILE_SCOPE("PipelineCompiler::Optimize");
+		pso->Init(mDevice->GetDevice(), key, mDevice->GetPipelineCache());
+	}
+	catch (const std::exception& e) {
+		LOG_WARNING("monolithic pipeline failed, linked one is kept: {}", e.what());
+		failed = true;
+	}
+	catch (const DxVkException& e) {
+		LOG_WARNING("monolithic pipeline failed, linked one is kept: {}", e.ToString());
+		failed = true;
+	}
+
+	std::unique_lock lock(mMutex);
+	entry->optimizeState = failed ? State::Failed : State::Ready;
+	if (entry->orphaned)
+	{
+		//never handed out, no frame can use it
+		--mOrphans;
+		lock.unlock();
+		if (!failed)
+			pso->Clear();
+		return;
+	}
+	if (!failed)
+		entry->optimized = std::move(pso);
+}
+
+void PipelineCompiler::Run()
+{
+	PROFILE_THREAD("Pipeline Compiler");
+
+	while (true)
+	{
+		std::unique_lock lock(mMutex);
+		mJobQueued.wait(lock, [this]() { return mStop || !mQueue.empty() || !mOptimizeQueue.empty(); });
+		if (mStop)
+			return;
+
+		//a pipeline nobody can draw yet goes before a faster version of one already drawn
+		const bool optimize = mQueue.empty();
+		std::deque<Job>& queue = optimize ? mOptimizeQueue : mQueue;
+		Job job = std::move(queue.front());
+		queue.pop_front();
+		(optimize ? job.second->optimizeState : job.second->state) = State::Compiling;
+		++mCompiling;
+		lock.unlock();
+
+		if (optimize)
+			Optimize(job);
+		else
+			Compile(job);
+
+		lock.lock();
+		--mCompiling;
+		mJobDone.notify_all();
+		//an optimize job may have been queued
+		mJobQueued.notify_one();
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "DeviceComponent.h"
+#include "PSO.h"
+#include "PipelineLibrary.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//Creates graphics pipelines on worker threads through the device pipeline cache, one pipeline per PSOKey
+//the frame never waits on it: TryGet returns null until the pipeline is ready and the caller draws with
+//the pipeline it had before, or skips the draw
+//with VK_EXT_graphics_pipeline_library a new key is first linked from cached parts, which takes about link time,
+//its monolithic pipeline is built when no link is waiting and replaces the linked one in TryGet
+//shader and mesh of a key must stay alive until its pipeline is ready, or removed and GetOrphanCount is 0
+class PipelineCompiler : public DeviceComponent
+{
+public:
+	//0: half of hardware threads, at least one; useLibrary is ignored when the device doesn't support it
+	PipelineCompiler(Device* device, bool useLibrary = true, uint32_t threadCount = 0);
+	~PipelineCompiler();
+
+	PipelineCompiler(const PipelineCompiler&) = delete;
+	PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+	//queued on first request of the key, the future is the first usable pipeline and throws if creation failed
+	std::shared_future<PSO*> Request(const PSOKey& key);
+	//best ready pipeline or null, never blocks; a new key is queued, a failed key stays null
+	//the result changes once when the monolithic pipeline replaces the linked one, both live until the key is removed
+	PSO* TryGet(const PSOKey& key);
+	//blocks until every queued pipeline, monolithic ones included, is built; load time only
+	void WaitIdle();
+
+	//pipelines of matching keys leave the cache, the caller destroys them after the gpu is done with them
+	//never blocks: queued builds are dropped, a running build is orphaned and destroys its own pipeline when done
+	//library parts of a shader no remaining key or orphaned link uses are destroyed
+	std::vector<std::unique_ptr<PSO>> Remove(const std::function<bool(const PSOKey&)>& predicate);
+	//destroys every pipeline and waits orphaned builds, gpu must be idle
+	void Clear();
+
+	size_t GetPendingCount() const;
+	//builds of removed keys still running, they read the shaders and mesh of their key
+	uint32_t GetOrphanCount() const;
+	bool IsUsingLibrary() const { return mUseLibrary; }
+
+private:
+	enum class State { Queued, Compiling, Ready, Failed };
+
+	struct Entry
+	{
+		State state = State::Queued;
+		//state of the background monolithic build, Ready when it's done or not needed
+		State optimizeState = State::Ready;
+		//first usable pipeline, linked when the library is used
+		std::unique_ptr<PSO> pso;
+		std::unique_ptr<PSO> optimized;
+		//removed while its first or monolithic build was running
+		bool orphaned = false;
+		std::promise<PSO*> promise;
+		std::shared_future<PSO*> future;
+	};
+	using Job = std::pair<PSOKey, std::shared_ptr<Entry>>;
+
+	std::shared_ptr<Entry> FindOrQueue(const PSOKey& key);
+	void Compile(const Job& job);
+	void Optimize(const Job& job);
+	void Run();
+
+	bool mUseLibrary = false;
+	PipelineLibrary mLibrary;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mJobQueued;
+	std::condition_variable mJobDone;
+	std::unordered_map<PSOKey, std::shared_ptr<Entry>> mEntries;
+	std::deque<Job> mQueue;
+	//monolithic builds run only when mQueue is empty
+	std::deque<Job> mOptimizeQueue;
+	uint32_t mCompiling = 0;
+	uint32_t mOrphans = 0;
+	//spirv hashes of orphaned links, their library parts are kept until the link is done
+	std::unordered_multiset<uint64_t> mOrphanShaders;
+	bool mStop = false;
+
+	std::vector<std::thread> mThreads;
+};
@@ -2,9 +2,12 @@
 
 #include "dxUtil.hpp"
 #include "SamplerPool.hpp"
+#include "ConcurrentCache.hpp"
 
 #include <vulkan/vulkan.h>
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
 #include <type_traits>
 
 struct DescriptorSetLayoutBindingDesc
@@ -47,7 +50,8 @@ struct DescriptorSetLayoutBindingDesc
 			return descriptorCount;
 	}
 
-	std::strong_ordering operator<=>(const DescriptorSetLayoutBindingDesc&) const = default;
+	//SamplerDesc has float member, so ordering is partial
+	auto operator<=>(const DescriptorSetLayoutBindingDesc&) const = default;
 	// bool operator==(const DescriptorSetLayoutBindingDesc& rhs) const
 	// {
 	// 	return this->binding != rhs.binding
@@ -201,11 +205,10 @@ class DescriptorSetLayoutPool
 
 public:
 
+	//thread safe, set layout of same desc only create once
 	VkDescriptorSetLayout Get(const DescriptorSetLayoutDesc& layoutDesc)
 	{
-		auto ite = mDescriptorSetLayoutPool.find(layoutDesc);
-		if (ite == mDescriptorSetLayoutPool.end())
-		{
+		return mDescriptorSetLayoutPool.GetOrCreate(layoutDesc, [this](const DescriptorSetLayoutDesc& layoutDesc) {
 			VkDescriptorSetLayout newSetLayout;
 
 			std::vector<VkDescriptorSetLayoutBinding> tempBindingSpace(layoutDesc.NeedTempBindingSpace());
@@ -216,31 +219,27 @@ public:
 				tempSamplerSpace[bindingIndex].resize(layoutDesc.pBindings[bindingIndex].NeedTempVkSamplerSpace());
 				tempSamplerPointerSpace[bindingIndex] = tempSamplerSpace[bindingIndex].data();
 			}
-				
 
 			VkDescriptorSetLayoutCreateInfo createInfo = layoutDesc.ToLayout(tempBindingSpace.data(), mSamplerPool, tempSamplerPointerSpace.data());
 			ThrowIfFailed(vkCreateDescriptorSetLayout(mDevice, &createInfo, nullptr, &newSetLayout));
 
-			bool isSuccess;
-			std::tie(ite, isSuccess) = mDescriptorSetLayoutPool.insert(std::make_pair(layoutDesc, newSetLayout));
-		}
-
-		return ite->second;
+			return newSetLayout;
+		});
 	}
 
 private:
-	std::unordered_map<DescriptorSetLayoutDesc, VkDescriptorSetLayout> mDescriptorSetLayoutPool;
+	ConcurrentCache<DescriptorSetLayoutDesc, VkDescriptorSetLayout> mDescriptorSetLayoutPool;
 	VkDevice mDevice;
 	SamplerPool* mSamplerPool;
 
 	void Clear()
 	{
-		for (auto ite = mDescriptorSetLayoutPool.begin(); ite != mDescriptorSetLayoutPool.end(); ++ite)
-		{
-			vkDestroyDescriptorSetLayout(mDevice, ite->second, nullptr);
-		}
+		mDescriptorSetLayoutPool.ForEach([this](const DescriptorSetLayoutDesc&, VkDescriptorSetLayout setLayout) {
+			if (setLayout != VK_NULL_HANDLE)
+				vkDestroyDescriptorSetLayout(mDevice, setLayout, nullptr);
+		});
 
-		mDescriptorSetLayoutPool.clear();
+		mDescriptorSetLayoutPool.Clear();
 	}
 
 	void Init(VkDevice device, SamplerPool* pSamplerPool)
@@ -257,7 +256,7 @@ struct std::hash<std::vector<DescriptorSetLayoutDesc>>
 	{
 		std::size_t res = 0;
 		for (int i = 0; i < key.size(); ++i)
-			i ^= std::hash<DescriptorSetLayoutDesc>()(key[i]) << (i % 8);
+			res ^= std::hash<DescriptorSetLayoutDesc>()(key[i]) << (i % 8);
 
 		return res;
 	}
@@ -272,49 +271,90 @@ struct std::equal_to<std::vector<DescriptorSetLayoutDesc>>
 	}
 };
 
+//pipeline layout cache key, set layouts + push constant ranges
+struct PipelineLayoutDesc
+{
+	std::vector<DescriptorSetLayoutDesc> setLayouts;
+	std::vector<VkPushConstantRange> pushConstantRanges;
+
+	bool operator==(const PipelineLayoutDesc& rhs) const
+	{
+		if (!std::equal_to<std::vector<DescriptorSetLayoutDesc>>()(setLayouts, rhs.setLayouts))
+			return false;
+
+		return std::equal(pushConstantRanges.begin(), pushConstantRanges.end(), rhs.pushConstantRanges.begin(), rhs.pushConstantRanges.end(),
+			[](const VkPushConstantRange& lhs, const VkPushConstantRange& rhs) {
+				return lhs.stageFlags == rhs.stageFlags && lhs.offset == rhs.offset && lhs.size == rhs.size;
+			});
+	}
+};
+
+template<>
+struct std::hash<PipelineLayoutDesc>
+{
+	std::size_t operator()(const PipelineLayoutDesc& key) const
+	{
+		std::size_t res = std::hash<std::vector<DescriptorSetLayoutDesc>>()(key.setLayouts);
+		for (const VkPushConstantRange& range : key.pushConstantRanges)
+		{
+			res ^= std::hash<VkShaderStageFlags>()(range.stageFlags) << 3;
+			res ^= std::hash<uint32_t>()(range.offset) << 1;
+			res ^= std::hash<uint32_t>()(range.size) << 2;
+		}
+
+		return res;
+	}
+};
+
 class PipelineLayoutPool
 {
 	friend class Device;
 
 public:
 
-	VkPipelineLayout Get(const std::vector<DescriptorSetLayoutDesc>& setLayoutDescs, std::vector<VkDescriptorSetLayout>& setLayouts)
+	//thread safe, setLayouts is always filled (cache hit too)
+	VkPipelineLayout Get(const PipelineLayoutDesc& layoutDesc, std::vector<VkDescriptorSetLayout>& setLayouts)
 	{
-		auto ite = mPipelineLayoutPool.find(setLayoutDescs);
-		if (ite != mPipelineLayoutPool.end())
-			return ite->second;
-		else
-		{
-			setLayouts.resize(setLayoutDescs.size());
+		PipelineLayoutEntry entry = mPipelineLayoutPool.GetOrCreate(layoutDesc, [this](const PipelineLayoutDesc& layoutDesc) {
+			const std::vector<DescriptorSetLayoutDesc>& setLayoutDescs = layoutDesc.setLayouts;
+
+			PipelineLayoutEntry newEntry;
+			newEntry.setLayouts.resize(setLayoutDescs.size());
 			for (int setIndex = 0; setIndex < setLayoutDescs.size(); ++setIndex)
 			{
-				//TODO: there hash calc has problem
-				setLayouts[setIndex] = mDescriptorSetLayoutPool.Get(setLayoutDescs[setIndex]);
+				newEntry.setLayouts[setIndex] = mDescriptorSetLayoutPool.Get(setLayoutDescs[setIndex]);
 			}
 
 			VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 			pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-			pipelineLayoutInfo.pushConstantRangeCount = 0; // OpCyoutional
-			pipelineLayoutInfo.pPushConstantRanges = 0; // Optional
-			pipelineLayoutInfo.setLayoutCount = setLayouts.size();
-			pipelineLayoutInfo.pSetLayouts = setLayouts.data();
-
-			VkPipelineLayout pipelineLayout;
-			ThrowIfFailed(vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
-			mPipelineLayoutPool[setLayoutDescs] = pipelineLayout;
-			return pipelineLayout;
-		}
+			pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(layoutDesc.pushConstantRanges.size());
+			pipelineLayoutInfo.pPushConstantRanges = layoutDesc.pushConstantRanges.data();
+			pipelineLayoutInfo.setLayoutCount = newEntry.setLayouts.size();
+			pipelineLayoutInfo.pSetLayouts = newEntry.setLayouts.data();
+
+			ThrowIfFailed(vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr, &newEntry.pipelineLayout));
+			return newEntry;
+		});
+
+		setLayouts = entry.setLayouts;
+		return entry.pipelineLayout;
 	}
 private:
 
+	struct PipelineLayoutEntry
+	{
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSetLayout> setLayouts;
+	};
+
 	void Clear()
 	{
-		for (auto ite = mPipelineLayoutPool.begin(); ite != mPipelineLayoutPool.end(); ++ite)
-		{
-			vkDestroyPipelineLayout(mDevice, ite->second, nullptr);
-		}
+		mPipelineLayoutPool.ForEach([this](const PipelineLayoutDesc&, const PipelineLayoutEntry& entry) {
+			if (entry.pipelineLayout != VK_NULL_HANDLE)
+				vkDestroyPipelineLayout(mDevice, entry.pipelineLayout, nullptr);
+		});
 
-		mPipelineLayoutPool.clear();
+		mPipelineLayoutPool.Clear();
 		mDescriptorSetLayoutPool.Clear();
 	}
 
@@ -324,8 +364,7 @@ private:
 		mDescriptorSetLayoutPool.Init(device, pSamplerPool);
 	}
 
-	std::unordered_map<std::vector<DescriptorSetLayoutDesc>, VkPipelineLayout, 
-		std::hash<std::vector<DescriptorSetLayoutDesc>>, std::equal_to<std::vector<DescriptorSetLayoutDesc>>> mPipelineLayoutPool;
+	ConcurrentCache<PipelineLayoutDesc, PipelineLayoutEntry> mPipelineLayoutPool;
 	DescriptorSetLayoutPool mDescriptorSetLayoutPool;
 	VkDevice mDevice;
 };
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "dxUtil.hpp"
+#include "ConcurrentCache.hpp"
+#include "PSO.h"
+
+#include <vulkan/vulkan.h>
+#include <functional>
+
+//Cache of the four VK_EXT_graphics_pipeline_library parts, PSO::InitLinked builds missing parts and links them
+//thread safe, each part is created once
+class PipelineLibrary
+{
+public:
+	enum class Part { VertexInput, PreRasterization, FragmentShader, FragmentOutput, Count };
+
+	void Init(VkDevice device)
+	{
+		mDevice = device;
+	}
+
+	//factory: VkPipeline(), creates the part with VK_PIPELINE_CREATE_LIBRARY_BIT_KHR
+	VkPipeline Get(Part part, const PipelineLibraryKey& key, const std::function<VkPipeline()>& factory)
+	{
+		return mParts[static_cast<size_t>(part)].GetOrCreate(key, [&factory](const PipelineLibraryKey&) { return factory(); });
+	}
+
+	//destroys the shader parts of a spir-v hash, a linked pipeline doesn't need its parts anymore
+	//no link of that shader may be running, links of other shaders may
+	void Remove(uint64_t shader)
+	{
+		for (ConcurrentCache<PipelineLibraryKey, VkPipeline>& parts : mParts)
+		{
+			parts.EraseIf([this, shader](const PipelineLibraryKey& key, VkPipeline pipeline) {
+				if (key.shader != shader)
+					return false;
+				if (pipeline != VK_NULL_HANDLE)
+					vkDestroyPipeline(mDevice, pipeline, nullptr);
+				return true;
+			});
+		}
+	}
+
+	//Not thread safe with Get, parts hold render pass handles and are cleared with them
+	void Clear()
+	{
+		for (ConcurrentCache<PipelineLibraryKey, VkPipeline>& parts : mParts)
+		{
+			parts.ForEach([this](const PipelineLibraryKey&, VkPipeline pipeline) {
+				if (pipeline != VK_NULL_HANDLE)
+					vkDestroyPipeline(mDevice, pipeline, nullptr);
+			});
+			parts.Clear();
+		}
+	}
+
+	size_t Size() const
+	{
+		size_t size = 0;
+		for (const ConcurrentCache<PipelineLibraryKey, VkPipeline>& parts : mParts)
+			size += parts.Size();
+		return size;
+	}
+
+private:
+	VkDevice mDevice = VK_NULL_HANDLE;
+	ConcurrentCache<PipelineLibraryKey, VkPipeline> mParts[static_cast<size_t>(Part::Count)];
+};
@@ -0,0 +1,200 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace Profiler
+{
+	namespace
+	{
+		enum class EventType : uint32_t { Scope, Counter };
+
+		struct Event
+		{
+			const char* name;
+			const char* detail;
+			uint64_t begin;
+			//end of scope, bit pattern of double for counter
+			uint64_t end;
+			EventType type;
+		};
+
+		//fields are relaxed atomics so a reader racing the writer gets torn values, not undefined behavior
+		struct EventSlot
+		{
+			std::atomic<const char*> name;
+			std::atomic<const char*> detail;
+			std::atomic<uint64_t> begin;
+			std::atomic<uint64_t> end;
+			std::atomic<EventType> type;
+		};
+
+		//single writer, the owning thread; reader copies and drops what was overwritten meanwhile
+		struct ThreadBuffer
+		{
+			uint32_t threadId = 0;
+			std::atomic<const char*> threadName = nullptr;
+			std::atomic<uint64_t> writeIndex = 0;
+			std::unique_ptr<EventSlot[]> events = std::make_unique<EventSlot[]>(RingCapacity);
+		};
+
+		const std::chrono::steady_clock::time_point gStartTime = std::chrono::steady_clock::now();
+
+		//buffers are never freed, a trace still has events of exited threads
+		std::mutex gBuffersMutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> gBuffers;
+
+		std::mutex gInternMutex;
+		std::unordered_set<std::string> gInternedStrings;
+
+		ThreadBuffer& GetThreadBuffer()
+		{
+			thread_local ThreadBuffer* buffer = nullptr;
+			if (buffer == nullptr)
+			{
+				std::lock_guard lock(gBuffersMutex);
+				buffer = gBuffers.emplace_back(std::make_unique<ThreadBuffer>()).get();
+				buffer->threadId = static_cast<uint32_t>(gBuffers.size());
+			}
+			return *buffer;
+		}
+
+		void Push(const Event& event)
+		{
+			ThreadBuffer& buffer = GetThreadBuffer();
+			uint64_t index = buffer.writeIndex.load(std::memory_order_relaxed);
+			EventSlot& slot = buffer.events[index & (RingCapacity - 1)];
+			//a reader that sees any field below also sees writeIndex == index, pairs with the fence in WriteChromeTrace
+			std::atomic_thread_fence(std::memory_order_release);
+			slot.name.store(event.name, std::memory_order_relaxed);
+			slot.detail.store(event.detail, std::memory_order_relaxed);
+			slot.begin.store(event.begin, std::memory_order_relaxed);
+			slot.end.store(event.end, std::memory_order_relaxed);
+			slot.type.store(event.type, std::memory_order_relaxed);
+			buffer.writeIndex.store(index + 1, std::memory_order_release);
+		}
+
+		std::string Escape(const char* text)
+		{
+			std::string res;
+			for (; *text != '\0'; ++text)
+			{
+				if (*text == '"' || *text == '\\')
+					res.push_back('\\');
+				res.push_back(*text);
+			}
+			return res;
+		}
+	}
+
+	uint64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gStartTime).count();
+	}
+
+	void RecordScope(const char* name, const char* detail, uint64_t begin, uint64_t end)
+	{
+		Push({ name, detail, begin, end, EventType::Scope });
+	}
+
+	void RecordCounter(const char* name, double value)
+	{
+		Push({ name, nullptr, Now(), std::bit_cast<uint64_t>(value), EventType::Counter });
+	}
+
+	const char* Intern(std::string_view text)
+	{
+		std::lock_guard lock(gInternMutex);
+		return gInternedStrings.emplace(text).first->c_str();
+	}
+
+	void SetThreadName(const char* name)
+	{
+		GetThreadBuffer().threadName.store(name, std::memory_order_relaxed);
+	}
+
+	bool WriteChromeTrace(const std::string& path)
+	{
+		std::ofstream file(path, std::ios::trunc);
+		if (!file)
+		{
+			std::cerr << "can't write trace: " << path << std::endl;
+			return false;
+		}
+
+		std::vector<ThreadBuffer*> buffers;
+		{
+			std::lock_guard lock(gBuffersMutex);
+			for (const std::unique_ptr<ThreadBuffer>& buffer : gBuffers)
+				buffers.push_back(buffer.get());
+		}
+
+		//ts and dur are microseconds
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		size_t eventCount = 0;
+		std::vector<Event> events;
+		for (ThreadBuffer* buffer : buffers)
+		{
+			const char* threadName = buffer->threadName.load(std::memory_order_relaxed);
+			if (threadName != nullptr)
+			{
+				file << std::format("{}{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+					first ? "" : ",\n", buffer->threadId, Escape(threadName));
+				first = false;
+			}
+
+			uint64_t end = buffer->writeIndex.load(std::memory_order_acquire);
+			uint64_t begin = end > RingCapacity ? end - RingCapacity : 0;
+			events.clear();
+			for (uint64_t i = begin; i < end; ++i)
+			{
+				const EventSlot& slot = buffer->events[i & (RingCapacity - 1)];
+				events.push_back({ slot.name.load(std::memory_order_relaxed), slot.detail.load(std::memory_order_relaxed),
+					slot.begin.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed), slot.type.load(std::memory_order_relaxed) });
+			}
+
+			//writer may have lapped the copy, the oldest copied entries are torn
+			//slot of endAfterCopy may be half written, it is the one of endAfterCopy + 1 - RingCapacity
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t endAfterCopy = buffer->writeIndex.load(std::memory_order_relaxed);
+			uint64_t validBegin = endAfterCopy + 1 > RingCapacity ? endAfterCopy + 1 - RingCapacity : 0;
+			size_t skip = static_cast<size_t>(std::min(std::max(validBegin, begin) - begin, end - begin));
+
+			for (size_t i = skip; i < events.size(); ++i)
+			{
+				const Event& event = events[i];
+				file << (first ? "" : ",\n");
+				first = false;
+
+				if (event.type == EventType::Counter)
+				{
+					file << std::format("{{\"ph\":\"C\",\"name\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"args\":{{\"value\":{}}}}}",
+						Escape(event.name), buffer->threadId, event.begin / 1000.0, std::bit_cast<double>(event.end));
+				}
+				else
+				{
+					file << std::format("{{\"ph\":\"X\",\"name\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}",
+						Escape(event.name), buffer->threadId, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+					if (event.detail != nullptr)
+						file << std::format(",\"args\":{{\"detail\":\"{}\"}}", Escape(event.detail));
+					file << "}";
+				}
+			}
+			eventCount += events.size() - skip;
+		}
+		file << "\n]}\n";
+
+		std::cout << std::format("trace: {} events of {} threads written to {}", eventCount, buffers.size(), path) << std::endl;
+		return true;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+//CPU instrumentation, each thread records into its own ring buffer without lock
+//the newest events of every thread are written as Chrome trace-event json on demand,
+//open it in chrome://tracing or ui.perfetto.dev
+//SOCO_PROFILER=0 compiles every macro to nothing
+#ifndef SOCO_PROFILER
+#define SOCO_PROFILER 1
+#endif
+
+namespace Profiler
+{
+	//events kept per thread, older ones are overwritten
+	constexpr uint32_t RingCapacity = 1 << 16;
+
+	//ns since process start, steady_clock
+	uint64_t Now();
+
+	//name and detail must outlive the profiler: string literal or Intern
+	void RecordScope(const char* name, const char* detail, uint64_t begin, uint64_t end);
+	void RecordCounter(const char* name, double value);
+	//stable copy of a runtime string, takes a lock, don't call it per event in hot loops
+	const char* Intern(std::string_view text);
+	void SetThreadName(const char* name);
+
+	//snapshot of every thread's ring, safe while other threads keep recording
+	bool WriteChromeTrace(const std::string& path);
+
+	class ScopedEvent
+	{
+	public:
+		ScopedEvent(const char* name, const char* detail = nullptr) : mName(name), mDetail(detail), mBegin(Now()) {}
+		~ScopedEvent() { RecordScope(mName, mDetail, mBegin, Now()); }
+
+		ScopedEvent(const ScopedEvent&) = delete;
+		ScopedEvent& operator=(const ScopedEvent&) = delete;
+
+	private:
+		const char* mName;
+		const char* mDetail;
+		uint64_t mBegin;
+	};
+}
+
+#if SOCO_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) Profiler::ScopedEvent PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_SCOPE_DETAIL(name, detail) Profiler::ScopedEvent PROFILE_CONCAT(profileScope, __LINE__)(name, detail)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_COUNTER(name, value) Profiler::RecordCounter(name, value)
+#define PROFILE_THREAD(name) Profiler::SetThreadName(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_SCOPE_DETAIL(name, detail)
+#define PROFILE_FUNCTION()
+#define PROFILE_COUNTER(name, value)
+#define PROFILE_THREAD(name)
+#endif
@@ -53,8 +53,11 @@ struct QueueFamilyIndices {
 				if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
 					indices.transferFamily = i;
 
+				//headless: no surface, present queue is the graphics queue
 				VkBool32 presentSupport = false;
-				if (vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport) == VK_SUCCESS && presentSupport)
+				if (surface == VK_NULL_HANDLE)
+					indices.presentFamily = indices.graphicsFamily;
+				else if (vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport) == VK_SUCCESS && presentSupport)
 					indices.presentFamily = i;
 			}
 
@@ -0,0 +1,667 @@
+#include "RenderGraph.h"
+#include "dxUtil.hpp"
+#include "Profiler.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <numeric>
+
+namespace
+{
+	VkImageAspectFlags GetAspectMask(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		case VK_FORMAT_S8_UINT:
+			return VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+	}
+
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+RenderGraph::TextureHandle RenderGraph::ImportTexture(const std::string& name, const std::vector<VkImage>& images, const std::vector<VkImageView>& views,
+	VkFormat format, VkExtent2D extent, VkImageLayout finalLayout, VkPipelineStageFlags2KHR initialStage)
+{
+	Texture& texture = mTextures.emplace_back();
+	texture.name = name;
+	texture.format = format;
+	texture.extent = extent;
+	texture.imported = true;
+	texture.images = images;
+	texture.views = views;
+	texture.finalLayout = finalLayout;
+	texture.initialStages = initialStage;
+
+	return static_cast<TextureHandle>(mTextures.size() - 1);
+}
+
+RenderGraph::TextureHandle RenderGraph::CreateTexture(const std::string& name, VkFormat format, VkExtent2D extent)
+{
+	Texture& texture = mTextures.emplace_back();
+	texture.name = name;
+	texture.format = format;
+	texture.extent = extent;
+
+	return static_cast<TextureHandle>(mTextures.size() - 1);
+}
+
+RenderGraph::PassHandle RenderGraph::AddPass(const std::string& name, ExecuteFunc execute)
+{
+	Pass& pass = mPasses.emplace_back();
+	pass.name = name;
+	pass.execute = std::move(execute);
+
+	return static_cast<PassHandle>(mPasses.size() - 1);
+}
+
+void RenderGraph::WriteColor(PassHandle pass, TextureHandle texture, std::optional<VkClearColorValue> clear)
+{
+	Access access{ texture, AccessType::Color, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR };
+	if (clear.has_value())
+		access.clear = VkClearValue{ .color = *clear };
+
+	mTextures[texture].usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	AddAccess(pass, access);
+}
+
+void RenderGraph::WriteDepth(PassHandle pass, TextureHandle texture, std::optional<VkClearDepthStencilValue> clear)
+{
+	Access access{ texture, AccessType::Depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR };
+	if (clear.has_value())
+		access.clear = VkClearValue{ .depthStencil = *clear };
+
+	mTextures[texture].usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	AddAccess(pass, access);
+}
+
+void RenderGraph::ReadDepth(PassHandle pass, TextureHandle texture)
+{
+	//store op of the attachment is still a write, keep write access for the next barrier
+	Access access{ texture, AccessType::DepthRead, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR };
+
+	mTextures[texture].usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	AddAccess(pass, access);
+}
+
+void RenderGraph::ReadTexture(PassHandle pass, TextureHandle texture, VkPipelineStageFlags2KHR stages)
+{
+	Access access{ texture, AccessType::Sampled, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, stages, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR };
+
+	mTextures[texture].usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	AddAccess(pass, access);
+}
+
+void RenderGraph::ReadTransfer(PassHandle pass, TextureHandle texture)
+{
+	Access access{ texture, AccessType::TransferRead, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR };
+
+	mTextures[texture].usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	AddAccess(pass, access);
+}
+
+void RenderGraph::AddAccess(PassHandle pass, const Access& access)
+{
+	if (mCompiled)
+		throw std::runtime_error(std::format("render graph: pass {} is changed after compile", mPasses[pass].name));
+
+	for (const Access& other : mPasses[pass].accesses)
+	{
+		if (other.texture == access.texture)
+			throw std::runtime_error(std::format("render graph: pass {} access {} twice", mPasses[pass].name, mTextures[access.texture].name));
+	}
+
+	mPasses[pass].accesses.push_back(access);
+}
+
+void RenderGraph::Compile()
+{
+	PROFILE_FUNCTION();
+
+	CullPasses();
+	AllocateTransientTextures();
+	CreateRenderPasses();
+	BuildBarriers();
+	mCompiled = true;
+}
+
+void RenderGraph::CullPasses()
+{
+	//from the last pass, a pass is alive if it writes something read later or imported
+	std::vector<bool> needed(mTextures.size());
+	for (size_t i = 0; i < mTextures.size(); ++i)
+		needed[i] = mTextures[i].imported;
+
+	for (size_t i = mPasses.size(); i-- > 0;)
+	{
+		Pass& pass = mPasses[i];
+		pass.culled = std::none_of(pass.accesses.begin(), pass.accesses.end(), [&](const Access& access) {
+			return access.type == AccessType::TransferRead
+				|| ((access.type == AccessType::Color || access.type == AccessType::Depth) && needed[access.texture]);
+		});
+		if (pass.culled)
+			continue;
+
+		//clear overwrites the whole texture, writes before it are useless
+		for (const Access& access : pass.accesses)
+		{
+			if (access.clear.has_value())
+				needed[access.texture] = false;
+		}
+		for (const Access& access : pass.accesses)
+		{
+			if (!access.clear.has_value())
+				needed[access.texture] = true;
+		}
+	}
+
+	for (uint32_t passIndex = 0; passIndex < mPasses.size(); ++passIndex)
+	{
+		if (mPasses[passIndex].culled)
+			continue;
+
+		for (const Access& access : mPasses[passIndex].accesses)
+		{
+			Texture& texture = mTextures[access.texture];
+			texture.firstPass = std::min(texture.firstPass, passIndex);
+			texture.lastPass = std::max(texture.lastPass, passIndex);
+		}
+	}
+}
+
+void RenderGraph::AllocateTransientTextures()
+{
+	std::vector<TextureHandle> transients;
+	for (TextureHandle i = 0; i < mTextures.size(); ++i)
+	{
+		Texture& texture = mTextures[i];
+		if (texture.imported || texture.firstPass == UINT32_MAX)
+			continue;
+
+		VkImageCreateInfo imageInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = texture.format,
+			.extent = { texture.extent.width, texture.extent.height, 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = texture.usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+		};
+
+		VkImage image;
+		ThrowIfFailed(vkCreateImage(mDevice->GetDevice(), &imageInfo, nullptr, &image));
+		texture.images = { image };
+
+		vkGetImageMemoryRequirements(mDevice->GetDevice(), image, &texture.memRequirements);
+		texture.memoryTypeIndex = mDevice->FindMemoryType(texture.memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		transients.push_back(i);
+	}
+
+	//big first, each texture takes the lowest offset not used by a texture alive at the same time
+	std::sort(transients.begin(), transients.end(), [&](TextureHandle a, TextureHandle b) {
+		return mTextures[a].memRequirements.size > mTextures[b].memRequirements.size;
+	});
+
+	auto LifetimeOverlap = [](const Texture& a, const Texture& b) {
+		return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+	};
+	auto MemoryOverlap = [](const Texture& a, const Texture& b) {
+		return a.memoryTypeIndex == b.memoryTypeIndex
+			&& a.memoryOffset < b.memoryOffset + b.memRequirements.size && b.memoryOffset < a.memoryOffset + a.memRequirements.size;
+	};
+
+	std::vector<VkDeviceSize> memorySizes;
+	for (size_t i = 0; i < transients.size(); ++i)
+	{
+		Texture& texture = mTextures[transients[i]];
+		texture.memoryOffset = 0;
+
+		bool moved = true;
+		while (moved)
+		{
+			moved = false;
+			for (size_t j = 0; j < i; ++j)
+			{
+				const Texture& placed = mTextures[transients[j]];
+				if (LifetimeOverlap(texture, placed) && MemoryOverlap(texture, placed))
+				{
+					texture.memoryOffset = AlignUp(placed.memoryOffset + placed.memRequirements.size, texture.memRequirements.alignment);
+					moved = true;
+				}
+			}
+		}
+
+		if (memorySizes.size() <= texture.memoryTypeIndex)
+			memorySizes.resize(texture.memoryTypeIndex + 1, 0);
+		memorySizes[texture.memoryTypeIndex] = std::max(memorySizes[texture.memoryTypeIndex], texture.memoryOffset + texture.memRequirements.size);
+	}
+
+	mTransientMemories.assign(memorySizes.size(), VK_NULL_HANDLE);
+	for (uint32_t typeIndex = 0; typeIndex < memorySizes.size(); ++typeIndex)
+	{
+		if (memorySizes[typeIndex] != 0)
+			mTransientMemories[typeIndex] = mDevice->AllocateMemory(memorySizes[typeIndex], 1u << typeIndex, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	for (TextureHandle handle : transients)
+	{
+		Texture& texture = mTextures[handle];
+		ThrowIfFailed(vkBindImageMemory(mDevice->GetDevice(), texture.images[0], mTransientMemories[texture.memoryTypeIndex], texture.memoryOffset));
+
+		VkImageViewCreateInfo viewInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = texture.images[0],
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = texture.format,
+			.subresourceRange = { GetAspectMask(texture.format), 0, 1, 0, 1 }
+		};
+
+		VkImageView view;
+		ThrowIfFailed(vkCreateImageView(mDevice->GetDevice(), &viewInfo, nullptr, &view));
+		texture.views = { view };
+
+		//first use in a frame waits the last use of every texture in the same memory, include itself in the previous frame
+		for (TextureHandle otherHandle : transients)
+		{
+			const Texture& other = mTextures[otherHandle];
+			if (otherHandle != handle && !MemoryOverlap(texture, other))
+				continue;
+
+			for (const Access& access : mPasses[other.lastPass].accesses)
+			{
+				if (access.texture != otherHandle)
+					continue;
+
+				texture.initialStages |= access.stages;
+				if (!IsReadOnly(access.type))
+					texture.initialAccess |= access.access;
+			}
+		}
+	}
+}
+
+void RenderGraph::CreateRenderPasses()
+{
+	for (uint32_t passIndex = 0; passIndex < mPasses.size(); ++passIndex)
+	{
+		Pass& pass = mPasses[passIndex];
+		if (pass.culled)
+			continue;
+
+		std::vector<VkAttachmentDescription> attachments;
+		std::vector<VkAttachmentReference> colorRefs;
+		std::optional<VkAttachmentReference> depthRef;
+		std::vector<TextureHandle> attachmentTextures;
+		uint32_t variantCount = 1;
+
+		for (const Access& access : pass.accesses)
+		{
+			if (IsReadOnly(access.type))
+				continue;
+
+			const Texture& texture = mTextures[access.texture];
+			//layout is done by graph barriers, render pass keeps it unchanged
+			VkAttachmentDescription attachment
+			{
+				.format = texture.format,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.loadOp = access.clear.has_value() ? VK_ATTACHMENT_LOAD_OP_CLEAR
+					: texture.firstPass < passIndex ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				.storeOp = texture.imported || texture.lastPass > passIndex ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.initialLayout = access.layout,
+				.finalLayout = access.layout
+			};
+
+			VkAttachmentReference ref{ .attachment = static_cast<uint32_t>(attachments.size()), .layout = access.layout };
+			VkRenderingAttachmentInfoKHR renderingAttachment
+			{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+				.imageLayout = access.layout,
+				.loadOp = attachment.loadOp,
+				.storeOp = attachment.storeOp,
+				.clearValue = access.clear.value_or(VkClearValue{})
+			};
+			if (access.type == AccessType::Color)
+			{
+				colorRefs.push_back(ref);
+				pass.colorFormats.push_back(texture.format);
+				pass.colorAttachments.push_back(renderingAttachment);
+				pass.colorTextures.push_back(access.texture);
+			}
+			else
+			{
+				depthRef = ref;
+				pass.depthFormat = texture.format;
+				pass.depthAttachment = renderingAttachment;
+				pass.depthTexture = access.texture;
+			}
+
+			attachments.push_back(attachment);
+			attachmentTextures.push_back(access.texture);
+			pass.clearValues.push_back(access.clear.value_or(VkClearValue{}));
+			pass.extent = texture.extent;
+			variantCount = std::max(variantCount, static_cast<uint32_t>(texture.views.size()));
+		}
+
+		//pass without attachment(copy, compute) records outside render pass
+		if (attachments.empty())
+			continue;
+
+		if (mDevice->IsDynamicRenderingSupported())
+		{
+			pass.rendering = true;
+			continue;
+		}
+
+		VkSubpassDescription subpass
+		{
+			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+			.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size()),
+			.pColorAttachments = colorRefs.data(),
+			.pDepthStencilAttachment = depthRef.has_value() ? &depthRef.value() : nullptr
+		};
+
+		VkRenderPassCreateInfo renderPassInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+			.attachmentCount = static_cast<uint32_t>(attachments.size()),
+			.pAttachments = attachments.data(),
+			.subpassCount = 1,
+			.pSubpasses = &subpass
+		};
+
+		ThrowIfFailed(vkCreateRenderPass(mDevice->GetDevice(), &renderPassInfo, nullptr, &pass.renderPass));
+
+		pass.framebuffers.resize(variantCount);
+		for (uint32_t variant = 0; variant < variantCount; ++variant)
+		{
+			std::vector<VkImageView> views;
+			for (TextureHandle texture : attachmentTextures)
+				views.push_back(GetTextureView(texture, variant));
+
+			VkFramebufferCreateInfo framebufferInfo
+			{
+				.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+				.renderPass = pass.renderPass,
+				.attachmentCount = static_cast<uint32_t>(views.size()),
+				.pAttachments = views.data(),
+				.width = pass.extent.width,
+				.height = pass.extent.height,
+				.layers = 1
+			};
+
+			ThrowIfFailed(vkCreateFramebuffer(mDevice->GetDevice(), &framebufferInfo, nullptr, &pass.framebuffers[variant]));
+		}
+	}
+}
+
+void RenderGraph::BuildBarriers()
+{
+	std::vector<TextureState> states(mTextures.size());
+	for (size_t i = 0; i < mTextures.size(); ++i)
+	{
+		states[i].writeStages = mTextures[i].initialStages;
+		states[i].writeAccess = mTextures[i].initialAccess;
+	}
+
+	auto MakeBarrier = [&](TextureHandle texture, VkPipelineStageFlags2KHR srcStages, VkAccessFlags2KHR srcAccess,
+		VkPipelineStageFlags2KHR dstStages, VkAccessFlags2KHR dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout)
+	{
+		return VkImageMemoryBarrier2KHR
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR,
+			.srcStageMask = srcStages,
+			.srcAccessMask = srcAccess,
+			.dstStageMask = dstStages,
+			.dstAccessMask = dstAccess,
+			.oldLayout = oldLayout,
+			.newLayout = newLayout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.subresourceRange = { GetAspectMask(mTextures[texture].format), 0, 1, 0, 1 }
+		};
+	};
+
+	uint32_t barrierCount = 0;
+	uint32_t batchCount = 0;
+	for (Pass& pass : mPasses)
+	{
+		if (pass.culled)
+			continue;
+
+		for (const Access& access : pass.accesses)
+		{
+			TextureState& state = states[access.texture];
+			bool layoutChange = state.layout != access.layout;
+
+			if (IsReadOnly(access.type))
+			{
+				//read after read in the same layout and stage is already visible
+				if (!layoutChange && (state.writeStages == 0 || (access.stages & ~state.readStages) == 0))
+					continue;
+
+				//layout transition is a write, it must wait the reads before
+				pass.barriers.push_back(MakeBarrier(access.texture,
+					state.writeStages | (layoutChange ? state.readStages : 0), state.writeAccess,
+					access.stages, access.access, state.layout, access.layout));
+
+				if (layoutChange)
+				{
+					state.writeStages = access.stages;
+					state.writeAccess = 0;
+					state.readStages = access.stages;
+					state.readAccess = access.access;
+				}
+				else
+				{
+					state.readStages |= access.stages;
+					state.readAccess |= access.access;
+				}
+			}
+			else
+			{
+				if (!layoutChange && state.writeStages == 0 && state.readStages == 0)
+				{
+					state.writeStages = access.stages;
+					state.writeAccess = access.access;
+					continue;
+				}
+
+				pass.barriers.push_back(MakeBarrier(access.texture,
+					state.writeStages | state.readStages, state.writeAccess,
+					access.stages, access.access, state.layout, access.layout));
+
+				state.writeStages = access.stages;
+				state.writeAccess = access.access;
+				state.readStages = 0;
+				state.readAccess = 0;
+			}
+
+			state.layout = access.layout;
+			pass.barrierTextures.push_back(access.texture);
+		}
+
+		barrierCount += pass.barriers.size();
+		batchCount += pass.barriers.empty() ? 0 : 1;
+	}
+
+	for (TextureHandle i = 0; i < mTextures.size(); ++i)
+	{
+		const Texture& texture = mTextures[i];
+		const TextureState& state = states[i];
+		if (!texture.imported || texture.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || texture.finalLayout == state.layout)
+			continue;
+
+		mFinalBarriers.push_back(MakeBarrier(i, state.writeStages | state.readStages, state.writeAccess,
+			VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, 0, state.layout, texture.finalLayout));
+		mFinalBarrierTextures.push_back(i);
+	}
+	barrierCount += mFinalBarriers.size();
+	batchCount += mFinalBarriers.empty() ? 0 : 1;
+
+	uint32_t culledCount = std::count_if(mPasses.begin(), mPasses.end(), [](const Pass& pass) { return pass.culled; });
+	VkDeviceSize transientSize = std::accumulate(mTextures.begin(), mTextures.end(), VkDeviceSize(0), [](VkDeviceSize sum, const Texture& texture) {
+		return sum + (texture.imported || texture.firstPass == UINT32_MAX ? 0 : texture.memRequirements.size);
+	});
+	VkDeviceSize aliasedSize = 0;
+	for (TextureHandle i = 0; i < mTextures.size(); ++i)
+	{
+		if (!mTextures[i].imported && mTextures[i].firstPass != UINT32_MAX)
+			aliasedSize = std::max(aliasedSize, mTextures[i].memoryOffset + mTextures[i].memRequirements.size);
+	}
+
+	LOG_INFO("render graph: {} passes ({} culled), transient memory {} KB (unaliased {} KB), {} barriers in {} batches",
+		mPasses.size(), culledCount, aliasedSize / 1024, transientSize / 1024, barrierCount, batchCount);
+}
+
+VkImage RenderGraph::GetImage(TextureHandle texture, uint32_t variant) const
+{
+	const std::vector<VkImage>& images = mTextures[texture].images;
+	return images[variant % images.size()];
+}
+
+VkImageView RenderGraph::GetTextureView(TextureHandle texture, uint32_t variant) const
+{
+	const std::vector<VkImageView>& views = mTextures[texture].views;
+	return views[variant % views.size()];
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer, uint32_t variant)
+{
+	auto FlushBarriers = [&](std::vector<VkImageMemoryBarrier2KHR>& barriers, const std::vector<TextureHandle>& textures) {
+		if (barriers.empty())
+			return;
+
+		for (size_t i = 0; i < barriers.size(); ++i)
+			barriers[i].image = GetImage(textures[i], variant);
+
+		VkDependencyInfoKHR dependencyInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+			.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size()),
+			.pImageMemoryBarriers = barriers.data()
+		};
+		mDevice->CmdPipelineBarrier2(commandBuffer, dependencyInfo);
+	};
+
+	GpuProfiler* gpuProfiler = mDevice->GetGpuProfiler();
+	for (Pass& pass : mPasses)
+	{
+		if (pass.culled)
+			continue;
+
+		//barrier wait is charged to the pass that needs it
+		GpuProfiler::Scope gpuScope(*gpuProfiler, commandBuffer, pass.name);
+		FlushBarriers(pass.barriers, pass.barrierTextures);
+
+		if (pass.rendering)
+		{
+			for (size_t i = 0; i < pass.colorAttachments.size(); ++i)
+				pass.colorAttachments[i].imageView = GetTextureView(pass.colorTextures[i], variant);
+			if (pass.depthTexture.has_value())
+				pass.depthAttachment.imageView = GetTextureView(*pass.depthTexture, variant);
+
+			VkRenderingInfoKHR renderingInfo
+			{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+				.renderArea = { { 0, 0 }, pass.extent },
+				.layerCount = 1,
+				.colorAttachmentCount = static_cast<uint32_t>(pass.colorAttachments.size()),
+				.pColorAttachments = pass.colorAttachments.data(),
+				.pDepthAttachment = pass.depthTexture.has_value() ? &pass.depthAttachment : nullptr
+			};
+
+			mDevice->CmdBeginRendering(commandBuffer, renderingInfo);
+			pass.execute(commandBuffer);
+			mDevice->CmdEndRendering(commandBuffer);
+			continue;
+		}
+
+		if (pass.renderPass == VK_NULL_HANDLE)
+		{
+			pass.execute(commandBuffer);
+			continue;
+		}
+
+		VkRenderPassBeginInfo renderPassBeginInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+			.renderPass = pass.renderPass,
+			.framebuffer = pass.framebuffers[variant % pass.framebuffers.size()],
+			.renderArea = { { 0, 0 }, pass.extent },
+			.clearValueCount = static_cast<uint32_t>(pass.clearValues.size()),
+			.pClearValues = pass.clearValues.data()
+		};
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		pass.execute(commandBuffer);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	FlushBarriers(mFinalBarriers, mFinalBarrierTextures);
+}
+
+void RenderGraph::Clear()
+{
+	VkDevice device = mDevice->GetDevice();
+
+	for (Pass& pass : mPasses)
+	{
+		for (VkFramebuffer framebuffer : pass.framebuffers)
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		if (pass.renderPass != VK_NULL_HANDLE)
+			vkDestroyRenderPass(device, pass.renderPass, nullptr);
+	}
+
+	for (Texture& texture : mTextures)
+	{
+		if (texture.imported)
+			continue;
+
+		for (VkImageView view : texture.views)
+			vkDestroyImageView(device, view, nullptr);
+		for (VkImage image : texture.images)
+			vkDestroyImage(device, image, nullptr);
+	}
+
+	for (VkDeviceMemory memory : mTransientMemories)
+	{
+		if (memory != VK_NULL_HANDLE)
+			vkFreeMemory(device, memory, nullptr);
+	}
+
+	mTextures.clear();
+	mPasses.clear();
+	mTransientMemories.clear();
+	mFinalBarriers.clear();
+	mFinalBarrierTextures.clear();
+	mCompiled = false;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "DeviceComponent.h"
+
+//Passes declare the textures they read and write, Compile culls passes whose output is never used,
+//precomputes one barrier batch per pass and places transient textures with disjoint lifetimes in the same memory
+//Execute only replays the compiled result, so a new pass does not add per frame allocation
+//every executed pass is a GpuProfiler scope of its name
+//with VK_KHR_dynamic_rendering passes begin rendering on the attachment views, no render pass or framebuffer is created
+class RenderGraph : public DeviceComponent
+{
+public:
+	using TextureHandle = uint32_t;
+	using PassHandle = uint32_t;
+	using ExecuteFunc = std::function<void(VkCommandBuffer)>;
+
+	RenderGraph(Device* device) : DeviceComponent(device) {}
+	~RenderGraph() { Clear(); }
+
+	//Textures owned outside, one image per variant(e.g. swap chain images), Execute select the variant
+	//initialStage: stage that the first use must wait, e.g. acquire semaphore wait stage
+	TextureHandle ImportTexture(const std::string& name, const std::vector<VkImage>& images, const std::vector<VkImageView>& views,
+		VkFormat format, VkExtent2D extent, VkImageLayout finalLayout, VkPipelineStageFlags2KHR initialStage);
+	//Transient textures only live inside the graph, usage is collected from the passes
+	TextureHandle CreateTexture(const std::string& name, VkFormat format, VkExtent2D extent);
+
+	PassHandle AddPass(const std::string& name, ExecuteFunc execute);
+	void WriteColor(PassHandle pass, TextureHandle texture, std::optional<VkClearColorValue> clear = std::nullopt);
+	void WriteDepth(PassHandle pass, TextureHandle texture, std::optional<VkClearDepthStencilValue> clear = std::nullopt);
+	//depth test without write, e.g. main pass after depth prepass
+	void ReadDepth(PassHandle pass, TextureHandle texture);
+	void ReadTexture(PassHandle pass, TextureHandle texture, VkPipelineStageFlags2KHR stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR);
+	//copy source, e.g. readback to host; the copy leaves the graph so the pass is never culled
+	void ReadTransfer(PassHandle pass, TextureHandle texture);
+
+	void Compile();
+	void Execute(VkCommandBuffer commandBuffer, uint32_t variant = 0);
+	void Clear();
+
+	//valid after Compile, VK_NULL_HANDLE for culled pass and with dynamic rendering
+	VkRenderPass GetRenderPass(PassHandle pass) const { return mPasses[pass].renderPass; }
+	//attachment formats in the order they are written, what a pipeline of the pass is created for with dynamic rendering
+	const std::vector<VkFormat>& GetColorFormats(PassHandle pass) const { return mPasses[pass].colorFormats; }
+	VkFormat GetDepthFormat(PassHandle pass) const { return mPasses[pass].depthFormat; }
+	VkImageView GetTextureView(TextureHandle texture, uint32_t variant = 0) const;
+	bool IsPassCulled(PassHandle pass) const { return mPasses[pass].culled; }
+
+private:
+	enum class AccessType { Color, Depth, DepthRead, Sampled, TransferRead };
+	//not an attachment, no store op writes it
+	static bool IsReadOnly(AccessType type) { return type == AccessType::Sampled || type == AccessType::TransferRead; }
+
+	struct Access
+	{
+		TextureHandle texture;
+		AccessType type;
+		VkImageLayout layout;
+		VkPipelineStageFlags2KHR stages;
+		VkAccessFlags2KHR access;
+		std::optional<VkClearValue> clear;
+	};
+
+	struct Texture
+	{
+		std::string name;
+		VkFormat format;
+		VkExtent2D extent;
+		VkImageUsageFlags usage = 0;
+
+		bool imported = false;
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		//state at the start of a frame, for transient it's the last use of every texture sharing its memory
+		VkPipelineStageFlags2KHR initialStages = 0;
+		VkAccessFlags2KHR initialAccess = 0;
+
+		//lifetime in pass index, transient memory placement
+		uint32_t firstPass = UINT32_MAX;
+		uint32_t lastPass = 0;
+		VkMemoryRequirements memRequirements = {};
+		uint32_t memoryTypeIndex = 0;
+		VkDeviceSize memoryOffset = 0;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		ExecuteFunc execute;
+		std::vector<Access> accesses;
+		bool culled = false;
+
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		std::vector<VkFramebuffer> framebuffers;
+		VkExtent2D extent = {};
+		std::vector<VkClearValue> clearValues;
+		std::vector<VkFormat> colorFormats;
+		VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+		//dynamic rendering, image view is filled in Execute
+		bool rendering = false;
+		std::vector<VkRenderingAttachmentInfoKHR> colorAttachments;
+		std::vector<TextureHandle> colorTextures;
+		VkRenderingAttachmentInfoKHR depthAttachment = {};
+		std::optional<TextureHandle> depthTexture;
+
+		//barriers before the pass, image is filled in Execute for imported textures
+		std::vector<VkImageMemoryBarrier2KHR> barriers;
+		std::vector<TextureHandle> barrierTextures;
+	};
+
+	struct TextureState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags2KHR writeStages = 0;
+		VkAccessFlags2KHR writeAccess = 0;
+		//reads after the last write, write must wait them
+		VkPipelineStageFlags2KHR readStages = 0;
+		VkAccessFlags2KHR readAccess = 0;
+	};
+
+	void AddAccess(PassHandle pass, const Access& access);
+	void CullPasses();
+	void AllocateTransientTextures();
+	void CreateRenderPasses();
+	void BuildBarriers();
+	VkImage GetImage(TextureHandle texture, uint32_t variant) const;
+
+	std::vector<Texture> mTextures;
+	std::vector<Pass> mPasses;
+
+	std::vector<VkDeviceMemory> mTransientMemories;
+	//transition of imported textures after the last pass
+	std::vector<VkImageMemoryBarrier2KHR> mFinalBarriers;
+	std::vector<TextureHandle> mFinalBarrierTextures;
+	bool mCompiled = false;
+};
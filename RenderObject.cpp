@@ -1,2 +1,6 @@
 ﻿#include "RenderObject.h"
 
+RenderObject::RenderObject(Mesh* mesh, uint32_t materialIndex, const Transform& transform)
+    : mMesh(mesh), mMaterialIndex(materialIndex), mTransform(transform)
+{
+}
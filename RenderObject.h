@@ -1,18 +1,26 @@
 ﻿#pragma once
 
 #include "Mesh.h"
-#include "Shader.h"
 #include "Transform.hpp"
 
+//Scene object, transform may be parented to another object so objects need stable address
 class RenderObject
 {
 public:
-    RenderObject(Mesh* mesh, Shader* shader);
+    RenderObject(Mesh* mesh, uint32_t materialIndex, const Transform& transform = {});
+
+    Mesh* GetMesh() const { return mMesh; }
+    uint32_t GetMaterialIndex() const { return mMaterialIndex; }
+    Transform* GetTransform() { return &mTransform; }
+    const Transform* GetTransform() const { return &mTransform; }
+
+    //last selected lod, lod selection keeps hysteresis with it
+    uint32_t GetLod() const { return mLod; }
+    void SetLod(uint32_t lod) { mLod = lod; }
 
-    
-    
 private:
     Mesh* mMesh;
-    Shader* mShader;
+    uint32_t mMaterialIndex;
     Transform mTransform;
+    uint32_t mLod = 0;
 };
@@ -1,19 +1,30 @@
 #pragma once
 
 #include "dxUtil.hpp"
+#include "ConcurrentCache.hpp"
 
 #include <vulkan/vulkan.h>
-#include <regex>
-#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <charconv>
+#include <format>
 
 struct SamplerDesc
 {
-	VkFilter filter;
-	bool anisoEnable;
-	uint32_t maxAniso;
-	VkSamplerAddressMode addressMode;
+	VkFilter magFilter = VK_FILTER_NEAREST;
+	VkFilter minFilter = VK_FILTER_NEAREST;
+	VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	bool anisoEnable = false;
+	uint32_t maxAniso = 0;
+	VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	bool compareEnable = false;
+	VkCompareOp compareOp = VK_COMPARE_OP_NEVER;
+	float mipLodBias = 0.0f;
+	VkBorderColor borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
 
-	std::strong_ordering operator<=>(const SamplerDesc&) const = default;
+	//mipLodBias is float, so ordering is partial
+	auto operator<=>(const SamplerDesc&) const = default;
 
 //	bool operator<(const SamplerDesc& rhs) const 
 //	{
@@ -52,12 +63,21 @@ struct std::hash<SamplerDesc>
 	std::size_t operator()(const SamplerDesc& key) const
 	{
 		using VkFilterUnderlyingType = std::underlying_type_t<VkFilter>;
+		using VkSamplerMipmapModeUnderlyingType = std::underlying_type_t<VkSamplerMipmapMode>;
 		using VkSamplerAddressModeUnderlyingType = std::underlying_type_t<VkSamplerAddressMode>;
+		using VkCompareOpUnderlyingType = std::underlying_type_t<VkCompareOp>;
+		using VkBorderColorUnderlyingType = std::underlying_type_t<VkBorderColor>;
 
-		size_t res = std::hash<VkFilterUnderlyingType>()(key.filter);
+		size_t res = std::hash<VkFilterUnderlyingType>()(key.magFilter);
+		res ^= std::hash<VkFilterUnderlyingType>()(key.minFilter) << 1;
+		res ^= std::hash<VkSamplerMipmapModeUnderlyingType>()(key.mipmapMode) << 2;
 		res ^= std::hash<bool>()(key.anisoEnable) << 4;
 		res ^= std::hash<uint32_t>()(key.maxAniso) << 2;
 		res ^= std::hash<VkSamplerAddressModeUnderlyingType>()(key.addressMode) << 1;
+		res ^= std::hash<bool>()(key.compareEnable) << 5;
+		res ^= std::hash<VkCompareOpUnderlyingType>()(key.compareOp) << 3;
+		res ^= std::hash<float>()(key.mipLodBias) << 1;
+		res ^= std::hash<VkBorderColorUnderlyingType>()(key.borderColor) << 6;
 
 		return res;
 	}
@@ -77,71 +97,140 @@ public:
 
 	//}
 
+	//thread safe, sampler of same desc only create once
 	VkSampler Get(const SamplerDesc& samplerDesc)
 	{
-		auto ite = mSamplerPool.find(samplerDesc);
-		VkSampler sampler;
-		if (ite != mSamplerPool.end())
-		{
-			sampler = ite->second;
-		}
-		else
-		{
-			sampler = CreateSampler(samplerDesc);
-			mSamplerPool.insert(std::make_pair(samplerDesc, sampler));
-		}
-
-		return sampler;
+		return mSamplerPool.GetOrCreate(samplerDesc, [this](const SamplerDesc& desc) { return CreateSampler(desc); });
 	}
 
-	//name regular
+	//name regular, case insensitive
 	//filter linear\nearest
 	//aniso aniso__
 	//addressMode repeat mirror clamp edge border
-	static SamplerDesc ParseSamplerName(const std::string samplerName)
+	//compare cmp + never less equal lessequal greater notequal greaterequal always, e.g. gsamShadowCmpLessEqual
+	//constexpr, C++ side sampler can parse on compile time / C++samplerڱڽ
+	static constexpr SamplerDesc ParseSamplerName(std::string_view samplerName)
 	{
-		std::string lowerSamplerName(samplerName.size(), '_');
-		std::transform(samplerName.cbegin(), samplerName.cend(), lowerSamplerName.begin(), (int (*)(int))std::tolower);
-
 		SamplerDesc samplerDesc;
 		//filter
-		if (lowerSamplerName.find("linear") != std::string::npos)
-			samplerDesc.filter = VK_FILTER_LINEAR;
-		else
-			samplerDesc.filter = VK_FILTER_NEAREST;
+		VkFilter filter = ContainsNoCase(samplerName, "linear") ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+		samplerDesc.magFilter = filter;
+		samplerDesc.minFilter = filter;
+		samplerDesc.mipmapMode = filter == VK_FILTER_LINEAR ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
 
-		//aniso
-		const std::regex anisoRgx("aniso(\\d+)");
-		std::smatch res;
-		if (std::regex_search(lowerSamplerName.cbegin(), lowerSamplerName.cend(), res, anisoRgx))
-		{
-			std::string aniso = res[1];
-			samplerDesc.anisoEnable = true;
-			samplerDesc.maxAniso = std::stoi(aniso);
-		}
-		else
+		//aniso, same as regex aniso(\d+)
+		for (size_t pos = FindNoCase(samplerName, "aniso"); pos != std::string_view::npos; pos = FindNoCase(samplerName, "aniso", pos + 1))
 		{
-			samplerDesc.anisoEnable = false;
-			samplerDesc.maxAniso = 0;
+			size_t digitEnd = pos + 5;
+			uint32_t aniso = 0;
+			while (digitEnd < samplerName.size() && samplerName[digitEnd] >= '0' && samplerName[digitEnd] <= '9')
+				aniso = aniso * 10 + static_cast<uint32_t>(samplerName[digitEnd++] - '0');
+
+			if (digitEnd != pos + 5)
+			{
+				samplerDesc.anisoEnable = true;
+				samplerDesc.maxAniso = aniso;
+				break;
+			}
 		}
 
 		//address mode
-		samplerDesc.addressMode = GetAddressMode(lowerSamplerName);
+		samplerDesc.addressMode = GetAddressMode(samplerName);
+
+		//compare
+		size_t cmpPos = FindNoCase(samplerName, "cmp");
+		if (cmpPos != std::string_view::npos)
+			samplerDesc.compareEnable = ParseCompareOp(samplerName.substr(cmpPos + 3), false, samplerDesc.compareOp);
+
 		return samplerDesc;
 	}
 
+	//explicit sampler state in hlsl, write in comment on the line before declaration, override the name parse
+	//hlslʽsampler״̬, дһеע, ֽĽ
+	//	//[[sampler(min=linear, mag=linear, mip=nearest, address=clampborder, border=opaquewhite, compare=lessequal, lodbias=-0.5, aniso=4)]]
+	//	SamplerComparisonState gsamShadow : register(s1);
+	//keys: filter(min+mag+mip) min mag mip address border compare lodbias aniso
+	//SamplerComparisonState without compare key use lessequal
+	static std::unordered_map<std::string, SamplerDesc> ParseSamplerAnnotations(std::string_view source)
+	{
+		constexpr std::string_view annotationBegin = "[[sampler(";
+		constexpr std::string_view annotationEnd = ")]]";
+		constexpr std::string_view samplerState = "SamplerState";
+		constexpr std::string_view samplerComparisonState = "SamplerComparisonState";
+
+		auto IsIdentifierChar = [](char c) {
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+		};
+		auto IsSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+
+		std::unordered_map<std::string, SamplerDesc> res;
+
+		for (size_t pos = source.find("Sampler"); pos != std::string_view::npos; pos = source.find("Sampler", pos + 1))
+		{
+			if (pos != 0 && IsIdentifierChar(source[pos - 1]))
+				continue;
+
+			bool isComparison = source.substr(pos).starts_with(samplerComparisonState);
+			if (!isComparison && !source.substr(pos).starts_with(samplerState))
+				continue;
+
+			size_t nameBegin = pos + (isComparison ? samplerComparisonState.size() : samplerState.size());
+			if (nameBegin >= source.size() || !IsSpace(source[nameBegin]))
+				continue;
+			while (nameBegin < source.size() && IsSpace(source[nameBegin]))
+				++nameBegin;
+			size_t nameEnd = nameBegin;
+			while (nameEnd < source.size() && IsIdentifierChar(source[nameEnd]))
+				++nameEnd;
+			if (nameEnd == nameBegin)
+				continue;
+
+			std::string name(source.substr(nameBegin, nameEnd - nameBegin));
+
+			//annotation must be right before declaration, only space between them
+			std::string_view annotation;
+			size_t annotationPos = source.rfind(annotationBegin, pos);
+			if (annotationPos != std::string_view::npos)
+			{
+				size_t endPos = source.find(annotationEnd, annotationPos);
+				if (endPos != std::string_view::npos && endPos < pos)
+				{
+					size_t argsBegin = annotationPos + annotationBegin.size();
+					std::string_view between = source.substr(endPos + annotationEnd.size(), pos - endPos - annotationEnd.size());
+					if (std::all_of(between.begin(), between.end(), IsSpace))
+						annotation = source.substr(argsBegin, endPos - argsBegin);
+				}
+			}
+
+			if (annotation.empty() && !isComparison)
+				continue;
+
+			SamplerDesc samplerDesc = ParseSamplerName(name);
+			if (isComparison && !samplerDesc.compareEnable)
+			{
+				samplerDesc.compareEnable = true;
+				samplerDesc.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+			}
+
+			ApplyAnnotation(name, annotation, samplerDesc);
+			res[name] = samplerDesc;
+		}
+
+		return res;
+	}
+
 private:
 	uint32_t mMaxSamplerAnisotropy;
 	VkDevice mDevice;
-	std::map<SamplerDesc, VkSampler> mSamplerPool;
+	ConcurrentCache<SamplerDesc, VkSampler> mSamplerPool;
 
 	void Clear()
 	{
-		for (auto mapIte = mSamplerPool.begin(); mapIte != mSamplerPool.end(); ++mapIte)
-		{
-			vkDestroySampler(mDevice, mapIte->second, nullptr);
-		}
-		mSamplerPool.clear();
+		mSamplerPool.ForEach([this](const SamplerDesc&, VkSampler sampler) {
+			if (sampler != VK_NULL_HANDLE)
+				vkDestroySampler(mDevice, sampler, nullptr);
+		});
+		mSamplerPool.Clear();
 	}
 
 	SamplerPool() = default;
@@ -160,11 +249,15 @@ private:
 		createInfo.addressModeU = samplerDesc.addressMode;
 		createInfo.addressModeV = samplerDesc.addressMode;
 		createInfo.addressModeW = samplerDesc.addressMode;
-		createInfo.magFilter = samplerDesc.filter;
-		createInfo.minFilter = samplerDesc.filter;
-		createInfo.mipmapMode = samplerDesc.filter == VK_FILTER_LINEAR ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		createInfo.magFilter = samplerDesc.magFilter;
+		createInfo.minFilter = samplerDesc.minFilter;
+		createInfo.mipmapMode = samplerDesc.mipmapMode;
+		createInfo.mipLodBias = samplerDesc.mipLodBias;
 		createInfo.anisotropyEnable = samplerDesc.anisoEnable ? VK_TRUE : VK_FALSE;
 		createInfo.maxAnisotropy = std::min(samplerDesc.maxAniso, mMaxSamplerAnisotropy);
+		createInfo.compareEnable = samplerDesc.compareEnable ? VK_TRUE : VK_FALSE;
+		createInfo.compareOp = samplerDesc.compareOp;
+		createInfo.borderColor = samplerDesc.borderColor;
 
 		VkSampler newSampler;
 		ThrowIfFailed(vkCreateSampler(mDevice, &createInfo, nullptr, &newSampler));
@@ -196,11 +289,201 @@ private:
 		return createInfo;
 	}
 
-	static VkSamplerAddressMode GetAddressMode(const std::string lowerSamplerName)
+	static constexpr char ToLower(char c)
+	{
+		return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+
+	//lowerPattern must be lower case
+	static constexpr bool StartsWithNoCase(std::string_view str, std::string_view lowerPattern)
+	{
+		if (str.size() < lowerPattern.size())
+			return false;
+
+		for (size_t i = 0; i < lowerPattern.size(); ++i)
+		{
+			if (ToLower(str[i]) != lowerPattern[i])
+				return false;
+		}
+
+		return true;
+	}
+
+	static constexpr size_t FindNoCase(std::string_view str, std::string_view lowerPattern, size_t offset = 0)
+	{
+		for (size_t pos = offset; pos + lowerPattern.size() <= str.size(); ++pos)
+		{
+			if (StartsWithNoCase(str.substr(pos), lowerPattern))
+				return pos;
+		}
+
+		return std::string_view::npos;
+	}
+
+	static constexpr bool ContainsNoCase(std::string_view str, std::string_view lowerPattern)
+	{
+		return FindNoCase(str, lowerPattern) != std::string_view::npos;
+	}
+
+	static constexpr bool EqualNoCase(std::string_view str, std::string_view lowerPattern)
+	{
+		return str.size() == lowerPattern.size() && StartsWithNoCase(str, lowerPattern);
+	}
+
+	//prefix match for sampler name (gsamCmpLessEqualXXX), exact match for annotation value
+	static constexpr bool ParseCompareOp(std::string_view str, bool exact, VkCompareOp& compareOp)
+	{
+		//longer name first, "lessequal" must match before "less"
+		constexpr std::pair<std::string_view, VkCompareOp> compareOps[] = {
+			{ "lessorequal", VK_COMPARE_OP_LESS_OR_EQUAL },
+			{ "lessequal", VK_COMPARE_OP_LESS_OR_EQUAL },
+			{ "greaterorequal", VK_COMPARE_OP_GREATER_OR_EQUAL },
+			{ "greaterequal", VK_COMPARE_OP_GREATER_OR_EQUAL },
+			{ "notequal", VK_COMPARE_OP_NOT_EQUAL },
+			{ "less", VK_COMPARE_OP_LESS },
+			{ "greater", VK_COMPARE_OP_GREATER },
+			{ "equal", VK_COMPARE_OP_EQUAL },
+			{ "always", VK_COMPARE_OP_ALWAYS },
+			{ "never", VK_COMPARE_OP_NEVER },
+		};
+
+		for (const auto& [name, op] : compareOps)
+		{
+			if (exact ? EqualNoCase(str, name) : StartsWithNoCase(str, name))
+			{
+				compareOp = op;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static constexpr bool ParseFilter(std::string_view str, VkFilter& filter)
+	{
+		if (EqualNoCase(str, "linear"))
+			filter = VK_FILTER_LINEAR;
+		else if (EqualNoCase(str, "nearest") || EqualNoCase(str, "point"))
+			filter = VK_FILTER_NEAREST;
+		else
+			return false;
+
+		return true;
+	}
+
+	static constexpr bool ParseAddressMode(std::string_view str, VkSamplerAddressMode& addressMode)
+	{
+		constexpr std::pair<std::string_view, VkSamplerAddressMode> addressModes[] = {
+			{ "repeat", VK_SAMPLER_ADDRESS_MODE_REPEAT },
+			{ "wrap", VK_SAMPLER_ADDRESS_MODE_REPEAT },
+			{ "mirror", VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT },
+			{ "mirrorrepeat", VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT },
+			{ "clamp", VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+			{ "clampedge", VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+			{ "border", VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER },
+			{ "clampborder", VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER },
+			{ "mirrorclampedge", VK_SAMPLER_ADDRESS_MODE_MIRROR_CLAMP_TO_EDGE },
+		};
+
+		for (const auto& [name, mode] : addressModes)
+		{
+			if (EqualNoCase(str, name))
+			{
+				addressMode = mode;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static constexpr bool ParseBorderColor(std::string_view str, VkBorderColor& borderColor)
+	{
+		if (EqualNoCase(str, "transparentblack"))
+			borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+		else if (EqualNoCase(str, "opaqueblack"))
+			borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		else if (EqualNoCase(str, "opaquewhite"))
+			borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		else
+			return false;
+
+		return true;
+	}
+
+	//annotation: key=value, key=value ...
+	static void ApplyAnnotation(const std::string& samplerName, std::string_view annotation, SamplerDesc& samplerDesc)
+	{
+		auto Trim = [](std::string_view str) {
+			while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+				str.remove_prefix(1);
+			while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+				str.remove_suffix(1);
+			return str;
+		};
+
+		while (!annotation.empty())
+		{
+			size_t comma = annotation.find(',');
+			std::string_view arg = Trim(annotation.substr(0, comma));
+			annotation = comma == std::string_view::npos ? std::string_view() : annotation.substr(comma + 1);
+
+			if (arg.empty())
+				continue;
+
+			size_t equal = arg.find('=');
+			std::string_view key = Trim(arg.substr(0, equal));
+			std::string_view value = equal == std::string_view::npos ? std::string_view() : Trim(arg.substr(equal + 1));
+
+			bool success = true;
+			if (EqualNoCase(key, "filter"))
+			{
+				VkFilter filter = VK_FILTER_NEAREST;
+				success = ParseFilter(value, filter);
+				samplerDesc.magFilter = filter;
+				samplerDesc.minFilter = filter;
+				samplerDesc.mipmapMode = filter == VK_FILTER_LINEAR ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			}
+			else if (EqualNoCase(key, "min"))
+				success = ParseFilter(value, samplerDesc.minFilter);
+			else if (EqualNoCase(key, "mag"))
+				success = ParseFilter(value, samplerDesc.magFilter);
+			else if (EqualNoCase(key, "mip"))
+			{
+				VkFilter filter = VK_FILTER_NEAREST;
+				success = ParseFilter(value, filter);
+				samplerDesc.mipmapMode = filter == VK_FILTER_LINEAR ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			}
+			else if (EqualNoCase(key, "address"))
+				success = ParseAddressMode(value, samplerDesc.addressMode);
+			else if (EqualNoCase(key, "border"))
+				success = ParseBorderColor(value, samplerDesc.borderColor);
+			else if (EqualNoCase(key, "compare"))
+				samplerDesc.compareEnable = success = ParseCompareOp(value, true, samplerDesc.compareOp);
+			else if (EqualNoCase(key, "lodbias"))
+			{
+				auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), samplerDesc.mipLodBias);
+				success = ec == std::errc() && ptr == value.data() + value.size();
+			}
+			else if (EqualNoCase(key, "aniso"))
+			{
+				auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), samplerDesc.maxAniso);
+				success = ec == std::errc() && ptr == value.data() + value.size();
+				samplerDesc.anisoEnable = success && samplerDesc.maxAniso > 0;
+			}
+			else
+				success = false;
+
+			if (!success)
+				throw std::runtime_error(std::format("invalid sampler annotation \"{}\" on {}", arg, samplerName));
+		}
+	}
+
+	static constexpr VkSamplerAddressMode GetAddressMode(std::string_view samplerName)
 	{
 		VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		bool isRepeat = lowerSamplerName.find("repeat") != std::string::npos;
-		bool isMirror = lowerSamplerName.find("mirror") != std::string::npos;
+		bool isRepeat = ContainsNoCase(samplerName, "repeat");
+		bool isMirror = ContainsNoCase(samplerName, "mirror");
 		if (isRepeat)
 		{
 			if (isMirror)
@@ -209,17 +492,17 @@ private:
 		}
 		else
 		{
-			bool isClamp = lowerSamplerName.find("clamp") != std::string::npos;
+			bool isClamp = ContainsNoCase(samplerName, "clamp");
 			if (isClamp)
 			{
-				bool isBorder = lowerSamplerName.find("border") != std::string::npos;
+				bool isBorder = ContainsNoCase(samplerName, "border");
 				if (isBorder)
 				{
 					addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
 				}
 				else
 				{
-					bool isEdge = lowerSamplerName.find("edge") != std::string::npos;
+					bool isEdge = ContainsNoCase(samplerName, "edge");
 					if (isEdge)
 					{
 						if (isMirror)
@@ -234,4 +517,9 @@ private:
 
 		return addressMode;
 	}
-};
\ No newline at end of file
+};
+
+//compile time check of name parse / ڼֽ
+static_assert(SamplerPool::ParseSamplerName("gsamLinearWrapAniso2").maxAniso == 2);
+static_assert(SamplerPool::ParseSamplerName("gsamLinearClampEdge").addressMode == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+static_assert(SamplerPool::ParseSamplerName("gsamShadowCmpLessEqual").compareOp == VK_COMPARE_OP_LESS_OR_EQUAL);
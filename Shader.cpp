@@ -4,11 +4,17 @@
 #include "inc/dxcapi.h"         // Be sure to link with dxcompiler.lib.
 #include <d3d12shader.h>    // Shader reflection.
 #include "dxUtil.hpp"
+#include "Profiler.h"
+#include "Log.h"
 
 #include <vk_format_utils.h>
 
 #include <iostream>
 #include <format>
+#include <set>
+#include <optional>
+#include <cstring>
+#include <unordered_map>
 
 enum class RegisterType : uint8_t
 {
@@ -64,6 +70,40 @@ std::wstring RegisterTypeToWString(const RegisterType type)
 	}
 }
 
+//default include handler that remembers every file it opened, hot reload watches them too
+//lives on the stack for one LoadFromFile, reference count is not used
+class RecordingIncludeHandler : public IDxcIncludeHandler
+{
+public:
+	RecordingIncludeHandler(IDxcIncludeHandler* handler, std::set<std::filesystem::path>& includes) : mHandler(handler), mIncludes(includes) {}
+
+	HRESULT STDMETHODCALLTYPE LoadSource(LPCWSTR pFilename, IDxcBlob** ppIncludeSource) override
+	{
+		HRESULT hr = mHandler->LoadSource(pFilename, ppIncludeSource);
+		if (SUCCEEDED(hr))
+			mIncludes.insert(std::filesystem::absolute(pFilename).lexically_normal());
+		return hr;
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+	{
+		if (riid == __uuidof(IDxcIncludeHandler) || riid == __uuidof(IUnknown))
+		{
+			*ppvObject = static_cast<IDxcIncludeHandler*>(this);
+			return S_OK;
+		}
+		*ppvObject = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+	ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+private:
+	IDxcIncludeHandler* mHandler;
+	std::set<std::filesystem::path>& mIncludes;
+};
+
 auto StageToShaderModel = [](VkShaderStageFlagBits stage) -> LPCWSTR
 {
 	switch (stage)
@@ -83,8 +123,10 @@ auto StageToShaderModel = [](VkShaderStageFlagBits stage) -> LPCWSTR
 	}
 };
 
-std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring filename, ShaderEntry& entries)
+std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring filename, ShaderEntry& entries,
+	const std::vector<std::wstring>& defines)
 {
+	PROFILE_SCOPE_DETAIL("Shader::LoadFromFile", Profiler::Intern(to_string(filename)));
 	std::unique_ptr<Shader> res(new Shader(device));
 
 	static CComPtr<IDxcUtils> pUtils;
@@ -102,8 +144,15 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 	Source.Size = pSource->GetBufferSize();
 	Source.Encoding = DXC_CP_UTF8;
 
-	CComPtr<IDxcIncludeHandler> pIncludeHandler;
-	pUtils->CreateDefaultIncludeHandler(&pIncludeHandler);
+	CComPtr<IDxcIncludeHandler> pDefaultIncludeHandler;
+	pUtils->CreateDefaultIncludeHandler(&pDefaultIncludeHandler);
+	std::set<std::filesystem::path> includes;
+	RecordingIncludeHandler includeHandler(pDefaultIncludeHandler, includes);
+	IDxcIncludeHandler* pIncludeHandler = &includeHandler;
+
+	//explicit sampler state written in source, parse once per file / 源码中显式声明的sampler状态, 每个文件只解析一次
+	const std::unordered_map<std::string, SamplerDesc> samplerAnnotations
+		= SamplerPool::ParseSamplerAnnotations(std::string_view(static_cast<const char*>(Source.Ptr), Source.Size));
 
 	using SetLayoutIndex = uint8_t;
 	using BindingIndex = uint16_t;
@@ -113,12 +162,15 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 	using RegisterOffset = uint16_t;
 	std::vector<std::tuple<RegisterType, SetLayoutIndex, RegisterOffset>> registerOffset;
 
-	auto InitStage = [&device, filename, &res, &Source, &pIncludeHandler, &registerMinMaxRange, &registerOffset]
+	auto InitStage = [&device, filename, &defines, &res, &Source, &pIncludeHandler, &registerMinMaxRange, &registerOffset, &samplerAnnotations]
 		(VkShaderStageFlagBits stage, LPCWSTR entry, bool secondCompile)
 	{
 		if (entry == nullptr)
 			return;
 
+		//first compile reflects bindings, second compile is shifted and creates module
+		PROFILE_SCOPE_DETAIL(secondCompile ? "Shader::CompileShifted" : "Shader::CompileReflect", magic_enum::enum_name(stage).data());
+
 		//std::vector<LPCWSTR> arguments;
 		std::vector<std::wstring> arguments;
 		arguments.push_back(filename.c_str());
@@ -128,6 +180,11 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 		arguments.push_back(StageToShaderModel(stage));
 		arguments.push_back(L"-spirv");
 		arguments.push_back(L"-fvk-auto-shift-bindings");
+		for (const std::wstring& define : defines)
+		{
+			arguments.push_back(L"-D");
+			arguments.push_back(define);
+		}
 
 		//open reflection on first compile / 第一次编译开启反射
 		if (!secondCompile)
@@ -143,11 +200,15 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 				arguments.push_back(std::format(L"{}", std::get<1>(*offsetIte)));
 			}
 
+#if SOCO_LOG_LEVEL <= 0
+			std::wstring commandLine;
 			for (auto ite = arguments.begin(); ite != arguments.end(); ++ite)
 			{
-				std::wcout << *ite << " ";
+				commandLine += *ite;
+				commandLine += L" ";
 			}
-			std::cout << std::endl;
+			LOG_DEBUG("{}", std::move(commandLine));
+#endif
 		}
 
 		static CComPtr<IDxcCompiler3> pCompiler;
@@ -159,13 +220,16 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 			[](const std::wstring& arg){ return arg.c_str(); });
 		
 		CComPtr<IDxcResult> pResults;
-		ThrowIfFailed(pCompiler->Compile(
-			&Source,
-			charArguments.data(),
-			charArguments.size(),
-			pIncludeHandler,
-			IID_PPV_ARGS(&pResults)
-		));
+		{
+			PROFILE_SCOPE("DXC Compile");
+			ThrowIfFailed(pCompiler->Compile(
+				&Source,
+				charArguments.data(),
+				charArguments.size(),
+				pIncludeHandler,
+				IID_PPV_ARGS(&pResults)
+			));
+		}
 
 		CComPtr<IDxcBlobUtf8> pErrors = nullptr;
 		ThrowIfFailed(pResults->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&pErrors), nullptr));
@@ -187,6 +251,7 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 		//Create ShaderModule and Reflect
 		if (!secondCompile)
 		{
+			PROFILE_SCOPE("SPIRV-Reflect");
 			SpvReflectShaderModule reflectShaderModule;
 			ThrowIfFailed(spvReflectCreateShaderModule(pShader->GetBufferSize(), pShader->GetBufferPointer(), &reflectShaderModule));
 			switch (stage)
@@ -194,11 +259,13 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 			case VK_SHADER_STAGE_VERTEX_BIT:
 				res->mVertexReflectShaderModule = reflectShaderModule;
 
-				res->mInputVariables.resize(reflectShaderModule.input_variable_count);
 				for (int varIndex = 0; varIndex < reflectShaderModule.input_variable_count; ++varIndex)
 				{
 					SpvReflectInterfaceVariable* inputVar = reflectShaderModule.input_variables[varIndex];
-					res->mInputVariables[varIndex] = std::make_pair(inputVar->semantic, inputVar->location);
+					//SV_VertexID, SV_InstanceID are not fetched from vertex buffers
+					if ((inputVar->decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) != 0)
+						continue;
+					res->mInputVariables.push_back(std::make_pair(inputVar->semantic, inputVar->location));
 				}
 
 				break;
@@ -216,6 +283,30 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 				break;
 			}
 
+			//push constant, stages share one range so one vkCmdPushConstants covers all
+			//所有stage共用一个push constant range
+			for (uint32_t blockIndex = 0; blockIndex < reflectShaderModule.push_constant_block_count; ++blockIndex)
+			{
+				const SpvReflectBlockVariable& block = reflectShaderModule.push_constant_blocks[blockIndex];
+				VkPushConstantRange& range = res->mPushConstantRange;
+
+				uint32_t blockBegin = block.offset;
+				uint32_t blockEnd = block.offset + ((block.size + 3) & ~3u);
+				if (range.size == 0)
+				{
+					range.offset = blockBegin;
+					range.size = blockEnd - blockBegin;
+				}
+				else
+				{
+					uint32_t rangeBegin = std::min(range.offset, blockBegin);
+					uint32_t rangeEnd = std::max(range.offset + range.size, blockEnd);
+					range.offset = rangeBegin;
+					range.size = rangeEnd - rangeBegin;
+				}
+				range.stageFlags |= static_cast<VkShaderStageFlags>(reflectShaderModule.shader_stage);
+			}
+
 			//if set not found, create set
 			if (reflectShaderModule.descriptor_set_count > 0)
 			{
@@ -268,9 +359,15 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 						//only get immutable sampler desc in first stage / 只在第一个shader stage获取immutable sampler 描述符
 						if (binding->descriptor_type == SpvReflectDescriptorType::SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLER)
 						{
-							bindPtr->samplerDesc = SamplerPool::ParseSamplerName(binding->name);
+							auto annotationIte = samplerAnnotations.find(binding->name);
+							bindPtr->samplerDesc = annotationIte != samplerAnnotations.end()
+								? annotationIte->second : SamplerPool::ParseSamplerName(binding->name);
 						}
 
+						if (binding->descriptor_type == SpvReflectDescriptorType::SPV_REFLECT_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+							|| binding->descriptor_type == SpvReflectDescriptorType::SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+							res->mParameterBlocks.push_back(ReflectParameterBlock(*binding));
+
 						bindPtr->name = binding->name;
 						bindPtr->binding = binding->binding;
 						bindPtr->descriptorCount = binding->count;
@@ -304,15 +401,10 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 
 					bindPtr->stageFlags |= static_cast<VkShaderStageFlagBits>(reflectShaderModule.shader_stage);
 
-					std::cout << j
-						<< " name:" << binding->name
-						<< " binding: " << binding->binding
-						<< " type: " << magic_enum::enum_name(binding->descriptor_type)
-						<< " array ele count: " << binding->count
-						<< " set: " << binding->set
-						<< std::endl;
+					LOG_DEBUG("{} name:{} binding: {} type: {} array ele count: {} set: {}",
+						j, binding->name, binding->binding, magic_enum::enum_name(binding->descriptor_type), binding->count, binding->set);
 				}
-				std::cout << "---" << std::endl;
+				LOG_DEBUG("---");
 			}
 
 			VkPipelineShaderStageCreateInfo shaderStageInfo{};
@@ -334,6 +426,16 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 				return shaderStageInfo.stage == stage;
 			});
 			stageInfo->module = CreateShaderModule(device->GetDevice(), pShader->GetBufferPointer(), pShader->GetBufferSize());
+
+			//stages are always compiled in the same order, the hash doesn't depend on defines that didn't change the code
+			auto HashBytes = [&res](const void* data, size_t size) {
+				for (size_t i = 0; i < size; ++i)
+					res->mSpirvHash = (res->mSpirvHash ^ static_cast<const uint8_t*>(data)[i]) * 1099511628211ull;
+			};
+			HashBytes(&stage, sizeof(stage));
+			HashBytes(pShader->GetBufferPointer(), pShader->GetBufferSize());
+
+			res->ReflectSpecializationConstants(static_cast<const uint32_t*>(pShader->GetBufferPointer()), pShader->GetBufferSize() / sizeof(uint32_t), stage);
 		}
 
 
@@ -346,6 +448,7 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 	InitStage(VK_SHADER_STAGE_GEOMETRY_BIT, entries.gs, false);
 
 	std::vector<std::pair<RegisterType, MinMaxRange>> willSortList;
+	PROFILE_SCOPE("Shader::ShiftRegisters");
 	for (auto setIte = registerMinMaxRange.begin(); setIte != registerMinMaxRange.end(); ++setIte)
 	{
 		size_t registerTypeCount = setIte->second.size();
@@ -399,18 +502,43 @@ std::unique_ptr<Shader> Shader::LoadFromFile(Device* device, const std::wstring
 	InitStage(VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, entries.hs, true);
 	InitStage(VK_SHADER_STAGE_GEOMETRY_BIT, entries.gs, true);
 
+	if (res->HasPushConstant())
+	{
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(device->GetPhysicalDevice(), &properties);
+		if (res->mPushConstantRange.offset + res->mPushConstantRange.size > properties.limits.maxPushConstantsSize)
+			throw std::runtime_error(std::format("push constant size {} exceeds device limit {}",
+				res->mPushConstantRange.offset + res->mPushConstantRange.size, properties.limits.maxPushConstantsSize));
+	}
+
 	res->CreatePipelineLayout();
 
+	res->mSourceFiles.push_back(std::filesystem::absolute(filename).lexically_normal());
+	for (const std::filesystem::path& include : includes)
+	{
+		if (include != res->mSourceFiles.front())
+			res->mSourceFiles.push_back(include);
+	}
+
 	return res;
 }
 
 void Shader::CreatePipelineLayout()
 {
-	mPipelineLayout = mDevice->GetPipelineLayoutPool()->Get(mSetLayoutsDesc, mSetLayouts);
+	PROFILE_FUNCTION();
+
+	PipelineLayoutDesc layoutDesc;
+	layoutDesc.setLayouts = mSetLayoutsDesc;
+	if (HasPushConstant())
+		layoutDesc.pushConstantRanges.push_back(mPushConstantRange);
+
+	mPipelineLayout = mDevice->GetPipelineLayoutPool()->Get(layoutDesc, mSetLayouts);
 }
 
 VkShaderModule Shader::CreateShaderModule(VkDevice device, const void* codebytes, size_t size)
 {
+	PROFILE_FUNCTION();
+
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	createInfo.codeSize = size;
@@ -422,6 +550,154 @@ VkShaderModule Shader::CreateShaderModule(VkDevice device, const void* codebytes
 	return shaderModule;
 }
 
+void Shader::ReflectSpecializationConstants(const uint32_t* code, size_t wordCount, VkShaderStageFlagBits stage)
+{
+	constexpr uint32_t OpName = 5;
+	constexpr uint32_t OpTypeBool = 20;
+	constexpr uint32_t OpTypeInt = 21;
+	constexpr uint32_t OpTypeFloat = 22;
+	constexpr uint32_t OpSpecConstantTrue = 48;
+	constexpr uint32_t OpSpecConstantFalse = 49;
+	constexpr uint32_t OpSpecConstant = 50;
+	constexpr uint32_t OpDecorate = 71;
+	constexpr uint32_t DecorationSpecId = 1;
+
+	std::unordered_map<uint32_t, std::string> names;
+	std::unordered_map<uint32_t, uint32_t> specIds;
+	//type id -> scalar type, 32 bit only
+	std::unordered_map<uint32_t, SpecializationConstantType> types;
+	struct Constant
+	{
+		uint32_t typeId;
+		uint32_t resultId;
+		uint32_t value;
+	};
+	std::vector<Constant> constants;
+
+	//5 words header, then instructions of (word count << 16 | opcode) and operands
+	for (size_t i = 5; i < wordCount;)
+	{
+		uint32_t opcode = code[i] & 0xFFFF;
+		uint32_t count = code[i] >> 16;
+		if (count == 0 || i + count > wordCount)
+			break;
+
+		const uint32_t* operands = code + i + 1;
+		switch (opcode)
+		{
+		case OpName:
+			if (count > 2)
+				names[operands[0]] = std::string(reinterpret_cast<const char*>(operands + 1), strnlen(reinterpret_cast<const char*>(operands + 1), (count - 2) * 4));
+			break;
+		case OpTypeBool:
+			types[operands[0]] = SpecializationConstantType::Bool;
+			break;
+		case OpTypeInt:
+			if (operands[1] == 32)
+				types[operands[0]] = operands[2] != 0 ? SpecializationConstantType::Int : SpecializationConstantType::UInt;
+			break;
+		case OpTypeFloat:
+			if (operands[1] == 32)
+				types[operands[0]] = SpecializationConstantType::Float;
+			break;
+		case OpSpecConstantTrue:
+		case OpSpecConstantFalse:
+			constants.push_back({ operands[0], operands[1], opcode == OpSpecConstantTrue ? 1u : 0u });
+			break;
+		case OpSpecConstant:
+			if (count == 4)
+				constants.push_back({ operands[0], operands[1], operands[2] });
+			break;
+		case OpDecorate:
+			if (count >= 4 && operands[1] == DecorationSpecId)
+				specIds[operands[0]] = operands[2];
+			break;
+		}
+		i += count;
+	}
+
+	for (const Constant& constant : constants)
+	{
+		auto specId = specIds.find(constant.resultId);
+		auto type = types.find(constant.typeId);
+		if (specId == specIds.end() || type == types.end())
+			continue;
+
+		auto ite = std::find_if(mSpecializationConstants.begin(), mSpecializationConstants.end(),
+			[id = specId->second](const SpecializationConstant& specializationConstant) { return specializationConstant.id == id; });
+		if (ite != mSpecializationConstants.end())
+		{
+			ite->stageFlags |= stage;
+			continue;
+		}
+
+		mSpecializationConstants.push_back({ names[constant.resultId], specId->second, type->second, constant.value, static_cast<VkShaderStageFlags>(stage) });
+		LOG_DEBUG("specialization constant {} id {} type {} default {:#x}", mSpecializationConstants.back().name, specId->second,
+			magic_enum::enum_name(type->second), constant.value);
+	}
+}
+
+const SpecializationConstant* Shader::FindSpecializationConstant(std::string_view name) const
+{
+	auto ite = std::find_if(mSpecializationConstants.begin(), mSpecializationConstants.end(),
+		[name](const SpecializationConstant& specializationConstant) { return specializationConstant.name == name; });
+	return ite == mSpecializationConstants.end() ? nullptr : &*ite;
+}
+
+const ParameterBlockLayout* Shader::FindParameterBlock(std::string_view name) const
+{
+	auto ite = std::find_if(mParameterBlocks.begin(), mParameterBlocks.end(), [name](const ParameterBlockLayout& block) { return block.name == name; });
+	return ite == mParameterBlocks.end() ? nullptr : &*ite;
+}
+
+ParameterBlockLayout Shader::ReflectParameterBlock(const SpvReflectDescriptorBinding& binding)
+{
+	ParameterBlockLayout layout{ binding.name, binding.block.padded_size };
+
+	//StructuredBuffer<T> is a block of one runtime array of T, the layout is the one of T
+	const SpvReflectBlockVariable* block = &binding.block;
+	if (binding.descriptor_type == SpvReflectDescriptorType::SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_BUFFER && block->member_count == 1
+		&& (block->members[0].type_description->type_flags & SPV_REFLECT_TYPE_FLAG_ARRAY) != 0)
+	{
+		block = &block->members[0];
+		layout.size = block->array.stride;
+	}
+
+	for (uint32_t i = 0; i < block->member_count; ++i)
+	{
+		const SpvReflectBlockVariable& member = block->members[i];
+		const SpvReflectTypeDescription& type = *member.type_description;
+		const bool isFloat = (type.type_flags & SPV_REFLECT_TYPE_FLAG_FLOAT) != 0;
+		const bool is32Bit = type.traits.numeric.scalar.width == 32;
+
+		std::optional<ShaderParameterType> parameterType;
+		if ((type.type_flags & (SPV_REFLECT_TYPE_FLAG_ARRAY | SPV_REFLECT_TYPE_FLAG_STRUCT)) != 0 || !is32Bit)
+			parameterType = std::nullopt;
+		else if ((type.type_flags & SPV_REFLECT_TYPE_FLAG_MATRIX) != 0)
+		{
+			if (isFloat && type.traits.numeric.matrix.column_count == 4 && type.traits.numeric.matrix.row_count == 4)
+				parameterType = ShaderParameterType::Float4x4;
+		}
+		else if ((type.type_flags & SPV_REFLECT_TYPE_FLAG_VECTOR) != 0)
+		{
+			if (isFloat)
+				parameterType = static_cast<ShaderParameterType>(static_cast<uint32_t>(ShaderParameterType::Float) + type.traits.numeric.vector.component_count - 1);
+		}
+		else if (isFloat)
+			parameterType = ShaderParameterType::Float;
+		else if ((type.type_flags & SPV_REFLECT_TYPE_FLAG_INT) != 0)
+			parameterType = type.traits.numeric.scalar.signedness ? ShaderParameterType::Int : ShaderParameterType::UInt;
+
+		if (!parameterType.has_value())
+		{
+			LOG_DEBUG("{}.{} is not a parameter type, skipped", layout.name, member.name);
+			continue;
+		}
+		layout.parameters.push_back({ member.name, *parameterType, member.offset });
+	}
+	return layout;
+}
+
 void Shader::SetupPipelineShaderStageInfo(VkGraphicsPipelineCreateInfo& pipelineInfo) const
 {
 	pipelineInfo.stageCount = mStageContainer.size();
@@ -440,7 +716,10 @@ void Shader::SetupPipelineLayout(VkGraphicsPipelineCreateInfo& pipelineInfo) con
 
 bool Shader::IsPipelineLayoutEqual(const Shader& a, const Shader& b)
 {
-	return a.mSetLayouts == b.mSetLayouts;
+	return a.mSetLayouts == b.mSetLayouts
+		&& a.mPushConstantRange.stageFlags == b.mPushConstantRange.stageFlags
+		&& a.mPushConstantRange.offset == b.mPushConstantRange.offset
+		&& a.mPushConstantRange.size == b.mPushConstantRange.size;
 }
 
 Shader::BindingPoint Shader::GetBindingPoint(const std::string name) const
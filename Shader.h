@@ -4,6 +4,13 @@
 
 #include <string>
 #include <memory>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+#include <bit>
+#include <string_view>
 #include <windows.h>
 #include <vulkan/vulkan.h>
 #include <spirv_reflect.h>
@@ -27,11 +34,147 @@ struct ShaderEntry
 	LPCWSTR gs = nullptr;
 };
 
+//[[vk::constant_id(N)]] const T name = default; in hlsl, 32 bit scalar only
+enum class SpecializationConstantType : uint8_t { Bool, Int, UInt, Float };
+
+struct SpecializationConstant
+{
+	std::string name;
+	uint32_t id;
+	SpecializationConstantType type;
+	//bit pattern of the hlsl default value
+	uint32_t defaultValue;
+	VkShaderStageFlags stageFlags;
+};
+
+//values of specialization constants for one pipeline, part of PSOKey
+//set by name, checked against shader reflection when the pipeline is built; constants not set keep the hlsl default
+class SpecializationValues
+{
+public:
+	struct Value
+	{
+		std::string name;
+		SpecializationConstantType type;
+		uint32_t bits;
+
+		auto operator<=>(const Value&) const = default;
+	};
+
+	template<typename T>
+	SpecializationValues& Set(std::string_view name, T value)
+	{
+		static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int32_t> || std::is_same_v<T, uint32_t> || std::is_same_v<T, float>,
+			"specialization constant is bool, int, uint or float");
+
+		Value entry{ std::string(name) };
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			entry.type = SpecializationConstantType::Bool;
+			entry.bits = value ? 1u : 0u;
+		}
+		else if constexpr (std::is_same_v<T, int32_t>)
+		{
+			entry.type = SpecializationConstantType::Int;
+			entry.bits = std::bit_cast<uint32_t>(value);
+		}
+		else if constexpr (std::is_same_v<T, uint32_t>)
+		{
+			entry.type = SpecializationConstantType::UInt;
+			entry.bits = value;
+		}
+		else
+		{
+			entry.type = SpecializationConstantType::Float;
+			entry.bits = std::bit_cast<uint32_t>(value);
+		}
+
+		//sorted by name, equal sets compare equal whatever order they were set in
+		auto ite = std::lower_bound(mValues.begin(), mValues.end(), entry.name, [](const Value& value, const std::string& name) { return value.name < name; });
+		if (ite != mValues.end() && ite->name == entry.name)
+			*ite = std::move(entry);
+		else
+			mValues.insert(ite, std::move(entry));
+		return *this;
+	}
+
+	const std::vector<Value>& GetValues() const { return mValues; }
+	bool IsEmpty() const { return mValues.empty(); }
+
+	auto operator<=>(const SpecializationValues&) const = default;
+
+private:
+	std::vector<Value> mValues;
+};
+
+template<>
+struct std::hash<SpecializationValues>
+{
+	std::size_t operator()(const SpecializationValues& key) const
+	{
+		std::size_t res = std::hash<size_t>()(key.GetValues().size());
+		for (const SpecializationValues::Value& value : key.GetValues())
+		{
+			res ^= std::hash<std::string>()(value.name) << 1;
+			res ^= std::hash<uint32_t>()(value.bits) >> 1;
+		}
+		return res;
+	}
+};
+
+//member of a reflected cbuffer or StructuredBuffer element, types a material can set
+enum class ShaderParameterType : uint8_t { Float, Float2, Float3, Float4, Float4x4, Int, UInt };
+
+struct ShaderParameter
+{
+	std::string name;
+	ShaderParameterType type;
+	//bytes from the start of the block, or of the element for StructuredBuffer
+	uint32_t offset;
+
+	auto operator<=>(const ShaderParameter&) const = default;
+};
+
+//layout of a buffer binding, reflected from spir-v; size is the element stride for StructuredBuffer
+struct ParameterBlockLayout
+{
+	std::string name;
+	uint32_t size = 0;
+	std::vector<ShaderParameter> parameters;
+
+	//nullptr if the block has no such member
+	const ShaderParameter* FindParameter(std::string_view name) const
+	{
+		auto ite = std::find_if(parameters.begin(), parameters.end(), [name](const ShaderParameter& parameter) { return parameter.name == name; });
+		return ite == parameters.end() ? nullptr : &*ite;
+	}
+
+	auto operator<=>(const ParameterBlockLayout&) const = default;
+};
+
 class Shader : public DeviceComponent
 {
 public:
 
-	static std::unique_ptr<Shader> LoadFromFile(Device* device, const std::wstring filename, ShaderEntry& entries);
+	//defines are passed as -D, keyword variants are compiled through ShaderVariants
+	//throws on compile error, may run off the main thread
+	static std::unique_ptr<Shader> LoadFromFile(Device* device, const std::wstring filename, ShaderEntry& entries,
+		const std::vector<std::wstring>& defines = {});
+
+	//the file and every file it included, absolute and lexically normal
+	const std::vector<std::filesystem::path>& GetSourceFiles() const { return mSourceFiles; }
+	//FNV-1a of stage and spir-v of every stage, equal hash means the shaders compiled identically
+	uint64_t GetSpirvHash() const { return mSpirvHash; }
+
+	//reflected from spir-v, merged by id across stages
+	const std::vector<SpecializationConstant>& GetSpecializationConstants() const { return mSpecializationConstants; }
+	//nullptr if the shader doesn't declare it
+	const SpecializationConstant* FindSpecializationConstant(std::string_view name) const;
+
+	//cbuffer and StructuredBuffer bindings by variable name, members of unsupported type are left out
+	const std::vector<ParameterBlockLayout>& GetParameterBlocks() const { return mParameterBlocks; }
+	//nullptr if the shader doesn't declare it
+	const ParameterBlockLayout* FindParameterBlock(std::string_view name) const;
 
 	//void SetupInputLayout(VkGraphicsPipelineCreateInfo& pipelineInfo, const Mesh& mesh) const;
 	using InputVariable = std::pair<std::string, uint32_t>;
@@ -48,19 +191,41 @@ public:
 	VkPipelineLayout GetPipelineLayout() const { return mPipelineLayout; }
 	const std::vector<VkDescriptorSetLayout>& GetDescriptorSetLayout() const { return mSetLayouts; }
 
+	//[[vk::push_constant]] block of all stages merge into one range
+	bool HasPushConstant() const { return mPushConstantRange.size != 0; }
+	const VkPushConstantRange& GetPushConstantRange() const { return mPushConstantRange; }
+
+	//per draw data without buffer and descriptor write, T must match push constant block layout
+	//offset is relative to the start of the block, which need not be 0
+	template<typename T>
+	void PushConstants(VkCommandBuffer commandBuffer, const T& data, uint32_t offset = 0) const
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "push constant data must be trivially copyable");
+		assert(offset + sizeof(T) <= mPushConstantRange.size && "push constant data out of range");
+
+		vkCmdPushConstants(commandBuffer, mPipelineLayout, mPushConstantRange.stageFlags, mPushConstantRange.offset + offset, static_cast<uint32_t>(sizeof(T)), &data);
+	}
+
 	~Shader();
 private:
 
-	SpvReflectShaderModule mVertexReflectShaderModule;
-	SpvReflectShaderModule mPixelReflectShaderModule;
-	SpvReflectShaderModule mDomainReflectShaderModule;
-	SpvReflectShaderModule mHullReflectShaderModule;
-	SpvReflectShaderModule mGeometryReflectShaderModule;
+	//zero for stage without entry, destroy skip it
+	SpvReflectShaderModule mVertexReflectShaderModule = {};
+	SpvReflectShaderModule mPixelReflectShaderModule = {};
+	SpvReflectShaderModule mDomainReflectShaderModule = {};
+	SpvReflectShaderModule mHullReflectShaderModule = {};
+	SpvReflectShaderModule mGeometryReflectShaderModule = {};
 
 	std::vector<VkPipelineShaderStageCreateInfo> mStageContainer;
 	std::vector<DescriptorSetLayoutDesc> mSetLayoutsDesc;
 
 	std::vector<InputVariable> mInputVariables;
+	VkPushConstantRange mPushConstantRange = {};
+
+	std::vector<std::filesystem::path> mSourceFiles;
+	std::vector<SpecializationConstant> mSpecializationConstants;
+	std::vector<ParameterBlockLayout> mParameterBlocks;
+	uint64_t mSpirvHash = 14695981039346656037ull;
 
 	VkPipelineLayout mPipelineLayout;
 	std::vector<VkDescriptorSetLayout> mSetLayouts;
@@ -69,4 +234,7 @@ private:
 	void CreatePipelineLayout();
 
 	static VkShaderModule CreateShaderModule(VkDevice device, const void* codebytes, size_t size);
+	//spirv-reflect doesn't reflect specialization constants, read OpSpecConstant* and their decorations directly
+	void ReflectSpecializationConstants(const uint32_t* code, size_t wordCount, VkShaderStageFlagBits stage);
+	static ParameterBlockLayout ReflectParameterBlock(const SpvReflectDescriptorBinding& binding);
 };
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "ShaderVariants.h"
+#include "dxUtil.hpp"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+ShaderVariants::ShaderVariants(Device* device, const std::wstring& filename, const ShaderEntry& entries)
+	: DeviceComponent(device), mFilename(filename), mEntries(entries)
+{
+	std::ifstream file(std::filesystem::path(filename), std::ios::binary);
+	if (!file)
+		throw std::runtime_error(std::format("can't read shader: {}", to_string(filename)));
+	std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	mKeywords = ParseKeywords(source);
+	if (mKeywords.size() > MaxKeywords)
+		throw std::runtime_error(std::format("{} declares {} keywords, at most {}", to_string(filename), mKeywords.size(), MaxKeywords));
+}
+
+std::unique_ptr<ShaderVariants> ShaderVariants::Reload() const
+{
+	return std::make_unique<ShaderVariants>(mDevice, mFilename, mEntries);
+}
+
+ShaderVariants::KeywordMask ShaderVariants::GetKeywordMask(std::string_view keyword) const
+{
+	auto ite = std::find(mKeywords.begin(), mKeywords.end(), keyword);
+	return ite == mKeywords.end() ? 0 : 1ull << (ite - mKeywords.begin());
+}
+
+ShaderVariants::KeywordMask ShaderVariants::GetKeywordMask(const std::vector<std::string>& keywords) const
+{
+	KeywordMask mask = 0;
+	for (const std::string& keyword : keywords)
+		mask |= GetKeywordMask(keyword);
+	return mask;
+}
+
+Shader* ShaderVariants::GetVariant(KeywordMask keywords)
+{
+	if (mKeywords.size() < MaxKeywords)
+		keywords &= (1ull << mKeywords.size()) - 1;
+	auto ite = mVariants.find(keywords);
+	if (ite != mVariants.end())
+		return ite->second;
+
+	PROFILE_SCOPE("ShaderVariants::Compile");
+	std::vector<std::wstring> defines;
+	std::wstring keywordText;
+	for (KeywordMask bits = keywords; bits != 0; bits &= bits - 1)
+	{
+		const std::string& keyword = mKeywords[std::countr_zero(bits)];
+		defines.push_back(to_wstring(keyword));
+		keywordText += to_wstring(keyword) + L" ";
+	}
+
+	ShaderEntry entries = mEntries;
+	std::unique_ptr<Shader> shader = Shader::LoadFromFile(mDevice, mFilename, entries, defines);
+
+	//keyword not used by any stage, share the shader compiled before and drop this one
+	auto sameShader = mShadersBySpirvHash.find(shader->GetSpirvHash());
+	if (sameShader != mShadersBySpirvHash.end())
+	{
+		LOG_DEBUG("shader variant {} [{}] is identical to a compiled variant", to_string(mFilename), std::move(keywordText));
+		return mVariants[keywords] = sameShader->second;
+	}
+
+	LOG_DEBUG("shader variant {} [{}] compiled", to_string(mFilename), std::move(keywordText));
+	Shader* res = mShaders.emplace_back(std::move(shader)).get();
+	mShadersBySpirvHash[res->GetSpirvHash()] = res;
+	return mVariants[keywords] = res;
+}
+
+std::vector<std::string> ShaderVariants::ParseKeywords(std::string_view source)
+{
+	constexpr std::string_view annotationBegin = "[[multi_compile(";
+	constexpr std::string_view annotationEnd = ")]]";
+
+	auto IsIdentifierChar = [](char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	};
+
+	std::vector<std::string> keywords;
+	for (size_t pos = source.find(annotationBegin); pos != std::string_view::npos; pos = source.find(annotationBegin, pos + 1))
+	{
+		size_t argsBegin = pos + annotationBegin.size();
+		size_t argsEnd = source.find(annotationEnd, argsBegin);
+		if (argsEnd == std::string_view::npos)
+			break;
+
+		std::string_view args = source.substr(argsBegin, argsEnd - argsBegin);
+		for (size_t i = 0; i < args.size();)
+		{
+			if (!IsIdentifierChar(args[i]))
+			{
+				++i;
+				continue;
+			}
+			size_t end = i;
+			while (end < args.size() && IsIdentifierChar(args[end]))
+				++end;
+
+			std::string keyword(args.substr(i, end - i));
+			if (std::find(keywords.begin(), keywords.end(), keyword) == keywords.end())
+				keywords.push_back(std::move(keyword));
+			i = end;
+		}
+	}
+	return keywords;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "DeviceComponent.h"
+#include "Shader.h"
+
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+//Keyword variants of one shader file, keywords are declared in a comment of the hlsl
+//	//[[multi_compile(_VERTEX_COLOR, _ALPHA_TEST)]]
+//and tested with #ifdef, each keyword is one bit of the variant key in declaration order
+//a variant is compiled on first request with the keywords of its key defined,
+//variants whose spir-v is identical share one Shader
+class ShaderVariants : public DeviceComponent
+{
+public:
+	using KeywordMask = uint64_t;
+	static constexpr uint32_t MaxKeywords = 64;
+
+	//reads keyword declarations, compiles nothing, throws if the file can't be read
+	ShaderVariants(Device* device, const std::wstring& filename, const ShaderEntry& entries);
+
+	//same file and entries, keywords are parsed again
+	std::unique_ptr<ShaderVariants> Reload() const;
+
+	const std::vector<std::string>& GetKeywords() const { return mKeywords; }
+	//keywords not declared in the file are ignored
+	KeywordMask GetKeywordMask(std::string_view keyword) const;
+	KeywordMask GetKeywordMask(const std::vector<std::string>& keywords) const;
+
+	//compile on first request, throws on compile error
+	Shader* GetVariant(KeywordMask keywords = 0);
+
+	//requested keys, and distinct Shaders behind them
+	size_t GetVariantCount() const { return mVariants.size(); }
+	size_t GetUniqueShaderCount() const { return mShaders.size(); }
+
+private:
+	static std::vector<std::string> ParseKeywords(std::string_view source);
+
+	std::wstring mFilename;
+	ShaderEntry mEntries;
+	std::vector<std::string> mKeywords;
+
+	std::vector<std::unique_ptr<Shader>> mShaders;
+	std::unordered_map<KeywordMask, Shader*> mVariants;
+	std::unordered_map<uint64_t, Shader*> mShadersBySpirvHash;
+};
@@ -0,0 +1,28 @@
+// depth prepass, only POSITION is read so PSO bind the position stream alone
+cbuffer PerCamera : register(b0)
+{
+	float4x4 WorldToClipMatrix;
+}
+
+struct PerObjectData
+{
+	float4x4 ObjectToWorldMatrix;
+	float4x4 WorldToObjectMatrix;
+};
+[[vk::push_constant]] PerObjectData PerObject;
+
+struct Varyings
+{
+	// Invariant decoration: same expression and inputs give the same position in every pipeline
+	[[vk::invariant]] float4 positionCS : SV_POSITION;
+};
+
+// same expression as unlit.hlsl vert, main pass test depth EQUAL against it
+// precise only stops dxc from reordering the math, invariant is what the driver must keep across pipelines
+Varyings vert(float3 positionOS : POSITION)
+{
+	Varyings output;
+	precise float4 positionCS = mul(WorldToClipMatrix, mul(PerObject.ObjectToWorldMatrix, float4(positionOS, 1)));
+	output.positionCS = positionCS;
+	return output;
+}
@@ -1,44 +1,69 @@
+// keywords, each is one bit of the variant key, see ShaderVariants.h
+//[[multi_compile(_VERTEX_COLOR)]]
+
+// specialization constants, set per pipeline by name, see SpecializationValues in Shader.h
+[[vk::constant_id(0)]] const float ColorBias = 0.5f;
+
 // [[vk::binding(0, 0)]]
 cbuffer PerCamera : register(b0)
 {
 	float4x4 WorldToClipMatrix;
 }
 
-// [[vk::binding(1, 0)]]
-cbuffer PerMaterial : register(b1, space2)
+// parameters of every material in one buffer, the draw's firstInstance is its material index
+// members are set by name through Material::Set, layout is reflected, see MaterialSystem.h
+struct PerMaterialData
 {
     float4 _MainTex_ST;
     float4 _Color;
-}
+};
+StructuredBuffer<PerMaterialData> PerMaterial : register(t0, space2);
 
-// [[vk::binding(2, 0)]]
-cbuffer PerObject : register(b2, space5)
+// per draw data use push constant, 128 bytes is the minimum guaranteed size
+struct PerObjectData
 {
 	float4x4 ObjectToWorldMatrix;
 	float4x4 WorldToObjectMatrix;
-}
+};
+[[vk::push_constant]] PerObjectData PerObject;
 
 //[[vk::binding(0, 1)]]
 Texture2D _MainTex : register(t0);
 //[[vk::binding(0, 3)]]
 SamplerState gsamLinearWrapAniso2[3] : register(s0);
 
+// vertex stream is quantized by Mesh::Quantize
+// position: snorm16 in mesh bounds, dequantize is folded into ObjectToWorldMatrix
+// normal/tangent: octahedral snorm, tangent.z is sign of bitangent
+float3 OctDecode(float2 oct)
+{
+	float3 n = float3(oct, 1 - abs(oct.x) - abs(oct.y));
+	float t = saturate(-n.z);
+	n.x += n.x >= 0 ? -t : t;
+	n.y += n.y >= 0 ? -t : t;
+	return normalize(n);
+}
+
 struct Attributes
 {
     float3 positionOS : POSITION;
-    float3 normalOS : NORMAL;
-    float3 tangentOS : TANGENT;
+    float2 normalOct : NORMAL;
+    float3 tangentOct : TANGENT;
     float2 uv0 : TEXCOORD;
     float2 uv1 : TEXCOORD1;
 	float3 color : COLOR;
+	// without -fvk-support-nonzero-base-instance it includes firstInstance
+	uint instanceID : SV_InstanceID;
 };
 
 struct Varyings
 {
-	float4 positionCS : SV_POSITION;
+	// invariant like depth.hlsl, depth test is EQUAL after prepass
+	[[vk::invariant]] float4 positionCS : SV_POSITION;
     float2 uv : TEXCOORD;
     float2 uv1 : TEXCOORD1;
 	float3 color : COLOR;
+	nointerpolation uint materialIndex : MATERIAL_INDEX;
 };
 
 
@@ -48,8 +73,11 @@ Varyings vert(Attributes input)
     //output.positionCS = float4(input.positionOS, 1);
 
     //output.positionCS = mul(WorldToClipMatrix, float4(input.positionOS, 1));
-	output.positionCS = mul(WorldToClipMatrix, mul(ObjectToWorldMatrix, float4(input.positionOS, 1)));
+	// precise keeps dxc from reordering it, the Invariant decoration on positionCS makes it match depth.hlsl
+	precise float4 positionCS = mul(WorldToClipMatrix, mul(PerObject.ObjectToWorldMatrix, float4(input.positionOS, 1)));
+	output.positionCS = positionCS;
 	output.color = input.color;
+	output.materialIndex = input.instanceID;
  //   output.uv = input.uv0 * _MainTex_ST.xy + _MainTex_ST.zw;
  //   output.uv1 = input.uv1;
 
@@ -60,5 +88,9 @@ float4 frag(Varyings input) : SV_TARGET
 {
     //return float4(input.color, 1);
     float4 color = _MainTex.Sample(gsamLinearWrapAniso2[0], input.uv);
-    return float4(color.rgb * input.color * _Color.rgb + 0.5f, 1);
+#ifdef _VERTEX_COLOR
+    color.rgb *= input.color;
+#endif
+    PerMaterialData material = PerMaterial[input.materialIndex];
+    return float4(color.rgb * material._Color.rgb + ColorBias, 1);
 }                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                   
\ No newline at end of file
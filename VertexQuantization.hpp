@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <vulkan/vulkan.h>
+
+//Encoding of float vertex attribute, Float keep source data
+enum class PositionEncoding { Float, Half, Snorm16 };
+enum class DirectionEncoding { Float, OctSnorm16, OctSnorm8 };
+enum class TexcoordEncoding { Float, Half };
+enum class ColorEncoding { Float, Unorm8 };
+
+//Snorm16 position is relative to mesh bounds, draw with ObjectToWorld * Mesh::GetPositionDequantizeMatrix()
+//Oct normal/tangent: xy = octahedral direction, tangent z = sign of w, decode with OctDecode in shader
+struct VertexQuantizeSettings
+{
+	PositionEncoding position = PositionEncoding::Snorm16;
+	DirectionEncoding normal = DirectionEncoding::OctSnorm16;
+	DirectionEncoding tangent = DirectionEncoding::OctSnorm16;
+	TexcoordEncoding texcoord = TexcoordEncoding::Half;
+	ColorEncoding color = ColorEncoding::Unorm8;
+};
+
+//Decoded value against source value, position in object space units, direction in unit vector length
+struct VertexAttributeError
+{
+	std::string semantic;
+	VkFormat sourceFormat;
+	VkFormat format;
+	uint32_t sourceSize;
+	uint32_t size;
+	float maxError;
+	float meanError;
+};
+
+namespace VertexQuantization
+{
+	//Float <-> IEEE half, round to nearest even, overflow to inf
+	inline uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t absBits = bits & 0x7FFFFFFF;
+
+		if (absBits >= 0x7F800000)//inf or nan
+			return static_cast<uint16_t>(sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0));
+		if (absBits >= 0x477FF000)//rounds to greater than max half
+			return static_cast<uint16_t>(sign | 0x7C00);
+		if (absBits < 0x38800000)//denormal half
+		{
+			float absValue;
+			memcpy(&absValue, &absBits, sizeof(absValue));
+			return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(absValue * 16777216.0f)));
+		}
+
+		uint32_t rounded = absBits + 0xFFF + ((absBits >> 13) & 1) - (112u << 23);
+		return static_cast<uint16_t>(sign | (rounded >> 13));
+	}
+
+	inline float HalfToFloat(uint16_t half)
+	{
+		uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1F;
+		uint32_t mantissa = half & 0x3FF;
+
+		float value;
+		if (exponent == 0)
+			value = static_cast<float>(mantissa) / 16777216.0f;
+		else if (exponent == 31)
+			value = mantissa == 0 ? INFINITY : NAN;
+		else
+		{
+			uint32_t bits = ((exponent + 112) << 23) | (mantissa << 13);
+			memcpy(&value, &bits, sizeof(value));
+		}
+		return sign ? -value : value;
+	}
+
+	inline int16_t FloatToSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	inline float Snorm16ToFloat(int16_t value)
+	{
+		return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+	}
+
+	inline int8_t FloatToSnorm8(float value)
+	{
+		return static_cast<int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+	}
+
+	inline float Snorm8ToFloat(int8_t value)
+	{
+		return std::max(static_cast<float>(value) / 127.0f, -1.0f);
+	}
+
+	inline uint8_t FloatToUnorm8(float value)
+	{
+		return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+	}
+
+	inline float Unorm8ToFloat(uint8_t value)
+	{
+		return static_cast<float>(value) / 255.0f;
+	}
+
+	//Octahedral map of unit vector to [-1, 1]^2 (Cigolle 2014)
+	inline void OctEncode(const float direction[3], float oct[2])
+	{
+		float l1 = std::abs(direction[0]) + std::abs(direction[1]) + std::abs(direction[2]);
+		if (l1 <= 0.0f)
+		{
+			oct[0] = 0.0f;
+			oct[1] = 0.0f;
+			return;
+		}
+
+		float x = direction[0] / l1;
+		float y = direction[1] / l1;
+		if (direction[2] < 0.0f)
+		{
+			float foldX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldX;
+			y = foldY;
+		}
+		oct[0] = x;
+		oct[1] = y;
+	}
+
+	inline void OctDecode(const float oct[2], float direction[3])
+	{
+		float x = oct[0];
+		float y = oct[1];
+		float z = 1.0f - std::abs(x) - std::abs(y);
+		float t = std::max(-z, 0.0f);
+		x += x >= 0.0f ? -t : t;
+		y += y >= 0.0f ? -t : t;
+
+		float length = std::sqrt(x * x + y * y + z * z);
+		direction[0] = x / length;
+		direction[1] = y / length;
+		direction[2] = z / length;
+	}
+
+	//Component count of 32bit float format, 0 for other format
+	inline uint32_t FloatComponentCount(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R32_SFLOAT: return 1;
+		case VK_FORMAT_R32G32_SFLOAT: return 2;
+		case VK_FORMAT_R32G32B32_SFLOAT: return 3;
+		case VK_FORMAT_R32G32B32A32_SFLOAT: return 4;
+		default: return 0;
+		}
+	}
+}
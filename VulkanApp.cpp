@@ -3,16 +3,101 @@
 #include <vector>
 #include <set>
 #include <iostream>
+#include <fstream>
+#include <chrono>
+#include <format>
+#include <string_view>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
 
 #include "QueueFamilyIndices.hpp"
 #include "SwapChainSupportDetails.hpp"
 
 #include "dxUtil.hpp"
+#include "Profiler.h"
+#include "Log.h"
 
 namespace Soco {
+	bool TriangleApp::ParseCommandLine(int argc, char** argv)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string_view option = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (option == "--headless")
+				mHeadless = true;
+			else if (option == "--frames" && hasValue)
+				mFrameCount = static_cast<uint32_t>(std::max(std::atoi(argv[++i]), 1));
+			else if (option == "--duration" && hasValue)
+				mDuration = std::atof(argv[++i]);
+			else if (option == "--size" && hasValue)
+			{
+				char* end = nullptr;
+				long width = std::strtol(argv[++i], &end, 10);
+				long height = *end == 'x' ? std::strtol(end + 1, &end, 10) : 0;
+				if (width <= 0 || height <= 0 || *end != '\0')
+				{
+					std::cerr << "invalid size: " << argv[i] << ", expect WxH" << std::endl;
+					return false;
+				}
+				mWidth = static_cast<int>(width);
+				mHeight = static_cast<int>(height);
+			}
+			else if (option == "--readback" && hasValue)
+				mReadbackPath = argv[++i];
+			else if (option == "--benchmark" && hasValue)
+			{
+				const BenchmarkPreset* preset = BenchmarkPreset::Find(argv[++i]);
+				if (preset == nullptr)
+				{
+					std::cerr << "unknown benchmark preset: " << argv[i] << ", presets:";
+					for (const BenchmarkPreset& knownPreset : BenchmarkPreset::GetPresets())
+						std::cerr << " " << knownPreset.name;
+					std::cerr << std::endl;
+					return false;
+				}
+				mBenchmark = std::make_unique<Benchmark>(*preset);
+			}
+			else if (option == "--json" && hasValue)
+				mBenchmarkJsonPath = argv[++i];
+			else if (option == "--trace" && hasValue)
+				mTracePath = argv[++i];
+			else if (option == "--no-pipeline-library")
+				mPipelineLibrary = false;
+			else
+			{
+				std::cerr << "unknown option: " << option << std::endl;
+				std::cerr << "usage: [--headless] [--frames N] [--duration seconds] [--size WxH] [--readback out.ppm] [--benchmark preset [--json out.json]] [--trace out.json] [--no-pipeline-library]" << std::endl;
+				return false;
+			}
+		}
+
+		if (!mBenchmarkJsonPath.empty() && !mBenchmark)
+		{
+			std::cerr << "--json needs --benchmark" << std::endl;
+			return false;
+		}
+
+		//swap chain image can't be copied, readback is only for offscreen image
+		if (!mReadbackPath.empty() && !mHeadless)
+		{
+			std::cerr << "--readback needs --headless" << std::endl;
+			return false;
+		}
+
+		//headless never closes by itself, benchmark ends after its measured frames
+		if (mHeadless && !mBenchmark && mFrameCount == 0 && mDuration <= 0.0)
+			mFrameCount = 100;
+
+		return true;
+	}
+
 	void TriangleApp::Run()
 	{
-		InitWindow();
+		PROFILE_THREAD("Main");
+		if (!mHeadless)
+			InitWindow();
 		InitVulkan();
 		MainLoop();
 		Cleanup();
@@ -47,13 +132,14 @@ namespace Soco {
 	const std::vector<const char*> TriangleApp::GetRequiredExtension()
 	{
 
-		unsigned int glfwExtensionCount;
-		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		//headless has no surface, glfw is not initialized
+		unsigned int glfwExtensionCount = 0;
+		const char** glfwExtensions = mHeadless ? nullptr : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-		std::cout << "glfw required instance extensions:" << std::endl;
+		LOG_DEBUG("glfw required instance extensions:");
 		for (unsigned int i = 0; i < glfwExtensionCount; ++i)
 		{
-			std::cout << "\t" << *(glfwExtensions + i) << std::endl;
+			LOG_DEBUG("\t{}", *(glfwExtensions + i));
 		}
 
 		unsigned int extensionCount = glfwExtensionCount;
@@ -76,9 +162,9 @@ namespace Soco {
 			std::vector<VkExtensionProperties> extensions(extensionCount);
 			ThrowIfFailed(vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data()));
 
-			std::cout << "available instance extensions(" << extensionCount << "):" << std::endl;
+			LOG_DEBUG("available instance extensions({}):", extensionCount);
 			for (const VkExtensionProperties& extension : extensions)
-				std::cout << "\t" << extension.extensionName << std::endl;
+				LOG_DEBUG("\t{}", extension.extensionName);
 		}
 
 		return extensions;
@@ -92,9 +178,9 @@ namespace Soco {
 		std::vector<VkLayerProperties> availableLayers(layerCount);
 		ThrowIfFailed(vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data()));
 
-		std::cout << "available layers(" << availableLayers.size() << "):" << std::endl;
+		LOG_DEBUG("available layers({}):", availableLayers.size());
 		for (const VkLayerProperties& layer : availableLayers)
-			std::cout << "\t" << layer.layerName << " : " << layer.description << std::endl;
+			LOG_DEBUG("\t{} : {}", layer.layerName, layer.description);
 
 		for (const char* layerName : mValidationLayers)
 		{
@@ -133,18 +219,10 @@ namespace Soco {
 		throw std::runtime_error("failed to find supported format!");
 	}
 
-	void TriangleApp::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
-	{
-		VkImageMemoryBarrier barrier = {};
-		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		barrier.oldLayout = oldLayout;
-		barrier.newLayout = newLayout;
-		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	}
-
 	void TriangleApp::CreateInstance()
 	{
+		PROFILE_FUNCTION();
+
 		VkApplicationInfo appInfo = {};
 
 		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -153,7 +231,7 @@ namespace Soco {
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = VK_API_VERSION_1_1;
 
 		if (mEnableValidationLayers && !CheckValidationLayerSupport())
 		{
@@ -187,12 +265,14 @@ namespace Soco {
 		const char* msg,
 		void* userData)
 	{
-		std::cerr << "validation layer: " << msg << std::endl;
+		LOG_ERROR("validation layer: {}", msg);
 		return VK_FALSE;
 	}
 
 	void TriangleApp::SetupDebugCallback()
 	{
+		PROFILE_FUNCTION();
+
 		if (!mEnableValidationLayers)
 			return;
 
@@ -222,6 +302,11 @@ namespace Soco {
 
 	void TriangleApp::CreateSurface()
 	{
+		PROFILE_FUNCTION();
+
+		if (mHeadless)
+			return;
+
 		if (glfwCreateWindowSurface(mInstance, mWindow, nullptr, &mSurface) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create window surface!");
@@ -230,13 +315,21 @@ namespace Soco {
 
 	void TriangleApp::CreateDevice()
 	{
+		PROFILE_FUNCTION();
+
 		mDeviceFeatures.samplerAnisotropy = true;
 
-		mDevice.Init(mInstance, mSurface, mDeviceExtensions, mQueryDeviceExtensions, mValidationLayers, mDeviceFeatures);
+		std::vector<const char*> deviceExtensions = mDeviceExtensions;
+		if (!mHeadless)
+			deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+		mDevice.Init(mInstance, mSurface, deviceExtensions, mQueryDeviceExtensions, mValidationLayers, mDeviceFeatures);
 	}
 
 	void TriangleApp::CreateSwapChain()
 	{
+		PROFILE_FUNCTION();
+
 		SwapChainSupportDetails swapChainSupport = SwapChainSupportDetails::QuerySwapChainSupport(mDevice.GetPhysicalDevice(), mSurface);
 
 		VkSurfaceFormatKHR surfaceFormat = SwapChainSupportDetails::ChooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -322,18 +415,97 @@ namespace Soco {
 
 	void TriangleApp::LoadShader()
 	{
+		PROFILE_FUNCTION();
+
 		ShaderEntry entries;
 		entries.vs = L"vert";
 		entries.ps = L"frag";
 
-		mShaders["Shaders/unlit.hlsl"] = Shader::LoadFromFile(&mDevice, L"Shaders/unlit.hlsl", entries);
+		mShaderVariants["Shaders/unlit.hlsl"] = std::make_unique<ShaderVariants>(&mDevice, L"Shaders/unlit.hlsl", entries);
+		mShaderKeywords["Shaders/unlit.hlsl"] = { "_VERTEX_COLOR" };
+
+		//vertex only, no fragment stage
+		ShaderEntry depthEntries;
+		depthEntries.vs = L"vert";
+		mShaderVariants["Shaders/depth.hlsl"] = std::make_unique<ShaderVariants>(&mDevice, L"Shaders/depth.hlsl", depthEntries);
+
+		//only the variants in use are compiled
+		for (const auto& [name, variants] : mShaderVariants)
+			mShaders[name] = variants->GetVariant(variants->GetKeywordMask(mShaderKeywords[name]));
 	}
 
 	void TriangleApp::CreateMesh()
 	{
-		Transform triangleTransform;
-		mMeshes["Triangle"] = FormatMesh::CreateTriangle(&mDevice);
-		mTransforms["Triangle"] = triangleTransform;
+		PROFILE_FUNCTION();
+
+		if (!mBenchmark)
+		{
+			mMeshes["Triangle"] = FormatMesh::CreateTriangle(&mDevice);
+			mMeshes["Triangle"]->BuildLods();
+			mMeshes["Triangle"]->BuildMeshlets();
+			mMeshes["Triangle"]->Quantize();
+			mMeshes["Triangle"]->SetStreamLayout(MeshStreamLayout::SplitPosition);
+			return;
+		}
+
+		//benchmark meshes differ in triangle count, from about 250 to 5k triangles
+		for (uint32_t i = 0; i < mBenchmark->GetPreset().meshCount; ++i)
+		{
+			uint32_t segments = 16 + 8 * (i % 8);
+			std::unique_ptr<Mesh>& mesh = mMeshes[std::format("Sphere{}", i)];
+			mesh = FormatMesh::CreateSphere(&mDevice, segments, segments / 2);
+			mesh->Optimize();
+			mesh->BuildLods();
+			mesh->BuildMeshlets();
+			mesh->Quantize();
+			mesh->SetStreamLayout(MeshStreamLayout::SplitPosition);
+		}
+	}
+
+	void TriangleApp::CreateScene()
+	{
+		PROFILE_FUNCTION();
+
+		if (!mBenchmark)
+		{
+			mRenderObjects.emplace_back(mMeshes["Triangle"].get(), 0);
+			return;
+		}
+
+		//chains of hierarchyDepth objects, chain roots on a grid in front of the camera, children orbit their parent
+		//mesh and material are interleaved so draws must be sorted to batch them
+		const BenchmarkPreset& preset = mBenchmark->GetPreset();
+		const uint32_t depth = std::max(preset.hierarchyDepth, 1u);
+		const uint32_t chainCount = (preset.objectCount + depth - 1) / depth;
+		const uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(chainCount))));
+		const float spacing = 1.5f;
+		mMaterialCount = std::max(preset.materialCount, 1u);
+
+		for (uint32_t i = 0; i < preset.objectCount; ++i)
+		{
+			uint32_t level = i % depth;
+			uint32_t chain = i / depth;
+
+			Transform transform;
+			if (level == 0)
+			{
+				float x = (static_cast<float>(chain % gridSize) - gridSize * 0.5f) * spacing;
+				float y = (static_cast<float>(chain / gridSize) - gridSize * 0.5f) * spacing;
+				transform.SetLocalPosition(glm::vec3(x, y, gridSize * spacing * 0.5f));
+			}
+			else
+			{
+				transform.mParent = mRenderObjects.back().GetTransform();
+				transform.SetLocalPosition(glm::vec3(0.8f, 0.0f, 0.0f));
+				transform.SetLocalScale(glm::vec3(0.8f));
+			}
+
+			Mesh* mesh = mMeshes[std::format("Sphere{}", i % preset.meshCount)].get();
+			mRenderObjects.emplace_back(mesh, i % mMaterialCount, transform);
+		}
+
+		LOG_INFO("benchmark scene: {} objects, {} meshes, {} chains of depth {}, {} materials",
+			mRenderObjects.size(), mMeshes.size(), chainCount, depth, mMaterialCount);
 	}
 
 	struct PerObject
@@ -344,75 +516,377 @@ namespace Soco {
 
 	void TriangleApp::CreateConstantBuffer()
 	{
+		PROFILE_FUNCTION();
+
 		mConstantBuffers["Triangle"] = std::make_unique<ConstantBuffer>(&mDevice);
 		mConstantBuffers["Triangle"]->Init(sizeof(PerObject));
 	}
 
-	void TriangleApp::CreateRenderPass()
+	void TriangleApp::CreateMaterials()
 	{
-		VkAttachmentDescription colorAttachment = {};
-		colorAttachment.format = mSwapChainImageFormat;
-		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		PROFILE_FUNCTION();
 
-		VkAttachmentReference colorAttachmentRef
+		//material i is the material index of the scene objects, colors are spread over hue
+		//materials only differ in parameters, so they share one pipeline state and one forward pipeline
+		const std::string shaderName = "Shaders/unlit.hlsl";
+		const Shader& shader = *mShaders[shaderName];
+		mMaterialSystem = std::make_unique<MaterialSystem>(&mDevice, shader, "PerMaterial", mMaterialCount);
+
+		SpecializationValues specialization;
+		specialization.Set("ColorBias", 0.5f);
+		for (uint32_t i = 0; i < mMaterialCount; ++i)
 		{
-			.attachment=0, 
-			.layout= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL 
-		};
+			float hue = static_cast<float>(i) / mMaterialCount * glm::two_pi<float>();
+			Material* material = mMaterialSystem->CreateMaterial(shaderName, shader, {}, specialization);
+			material->Set("_MainTex_ST", glm::vec4(1.0f, 1.0f, 0.0f, 0.0f));
+			material->Set("_Color", glm::vec4(0.5f + 0.5f * glm::cos(hue + glm::vec3(0.0f, 2.094f, 4.189f)), 1.0f));
+		}
+		LOG_INFO("{} materials in {} pipeline states", mMaterialSystem->GetMaterialCount(), mMaterialSystem->GetPipelineStates().size());
+	}
+
+	void TriangleApp::CreateRenderGraph()
+	{
+		PROFILE_FUNCTION();
+
+		//Depth, prepass and main pass use the same format
+		mDepthFormat = FindSupportFormat(
+			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+			VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+		);
 
-		VkSubpassDescription subpass
+		mRenderGraph = std::make_unique<RenderGraph>(&mDevice);
+		RenderGraph& graph = *mRenderGraph;
+
+		//acquire semaphore is waited at color output, the first barrier of back buffer chains on it
+		//offscreen image is not presented, it's left in the layout of the last pass
+		RenderGraph::TextureHandle backBuffer = graph.ImportTexture("BackBuffer", mSwapChainImages, mSwapChainImageViews,
+			mSwapChainImageFormat, mSwapChainExtent, mHeadless ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR | (mHeadless ? VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR : 0));
+		RenderGraph::TextureHandle depth = graph.CreateTexture("Depth", mDepthFormat, mSwapChainExtent);
+
+		if (mDepthPrepass)
 		{
-			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-			.colorAttachmentCount = 1, // SV_TARGET0 in shader
-			.pColorAttachments = &colorAttachmentRef
-		};
+			mDepthPass = graph.AddPass("DepthPrepass", [this](VkCommandBuffer commandBuffer) {
+				//not compiled yet, main pass without prepass depth draws nothing either
+				PSO* depthPSO = mGraphicsPipelineDescs[mDepthPipeline].pso;
+				if (depthPSO == nullptr)
+					return;
+				Shader* depthShader = mShaders["Shaders/depth.hlsl"];
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPSO->GetPipeline());
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthShader->GetPipelineLayout(), 0, mDepthDescriptorSets.size(), mDepthDescriptorSets.data(), 0, nullptr);
+				DrawMeshes(commandBuffer, depthShader, true, mMeshDraws);
+			});
+			graph.WriteDepth(mDepthPass, depth, VkClearDepthStencilValue{ 1.0f, 0 });
+		}
 
-		VkSubpassDependency dependency
+		mForwardPass = graph.AddPass("Forward", [this](VkCommandBuffer commandBuffer) {
+			//draws are sorted by material pipeline state, each run is drawn with its pipeline
+			//material shaders share the descriptor set layouts of unlit.hlsl, sets are bound again only when the shader changes
+			const Shader* boundShader = nullptr;
+			for (auto begin = mMeshDraws.begin(); begin != mMeshDraws.end();)
+			{
+				const uint32_t stateIndex = begin->pipelineStateIndex;
+				auto end = std::find_if(begin, mMeshDraws.end(), [stateIndex](const MeshDraw& meshDraw) { return meshDraw.pipelineStateIndex != stateIndex; });
+
+				//not compiled yet, objects of these materials are skipped
+				const GraphicsPipelineDesc& desc = mGraphicsPipelineDescs[mForwardPipelines[stateIndex]];
+				if (desc.pso != nullptr)
+				{
+					const Shader* shader = mShaders[desc.shader];
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, desc.pso->GetPipeline());
+					if (shader != boundShader)
+					{
+						vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->GetPipelineLayout(), 0, mDescriptorSets.size(), mDescriptorSets.data(), 0, nullptr);
+						boundShader = shader;
+					}
+					DrawMeshes(commandBuffer, shader, false, { begin, end });
+				}
+				begin = end;
+			}
+		});
+		graph.WriteColor(mForwardPass, backBuffer, VkClearColorValue{ { 0.0f, 0.0f, 0.0f, 1.0f } });
+		if (mDepthPrepass)
+			graph.ReadDepth(mForwardPass, depth);
+		else
+			graph.WriteDepth(mForwardPass, depth, VkClearDepthStencilValue{ 1.0f, 0 });
+
+		//copy only in the readback frame, the pass keeps the layout transition every frame
+		if (mReadbackBuffer != VK_NULL_HANDLE)
 		{
-			.srcSubpass = VK_SUBPASS_EXTERNAL,
-			.dstSubpass = 0,
+			RenderGraph::PassHandle readbackPass = graph.AddPass("Readback", [this](VkCommandBuffer commandBuffer) {
+				if (!mReadbackPending)
+					return;
 
-			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VkBufferImageCopy region
+				{
+					.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+					.imageExtent = { mSwapChainExtent.width, mSwapChainExtent.height, 1 }
+				};
+				vkCmdCopyImageToBuffer(commandBuffer, mSwapChainImages[0], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mReadbackBuffer, 1, &region);
 
-			.srcAccessMask = 0,
-			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
-		};
+				//host reads it after the fence
+				VkMemoryBarrier2KHR hostBarrier
+				{
+					.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR,
+					.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+					.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+					.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT_KHR,
+					.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT_KHR
+				};
+				VkDependencyInfoKHR dependencyInfo
+				{
+					.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+					.memoryBarrierCount = 1,
+					.pMemoryBarriers = &hostBarrier
+				};
+				mDevice.CmdPipelineBarrier2(commandBuffer, dependencyInfo);
+			});
+			graph.ReadTransfer(readbackPass, backBuffer);
+		}
+
+		graph.Compile();
+	}
 
-		VkRenderPassCreateInfo renderPassInfo
+	void TriangleApp::CreateGraphicsPipeline()
+	{
+		PROFILE_FUNCTION();
+
+		mGraphicsPipelineDescs.clear();
+		if (mDepthPrepass)
 		{
-			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-			.attachmentCount = 1,
-			.pAttachments = &colorAttachment,
+			RenderState depthState;
+			depthState.colorAttachmentCount = 0;
+			mDepthPipeline = mGraphicsPipelineDescs.size();
+			mGraphicsPipelineDescs.push_back({ "Shaders/depth.hlsl", mDepthPass, depthState });
+		}
 
-			.subpassCount = 1,
-			.pSubpasses = &subpass,
+		//forward pipelines come from the material states, materials with equal state share one
+		mForwardPipelines.clear();
+		for (const MaterialPipelineState& materialState : mMaterialSystem->GetPipelineStates())
+		{
+			RenderState state = materialState.renderState;
+			if (mDepthPrepass)
+			{
+				//every visible pixel is shaded once
+				state.depthCompareOp = VK_COMPARE_OP_EQUAL;
+				state.depthWrite = false;
+			}
+			mForwardPipelines.push_back(mGraphicsPipelineDescs.size());
+			mGraphicsPipelineDescs.push_back({ materialState.shader, mForwardPass, state, materialState.specialization });
+		}
 
-			.dependencyCount = 1,
-			.pDependencies = &dependency
-		};
+		//load time, the pipelines known up front are compiled in parallel and waited
+		for (const GraphicsPipelineDesc& desc : mGraphicsPipelineDescs)
+			mPipelineCompiler->Request(GetPipelineKey(desc, mShaders[desc.shader]));
+		mPipelineCompiler->WaitIdle();
+		UpdateGraphicsPipelines();
+	}
 
-		ThrowIfFailed(vkCreateRenderPass(mDevice.GetDevice(), &renderPassInfo, nullptr, &mRenderPass));
+	PSOKey TriangleApp::GetPipelineKey(const GraphicsPipelineDesc& desc, const Shader* shader) const
+	{
+		//every mesh is processed the same way and shares one vertex layout
+		//with dynamic rendering the render pass is null and the key holds the attachment formats, so a resize keeps the pipelines
+		VkRenderPass renderPass = mRenderGraph->GetRenderPass(desc.pass);
+		RenderTargetFormats formats;
+		if (renderPass == VK_NULL_HANDLE)
+			formats = { mRenderGraph->GetColorFormats(desc.pass), mRenderGraph->GetDepthFormat(desc.pass) };
+		return { shader, mMeshes.begin()->second.get(), renderPass, 0, std::move(formats), desc.state, desc.specialization };
+	}
 
+	void TriangleApp::UpdateGraphicsPipelines()
+	{
+		//a pipeline added after load is drawn from the frame its compile is done,
+		//a linked pipeline is replaced by its monolithic one when that is built
+		for (GraphicsPipelineDesc& desc : mGraphicsPipelineDescs)
+		{
+			if (PSO* pso = mPipelineCompiler->TryGet(GetPipelineKey(desc, mShaders[desc.shader])))
+				desc.pso = pso;
+		}
 	}
 
-	void TriangleApp::CreateGraphicsPipeline()
+	void TriangleApp::UpdateShaderHotReload()
+	{
+		ClearRetiredObjects(false);
+
+		for (const std::filesystem::path& file : mShaderWatcher->PollChanges())
+		{
+			for (const auto& [name, shader] : mShaders)
+			{
+				const std::vector<std::filesystem::path>& sourceFiles = shader->GetSourceFiles();
+				if (std::find(sourceFiles.begin(), sourceFiles.end(), file) != sourceFiles.end())
+					mShaderReloadQueue.insert(name);
+			}
+		}
+
+		//one compile in flight, changes meanwhile wait for the next one
+		if (!mShaderReload.valid() && !mShaderReloadQueue.empty())
+		{
+			//old shaders are only retired by this function, they outlive the task
+			struct ReloadJob
+			{
+				std::string name;
+				const ShaderVariants* variants;
+				std::vector<std::string> keywords;
+			};
+			std::vector<ReloadJob> jobs;
+			for (const std::string& name : mShaderReloadQueue)
+				jobs.push_back({ name, mShaderVariants[name].get(), mShaderKeywords[name] });
+			mShaderReloadQueue.clear();
+
+			mShaderReload = std::async(std::launch::async, [jobs = std::move(jobs)]() {
+				PROFILE_THREAD("Shader Reload");
+				std::map<std::string, std::unique_ptr<ShaderVariants>> shaders;
+				for (const ReloadJob& job : jobs)
+				{
+					//a broken edit keeps the old shader, only the variant in use is compiled
+					const std::string& name = job.name;
+					try {
+						std::unique_ptr<ShaderVariants> variants = job.variants->Reload();
+						variants->GetVariant(variants->GetKeywordMask(job.keywords));
+						shaders[name] = std::move(variants);
+					}
+					catch (const std::exception& e) {
+						LOG_ERROR("shader reload {} failed: {}", name, e.what());
+					}
+					catch (const DxVkException& e) {
+						LOG_ERROR("shader reload {} failed: {}", name, e.ToString());
+					}
+				}
+				return shaders;
+			});
+		}
+
+		if (!mShaderReload.valid() || mShaderReload.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			UpdateShaderSwaps();
+			return;
+		}
+
+		std::map<std::string, std::unique_ptr<ShaderVariants>> shaders = mShaderReload.get();
+		RetiredObjects retired{ mFrameIndex };
+		for (auto& [name, variants] : shaders)
+		{
+			//compiled by the task, this is a lookup
+			Shader* shader = variants->GetVariant(variants->GetKeywordMask(mShaderKeywords[name]));
+
+			//descriptor sets are allocated with the old layout
+			if (!Shader::IsPipelineLayoutEqual(*mShaders[name], *shader))
+			{
+				LOG_WARNING("shader reload {}: resource layout changed, restart to apply", name);
+				continue;
+			}
+
+			//a newer edit replaces a swap still waiting for its pipelines
+			auto ite = std::find_if(mShaderSwaps.begin(), mShaderSwaps.end(), [&](const ShaderSwap& swap) { return swap.name == name; });
+			if (ite != mShaderSwaps.end())
+			{
+				const Shader* stale = ite->shader;
+				for (std::unique_ptr<PSO>& pso : mPipelineCompiler->Remove([stale](const PSOKey& key) { return key.shader == stale; }))
+					retired.pipelines.push_back(std::move(pso));
+				retired.shaders.push_back(std::move(ite->variants));
+				mShaderSwaps.erase(ite);
+			}
+
+			ShaderSwap swap{ name, std::move(variants), shader };
+			for (const GraphicsPipelineDesc& desc : mGraphicsPipelineDescs)
+			{
+				if (desc.shader == name)
+					swap.pipelines.push_back(mPipelineCompiler->Request(GetPipelineKey(desc, shader)));
+			}
+			mShaderSwaps.push_back(std::move(swap));
+		}
+		if (!retired.shaders.empty())
+			mRetiredObjects.push_back(std::move(retired));
+
+		UpdateShaderSwaps();
+	}
+
+	void TriangleApp::UpdateShaderSwaps()
+	{
+		RetiredObjects retired{ mFrameIndex };
+		for (auto ite = mShaderSwaps.begin(); ite != mShaderSwaps.end();)
+		{
+			ShaderSwap& swap = *ite;
+			bool ready = std::all_of(swap.pipelines.begin(), swap.pipelines.end(), [](const std::shared_future<PSO*>& pipeline) {
+				return pipeline.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+			});
+			if (!ready)
+			{
+				++ite;
+				continue;
+			}
+
+			PROFILE_SCOPE("Shader Swap");
+			std::vector<PSO*> pipelines;
+			try {
+				for (const std::shared_future<PSO*>& pipeline : swap.pipelines)
+					pipelines.push_back(pipeline.get());
+			}
+			catch (const std::exception& e) {
+				//the compiler has logged it, keep the old shader
+				LOG_WARNING("shader reload {}: pipeline failed, old shader kept: {}", swap.name, e.what());
+			}
+			catch (const DxVkException& e) {
+				LOG_WARNING("shader reload {}: pipeline failed, old shader kept: {}", swap.name, e.ToString());
+			}
+
+			//material buffer keeps the layout it was created with
+			const bool compatible = mMaterialSystem->IsCompatible(*swap.shader);
+			if (!compatible)
+				LOG_WARNING("shader reload {}: {} layout changed, old shader kept until restart", swap.name, mMaterialSystem->GetLayout().name);
+
+			//pipelines of the shader that is not drawn anymore leave the compiler with it
+			const bool failed = !compatible || pipelines.size() != swap.pipelines.size();
+			const Shader* replaced = failed ? swap.shader : mShaders[swap.name];
+			if (failed)
+			{
+				retired.shaders.push_back(std::move(swap.variants));
+			}
+			else
+			{
+				size_t pipelineIndex = 0;
+				for (GraphicsPipelineDesc& desc : mGraphicsPipelineDescs)
+				{
+					if (desc.shader == swap.name)
+						desc.pso = pipelines[pipelineIndex++];
+				}
+				retired.shaders.push_back(std::move(mShaderVariants[swap.name]));
+				mShaderVariants[swap.name] = std::move(swap.variants);
+				mShaders[swap.name] = swap.shader;
+				LOG_INFO("shader reload {}: {} pipelines rebuilt", swap.name, pipelines.size());
+			}
+			for (std::unique_ptr<PSO>& pso : mPipelineCompiler->Remove([replaced](const PSOKey& key) { return key.shader == replaced; }))
+				retired.pipelines.push_back(std::move(pso));
+
+			ite = mShaderSwaps.erase(ite);
+		}
+		if (!retired.shaders.empty())
+			mRetiredObjects.push_back(std::move(retired));
+	}
+
+	void TriangleApp::ClearRetiredObjects(bool all)
 	{
-		mPSO.Init(mDevice.GetDevice(), *mShaders["Shaders/unlit.hlsl"].get(), *mMeshes["Triangle"].get(), mSwapChainExtent, mRenderPass, 0);
+		//OnUpload waits the queue idle, frames before the current one are complete
+		//an orphaned build may still read a retired shader
+		if (!all && mPipelineCompiler->GetOrphanCount() > 0)
+			return;
+		while (!mRetiredObjects.empty() && (all || mRetiredObjects.front().frame < mFrameIndex))
+		{
+			for (std::unique_ptr<PSO>& pso : mRetiredObjects.front().pipelines)
+				pso->Clear();
+			mRetiredObjects.pop_front();
+		}
 	}
 
 	void TriangleApp::CreateDescriptorPool()
 	{
+		PROFILE_FUNCTION();
+
 		//Shader* shader = mShaders["Shaders/unlit.hlsl"].get();
 
 		VkDescriptorPoolSize poolSizes[] = { 
 			{.type{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER}, .descriptorCount{1000}},
+			{.type{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER}, .descriptorCount{100}},
 			{.type{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE}, .descriptorCount{1000}},
 			{.type{VK_DESCRIPTOR_TYPE_SAMPLER}, .descriptorCount{1000}}
 		};
@@ -429,6 +903,8 @@ namespace Soco {
 
 	void TriangleApp::CreateDescriptorSet()
 	{
+		PROFILE_FUNCTION();
+
 		const std::vector<VkDescriptorSetLayout>& setLayouts = mShaders["Shaders/unlit.hlsl"]->GetDescriptorSetLayout();
 		mDescriptorSets.resize(setLayouts.size());
 
@@ -441,34 +917,39 @@ namespace Soco {
 		};
 
 		ThrowIfFailed(vkAllocateDescriptorSets(mDevice.GetDevice(), &allocInfo, mDescriptorSets.data()));
-	}
-
-	void TriangleApp::CreateFrameBuffer()
-	{
-		mSwapChainFrameBuffers.resize(mSwapChainImageViews.size());
 
-		for (size_t i = 0; i < mSwapChainImageViews.size(); ++i)
-		{
-			VkImageView attachments[] = {
-				mSwapChainImageViews[i]
-			};
+		const std::vector<VkDescriptorSetLayout>& depthSetLayouts = mShaders["Shaders/depth.hlsl"]->GetDescriptorSetLayout();
+		mDepthDescriptorSets.resize(depthSetLayouts.size());
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(depthSetLayouts.size());
+		allocInfo.pSetLayouts = depthSetLayouts.data();
+		ThrowIfFailed(vkAllocateDescriptorSets(mDevice.GetDevice(), &allocInfo, mDepthDescriptorSets.data()));
 
-			VkFramebufferCreateInfo framebufferInfo = {};
-			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebufferInfo.renderPass = mRenderPass;
-			framebufferInfo.attachmentCount = 1;
-			framebufferInfo.pAttachments = attachments;
-			framebufferInfo.width = mSwapChainExtent.width;
-			framebufferInfo.height = mSwapChainExtent.height;
-			framebufferInfo.layers = 1;
+		//the material buffer is written once, it never moves and draws only change the index
+		auto [materialSetIndex, materialBinding] = mShaders["Shaders/unlit.hlsl"]->GetBindingPoint("PerMaterial");
+		if (materialSetIndex >= setLayouts.size())
+			return;
 
-			ThrowIfFailed(vkCreateFramebuffer(mDevice.GetDevice(), &framebufferInfo, nullptr, &mSwapChainFrameBuffers[i]));
-		}
+		VkDescriptorBufferInfo materialBufferInfo = mMaterialSystem->GetBufferInfo();
+		VkWriteDescriptorSet materialWrite
+		{
+			.sType{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET},
+			.dstSet{mDescriptorSets[materialSetIndex]},
+			.dstBinding{materialBinding},
+			.dstArrayElement{0},
+			.descriptorCount{1},
+			.descriptorType{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER},
+			.pImageInfo{nullptr},
+			.pBufferInfo{&materialBufferInfo},
+			.pTexelBufferView{nullptr}
+		};
+		vkUpdateDescriptorSets(mDevice.GetDevice(), 1, &materialWrite, 0, nullptr);
 	}
 
 	void TriangleApp::CreateCommandBuffers()
 	{
-		mCommandBuffers.resize(mSwapChainFrameBuffers.size());
+		PROFILE_FUNCTION();
+
+		mCommandBuffers.resize(mSwapChainImages.size());
 
 		VkCommandBufferAllocateInfo allocInfo = {};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -483,88 +964,138 @@ namespace Soco {
 
 	void TriangleApp::CreateSemaphores()
 	{
+		PROFILE_FUNCTION();
+
 		VkSemaphoreCreateInfo semaphoreInfo = {};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
 		ThrowIfFailed(vkCreateSemaphore(mDevice.GetDevice(), &semaphoreInfo, nullptr, &mRenderFinishedSemaphore));
 		ThrowIfFailed(vkCreateSemaphore(mDevice.GetDevice(), &semaphoreInfo, nullptr, &mImageAvailableSemaphore));
+
+		if (mHeadless)
+		{
+			VkFenceCreateInfo fenceInfo
+			{
+				.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+				.flags = VK_FENCE_CREATE_SIGNALED_BIT
+			};
+			ThrowIfFailed(vkCreateFence(mDevice.GetDevice(), &fenceInfo, nullptr, &mFrameFence));
+		}
 	}
 
-	void TriangleApp::CreateImageResource()
+	void TriangleApp::CreateOffscreenTarget()
 	{
-		auto AllocAndBindImageMemory = [&](VkImage image, VkDeviceMemory memory, VkMemoryPropertyFlags properties)
-		{
-			VkMemoryRequirements memRequirements;
-			vkGetImageMemoryRequirements(mDevice.GetDevice(), image, &memRequirements);
+		PROFILE_FUNCTION();
 
-			VkMemoryAllocateInfo allocInfo = {};
-			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			allocInfo.allocationSize = memRequirements.size;
-			allocInfo.memoryTypeIndex = mDevice.FindMemoryType(memRequirements.memoryTypeBits, properties);
-			ThrowIfFailed(vkAllocateMemory(mDevice.GetDevice(), &allocInfo, nullptr, &memory));
+		mSwapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		mSwapChainExtent = { static_cast<uint32_t>(mWidth), static_cast<uint32_t>(mHeight) };
 
-			vkBindImageMemory(mDevice.GetDevice(), image, memory, 0);
+		VkImageCreateInfo imageInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = mSwapChainImageFormat,
+			.extent = { mSwapChainExtent.width, mSwapChainExtent.height, 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
 		};
 
-		auto CreateImage2DView = [&](VkImage image, VkFormat format, VkImageAspectFlagBits aspectFlag)
-		{
-			VkImageViewCreateInfo viewInfo = {};
-			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			viewInfo.image = image;
-			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			viewInfo.format = format;
-			viewInfo.subresourceRange.aspectMask = aspectFlag;
-			viewInfo.subresourceRange.baseMipLevel = 0;
-			viewInfo.subresourceRange.levelCount = 1;
-			viewInfo.subresourceRange.baseArrayLayer = 0;
-			viewInfo.subresourceRange.layerCount = 1;
+		VkImage image;
+		ThrowIfFailed(vkCreateImage(mDevice.GetDevice(), &imageInfo, nullptr, &image));
 
-			VkImageView imageView;
-			ThrowIfFailed(vkCreateImageView(mDevice.GetDevice(), &viewInfo, nullptr, &imageView));
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(mDevice.GetDevice(), image, &memRequirements);
+		mOffscreenMemory = mDevice.AllocateMemory(memRequirements.size, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		ThrowIfFailed(vkBindImageMemory(mDevice.GetDevice(), image, mOffscreenMemory, 0));
 
-			return imageView;
+		VkImageViewCreateInfo viewInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = mSwapChainImageFormat,
+			.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
 		};
 
-		auto CreateTex2D = [&](uint32_t width, uint32_t height, VkFormat format,
-			VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImageAspectFlagBits aspectFlag,
-			VkImage& image, VkDeviceMemory& imageMemory, VkImageView& view)
-		{
-			VkImageCreateInfo imageInfo = {};
-			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-			imageInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageInfo.extent.width = width;
-			imageInfo.extent.height = height;
-			imageInfo.extent.depth = 1;
-			imageInfo.mipLevels = 1; 
-			imageInfo.arrayLayers = 1;
-			imageInfo.format = format;
-			imageInfo.tiling = tiling;
-			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageInfo.usage = usage;
-			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			imageInfo.queueFamilyIndexCount = 0;
-			imageInfo.pQueueFamilyIndices = nullptr;
-
-			ThrowIfFailed(vkCreateImage(mDevice.GetDevice(), &imageInfo, nullptr, &image));
-			AllocAndBindImageMemory(image, imageMemory, properties);
-			CreateImage2DView(image, format, aspectFlag);
+		VkImageView view;
+		ThrowIfFailed(vkCreateImageView(mDevice.GetDevice(), &viewInfo, nullptr, &view));
+
+		mSwapChainImages = { image };
+		mSwapChainImageViews = { view };
+
+		if (mReadbackPath.empty())
+			return;
+
+		VkBufferCreateInfo bufferInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = static_cast<VkDeviceSize>(mSwapChainExtent.width) * mSwapChainExtent.height * 4,
+			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE
 		};
+		ThrowIfFailed(vkCreateBuffer(mDevice.GetDevice(), &bufferInfo, nullptr, &mReadbackBuffer));
 
-		//Depth
-		VkFormat depthFormat = FindSupportFormat(
-			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
-			VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-		);
-		
-		CreateTex2D(mSwapChainExtent.width, mSwapChainExtent.height, depthFormat,
-			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
-			mDepthImage, mDepthImageMemory, mDepthImageView
-		);
+		vkGetBufferMemoryRequirements(mDevice.GetDevice(), mReadbackBuffer, &memRequirements);
+		mReadbackMemory = mDevice.AllocateMemory(memRequirements.size, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		ThrowIfFailed(vkBindBufferMemory(mDevice.GetDevice(), mReadbackBuffer, mReadbackMemory, 0));
+	}
+
+	void TriangleApp::DestroyOffscreenTarget()
+	{
+		//view is destroyed with swap chain image views
+		for (const VkImage& image : mSwapChainImages)
+			vkDestroyImage(mDevice.GetDevice(), image, nullptr);
+		vkFreeMemory(mDevice.GetDevice(), mOffscreenMemory, nullptr);
+		vkDestroyBuffer(mDevice.GetDevice(), mReadbackBuffer, nullptr);
+		vkFreeMemory(mDevice.GetDevice(), mReadbackMemory, nullptr);
+
+		mSwapChainImages.clear();
+		mOffscreenMemory = VK_NULL_HANDLE;
+		mReadbackBuffer = VK_NULL_HANDLE;
+		mReadbackMemory = VK_NULL_HANDLE;
+	}
+
+	void TriangleApp::WriteReadback(const std::string& path)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			throw std::runtime_error(std::format("failed to open readback file {}", path));
+
+		void* data;
+		ThrowIfFailed(vkMapMemory(mDevice.GetDevice(), mReadbackMemory, 0, VK_WHOLE_SIZE, 0, &data));
+
+		//binary ppm, rgba8 to rgb8
+		const uint32_t width = mSwapChainExtent.width;
+		const uint32_t height = mSwapChainExtent.height;
+		file << "P6\n" << width << " " << height << "\n255\n";
+
+		const uint8_t* pixels = static_cast<const uint8_t*>(data);
+		std::vector<uint8_t> row(width * 3);
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				const uint8_t* pixel = pixels + (static_cast<size_t>(y) * width + x) * 4;
+				row[x * 3 + 0] = pixel[0];
+				row[x * 3 + 1] = pixel[1];
+				row[x * 3 + 2] = pixel[2];
+			}
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+
+		vkUnmapMemory(mDevice.GetDevice(), mReadbackMemory);
+		std::cout << "readback saved: " << path << std::endl;
 	}
 
 	void TriangleApp::CreateCamera()
 	{
+		PROFILE_FUNCTION();
+
 		mCamera = std::make_unique<Camera>(&mDevice);
 
 		Transform* cameraTransform = mCamera->GetTransform();
@@ -573,6 +1104,7 @@ namespace Soco {
 
 		mCamera->SetFov(glm::radians(90.0f));
 		mCamera->SetAspect((float)mWidth / (float)mHeight);
+		mCamera->SetViewportHeight((float)mHeight);
 		mCamera->SetNear(0.25f);
 		mCamera->SetFar(1000.0f);
 
@@ -581,95 +1113,207 @@ namespace Soco {
 
 	void TriangleApp::InitVulkan()
 	{
+		PROFILE_FUNCTION();
+
 		CreateInstance();
 		CreateSurface();
 		SetupDebugCallback();
 		CreateDevice();
-		CreateSwapChain();
+		mPipelineCompiler = std::make_unique<PipelineCompiler>(&mDevice, mPipelineLibrary);
+		if (mHeadless)
+			CreateOffscreenTarget();
+		else
+			CreateSwapChain();
 		LoadShader();
 		CreateMesh();
+		CreateScene();
 		CreateConstantBuffer();
-		CreateRenderPass();
+		CreateMaterials();
+		CreateRenderGraph();
 		CreateGraphicsPipeline();
 
 		CreateCamera();
 
 		CreateDescriptorPool();
 		CreateDescriptorSet();
-		CreateFrameBuffer();
 		CreateCommandBuffers();
 		CreateSemaphores();
-		CreateConstantBuffer();
+
+		//benchmark runs stay free of watcher thread and swaps
+		if (!mHeadless && !mBenchmark)
+			mShaderWatcher = std::make_unique<FileWatcher>("Shaders");
 	}
 
 	void TriangleApp::OnResize()
 	{
+		PROFILE_FUNCTION();
+
 		vkDeviceWaitIdle(mDevice.GetDevice());
 
 		//Create Resource
 		CreateSwapChain();
-		CreateRenderPass();
+		CreateRenderGraph();
 		CreateGraphicsPipeline();
-		CreateFrameBuffer();
 
 		mCamera->SetAspect((float)mWidth / (float)mHeight);
 	}
 
+	bool TriangleApp::IsLoopDone(uint32_t frame, double seconds)
+	{
+		if (!mHeadless && glfwWindowShouldClose(mWindow))
+			return true;
+		if (mFrameCount > 0 && frame >= mFrameCount)
+			return true;
+		if (mDuration > 0.0 && seconds >= mDuration)
+			return true;
+		if (mBenchmark && mBenchmark->IsDone())
+			return true;
+
+		return false;
+	}
+
 	void TriangleApp::MainLoop()
 	{
-		while (!glfwWindowShouldClose(mWindow)) {
-			glfwPollEvents();
+		auto begin = std::chrono::high_resolution_clock::now();
+		uint32_t frame = 0;
+		double seconds = 0.0;
+
+		while (!IsLoopDone(frame, seconds)) {
+			PROFILE_SCOPE("Frame");
+			if (!mHeadless)
+			{
+				glfwPollEvents();
+
+				//F12 dumps what the rings hold so far
+				bool dumpKey = glfwGetKey(mWindow, GLFW_KEY_F12) == GLFW_PRESS;
+				if (dumpKey && !mTraceKeyDown)
+					Profiler::WriteChromeTrace(mTracePath.empty() ? "trace.json" : mTracePath);
+				mTraceKeyDown = dumpKey;
+			}
+
+			if (mShaderWatcher)
+				UpdateShaderHotReload();
+			UpdateGraphicsPipelines();
+
+			if (mBenchmark)
+				mBenchmark->BeginFrame();
 
 			OnUpdate();
 			OnUpload();
 			OnRender();
+
+			if (mBenchmark)
+			{
+				mBenchmark->EndFrame();
+				mBenchmark->AddGpuFrame(*mDevice.GetGpuProfiler());
+			}
+
+			++frame;
+			++mFrameIndex;
+			seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
 		}
 
 		vkDeviceWaitIdle(mDevice.GetDevice());
+		seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+		//results below go straight to stdout, after everything logged during the loop
+		Log::Flush();
+
+		if (mHeadless && frame > 0)
+		{
+			std::cout << std::format("headless: {} frames {}x{}, {:.1f} ms, {:.3f} ms/frame, {:.1f} fps",
+				frame, mWidth, mHeight, seconds * 1000.0, seconds * 1000.0 / frame, frame / seconds) << std::endl;
+		}
+
+		if (mBenchmark)
+		{
+			mBenchmark->PrintSummary();
+			if (!mBenchmarkJsonPath.empty())
+				mBenchmark->WriteJson(mBenchmarkJsonPath, mWidth, mHeight, mHeadless);
+		}
+
+		if (!mTracePath.empty())
+			Profiler::WriteChromeTrace(mTracePath);
+
+		//one more frame of the last state with copy, not timed
+		if (!mReadbackPath.empty())
+		{
+			mReadbackPending = true;
+			OnUpload();
+			OnRender();
+			vkDeviceWaitIdle(mDevice.GetDevice());
+			mReadbackPending = false;
+
+			WriteReadback(mReadbackPath);
+		}
 	}
 
 	void TriangleApp::Cleanup()
 	{
+		mShaderWatcher.reset();
+		if (mShaderReload.valid())
+			mShaderReload.wait();
+		mShaderReload = {};
+		//waits the compiles still reading shaders
+		mPipelineCompiler->Clear();
+		mShaderSwaps.clear();
+		ClearRetiredObjects(true);
+
 		mCamera->ClearBuffer();
 
 		vkDestroySemaphore(mDevice.GetDevice(), mRenderFinishedSemaphore, nullptr);
 		vkDestroySemaphore(mDevice.GetDevice(), mImageAvailableSemaphore, nullptr);
+		vkDestroyFence(mDevice.GetDevice(), mFrameFence, nullptr);
 
 		vkFreeCommandBuffers(mDevice.GetDevice(), mDevice.GetGraphicsCommandPool(), mCommandBuffers.size(), mCommandBuffers.data());
 
-		for (const VkFramebuffer& swapChainFrameBuffer : mSwapChainFrameBuffers)
-			vkDestroyFramebuffer(mDevice.GetDevice(), swapChainFrameBuffer, nullptr);
-
 		vkFreeDescriptorSets(mDevice.GetDevice(), mDescriptorPool, mShaders["Shaders/unlit.hlsl"]->GetDescriptorSetLayout().size(), mDescriptorSets.data());
+		vkFreeDescriptorSets(mDevice.GetDevice(), mDescriptorPool, mDepthDescriptorSets.size(), mDepthDescriptorSets.data());
 		vkDestroyDescriptorPool(mDevice.GetDevice(), mDescriptorPool, nullptr);
 
 		mConstantBuffers.clear();
+		mMaterialSystem.reset();
+		mRenderObjects.clear();
 		mMeshes.clear();
 		mShaders.clear();
+		mShaderVariants.clear();
 
 
-		vkDestroyRenderPass(mDevice.GetDevice(), mRenderPass, nullptr);
-		mPSO.Clear();
+		mRenderGraph.reset();
+		mPipelineCompiler.reset();
 
 		for (const VkImageView& image : mSwapChainImageViews)
 			vkDestroyImageView(mDevice.GetDevice(), image, nullptr);
 
-		vkDestroySwapchainKHR(mDevice.GetDevice(), mSwapChain, nullptr);
+		if (mHeadless)
+			DestroyOffscreenTarget();
+		else
+			vkDestroySwapchainKHR(mDevice.GetDevice(), mSwapChain, nullptr);
 		mDevice.Destroy();
 		DestroyDebugReportCallbackEXT(mInstance, mCallback, nullptr);
 		vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
 		vkDestroyInstance(mInstance, nullptr);
-		glfwDestroyWindow(mWindow);
-		glfwTerminate();
+
+		if (!mHeadless)
+		{
+			glfwDestroyWindow(mWindow);
+			glfwTerminate();
+		}
 	}
 
 	void TriangleApp::CleanupSwapChainReferenceResource()
 	{
-		for (const VkFramebuffer& swapChainFrameBuffer : mSwapChainFrameBuffers)
-			vkDestroyFramebuffer(mDevice.GetDevice(), swapChainFrameBuffer, nullptr);
-
-		vkDestroyRenderPass(mDevice.GetDevice(), mRenderPass, nullptr);
-		mPSO.Clear();
+		//keys hold the old render pass; a reload waiting for its pipelines is compiled again
+		//dynamic rendering keys only hold formats, pipelines and pending reloads survive the resize
+		if (!mDevice.IsDynamicRenderingSupported())
+		{
+			mPipelineCompiler->Clear();
+			for (GraphicsPipelineDesc& desc : mGraphicsPipelineDescs)
+				desc.pso = nullptr;
+			for (const ShaderSwap& swap : mShaderSwaps)
+				mShaderReloadQueue.insert(swap.name);
+			mShaderSwaps.clear();
+		}
+		mRenderGraph.reset();
 
 		for (const VkImageView& image : mSwapChainImageViews)
 			vkDestroyImageView(mDevice.GetDevice(), image, nullptr);
@@ -677,6 +1321,8 @@ namespace Soco {
 
 	void TriangleApp::OnUpdate()
 	{
+		PROFILE_FUNCTION();
+
 		// Transform& triangleTransform = mTransforms["Triangle"];
 		// glm::quat triangleRotation = triangleTransform.GetLocalRotation();
 		// triangleRotation *= glm::quat(glm::vec3(0, 0, glm::radians(5.0f)));
@@ -690,11 +1336,24 @@ namespace Soco {
 
 		if (glm::abs(cameraPos).x > 5)
 			cameraToLeft = !cameraToLeft;
+
+		//every transform changes, child matrix is rebuilt through the whole chain
+		if (mBenchmark)
+		{
+			glm::quat spin(glm::vec3(0, glm::radians(1.0f), 0));
+			for (RenderObject& object : mRenderObjects)
+				object.GetTransform()->SetLocalRotation(object.GetTransform()->GetLocalRotation() * spin);
+		}
+
+		BenchmarkLap(FramePhase::Update);
 	}
 
 	void TriangleApp::OnUpload()
 	{
+		PROFILE_FUNCTION();
+
 		vkQueueWaitIdle(mDevice.GetPresentQueue().queue);
+		BenchmarkLap(FramePhase::Wait);
 
 		//PerCamera Buffer
 		mCamera->UpdateBuffer();
@@ -716,42 +1375,72 @@ namespace Soco {
 			.pTexelBufferView{nullptr}
 		};
 
-		//PerObject Buffer
-		Transform& triangleTransform = mTransforms["Triangle"];
+		VkWriteDescriptorSet writeSets[3] = { camearBufferDescriptorWrite };
+		uint32_t writeSetCount = 1;
 
+		if (mDepthPrepass)
+		{
+			auto [depthCameraSetIndex, depthCameraBinding] = mShaders["Shaders/depth.hlsl"]->GetBindingPoint("PerCamera");
+			VkWriteDescriptorSet depthCameraDescriptorWrite = camearBufferDescriptorWrite;
+			depthCameraDescriptorWrite.dstSet = mDepthDescriptorSets[depthCameraSetIndex];
+			depthCameraDescriptorWrite.dstBinding = depthCameraBinding;
+			writeSets[writeSetCount++] = depthCameraDescriptorWrite;
+		}
 
-		auto [objectBufferSetIndex, objectBufferBinding] = mShaders["Shaders/unlit.hlsl"]->GetBindingPoint("PerObject");
+		//PerObject Buffer, push constant shader write it in OnRender without buffer and descriptor
+		//使用push constant的shader在OnRender中直接写入, 不需要buffer和描述符
+		VkDescriptorBufferInfo objectBufferInfo;
+		if (!mShaders["Shaders/unlit.hlsl"]->HasPushConstant())
+		{
+			//one buffer for all draws, only the first object is right
+			RenderObject& object = mRenderObjects.front();
 
-		PerObject trianglePerObjectBuffer;
-		trianglePerObjectBuffer.ObjectToWorldMatrix = triangleTransform.GetGlobalMatrix();
-		trianglePerObjectBuffer.WorldToObjectMatrix = glm::inverse(trianglePerObjectBuffer.ObjectToWorldMatrix);
+			auto [objectBufferSetIndex, objectBufferBinding] = mShaders["Shaders/unlit.hlsl"]->GetBindingPoint("PerObject");
 
-		//Update perObjectBuffer
-		ConstantBuffer* perObjectBuffer = mConstantBuffers["Triangle"].get();
-		perObjectBuffer->UpdateBuffer(&trianglePerObjectBuffer);
-		VkDescriptorBufferInfo objectBufferInfo = perObjectBuffer->GetBufferInfo();
+			PerObject trianglePerObjectBuffer;
+			trianglePerObjectBuffer.ObjectToWorldMatrix = object.GetTransform()->GetGlobalMatrix() * object.GetMesh()->GetPositionDequantizeMatrix();
+			trianglePerObjectBuffer.WorldToObjectMatrix = glm::inverse(object.GetTransform()->GetGlobalMatrix());
 
-		VkWriteDescriptorSet objectBufferDescriptorWrite
-		{
-			.sType{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET},
-			.dstSet{mDescriptorSets[objectBufferSetIndex]},
-			.dstBinding{objectBufferBinding},
-			.dstArrayElement{0},
-			.descriptorCount{1},
-			.descriptorType{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER},
-			.pImageInfo{nullptr},
-			.pBufferInfo{&objectBufferInfo},
-			.pTexelBufferView{nullptr}
-		};
+			//Update perObjectBuffer
+			ConstantBuffer* perObjectBuffer = mConstantBuffers["Triangle"].get();
+			perObjectBuffer->UpdateBuffer(&trianglePerObjectBuffer);
+			objectBufferInfo = perObjectBuffer->GetBufferInfo();
+
+			VkWriteDescriptorSet objectBufferDescriptorWrite
+			{
+				.sType{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET},
+				.dstSet{mDescriptorSets[objectBufferSetIndex]},
+				.dstBinding{objectBufferBinding},
+				.dstArrayElement{0},
+				.descriptorCount{1},
+				.descriptorType{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER},
+				.pImageInfo{nullptr},
+				.pBufferInfo{&objectBufferInfo},
+				.pTexelBufferView{nullptr}
+			};
+			writeSets[writeSetCount++] = objectBufferDescriptorWrite;
+		}
 
-		VkWriteDescriptorSet writeSets[] = {camearBufferDescriptorWrite, objectBufferDescriptorWrite};
-		vkUpdateDescriptorSets(mDevice.GetDevice(), _countof(writeSets), writeSets, 0, nullptr);
+		vkUpdateDescriptorSets(mDevice.GetDevice(), writeSetCount, writeSets, 0, nullptr);
+		BenchmarkLap(FramePhase::Upload);
 	}
 
 	void TriangleApp::OnRender()
 	{
-		uint32_t imageIndex;
-		ThrowIfFailed(vkAcquireNextImageKHR(mDevice.GetDevice(), mSwapChain, std::numeric_limits<uint64_t>::max(), mImageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex));
+		PROFILE_FUNCTION();
+
+		uint32_t imageIndex = 0;
+		if (mHeadless)
+		{
+			ThrowIfFailed(vkWaitForFences(mDevice.GetDevice(), 1, &mFrameFence, VK_TRUE, std::numeric_limits<uint64_t>::max()));
+			ThrowIfFailed(vkResetFences(mDevice.GetDevice(), 1, &mFrameFence));
+		}
+		else
+			ThrowIfFailed(vkAcquireNextImageKHR(mDevice.GetDevice(), mSwapChain, std::numeric_limits<uint64_t>::max(), mImageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex));
+		BenchmarkLap(FramePhase::Wait);
+
+		CullObjects();
+		BenchmarkLap(FramePhase::Cull);
 
 		VkCommandBuffer currentCommandBuffer = mCommandBuffers[imageIndex];
 
@@ -765,39 +1454,21 @@ namespace Soco {
 		cmdBeginInfo.pInheritanceInfo = nullptr; // Optional
 
 		ThrowIfFailed(vkBeginCommandBuffer(currentCommandBuffer, &cmdBeginInfo));
+		GpuProfiler* gpuProfiler = mDevice.GetGpuProfiler();
+		gpuProfiler->BeginFrame(currentCommandBuffer);
 
-		vkCmdSetViewport(currentCommandBuffer, 0, 1, &(mPSO.GetViewport()));
-
-		VkRenderPassBeginInfo renderPassBeginInfo = {};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.renderPass = mRenderPass;
-		renderPassBeginInfo.framebuffer = mSwapChainFrameBuffers[imageIndex];
-		renderPassBeginInfo.renderArea.offset = { 0, 0 };
-		renderPassBeginInfo.renderArea.extent = mSwapChainExtent;
-		
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-		renderPassBeginInfo.clearValueCount = 1;
-		renderPassBeginInfo.pClearValues = &clearColor;
-		vkCmdBeginRenderPass(currentCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		Shader* shader = mShaders["Shaders/unlit.hlsl"].get();
-
-		vkCmdBindPipeline(currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSO.GetPipeline());
-		vkCmdBindDescriptorSets(currentCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader->GetPipelineLayout(), 0, mDescriptorSets.size(), mDescriptorSets.data(), 0, nullptr);
-
-		for (auto& [name, mesh] : mMeshes)
-		{
-			vkCmdBindIndexBuffer(currentCommandBuffer, mesh->GetIndexBuffer(), 0, mesh->GetIndexType());
-			vkCmdBindVertexBuffers(currentCommandBuffer, 0, mesh->GetBindingCount(), mesh->GetVertexBuffers(), mesh->GetOffsets());
+		//materials changed since the last frame, one copy before any pass reads them
+		mMaterialSystem->RecordUpload(currentCommandBuffer);
 
-			for (Mesh::SubmeshGeometry submesh : mesh->GetSubmesh())
-			{
-				vkCmdDrawIndexed(currentCommandBuffer, submesh.IndexCount, 1, submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
-			}
-		}
+		VkViewport viewport{ 0.0f, 0.0f, (float)mSwapChainExtent.width, (float)mSwapChainExtent.height, 0.0f, 1.0f };
+		vkCmdSetViewport(currentCommandBuffer, 0, 1, &viewport);
+		VkRect2D scissor{ { 0, 0 }, mSwapChainExtent };
+		vkCmdSetScissor(currentCommandBuffer, 0, 1, &scissor);
 
-		vkCmdEndRenderPass(currentCommandBuffer);
+		mRenderGraph->Execute(currentCommandBuffer, imageIndex);
+		gpuProfiler->EndFrame(currentCommandBuffer);
 		ThrowIfFailed(vkEndCommandBuffer(currentCommandBuffer));
+		BenchmarkLap(FramePhase::Record);
 
 		VkSemaphore waitSemaphores[] = { mImageAvailableSemaphore };
 		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
@@ -809,18 +1480,23 @@ namespace Soco {
 
 			VkSubmitInfo submitInfo = {};
 			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-			submitInfo.waitSemaphoreCount = _countof(waitSemaphores);
+			//headless: nothing acquired or presented
+			submitInfo.waitSemaphoreCount = mHeadless ? 0 : _countof(waitSemaphores);
 			submitInfo.pWaitSemaphores = waitSemaphores;
 			submitInfo.pWaitDstStageMask = waitStages;
 
 			submitInfo.commandBufferCount = 1;
 			submitInfo.pCommandBuffers = &mCommandBuffers[imageIndex];
 
-			submitInfo.signalSemaphoreCount = _countof(signalSemaphores);
+			submitInfo.signalSemaphoreCount = mHeadless ? 0 : _countof(signalSemaphores);
 			submitInfo.pSignalSemaphores = signalSemaphores;
 
-			ThrowIfFailed(vkQueueSubmit(mDevice.GetGraphicsQueue().queue, 1, &submitInfo, VK_NULL_HANDLE));
+			ThrowIfFailed(vkQueueSubmit(mDevice.GetGraphicsQueue().queue, 1, &submitInfo, mFrameFence));
 		}
+		BenchmarkLap(FramePhase::Submit);
+
+		if (mHeadless)
+			return;
 
 		//Presentation
 		{
@@ -837,7 +1513,84 @@ namespace Soco {
 
 			ThrowIfFailed(vkQueuePresentKHR(mDevice.GetPresentQueue().queue, &presentInfo));
 		}
+		BenchmarkLap(FramePhase::Present);
+	}
+
+	void TriangleApp::CullObjects()
+	{
+		PROFILE_FUNCTION();
+
+		//lod and culling once per frame, prepass and main pass must draw the same triangles
+		mMeshDraws.clear();
+		glm::vec3 cameraPosition = mCamera->GetTransform()->GetGlobalPosition();
+		for (RenderObject& object : mRenderObjects)
+		{
+			Mesh* mesh = object.GetMesh();
+			glm::mat4 objectToWorld = object.GetTransform()->GetGlobalMatrix();
+			glm::vec3 cameraPositionOS = glm::inverse(objectToWorld) * glm::vec4(cameraPosition, 1.0f);
+
+			//lod by projected error, meshlet is only built for lod 0
+			glm::vec4 boundingSphere = mesh->GetBoundingSphere();
+			float worldScale = std::max({ glm::length(glm::vec3(objectToWorld[0])), glm::length(glm::vec3(objectToWorld[1])), glm::length(glm::vec3(objectToWorld[2])) });
+			uint32_t lod = mCamera->SelectLod(mesh->GetLodErrors(), glm::vec3(objectToWorld * glm::vec4(glm::vec3(boundingSphere), 1.0f)), boundingSphere.w * worldScale, worldScale, object.GetLod());
+			object.SetLod(lod);
+
+			const uint32_t materialIndex = object.GetMaterialIndex();
+			MeshDraw meshDraw{ mesh, materialIndex, mMaterialSystem->GetMaterial(materialIndex)->GetPipelineStateIndex(), objectToWorld };
+			if (lod == 0)
+				mesh->CullMeshlets(mCamera->GetVPMatrix() * objectToWorld, cameraPositionOS, meshDraw.draws);
+			else
+				meshDraw.draws = mesh->GetLodSubmesh(lod);
+			if (!meshDraw.draws.empty())
+				mMeshDraws.push_back(std::move(meshDraw));
+		}
+
+		//pipeline then mesh, pipeline and vertex buffer are only bound when they change; material is per draw data
+		std::sort(mMeshDraws.begin(), mMeshDraws.end(), [](const MeshDraw& a, const MeshDraw& b) {
+			return a.pipelineStateIndex != b.pipelineStateIndex ? a.pipelineStateIndex < b.pipelineStateIndex : a.mesh < b.mesh;
+		});
+	}
+
+	void TriangleApp::DrawMeshes(VkCommandBuffer commandBuffer, const Shader* shader, bool positionOnly, std::span<const MeshDraw> meshDraws)
+	{
+		const Mesh* boundMesh = nullptr;
+
+		for (const MeshDraw& meshDraw : meshDraws)
+		{
+			const Mesh* mesh = meshDraw.mesh;
+			if (shader->HasPushConstant())
+			{
+				PerObject perObject;
+				//position may be quantized to mesh bounds, normal is not affected
+				perObject.ObjectToWorldMatrix = meshDraw.objectToWorld * mesh->GetPositionDequantizeMatrix();
+				perObject.WorldToObjectMatrix = glm::inverse(meshDraw.objectToWorld);
+				shader->PushConstants(commandBuffer, perObject);
+			}
 
+			if (mesh != boundMesh)
+			{
+				vkCmdBindIndexBuffer(commandBuffer, mesh->GetIndexBuffer(), 0, mesh->GetIndexType());
+				if (positionOnly)
+				{
+					const uint32_t positionBinding = mesh->GetPositionBinding();
+					vkCmdBindVertexBuffers(commandBuffer, positionBinding, 1, mesh->GetVertexBuffers() + positionBinding, mesh->GetOffsets() + positionBinding);
+				}
+				else
+					vkCmdBindVertexBuffers(commandBuffer, 0, mesh->GetBindingCount(), mesh->GetVertexBuffers(), mesh->GetOffsets());
+				boundMesh = mesh;
+			}
+
+			//firstInstance is the material index, SV_InstanceID of the single instance; depth only shader ignores it
+			for (const Mesh::SubmeshGeometry& submesh : meshDraw.draws)
+			{
+				vkCmdDrawIndexed(commandBuffer, submesh.IndexCount, 1, submesh.StartIndexLocation, submesh.BaseVertexLocation, meshDraw.materialIndex);
+			}
+		}
+	}
 
+	void TriangleApp::BenchmarkLap(FramePhase phase)
+	{
+		if (mBenchmark)
+			mBenchmark->Lap(phase);
 	}
 }
\ No newline at end of file
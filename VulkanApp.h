@@ -6,10 +6,23 @@
 #include <vector>
 #include <vulkan/vulkan.h>
 #include <memory>
+#include <string>
+#include <deque>
+#include <future>
+#include <map>
+#include <set>
+#include <span>
 
 #include "Device.hpp"
 #include "Shader.h"
+#include "ShaderVariants.h"
 #include "PSO.h"
+#include "PipelineCompiler.h"
+#include "RenderGraph.h"
+#include "RenderObject.h"
+#include "MaterialSystem.h"
+#include "Benchmark.h"
+#include "FileWatcher.h"
 
 #include "Camera.hpp"
 
@@ -17,6 +30,12 @@ namespace Soco
 {
 	class TriangleApp {
 	public:
+		//--headless [--frames N] [--duration seconds] [--size WxH] [--readback out.ppm]
+		//--benchmark <preset> [--json out.json], see Benchmark.h
+		//--trace out.json writes cpu profiler trace after main loop, F12 writes it any time in window mode
+		//--no-pipeline-library builds every pipeline monolithic even when VK_EXT_graphics_pipeline_library is supported
+		//return false on unknown option
+		bool ParseCommandLine(int argc, char** argv);
 		void Run();
 
 	private:
@@ -27,38 +46,50 @@ namespace Soco
 		const std::vector<const char*> GetRequiredExtension();
 		bool CheckValidationLayerSupport();
 		VkFormat FindSupportFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
-		void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
 		void CreateInstance();
 		void SetupDebugCallback();
 		void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator);
 		void CreateSurface();
 		void CreateDevice();
 		void CreateSwapChain();
+		void CreateOffscreenTarget();
+		void DestroyOffscreenTarget();
+		void WriteReadback(const std::string& path);
 		void LoadShader();
 		void CreateMesh();
+		void CreateScene();
 		void CreateConstantBuffer();
-		void CreateRenderPass();
+		void CreateMaterials();
+		void CreateRenderGraph();
 		void CreateGraphicsPipeline();
+		struct GraphicsPipelineDesc;
+		PSOKey GetPipelineKey(const GraphicsPipelineDesc& desc, const Shader* shader) const;
+		void UpdateGraphicsPipelines();
+		void UpdateShaderHotReload();
+		void UpdateShaderSwaps();
+		void ClearRetiredObjects(bool all);
 
 		void CreateCamera();
 
 		void CreateDescriptorPool();
 		void CreateDescriptorSet();
-		void CreateFrameBuffer();
 		void CreateCommandBuffers();
 		void CreateSemaphores();
 
-		void CreateImageResource();
-
 		void InitVulkan();
 		void OnResize();
 		void MainLoop();
+		bool IsLoopDone(uint32_t frame, double seconds);
 		void Cleanup();
 		void CleanupSwapChainReferenceResource();
 
 		void OnUpdate();
 		void OnUpload();
 		void OnRender();
+		void CullObjects();
+		struct MeshDraw;
+		void DrawMeshes(VkCommandBuffer commandBuffer, const Shader* shader, bool positionOnly, std::span<const MeshDraw> meshDraws);
+		void BenchmarkLap(FramePhase phase);
 
 		static VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugCallback(
 			VkDebugReportFlagsEXT flags,
@@ -71,7 +102,7 @@ namespace Soco
 			void* userData);
 
 	private:
-		GLFWwindow* mWindow;
+		GLFWwindow* mWindow = nullptr;
 
 		int mWidth = 800;
 		int mHeight = 600;
@@ -89,7 +120,6 @@ namespace Soco
 		VkSwapchainKHR mSwapChain = VK_NULL_HANDLE;
 		std::vector<VkImage> mSwapChainImages;
 		std::vector<VkImageView> mSwapChainImageViews;
-		std::vector<VkFramebuffer> mSwapChainFrameBuffers;
 
 		
 		std::vector<VkCommandBuffer> mCommandBuffers;
@@ -97,26 +127,119 @@ namespace Soco
 		VkSemaphore mImageAvailableSemaphore;
 		VkSemaphore mRenderFinishedSemaphore;
 
-		VkDeviceMemory mDepthImageMemory;
-		VkImage mDepthImage;
-		VkImageView mDepthImageView;
-
-		std::map<std::string, std::unique_ptr<Shader>> mShaders;
+		//headless: no window, surface and swap chain, the offscreen image takes the place of swap chain image
+		//one frame in flight, fence is waited before the command buffer is recorded again
+		bool mHeadless = false;
+		uint32_t mFrameCount = 0;
+		double mDuration = 0.0;
+		std::string mReadbackPath;
+		bool mReadbackPending = false;
+		VkDeviceMemory mOffscreenMemory = VK_NULL_HANDLE;
+		VkBuffer mReadbackBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory mReadbackMemory = VK_NULL_HANDLE;
+		VkFence mFrameFence = VK_NULL_HANDLE;
+
+		VkFormat mDepthFormat = VK_FORMAT_UNDEFINED;
+
+		//variants of each file, mShaders is the variant of the enabled keywords and is owned by its ShaderVariants
+		std::map<std::string, std::unique_ptr<ShaderVariants>> mShaderVariants;
+		std::map<std::string, std::vector<std::string>> mShaderKeywords;
+		std::map<std::string, Shader*> mShaders;
 		std::map<std::string, std::unique_ptr<Mesh>> mMeshes;
-		std::map<std::string, Transform> mTransforms;
 		std::map<std::string, std::unique_ptr<ConstantBuffer>> mConstantBuffers;
+		//deque: children keep pointer to parent transform
+		std::deque<RenderObject> mRenderObjects;
+
+		//PerMaterial of every material in one storage buffer written to the descriptor once,
+		//a draw passes its material index as firstInstance
+		uint32_t mMaterialCount = 1;
+		std::unique_ptr<MaterialSystem> mMaterialSystem;
 
 		VkDescriptorPool mDescriptorPool;
 		std::vector<VkDescriptorSet> mDescriptorSets;
 
-		VkRenderPass mRenderPass = VK_NULL_HANDLE;
-		PSO mPSO;
+		//render pass, framebuffer and depth texture are owned by the graph, rebuilt with swap chain
+		std::unique_ptr<RenderGraph> mRenderGraph;
+		RenderGraph::PassHandle mDepthPass = 0;
+		RenderGraph::PassHandle mForwardPass = 0;
+		//one per material pipeline state, indexed by Material::GetPipelineStateIndex
+		std::vector<size_t> mForwardPipelines;
+
+		//depth only pass with position stream before main pass, main pass test EQUAL without depth write
+		bool mDepthPrepass = true;
+		size_t mDepthPipeline = 0;
+		std::vector<VkDescriptorSet> mDepthDescriptorSets;
+
+		//pipelines are created by the compiler's worker threads, a frame never waits for one
+		std::unique_ptr<PipelineCompiler> mPipelineCompiler;
+		bool mPipelineLibrary = true;
+
+		//every pipeline and the shader it's built from, hot reload rebuilds only the pipelines of a changed shader
+		struct GraphicsPipelineDesc
+		{
+			std::string shader;
+			RenderGraph::PassHandle pass;
+			RenderState state;
+			//values of the shader's [[vk::constant_id]] constants, unset ones keep the default in hlsl
+			SpecializationValues specialization;
+			//owned by mPipelineCompiler, null until the first one is ready and the pass draws nothing
+			PSO* pso = nullptr;
+		};
+		std::vector<GraphicsPipelineDesc> mGraphicsPipelineDescs;
+
+		//shader hot reload, window mode only: Shaders directory is watched, a changed shader or include is
+		//recompiled on a worker thread, the result is swapped in at the next frame boundary
+		std::unique_ptr<FileWatcher> mShaderWatcher;
+		std::set<std::string> mShaderReloadQueue;
+		std::future<std::map<std::string, std::unique_ptr<ShaderVariants>>> mShaderReload;
+
+		//reloaded shader waiting for its pipelines, the old shader and pipelines are drawn until all are ready
+		struct ShaderSwap
+		{
+			std::string name;
+			std::unique_ptr<ShaderVariants> variants;
+			Shader* shader;
+			std::vector<std::shared_future<PSO*>> pipelines;
+		};
+		std::vector<ShaderSwap> mShaderSwaps;
+
+		//replaced objects the last frames may still use, freed when those frames are complete
+		struct RetiredObjects
+		{
+			uint64_t frame;
+			std::vector<std::unique_ptr<ShaderVariants>> shaders;
+			std::vector<std::unique_ptr<PSO>> pipelines;
+		};
+		std::deque<RetiredObjects> mRetiredObjects;
+		uint64_t mFrameIndex = 0;
+
+		//lod and culling result of this frame, prepass and main pass draw the same triangles
+		struct MeshDraw
+		{
+			Mesh* mesh;
+			uint32_t materialIndex;
+			uint32_t pipelineStateIndex;
+			glm::mat4 objectToWorld;
+			std::vector<Mesh::SubmeshGeometry> draws;
+		};
+		std::vector<MeshDraw> mMeshDraws;
 
 		std::unique_ptr<Camera> mCamera;
 
+		//null when not benchmarking
+		std::unique_ptr<Benchmark> mBenchmark;
+		std::string mBenchmarkJsonPath;
+
+		//Chrome trace of Profiler, see Profiler.h
+		std::string mTracePath;
+		bool mTraceKeyDown = false;
+
 		const std::vector<const char*> mValidationLayers = { "VK_LAYER_KHRONOS_validation" };
-		const std::vector<const char*> mDeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-		const std::vector<const char*> mQueryDeviceExtensions = { VK_GOOGLE_HLSL_FUNCTIONALITY_1_EXTENSION_NAME, VK_GOOGLE_USER_TYPE_EXTENSION_NAME };
+		//swap chain extension is added when there is a window
+		const std::vector<const char*> mDeviceExtensions = { VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME };
+		const std::vector<const char*> mQueryDeviceExtensions = { VK_GOOGLE_HLSL_FUNCTIONALITY_1_EXTENSION_NAME, VK_GOOGLE_USER_TYPE_EXTENSION_NAME,
+			VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+			VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME, VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME };
 		VkPhysicalDeviceFeatures mDeviceFeatures = {};
 
 #ifdef NDEBUG
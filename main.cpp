@@ -1,14 +1,30 @@
 #include "VulkanApp.h"
+#include "MeshConverter.h"
+#include "Log.h"
 #include <iostream>
 
-int main()
+int main(int argc, char** argv)
 {
+	try {
+		int toolResult = MeshConverter::Run(argc, argv);
+		if (toolResult >= 0)
+			return toolResult;
+	}
+	catch (const std::runtime_error& e) {
+		Log::Flush();
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
 	Soco::TriangleApp app;
 
 	try {
+		if (!app.ParseCommandLine(argc, argv))
+			return 1;
 		app.Run();
 	}
 	catch (const std::runtime_error& e) {
+		Log::Flush();
 		std::cerr << e.what() << std::endl;
 		return 1;
 	}